@@ -0,0 +1,50 @@
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <crypto/equihash.h>
+#include <uint256.h>
+
+enum class Solver { BASIC, OPTIMISED, ARENA };
+
+static void SolveEquihash(benchmark::State& state, Solver solver)
+{
+    // Equihash<48,5> as used on regtest, over a fixed header
+    const unsigned int n = 48, k = 5;
+    crypto_generichash_blake2b_state eh_state;
+    EhInitialiseState(n, k, eh_state);
+    const std::vector<unsigned char> input(108, 0x42);
+    crypto_generichash_blake2b_update(&eh_state, input.data(), input.size());
+
+    EhSolverArena arena;
+    arith_uint256 nonce;
+    while (state.KeepRunning()) {
+        crypto_generichash_blake2b_state curr_state = eh_state;
+        const uint256 nonce_bytes = ArithToUint256(nonce++);
+        crypto_generichash_blake2b_update(&curr_state, nonce_bytes.begin(), nonce_bytes.size());
+        // Enumerate all the solutions
+        std::function<bool(std::vector<unsigned char>)> validBlock = [](std::vector<unsigned char> soln) { return false; };
+        switch (solver) {
+        case Solver::BASIC:
+            EhBasicSolveUncancellable(n, k, curr_state, validBlock);
+            break;
+        case Solver::OPTIMISED:
+            EhOptimisedSolveUncancellable(n, k, curr_state, validBlock);
+            break;
+        case Solver::ARENA:
+            EhArenaSolveUncancellable(n, k, curr_state, validBlock, arena);
+            break;
+        }
+    }
+}
+
+static void EquihashBasicSolve(benchmark::State& state) { SolveEquihash(state, Solver::BASIC); }
+static void EquihashOptimisedSolve(benchmark::State& state) { SolveEquihash(state, Solver::OPTIMISED); }
+static void EquihashArenaSolve(benchmark::State& state) { SolveEquihash(state, Solver::ARENA); }
+
+BENCHMARK(EquihashBasicSolve, 20);
+BENCHMARK(EquihashOptimisedSolve, 20);
+BENCHMARK(EquihashArenaSolve, 20);
@@ -8,6 +8,7 @@
 #include <primitives/block.h>
 
 #include <memory>
+#include <set>
 
 class CTxMemPool;
 
@@ -148,11 +149,13 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /** Prefills the coinbase and the transactions whose txid is in prefill, and sends short ids for the rest. */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, const std::set<uint256>& prefill = {});
 
     uint64_t GetShortID(const uint256& txhash) const;
 
     size_t BlockTxCount() const { return shorttxids.size() + prefilledtxn.size(); }
+    size_t PrefilledTxCount() const { return prefilledtxn.size(); }
 
     ADD_SERIALIZE_METHODS;
 
@@ -219,6 +219,30 @@ public:
     //! Will be nullopt if nChainTx is zero.
     Optional<CAmount> nChainSaplingValue;
 
+    //! Number of Sprout note commitments added to the tree by this block.
+    //! Stored apart from the block index entry, see CDiskBlockShieldedCounts.
+    //! Will be nullopt for older blocks on old nodes until a reindex has taken place.
+    Optional<uint32_t> nSproutCommitments;
+
+    //! (memory only) Size of the Sprout note commitment tree up to and including this block.
+    //! Will be nullopt if nChainTx is zero or a block in the chain has no commitment count.
+    Optional<uint64_t> nChainSproutCommitments;
+
+    //! Number of Sapling note commitments added to the tree by this block.
+    //! Stored apart from the block index entry, see CDiskBlockShieldedCounts.
+    //! Will be nullopt for older blocks on old nodes until a reindex has taken place.
+    Optional<uint32_t> nSaplingCommitments;
+
+    //! (memory only) Size of the Sapling note commitment tree up to and including this block.
+    //! Will be nullopt if nChainTx is zero or a block in the chain has no commitment count.
+    Optional<uint64_t> nChainSaplingCommitments;
+
+    //! Number of Sapling spends in this block. Sprout spends need no count of
+    //! their own as every joinsplit adds note commitments.
+    //! Stored apart from the block index entry, see CDiskBlockShieldedCounts.
+    //! Will be nullopt for older blocks on old nodes until a reindex has taken place.
+    Optional<uint32_t> nSaplingSpends;
+
     //! block header
     int32_t nVersion;
     uint256 hashMerkleRoot;
@@ -259,6 +283,11 @@ public:
         nChainSproutValue = nullopt;
         nSaplingValue = 0;
         nChainSaplingValue = nullopt;
+        nSproutCommitments = nullopt;
+        nChainSproutCommitments = nullopt;
+        nSaplingCommitments = nullopt;
+        nChainSaplingCommitments = nullopt;
+        nSaplingSpends = nullopt;
 
         nVersion        = 0;
         hashMerkleRoot  = uint256();
@@ -335,6 +364,17 @@ public:
      */
     bool HaveTxsDownloaded() const { return nChainTx != 0; }
 
+    /**
+     * Check whether this block has Sprout or Sapling spends or outputs.
+     * Returns true as well if the counts are not known, as for blocks
+     * received by an older client version.
+     */
+    bool MayHaveShieldedActivity() const
+    {
+        if (!nSproutCommitments || !nSaplingCommitments || !nSaplingSpends) return true;
+        return *nSproutCommitments > 0 || *nSaplingCommitments > 0 || *nSaplingSpends > 0;
+    }
+
     int64_t GetBlockTime() const
     {
         return (int64_t)nTime;
@@ -510,6 +550,40 @@ public:
     }
 };
 
+/**
+ * The note commitment and Sapling spend counts of a block, as stored in the
+ * block tree database. They are kept in records of their own next to the
+ * CDiskBlockIndex entry rather than in it, so that client versions which do
+ * not know about them can still read and rewrite the block index entry
+ * without corrupting it.
+ */
+class CDiskBlockShieldedCounts
+{
+public:
+    uint32_t nSproutCommitments;
+    uint32_t nSaplingCommitments;
+    uint32_t nSaplingSpends;
+
+    CDiskBlockShieldedCounts() : nSproutCommitments(0), nSaplingCommitments(0), nSaplingSpends(0) {}
+
+    explicit CDiskBlockShieldedCounts(const CBlockIndex* pindex) {
+        // All counts must be known to be stored.
+        assert(pindex->nSproutCommitments && pindex->nSaplingCommitments && pindex->nSaplingSpends);
+        nSproutCommitments = *pindex->nSproutCommitments;
+        nSaplingCommitments = *pindex->nSaplingCommitments;
+        nSaplingSpends = *pindex->nSaplingSpends;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nSproutCommitments));
+        READWRITE(VARINT(nSaplingCommitments));
+        READWRITE(VARINT(nSaplingSpends));
+    }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
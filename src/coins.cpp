@@ -26,6 +26,8 @@ bool CCoinsView::BatchWrite(CCoinsMap &mapCoins,
                             CNullifiersMap &mapSproutNullifiers,
                             CNullifiersMap &mapSaplingNullifiers) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
+CCoinsViewCursor *CCoinsView::CursorAt(const uint256 &hash) const { return nullptr; }
+CNullifiersViewCursor *CCoinsView::NullifiersCursor(ShieldedType type) const { return nullptr; }
 
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
 {
@@ -53,6 +55,8 @@ bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
                                   CNullifiersMap &mapSproutNullifiers,
                                   CNullifiersMap &mapSaplingNullifiers) { return base->BatchWrite(mapCoins, hashBlock, hashSproutAnchor, hashSaplingAnchor, mapSproutAnchors, mapSaplingAnchors, mapSproutNullifiers, mapSaplingNullifiers); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
+CCoinsViewCursor *CCoinsViewBacked::CursorAt(const uint256 &hash) const { return base->CursorAt(hash); }
+CNullifiersViewCursor *CCoinsViewBacked::NullifiersCursor(ShieldedType type) const { return base->NullifiersCursor(type); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
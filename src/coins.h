@@ -214,6 +214,18 @@ private:
     uint256 hashBlock;
 };
 
+/** Cursor for iterating over the nullifier set of a shielded pool */
+class CNullifiersViewCursor
+{
+public:
+    virtual ~CNullifiersViewCursor() {}
+
+    virtual bool GetKey(uint256 &nf) const = 0;
+
+    virtual bool Valid() const = 0;
+    virtual void Next() = 0;
+};
+
 /** Abstract view on the open txout dataset. */
 class CCoinsView
 {
@@ -262,6 +274,13 @@ public:
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
 
+    //! Get a cursor to iterate over the state, starting at the first coin
+    //! whose txid is not lower than hash (in the byte order of the database)
+    virtual CCoinsViewCursor *CursorAt(const uint256 &hash) const;
+
+    //! Get a cursor to iterate over the nullifier set of a shielded pool
+    virtual CNullifiersViewCursor *NullifiersCursor(ShieldedType type) const;
+
     //! As we use CCoinsViews polymorphically, have a virtual destructor
     virtual ~CCoinsView() {}
 
@@ -296,6 +315,8 @@ public:
                     CNullifiersMap &mapSproutNullifiers,
                     CNullifiersMap &mapSaplingNullifiers) override;
     CCoinsViewCursor *Cursor() const override;
+    CCoinsViewCursor *CursorAt(const uint256 &hash) const override;
+    CNullifiersViewCursor *NullifiersCursor(ShieldedType type) const override;
     size_t EstimateSize() const override;
 };
 
@@ -348,6 +369,12 @@ public:
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
+    CCoinsViewCursor* CursorAt(const uint256 &hash) const override {
+        throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
+    }
+    CNullifiersViewCursor* NullifiersCursor(ShieldedType type) const override {
+        throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
+    }
 
     // Adds the tree to mapSproutAnchors (or mapSaplingAnchors based on the type of tree)
     // and sets the current commitment root to this root.
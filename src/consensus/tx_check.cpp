@@ -22,8 +22,10 @@
  * 2. ProcessNewBlock calls AcceptBlock, which calls CheckBlock (which calls CheckTransaction)
  *    and ContextualCheckBlock (which calls this function).
  * 3. The isInitBlockDownload argument is only to assist with testing.
+ * 4. fCheckShieldedProofs may only be unset if the same checks already passed
+ *    for the consensus branch of nHeight, see PreVerifyShieldedTransaction.
  */
-bool ContextualCheckTransaction(const CTransaction& tx, CValidationState &state, const int nHeight)
+bool ContextualCheckTransaction(const CTransaction& tx, CValidationState &state, const int nHeight, bool fCheckShieldedProofs)
 {
     const CChainParams& chainparams = Params();
 
@@ -79,6 +81,9 @@ bool ContextualCheckTransaction(const CTransaction& tx, CValidationState &state,
             return state.Invalid(ValidationInvalidReason::CONSENSUS, false, REJECT_INVALID, "bad-txns-oversize");
     }
 
+    if (!fCheckShieldedProofs)
+        return true;
+
     auto consensusBranchId = CurrentEpochBranchId(nHeight, chainparams.GetConsensus());
     auto prevConsensusBranchId = PrevEpochBranchId(consensusBranchId, chainparams.GetConsensus());
     uint256 dataToBeSigned;
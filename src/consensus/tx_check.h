@@ -22,8 +22,12 @@ class CChainParams;
 class CTransaction;
 class CValidationState;
 
-/** Check a transaction contextually against a set of consensus rules */
-bool ContextualCheckTransaction(const CTransaction& tx, CValidationState &state, int nHeight);
+/**
+ * Check a transaction contextually against a set of consensus rules. The
+ * JoinSplit signature and the Sapling proofs and signatures are only checked
+ * if fCheckShieldedProofs is set.
+ */
+bool ContextualCheckTransaction(const CTransaction& tx, CValidationState &state, int nHeight, bool fCheckShieldedProofs = true);
 
 /** Context-independent validity checks */
 bool CheckTransaction(const CTransaction& tx, CValidationState& state, ProofVerifier& verifier, bool fCheckDuplicateInputs=true);
@@ -723,6 +723,233 @@ invalidsolution:
     return false;
 }
 
+// Bucket of a row of ArenaSolve: its first collision bits, big-endian
+static inline size_t ArenaBucket(const unsigned char* row, size_t len)
+{
+    size_t bucket = 0;
+    for (size_t i = 0; i < len; i++) {
+        bucket = (bucket << 8) | row[i];
+    }
+    return bucket;
+}
+
+// Checks if two rows of round r of ArenaSolve were built from a common row of
+// one of the two rounds before, in which case combining them would repeat its
+// indices. Deeper repeats are left to the final check on the solution.
+static inline bool ArenaSharesRow(const eh_index* pairs, size_t roundStride, unsigned int r,
+                                  eh_index a, eh_index b)
+{
+    const eh_index* pa = pairs + (r-1)*roundStride + 2*a;
+    const eh_index* pb = pairs + (r-1)*roundStride + 2*b;
+    if (pa[0] == pb[0] || pa[0] == pb[1] || pa[1] == pb[0] || pa[1] == pb[1]) {
+        return true;
+    }
+    if (r < 2) {
+        return false;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        const eh_index* ca = pairs + (r-2)*roundStride + 2*pa[i];
+        for (size_t j = 0; j < 2; j++) {
+            const eh_index* cb = pairs + (r-2)*roundStride + 2*pb[j];
+            if (ca[0] == cb[0] || ca[0] == cb[1] || ca[1] == cb[0] || ca[1] == cb[1]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Writes the 2^r indices a row of round r of ArenaSolve was built from, with
+// the branches of each pair ordered as in a valid solution
+static void ExpandArenaRow(const eh_index* pairs, size_t roundStride, unsigned int r,
+                           eh_index row, eh_index* indices)
+{
+    if (r == 0) {
+        *indices = row;
+        return;
+    }
+    const eh_index* pair = pairs + (r-1)*roundStride + 2*row;
+    const size_t half = 1 << (r-1);
+    ExpandArenaRow(pairs, roundStride, r-1, pair[0], indices);
+    ExpandArenaRow(pairs, roundStride, r-1, pair[1], indices+half);
+    if (std::lexicographical_compare(indices+half, indices+2*half, indices, indices+half)) {
+        std::swap_ranges(indices, indices+half, indices+half);
+    }
+}
+
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::ArenaSolve(const eh_HashState& base_state,
+                               const std::function<bool(std::vector<unsigned char>)> validBlock,
+                               const std::function<bool(EhSolverCancelCheck)> cancelled,
+                               EhSolverArena& arena)
+{
+    eh_index init_size { 1 << (CollisionBitLength + 1) };
+    const size_t nBuckets { 1 << CollisionBitLength };
+    const size_t roundStride { 2*ArenaRows };
+    static_assert(ArenaRows >= (1 << (CollisionBitLength + 1)));
+
+    // The arena holds, in order: the pair of rows each row was built from for
+    // every round, the bucket boundaries, the rows of the current round in
+    // bucket order, and two tables of row hashes used in turn. Rows never move
+    // once written; only their order is bucketed, which replaces the sorts of
+    // BasicSolve. A round that fills its table drops the remaining pairs.
+    if (arena.buffer.size() < ArenaSize) {
+        arena.buffer.resize(ArenaSize);
+    }
+    arena.nPeakUsage = 0;
+    arena.nDroppedRows = 0;
+    eh_index* pairs = reinterpret_cast<eh_index*>(arena.buffer.data());
+    eh_index* bucketEnd = pairs + (K-1)*roundStride;
+    eh_index* order = bucketEnd + nBuckets;
+    unsigned char* table[2];
+    table[0] = reinterpret_cast<unsigned char*>(order + ArenaRows);
+    table[1] = table[0] + ArenaRows*HashLength;
+
+    auto bucket_rows = [&](const unsigned char* rows, size_t count, size_t width) {
+        std::fill(bucketEnd, bucketEnd + nBuckets, 0);
+        for (size_t i = 0; i < count; i++) {
+            bucketEnd[ArenaBucket(rows+i*width, CollisionByteLength)]++;
+        }
+        eh_index pos = 0;
+        for (size_t b = 0; b < nBuckets; b++) {
+            eh_index size = bucketEnd[b];
+            bucketEnd[b] = pos;
+            pos += size;
+        }
+        for (size_t i = 0; i < count; i++) {
+            order[bucketEnd[ArenaBucket(rows+i*width, CollisionByteLength)]++] = i;
+        }
+    };
+
+    // 1) Generate first list
+    LogPrint(BCLog::POW, "Generating first list\n");
+    unsigned char tmpHash[HashOutput];
+    for (eh_index g = 0; g*IndicesPerHashOutput < init_size; g++) {
+        GenerateHash(base_state, g, tmpHash, HashOutput);
+        for (eh_index i = 0; i < IndicesPerHashOutput && g*IndicesPerHashOutput+i < init_size; i++) {
+            ExpandArray(tmpHash+(i*N/8), N/8, table[0]+(g*IndicesPerHashOutput+i)*HashLength,
+                        HashLength, CollisionBitLength);
+        }
+        if (cancelled(ListGeneration)) throw solver_cancelled;
+    }
+
+    size_t nRows = init_size;
+    size_t width = HashLength;
+    size_t cur = 0;
+    size_t pairsUsage = 0;
+
+    // 3) Repeat step 2 until 2n/(k+1) bits remain
+    for (unsigned int r = 1; r < K && nRows > 0; r++) {
+        LogPrint(BCLog::POW, "Round %d:\n", r);
+        // 2a) Bucket the list by the next n/(k+1) bits
+        LogPrint(BCLog::POW, "- Bucketing list\n");
+        const unsigned char* in = table[cur];
+        bucket_rows(in, nRows, width);
+        if (cancelled(ListSorting)) throw solver_cancelled;
+
+        LogPrint(BCLog::POW, "- Finding collisions\n");
+        unsigned char* out = table[1-cur];
+        eh_index* roundPairs = pairs + (r-1)*roundStride;
+        const size_t outWidth = width - CollisionByteLength;
+        size_t nOut = 0;
+        for (size_t b = 0; b < nBuckets; b++) {
+            const size_t start = b ? bucketEnd[b-1] : 0;
+            const size_t end = bucketEnd[b];
+            if (end - start < 2) continue;
+
+            // 2b) Calculate tuples (X_i ^ X_j, (i, j)) for each pair in the bucket
+            for (size_t l = start; l < end - 1; l++) {
+                for (size_t m = l + 1; m < end; m++) {
+                    const eh_index x = order[l];
+                    const eh_index y = order[m];
+                    if (r > 1 && ArenaSharesRow(pairs, roundStride, r-1, x, y)) continue;
+                    if (nOut == ArenaRows) {
+                        arena.nDroppedRows++;
+                        continue;
+                    }
+                    roundPairs[2*nOut] = x;
+                    roundPairs[2*nOut+1] = y;
+                    const unsigned char* a = in + x*width + CollisionByteLength;
+                    const unsigned char* c = in + y*width + CollisionByteLength;
+                    unsigned char* row = out + nOut*outWidth;
+                    unsigned char any = 0;
+                    for (size_t i = 0; i < outWidth; i++) {
+                        row[i] = a[i] ^ c[i];
+                        any |= row[i];
+                    }
+                    // A row that is zero on all remaining bits is almost
+                    // certainly built from repeated indices, as in OptimisedSolve
+                    if (any) nOut++;
+                }
+            }
+            if (cancelled(ListColliding)) throw solver_cancelled;
+        }
+
+        pairsUsage += 2*sizeof(eh_index)*nOut;
+        arena.nPeakUsage = std::max(arena.nPeakUsage,
+                                    pairsUsage + sizeof(eh_index)*(nBuckets + nRows) +
+                                    nRows*width + nOut*outWidth);
+
+        nRows = nOut;
+        width = outWidth;
+        cur = 1 - cur;
+        if (cancelled(RoundEnd)) throw solver_cancelled;
+    }
+    if (arena.nDroppedRows > 0) {
+        LogPrint(BCLog::POW, "Equihash arena solver: dropped %u colliding pairs because a round was full\n", arena.nDroppedRows);
+    }
+
+    // k+1) Find a collision on last 2n(k+1) bits
+    LogPrint(BCLog::POW, "Final round:\n");
+    if (nRows > 1) {
+        LogPrint(BCLog::POW, "- Bucketing list\n");
+        const unsigned char* in = table[cur];
+        bucket_rows(in, nRows, width);
+        if (cancelled(FinalSorting)) throw solver_cancelled;
+        arena.nPeakUsage = std::max(arena.nPeakUsage,
+                                    pairsUsage + sizeof(eh_index)*(nBuckets + nRows) + nRows*width);
+
+        LogPrint(BCLog::POW, "- Finding collisions\n");
+        const size_t half = 1 << (K-1);
+        std::vector<eh_index> indices(1 << K);
+        std::vector<eh_index> sorted(1 << K);
+        for (size_t b = 0; b < nBuckets; b++) {
+            const size_t start = b ? bucketEnd[b-1] : 0;
+            const size_t end = bucketEnd[b];
+            if (end - start < 2) continue;
+
+            for (size_t l = start; l < end - 1; l++) {
+                for (size_t m = l + 1; m < end; m++) {
+                    const eh_index x = order[l];
+                    const eh_index y = order[m];
+                    if (memcmp(in + x*width + CollisionByteLength, in + y*width + CollisionByteLength,
+                               width - CollisionByteLength) != 0) continue;
+                    if (ArenaSharesRow(pairs, roundStride, K-1, x, y)) continue;
+
+                    ExpandArenaRow(pairs, roundStride, K-1, x, indices.data());
+                    ExpandArenaRow(pairs, roundStride, K-1, y, indices.data()+half);
+                    if (std::lexicographical_compare(indices.begin()+half, indices.end(), indices.begin(), indices.begin()+half)) {
+                        std::swap_ranges(indices.begin(), indices.begin()+half, indices.begin()+half);
+                    }
+                    sorted = indices;
+                    std::sort(sorted.begin(), sorted.end());
+                    if (std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()) continue;
+
+                    auto soln = GetMinimalFromIndices(indices, CollisionBitLength);
+                    assert(soln.size() == equihash_solution_size(N, K));
+                    if (validBlock(soln)) {
+                        return true;
+                    }
+                }
+            }
+            if (cancelled(FinalColliding)) throw solver_cancelled;
+        }
+    } else
+        LogPrint(BCLog::POW, "- List is empty\n");
+
+    return false;
+}
+
 template<unsigned int N, unsigned int K>
 bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln)
 {
@@ -779,6 +1006,10 @@ template bool Equihash<96,3>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<96,3>::ArenaSolve(const eh_HashState& base_state,
+                                         const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         EhSolverArena& arena);
 template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<200,9>
@@ -789,6 +1020,10 @@ template bool Equihash<200,9>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<200,9>::ArenaSolve(const eh_HashState& base_state,
+                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                          const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                          EhSolverArena& arena);
 template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<96,5>
@@ -799,6 +1034,10 @@ template bool Equihash<96,5>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<96,5>::ArenaSolve(const eh_HashState& base_state,
+                                         const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         EhSolverArena& arena);
 template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<48,5>
@@ -809,6 +1048,10 @@ template bool Equihash<48,5>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<48,5>::ArenaSolve(const eh_HashState& base_state,
+                                         const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                         const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                         EhSolverArena& arena);
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<144,5>
@@ -819,6 +1062,10 @@ template bool Equihash<144,5>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<144,5>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<144,5>::ArenaSolve(const eh_HashState& base_state,
+                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                          const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                          EhSolverArena& arena);
 template bool Equihash<144,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 
 // Explicit instantiations for Equihash<192,7>
@@ -829,4 +1076,8 @@ template bool Equihash<192,7>::BasicSolve(const eh_HashState& base_state,
 template bool Equihash<192,7>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
+template bool Equihash<192,7>::ArenaSolve(const eh_HashState& base_state,
+                                          const std::function<bool(std::vector<unsigned char>)> validBlock,
+                                          const std::function<bool(EhSolverCancelCheck)> cancelled,
+                                          EhSolverArena& arena);
 template bool Equihash<192,7>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
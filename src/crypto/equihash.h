@@ -152,6 +152,21 @@ class EhSolverCancelledException : public std::exception
     }
 };
 
+/**
+ * Memory used by Equihash<N,K>::ArenaSolve. The buffer is allocated by the
+ * first run and kept for the next ones, so a solver thread does not touch the
+ * heap while solving.
+ */
+class EhSolverArena
+{
+public:
+    std::vector<unsigned char> buffer;
+    //! Largest number of bytes of the buffer in use during the last run
+    size_t nPeakUsage{0};
+    //! Number of colliding pairs dropped by the last run because a round was full
+    size_t nDroppedRows{0};
+};
+
 inline constexpr size_t max(const size_t A, const size_t B) { return A > B ? A : B; }
 
 inline constexpr size_t equihash_solution_size(unsigned int N, unsigned int K) {
@@ -177,6 +192,10 @@ public:
     enum : size_t { TruncatedWidth=max(HashLength+sizeof(eh_trunc), 2*CollisionByteLength+sizeof(eh_trunc)*(1 << (K-1))) };
     enum : size_t { FinalTruncatedWidth=max(HashLength+sizeof(eh_trunc), 2*CollisionByteLength+sizeof(eh_trunc)*(1 << (K))) };
     enum : size_t { SolutionWidth=(1 << K)*(CollisionBitLength+1)/8 };
+    // Rows per round of ArenaSolve. The lists grow a little from round to
+    // round, and vary more for small parameters, hence the slack.
+    enum : size_t { ArenaRows=(1 << (CollisionBitLength + 1)) + (1 << (CollisionBitLength - 1)) + 1024 };
+    enum : size_t { ArenaSize=sizeof(eh_index)*(2*(K-1)*ArenaRows + (1 << CollisionBitLength) + ArenaRows) + 2*ArenaRows*HashLength };
 
     Equihash() { }
 
@@ -187,6 +206,10 @@ public:
     bool OptimisedSolve(const eh_HashState& base_state,
                         const std::function<bool(std::vector<unsigned char>)> validBlock,
                         const std::function<bool(EhSolverCancelCheck)> cancelled);
+    bool ArenaSolve(const eh_HashState& base_state,
+                    const std::function<bool(std::vector<unsigned char>)> validBlock,
+                    const std::function<bool(EhSolverCancelCheck)> cancelled,
+                    EhSolverArena& arena);
     bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
 };
 
@@ -272,6 +295,55 @@ inline bool EhOptimisedSolveUncancellable(unsigned int n, unsigned int k, const
                             [](EhSolverCancelCheck pos) { return false; });
 }
 
+inline bool EhArenaSolve(unsigned int n, unsigned int k, const eh_HashState& base_state,
+                    const std::function<bool(std::vector<unsigned char>)> validBlock,
+                    const std::function<bool(EhSolverCancelCheck)> cancelled,
+                    EhSolverArena& arena)
+{
+    if (n == 96 && k == 3) {
+        return Eh96_3.ArenaSolve(base_state, validBlock, cancelled, arena);
+    } else if (n == 200 && k == 9) {
+        return Eh200_9.ArenaSolve(base_state, validBlock, cancelled, arena);
+    } else if (n == 96 && k == 5) {
+        return Eh96_5.ArenaSolve(base_state, validBlock, cancelled, arena);
+    } else if (n == 48 && k == 5) {
+        return Eh48_5.ArenaSolve(base_state, validBlock, cancelled, arena);
+    } else if (n == 144 && k == 5) {
+        return Eh144_5.ArenaSolve(base_state, validBlock, cancelled, arena);
+    } else if (n == 192 && k == 7) {
+        return Eh192_7.ArenaSolve(base_state, validBlock, cancelled, arena);
+    } else {
+        throw std::invalid_argument("Unsupported Equihash parameters");
+    }
+}
+
+inline size_t EhArenaSize(unsigned int n, unsigned int k)
+{
+    if (n == 96 && k == 3) {
+        return Equihash<96,3>::ArenaSize;
+    } else if (n == 200 && k == 9) {
+        return Equihash<200,9>::ArenaSize;
+    } else if (n == 96 && k == 5) {
+        return Equihash<96,5>::ArenaSize;
+    } else if (n == 48 && k == 5) {
+        return Equihash<48,5>::ArenaSize;
+    } else if (n == 144 && k == 5) {
+        return Equihash<144,5>::ArenaSize;
+    } else if (n == 192 && k == 7) {
+        return Equihash<192,7>::ArenaSize;
+    } else {
+        throw std::invalid_argument("Unsupported Equihash parameters");
+    }
+}
+
+inline bool EhArenaSolveUncancellable(unsigned int n, unsigned int k, const eh_HashState& base_state,
+                    const std::function<bool(std::vector<unsigned char>)> validBlock,
+                    EhSolverArena& arena)
+{
+    return EhArenaSolve(n, k, base_state, validBlock,
+                        [](EhSolverCancelCheck pos) { return false; }, arena);
+}
+
 #define EhIsValidSolution(n, k, base_state, soln, ret)   \
     if (n == 96 && k == 3) {                             \
         ret = Eh96_3.IsValidSolution(base_state, soln);  \
@@ -0,0 +1,244 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/addressindex.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+
+constexpr char DB_ADDRESSINDEX = 'd';
+constexpr char DB_ADDRESSUNSPENTINDEX = 'u';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+/**
+ * Access to the address index database (indexes/addressindex/)
+ *
+ * Receiving and spending activity is stored under DB_ADDRESSINDEX keyed by
+ * address, height and position in the block, so that the history of an
+ * address can be read with a single range scan. The outputs still unspent on
+ * the indexed chain are stored under DB_ADDRESSUNSPENTINDEX.
+ */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadAddressIndex(const uint160& address_hash, int type,
+                          std::vector<std::pair<CAddressIndexKey, CAmount>>& address_index,
+                          int start, int end);
+
+    bool ReadAddressUnspentIndex(const uint160& address_hash, int type,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent_outputs);
+};
+
+AddressIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool AddressIndex::DB::ReadAddressIndex(const uint160& address_hash, int type,
+                                        std::vector<std::pair<CAddressIndexKey, CAmount>>& address_index,
+                                        int start, int end)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    if (start > 0 && end > 0) {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, address_hash, start)));
+    } else {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, address_hash)));
+    }
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == address_hash))
+            break;
+        if (end > 0 && key.second.blockHeight > end)
+            break;
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        address_index.push_back(std::make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadAddressUnspentIndex(const uint160& address_hash, int type,
+                                               std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent_outputs)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, address_hash)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressUnspentKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == address_hash))
+            break;
+        CAddressUnspentValue nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address unspent value");
+        unspent_outputs.push_back(std::make_pair(key.second, nValue));
+        pcursor->Next();
+    }
+    return true;
+}
+
+/**
+ * Read the undo data of a block and check that it is consistent with the block.
+ * The genesis block has no undo data as its outputs are not spendable.
+ */
+static bool ReadBlockUndo(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& block_undo)
+{
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return error("%s: failed to read undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: block and undo data inconsistent", __func__);
+    }
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        if (block_undo.vtxundo[i - 1].vprevout.size() != block.vtx[i]->vin.size()) {
+            return error("%s: transaction and undo data inconsistent", __func__);
+        }
+    }
+    return true;
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<AddressIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex() {}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // Exclude genesis block transactions because outputs are not spendable.
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!ReadBlockUndo(block, pindex, block_undo)) {
+        return false;
+    }
+
+    CDBBatch batch(*m_db);
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256 hash = tx.GetHash();
+
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = block_undo.vtxundo[i - 1];
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxIn& input = tx.vin[j];
+                const CTxOut& prevout = txundo.vprevout[j].out;
+                CScript::ScriptType scriptType = prevout.scriptPubKey.GetType();
+                if (scriptType == CScript::UNKNOWN) continue;
+                const uint160 addrHash = prevout.scriptPubKey.AddressHash();
+
+                // record spending activity
+                batch.Write(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, j, true)),
+                            prevout.nValue * -1);
+
+                // remove address from unspent index
+                batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(scriptType, addrHash, input.prevout.hash, input.prevout.n)));
+            }
+        }
+
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+            CScript::ScriptType scriptType = out.scriptPubKey.GetType();
+            if (scriptType == CScript::UNKNOWN) continue;
+            const uint160 addrHash = out.scriptPubKey.AddressHash();
+
+            // record receiving activity
+            batch.Write(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, k, false)),
+                        out.nValue);
+
+            // record unspent output
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(scriptType, addrHash, hash, k)),
+                        CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight));
+        }
+    }
+    return m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    CDBBatch batch(*m_db);
+
+    // Undo the effects of the disconnected blocks, most recent first, so that
+    // outputs created and spent within the rewound range end up erased.
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!ReadBlockUndo(block, pindex, block_undo)) {
+            return false;
+        }
+
+        for (int i = block.vtx.size() - 1; i >= 0; i--) {
+            const CTransaction& tx = *block.vtx[i];
+            const uint256 hash = tx.GetHash();
+
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                const CTxOut& out = tx.vout[k];
+                CScript::ScriptType scriptType = out.scriptPubKey.GetType();
+                if (scriptType == CScript::UNKNOWN) continue;
+                const uint160 addrHash = out.scriptPubKey.AddressHash();
+
+                // undo receiving activity
+                batch.Erase(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, k, false)));
+
+                // undo unspent index
+                batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(scriptType, addrHash, hash, k)));
+            }
+
+            if (tx.IsCoinBase()) continue;
+
+            const CTxUndo& txundo = block_undo.vtxundo[i - 1];
+            for (unsigned int j = tx.vin.size(); j-- > 0;) {
+                const CTxIn& input = tx.vin[j];
+                const Coin& coin = txundo.vprevout[j];
+                CScript::ScriptType scriptType = coin.out.scriptPubKey.GetType();
+                if (scriptType == CScript::UNKNOWN) continue;
+                const uint160 addrHash = coin.out.scriptPubKey.AddressHash();
+
+                // undo spending activity
+                batch.Erase(std::make_pair(DB_ADDRESSINDEX, CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, j, true)));
+
+                // restore unspent index
+                batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressUnspentKey(scriptType, addrHash, input.prevout.hash, input.prevout.n)),
+                            CAddressUnspentValue(coin.out.nValue, coin.out.scriptPubKey, coin.nHeight));
+            }
+        }
+    }
+
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::FindAddressIndex(const uint160& address_hash, int type,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount>>& address_index,
+                                    int start, int end) const
+{
+    return m_db->ReadAddressIndex(address_hash, type, address_index, start, end);
+}
+
+bool AddressIndex::FindAddressUnspent(const uint160& address_hash, int type,
+                                      std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent_outputs) const
+{
+    return m_db->ReadAddressUnspentIndex(address_hash, type, unspent_outputs);
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRESSINDEX_H
+#define BITCOIN_INDEX_ADDRESSINDEX_H
+
+#include <addressindex.h>
+#include <chain.h>
+#include <index/base.h>
+
+class CBlockUndo;
+
+/**
+ * AddressIndex is used to look up the transparent activity and the unspent
+ * outputs of an address. The index is written to its own LevelDB database
+ * and is built in the background from block and undo data, so it can be
+ * enabled on an existing node without a reindex.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    /// Look up the receiving and spending activity of an address, optionally
+    /// restricted to the blocks in [start, end].
+    bool FindAddressIndex(const uint160& address_hash, int type,
+                          std::vector<std::pair<CAddressIndexKey, CAmount>>& address_index,
+                          int start = 0, int end = 0) const;
+
+    /// Look up the unspent outputs of an address.
+    bool FindAddressUnspent(const uint160& address_hash, int type,
+                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspent_outputs) const;
+};
+
+/// The global address index, used in GetAddressIndex and GetAddressUnspent. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // BITCOIN_INDEX_ADDRESSINDEX_H
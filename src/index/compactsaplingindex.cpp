@@ -0,0 +1,402 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <dbwrapper.h>
+#include <index/compactsaplingindex.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores, for each block, the disk location and size of its serialized
+ * CompactSaplingBlock. As in BlockFilterIndex, entries belonging to blocks on the active chain are
+ * indexed by height, and those belonging to blocks that have been reorganized out of the active
+ * chain are indexed by block hash. The disk location of the next record to be written is stored
+ * under the DB_BLOCK_POS key.
+ *
+ * The record size is kept next to its location so that ranges of records can be copied out of the
+ * flat files without deserializing them.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_BLOCK_POS = 'P';
+
+constexpr unsigned int MAX_CSB_FILE_SIZE = 0x4000000; // 64 MiB
+/** The pre-allocation chunk size for csb?????.dat files */
+constexpr unsigned int CSB_FILE_CHUNK_SIZE = 0x100000; // 1 MiB
+
+std::unique_ptr<CompactSaplingIndex> g_compactsaplingindex;
+
+namespace {
+
+struct DBVal {
+    FlatFilePos pos;
+    uint32_t size;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(pos);
+        READWRITE(size);
+    }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for compact sapling index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for compact sapling index DB hash key");
+        }
+
+        READWRITE(hash);
+    }
+};
+
+}; // namespace
+
+CompactSaplingBlock::CompactSaplingBlock(const CBlock& block, const CBlockIndex* pindex)
+    : height(pindex->nHeight), hash(pindex->GetBlockHash()), prevHash(block.hashPrevBlock), time(block.nTime)
+{
+    for (uint32_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty()) continue;
+
+        CompactSaplingTx ctx;
+        ctx.index = i;
+        ctx.txid = tx.GetHash();
+        ctx.spends.resize(tx.vShieldedSpend.size());
+        for (size_t j = 0; j < tx.vShieldedSpend.size(); j++) {
+            ctx.spends[j].nullifier = tx.vShieldedSpend[j].nullifier;
+        }
+        ctx.outputs.resize(tx.vShieldedOutput.size());
+        for (size_t j = 0; j < tx.vShieldedOutput.size(); j++) {
+            const OutputDescription& output = tx.vShieldedOutput[j];
+            ctx.outputs[j].cmu = output.cm;
+            ctx.outputs[j].ephemeralKey = output.ephemeralKey;
+            std::copy(output.encCiphertext.begin(), output.encCiphertext.begin() + COMPACT_NOTE_SIZE,
+                      ctx.outputs[j].ciphertext.begin());
+        }
+        vtx.push_back(std::move(ctx));
+    }
+}
+
+CompactSaplingIndex::CompactSaplingIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "compactsapling";
+    fs::create_directories(path);
+
+    m_db = MakeUnique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+    m_block_fileseq = MakeUnique<FlatFileSeq>(std::move(path), "csb", CSB_FILE_CHUNK_SIZE);
+}
+
+bool CompactSaplingIndex::Init()
+{
+    if (!m_db->Read(DB_BLOCK_POS, m_next_block_pos)) {
+        // Check that the cause of the read failure is that the key does not exist. Any other errors
+        // indicate database corruption or a disk failure, and starting the index would cause
+        // further corruption.
+        if (m_db->Exists(DB_BLOCK_POS)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+
+        // If the DB_BLOCK_POS is not set, then initialize to the first location.
+        m_next_block_pos.nFile = 0;
+        m_next_block_pos.nPos = 0;
+    }
+    return BaseIndex::Init();
+}
+
+bool CompactSaplingIndex::CommitInternal(CDBBatch& batch)
+{
+    const FlatFilePos& pos = m_next_block_pos;
+
+    // Flush current file to disk.
+    CAutoFile file(m_block_fileseq->Open(pos), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        return error("%s: Failed to open compact block file %d", __func__, pos.nFile);
+    }
+    if (!FileCommit(file.Get())) {
+        return error("%s: Failed to commit compact block file %d", __func__, pos.nFile);
+    }
+
+    batch.Write(DB_BLOCK_POS, pos);
+    return BaseIndex::CommitInternal(batch);
+}
+
+bool CompactSaplingIndex::ReadRecordFromDisk(std::unique_ptr<CAutoFile>& filein, FlatFilePos& filein_pos,
+                                             const FlatFilePos& pos, uint32_t size, std::vector<unsigned char>& out) const
+{
+    // Records of consecutive blocks are usually adjacent in the same file, so the file opened for
+    // the previous record is reused and only repositioned when the record is elsewhere in it.
+    if (!filein || filein_pos.nFile != pos.nFile) {
+        filein = MakeUnique<CAutoFile>(m_block_fileseq->Open(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein->IsNull()) {
+            filein.reset();
+            return false;
+        }
+    } else if (filein_pos.nPos != pos.nPos && fseek(filein->Get(), pos.nPos, SEEK_SET)) {
+        filein.reset();
+        return error("%s: Unable to seek to position %u of compact block file %d", __func__, pos.nPos, pos.nFile);
+    }
+
+    size_t offset = out.size();
+    out.resize(offset + size);
+    try {
+        filein->read((char*)out.data() + offset, size);
+    }
+    catch (const std::exception& e) {
+        out.resize(offset);
+        filein.reset();
+        return error("%s: Failed to read compact block from disk: %s", __func__, e.what());
+    }
+
+    filein_pos = pos;
+    filein_pos.nPos += size;
+    return true;
+}
+
+size_t CompactSaplingIndex::WriteBlockToDisk(FlatFilePos& pos, const CompactSaplingBlock& block)
+{
+    size_t data_size = GetSerializeSize(block, CLIENT_VERSION);
+
+    // If writing the record would overflow the file, flush and move to the next one.
+    if (pos.nPos + data_size > MAX_CSB_FILE_SIZE) {
+        CAutoFile last_file(m_block_fileseq->Open(pos), SER_DISK, CLIENT_VERSION);
+        if (last_file.IsNull()) {
+            LogPrintf("%s: Failed to open compact block file %d\n", __func__, pos.nFile);
+            return 0;
+        }
+        if (!TruncateFile(last_file.Get(), pos.nPos)) {
+            LogPrintf("%s: Failed to truncate compact block file %d\n", __func__, pos.nFile);
+            return 0;
+        }
+        if (!FileCommit(last_file.Get())) {
+            LogPrintf("%s: Failed to commit compact block file %d\n", __func__, pos.nFile);
+            return 0;
+        }
+
+        pos.nFile++;
+        pos.nPos = 0;
+    }
+
+    // Pre-allocate sufficient space for the record.
+    bool out_of_space;
+    m_block_fileseq->Allocate(pos, data_size, out_of_space);
+    if (out_of_space) {
+        LogPrintf("%s: out of disk space\n", __func__);
+        return 0;
+    }
+
+    CAutoFile fileout(m_block_fileseq->Open(pos), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        LogPrintf("%s: Failed to open compact block file %d\n", __func__, pos.nFile);
+        return 0;
+    }
+
+    fileout << block;
+    return data_size;
+}
+
+bool CompactSaplingIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CompactSaplingBlock compact_block(block, pindex);
+
+    size_t bytes_written = WriteBlockToDisk(m_next_block_pos, compact_block);
+    if (bytes_written == 0) return false;
+
+    std::pair<uint256, DBVal> value;
+    value.first = pindex->GetBlockHash();
+    value.second.pos = m_next_block_pos;
+    value.second.size = bytes_written;
+
+    if (!m_db->Write(DBHeightKey(pindex->nHeight), value)) {
+        return false;
+    }
+
+    m_next_block_pos.nPos += bytes_written;
+    return true;
+}
+
+bool CompactSaplingIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    CDBBatch batch(*m_db);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+
+    // During a reorg, copy the entries of the blocks getting disconnected from the height index to
+    // the hash index so they can still be found once the height index entries are overwritten.
+    DBHeightKey key(new_tip->nHeight);
+    db_it->Seek(key);
+    for (int height = new_tip->nHeight; height <= current_tip->nHeight; ++height) {
+        if (!db_it->GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, DBVal> value;
+        if (!db_it->GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, GetName(), DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it->Next();
+    }
+
+    // The latest position gets written in Commit by the call to BaseIndex::Rewind, but since the
+    // hash index entries reference the flat files it is updated atomically here as well.
+    batch.Write(DB_BLOCK_POS, m_next_block_pos);
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+static bool LookupEntries(CDBWrapper& db, const char* index_name, int start_height,
+                          const CBlockIndex* stop_index, std::vector<DBVal>& results)
+{
+    if (start_height < 0) {
+        return error("%s: start height (%d) is negative", __func__, start_height);
+    }
+    if (start_height > stop_index->nHeight) {
+        return error("%s: start height (%d) is greater than stop height (%d)",
+                     __func__, start_height, stop_index->nHeight);
+    }
+
+    size_t results_size = static_cast<size_t>(stop_index->nHeight - start_height + 1);
+    std::vector<std::pair<uint256, DBVal>> values(results_size);
+
+    DBHeightKey key(start_height);
+    std::unique_ptr<CDBIterator> db_it(db.NewIterator());
+    db_it->Seek(DBHeightKey(start_height));
+    for (int height = start_height; height <= stop_index->nHeight; ++height) {
+        if (!db_it->Valid() || !db_it->GetKey(key) || key.height != height) {
+            return false;
+        }
+
+        size_t i = static_cast<size_t>(height - start_height);
+        if (!db_it->GetValue(values[i])) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        db_it->Next();
+    }
+
+    results.resize(results_size);
+
+    // Iterate backwards through block indexes to look up entries of blocks that are not on the
+    // active chain in the hash index.
+    for (const CBlockIndex* block_index = stop_index;
+         block_index && block_index->nHeight >= start_height;
+         block_index = block_index->pprev) {
+        uint256 block_hash = block_index->GetBlockHash();
+
+        size_t i = static_cast<size_t>(block_index->nHeight - start_height);
+        if (block_hash == values[i].first) {
+            results[i] = std::move(values[i].second);
+            continue;
+        }
+
+        if (!db.Read(DBHashKey(block_hash), results[i])) {
+            return error("%s: unable to read value in %s at key (%c, %s)",
+                         __func__, index_name, DB_BLOCK_HASH, block_hash.ToString());
+        }
+    }
+
+    return true;
+}
+
+bool CompactSaplingIndex::LookupBlock(const CBlockIndex* block_index, CompactSaplingBlock& block_out) const
+{
+    std::vector<CompactSaplingBlock> blocks;
+    if (!LookupRange(block_index->nHeight, block_index, blocks)) {
+        return false;
+    }
+
+    block_out = std::move(blocks.front());
+    return true;
+}
+
+bool CompactSaplingIndex::LookupRawRange(int start_height, const CBlockIndex* stop_index,
+                                         std::vector<unsigned char>& data_out) const
+{
+    std::vector<DBVal> entries;
+    if (!LookupEntries(*m_db, GetName(), start_height, stop_index, entries)) {
+        return false;
+    }
+
+    size_t total_size = 0;
+    for (const auto& entry : entries) {
+        total_size += entry.size;
+    }
+
+    data_out.clear();
+    data_out.reserve(total_size);
+    std::unique_ptr<CAutoFile> filein;
+    FlatFilePos filein_pos;
+    for (const auto& entry : entries) {
+        if (!ReadRecordFromDisk(filein, filein_pos, entry.pos, entry.size, data_out)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CompactSaplingIndex::LookupRange(int start_height, const CBlockIndex* stop_index,
+                                      std::vector<CompactSaplingBlock>& blocks_out) const
+{
+    std::vector<unsigned char> data;
+    if (!LookupRawRange(start_height, stop_index, data)) {
+        return false;
+    }
+
+    blocks_out.resize(static_cast<size_t>(stop_index->nHeight - start_height + 1));
+    try {
+        CDataStream stream(data, SER_DISK, CLIENT_VERSION);
+        for (auto& block : blocks_out) {
+            stream >> block;
+        }
+    }
+    catch (const std::exception& e) {
+        return error("%s: Failed to deserialize compact blocks: %s", __func__, e.what());
+    }
+
+    return true;
+}
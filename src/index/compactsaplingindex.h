@@ -0,0 +1,152 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COMPACTSAPLINGINDEX_H
+#define BITCOIN_INDEX_COMPACTSAPLINGINDEX_H
+
+#include <chain.h>
+#include <flatfile.h>
+#include <index/base.h>
+#include <streams.h>
+#include <zcash/Zcash.h>
+
+#include <array>
+
+/** Size of the prefix of encCiphertext needed to trial-decrypt a Sapling note (lead byte, d, v, rcm). */
+static constexpr size_t COMPACT_NOTE_SIZE = ZC_NOTEPLAINTEXT_LEADING + ZC_DIVERSIFIER_SIZE + ZC_V_SIZE + ZC_R_SIZE;
+
+/** Maximum number of compact blocks returned by a single RPC or REST request. */
+static constexpr int MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST = 1000;
+
+/** The parts of a Sapling spend a light client needs to detect spends of its notes. */
+struct CompactSaplingSpend {
+    uint256 nullifier;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nullifier);
+    }
+};
+
+/** The parts of a Sapling output a light client needs to trial-decrypt it and update its witnesses. */
+struct CompactSaplingOutput {
+    uint256 cmu;
+    uint256 ephemeralKey;
+    std::array<unsigned char, COMPACT_NOTE_SIZE> ciphertext;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(cmu);
+        READWRITE(ephemeralKey);
+        READWRITE(ciphertext);
+    }
+};
+
+/** A transaction reduced to its Sapling spends and outputs. */
+struct CompactSaplingTx {
+    //! Index of the transaction in the block
+    uint32_t index;
+    uint256 txid;
+    std::vector<CompactSaplingSpend> spends;
+    std::vector<CompactSaplingOutput> outputs;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(index);
+        READWRITE(txid);
+        READWRITE(spends);
+        READWRITE(outputs);
+    }
+};
+
+/**
+ * A block reduced to the transactions with Sapling spends or outputs. This is
+ * the record stored in the flat files of CompactSaplingIndex.
+ */
+struct CompactSaplingBlock {
+    int height;
+    uint256 hash;
+    uint256 prevHash;
+    uint32_t time;
+    std::vector<CompactSaplingTx> vtx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(height);
+        READWRITE(hash);
+        READWRITE(prevHash);
+        READWRITE(time);
+        READWRITE(vtx);
+    }
+
+    CompactSaplingBlock() : height(0), time(0) {}
+    CompactSaplingBlock(const CBlock& block, const CBlockIndex* pindex);
+};
+
+/**
+ * CompactSaplingIndex pre-extracts, for each block, the Sapling nullifiers
+ * and the note commitment, ephemeral key and compact ciphertext of each
+ * Sapling output, so light wallet servers do not have to read and
+ * deserialize full blocks. Records are stored in flat files referenced by
+ * LevelDB entries by height and, for blocks reorganized out of the active
+ * chain, by hash, in the same layout as BlockFilterIndex.
+ */
+class CompactSaplingIndex final : public BaseIndex
+{
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    FlatFilePos m_next_block_pos;
+    std::unique_ptr<FlatFileSeq> m_block_fileseq;
+
+    bool ReadRecordFromDisk(std::unique_ptr<CAutoFile>& filein, FlatFilePos& filein_pos,
+                            const FlatFilePos& pos, uint32_t size, std::vector<unsigned char>& out) const;
+    size_t WriteBlockToDisk(FlatFilePos& pos, const CompactSaplingBlock& block);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return "compactsaplingindex"; }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit CompactSaplingIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /** Get a single compact block. */
+    bool LookupBlock(const CBlockIndex* block_index, CompactSaplingBlock& block_out) const;
+
+    /**
+     * Get the serialized compact blocks between two heights on a chain,
+     * concatenated in height order. The records are copied from the flat
+     * files as they are, without being deserialized.
+     */
+    bool LookupRawRange(int start_height, const CBlockIndex* stop_index,
+                        std::vector<unsigned char>& data_out) const;
+
+    /** Get the compact blocks between two heights on a chain. */
+    bool LookupRange(int start_height, const CBlockIndex* stop_index,
+                     std::vector<CompactSaplingBlock>& blocks_out) const;
+};
+
+/// The global compact Sapling block index. May be null.
+extern std::unique_ptr<CompactSaplingIndex> g_compactsaplingindex;
+
+#endif // BITCOIN_INDEX_COMPACTSAPLINGINDEX_H
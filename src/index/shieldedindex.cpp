@@ -0,0 +1,141 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/shieldedindex.h>
+#include <util/system.h>
+#include <validation.h>
+
+constexpr char DB_SPROUT_NULLIFIER = 'n';
+constexpr char DB_SAPLING_NULLIFIER = 'N';
+constexpr char DB_SPROUT_COMMITMENT = 'c';
+constexpr char DB_SAPLING_COMMITMENT = 'C';
+constexpr char DB_TREE_SIZES = 's';
+
+std::unique_ptr<ShieldedIndex> g_shieldedindex;
+
+/** Number of Sprout and Sapling note commitments in the chain up to and including a block. */
+struct TreeSizes {
+    uint64_t sprout;
+    uint64_t sapling;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(sprout);
+        READWRITE(sapling);
+    }
+
+    TreeSizes() : sprout(0), sapling(0) {}
+};
+
+/**
+ * Access to the shielded index database (indexes/shieldedindex/)
+ *
+ * Nullifiers and note commitments are stored under a key prefix per shielded
+ * pool. The commitment tree sizes after each block are stored by block hash,
+ * so that positions of the next block can be computed without deserializing
+ * any tree, including after a reorg.
+ */
+class ShieldedIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+};
+
+ShieldedIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "shieldedindex", n_cache_size, f_memory, f_wipe)
+{}
+
+ShieldedIndex::ShieldedIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<ShieldedIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+ShieldedIndex::~ShieldedIndex() {}
+
+bool ShieldedIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    TreeSizes sizes;
+    if (pindex->pprev && !m_db->Read(std::make_pair(DB_TREE_SIZES, pindex->pprev->GetBlockHash()), sizes)) {
+        return error("%s: tree sizes of block %s not found", __func__, pindex->pprev->GetBlockHash().ToString());
+    }
+
+    CDBBatch batch(*m_db);
+    for (const auto& tx : block.vtx) {
+        const uint256 hash = tx->GetHash();
+
+        for (uint32_t js = 0; js < tx->vJoinSplit.size(); js++) {
+            const JSDescription& joinsplit = tx->vJoinSplit[js];
+            for (const uint256& nf : joinsplit.nullifiers) {
+                batch.Write(std::make_pair(DB_SPROUT_NULLIFIER, nf), CNullifierIndexValue(hash, pindex->nHeight, js));
+            }
+            for (uint32_t n = 0; n < joinsplit.commitments.size(); n++) {
+                batch.Write(std::make_pair(DB_SPROUT_COMMITMENT, joinsplit.commitments[n]),
+                            CCommitmentIndexValue(hash, pindex->nHeight, js * ZC_NUM_JS_OUTPUTS + n, sizes.sprout++));
+            }
+        }
+
+        for (uint32_t i = 0; i < tx->vShieldedSpend.size(); i++) {
+            batch.Write(std::make_pair(DB_SAPLING_NULLIFIER, tx->vShieldedSpend[i].nullifier),
+                        CNullifierIndexValue(hash, pindex->nHeight, i));
+        }
+        for (uint32_t i = 0; i < tx->vShieldedOutput.size(); i++) {
+            batch.Write(std::make_pair(DB_SAPLING_COMMITMENT, tx->vShieldedOutput[i].cm),
+                        CCommitmentIndexValue(hash, pindex->nHeight, i, sizes.sapling++));
+        }
+    }
+    batch.Write(std::make_pair(DB_TREE_SIZES, pindex->GetBlockHash()), sizes);
+    return m_db->WriteBatch(batch);
+}
+
+bool ShieldedIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    CDBBatch batch(*m_db);
+
+    // Nullifiers and commitments of the disconnected blocks are no longer on
+    // the chain. The tree sizes are kept as they are indexed by block hash.
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        for (const auto& tx : block.vtx) {
+            for (const JSDescription& joinsplit : tx->vJoinSplit) {
+                for (const uint256& nf : joinsplit.nullifiers) {
+                    batch.Erase(std::make_pair(DB_SPROUT_NULLIFIER, nf));
+                }
+                for (const uint256& cm : joinsplit.commitments) {
+                    batch.Erase(std::make_pair(DB_SPROUT_COMMITMENT, cm));
+                }
+            }
+            for (const SpendDescription& spend : tx->vShieldedSpend) {
+                batch.Erase(std::make_pair(DB_SAPLING_NULLIFIER, spend.nullifier));
+            }
+            for (const OutputDescription& output : tx->vShieldedOutput) {
+                batch.Erase(std::make_pair(DB_SAPLING_COMMITMENT, output.cm));
+            }
+        }
+    }
+
+    if (!m_db->WriteBatch(batch)) return false;
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& ShieldedIndex::GetDB() const { return *m_db; }
+
+bool ShieldedIndex::FindNullifier(const uint256& nullifier, ShieldedType type, CNullifierIndexValue& value) const
+{
+    return m_db->Read(std::make_pair(type == SPROUT ? DB_SPROUT_NULLIFIER : DB_SAPLING_NULLIFIER, nullifier), value);
+}
+
+bool ShieldedIndex::FindCommitment(const uint256& commitment, ShieldedType type, CCommitmentIndexValue& value) const
+{
+    return m_db->Read(std::make_pair(type == SPROUT ? DB_SPROUT_COMMITMENT : DB_SAPLING_COMMITMENT, commitment), value);
+}
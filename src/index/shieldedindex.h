@@ -0,0 +1,116 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SHIELDEDINDEX_H
+#define BITCOIN_INDEX_SHIELDEDINDEX_H
+
+#include <chain.h>
+#include <coins.h>
+#include <index/base.h>
+
+/** Where a nullifier was revealed: the spending transaction and its position. */
+struct CNullifierIndexValue {
+    uint256 txid;
+    int blockHeight;
+    //! Index of the JoinSplit (Sprout) or of the spend description (Sapling)
+    uint32_t index;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(blockHeight);
+        READWRITE(index);
+    }
+
+    CNullifierIndexValue(const uint256& t, int h, uint32_t i) : txid(t), blockHeight(h), index(i) {}
+
+    CNullifierIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        txid.SetNull();
+        blockHeight = 0;
+        index = 0;
+    }
+};
+
+/** Where a note commitment was created, and its position in the commitment tree. */
+struct CCommitmentIndexValue {
+    uint256 txid;
+    int blockHeight;
+    //! Index of the output description (Sapling), or JoinSplit index *
+    //! ZC_NUM_JS_OUTPUTS + output index within the JoinSplit (Sprout)
+    uint32_t outputIndex;
+    //! Position of the leaf in the note commitment tree
+    uint64_t position;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(blockHeight);
+        READWRITE(outputIndex);
+        READWRITE(position);
+    }
+
+    CCommitmentIndexValue(const uint256& t, int h, uint32_t i, uint64_t p) : txid(t), blockHeight(h), outputIndex(i), position(p) {}
+
+    CCommitmentIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        txid.SetNull();
+        blockHeight = 0;
+        outputIndex = 0;
+        position = 0;
+    }
+};
+
+/**
+ * ShieldedIndex is used to look up the transaction revealing a Sprout or
+ * Sapling nullifier, and the transaction and tree position of a note
+ * commitment. The index is written to its own LevelDB database, which also
+ * records the size of both commitment trees after each indexed block.
+ */
+class ShieldedIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "shieldedindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit ShieldedIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~ShieldedIndex() override;
+
+    /// Look up the transaction that revealed a nullifier.
+    bool FindNullifier(const uint256& nullifier, ShieldedType type, CNullifierIndexValue& value) const;
+
+    /// Look up the transaction that created a note commitment.
+    bool FindCommitment(const uint256& commitment, ShieldedType type, CCommitmentIndexValue& value) const;
+};
+
+/// The global shielded index. May be null.
+extern std::unique_ptr<ShieldedIndex> g_shieldedindex;
+
+#endif // BITCOIN_INDEX_SHIELDEDINDEX_H
@@ -0,0 +1,53 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SPENTINDEX_H
+#define BITCOIN_INDEX_SPENTINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+#include <spentindex.h>
+
+/**
+ * SpentIndex is used to look up the transaction input that spent a given
+ * output, together with the amount and address of the spent output. The index
+ * is written to its own LevelDB database and is built in the background.
+ */
+class SpentIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "spentindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~SpentIndex() override;
+
+    /// Look up the input spending an output.
+    ///
+    /// @param[in]   key    The outpoint to look up.
+    /// @param[out]  value  The spending transaction and input, and the spent amount and address.
+    /// @return  true if the output is spent on the indexed chain, false otherwise
+    bool FindSpent(const CSpentIndexKey& key, CSpentIndexValue& value) const;
+};
+
+/// The global spent index, used in GetSpentIndex. May be null.
+extern std::unique_ptr<SpentIndex> g_spentindex;
+
+#endif // BITCOIN_INDEX_SPENTINDEX_H
@@ -0,0 +1,124 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/timestampindex.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+
+constexpr char DB_TIMESTAMPINDEX = 'T';
+constexpr char DB_BLOCKHASHINDEX = 'h';
+
+std::unique_ptr<TimestampIndex> g_timestampindex;
+
+/**
+ * Access to the timestamp index database (indexes/timestampindex/)
+ *
+ * Block hashes are stored under DB_TIMESTAMPINDEX keyed by logical timestamp,
+ * and the logical timestamp of each block is stored under DB_BLOCKHASHINDEX so
+ * that the next block can be assigned a strictly greater one. Entries of
+ * blocks that are reorganized out of the active chain are kept, which is why
+ * lookups can be filtered on the active chain.
+ */
+class TimestampIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
+                            std::vector<std::pair<uint256, unsigned int>>& hashes);
+
+    bool ReadTimestampBlockIndex(const uint256& hash, unsigned int& ltimestamp) const;
+
+    bool WriteTimestamp(const CTimestampIndexKey& timestamp_index, const CTimestampBlockIndexKey& blockhash_index,
+                        const CTimestampBlockIndexValue& logicalts);
+};
+
+TimestampIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "timestampindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool TimestampIndex::DB::ReadTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
+                                            std::vector<std::pair<uint256, unsigned int>>& hashes)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTimestampIndexKey> key;
+        if (!(pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high)) {
+            break;
+        }
+        if (fActiveOnly) {
+            LOCK(cs_main);
+            CBlockIndex* pblockindex = LookupBlockIndex(key.second.blockHash);
+            if (::ChainActive().Contains(pblockindex)) {
+                hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
+            }
+        } else {
+            hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
+        }
+        pcursor->Next();
+    }
+    return true;
+}
+
+bool TimestampIndex::DB::ReadTimestampBlockIndex(const uint256& hash, unsigned int& ltimestamp) const
+{
+    CTimestampBlockIndexValue lts;
+    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
+        return false;
+
+    ltimestamp = lts.ltimestamp;
+    return true;
+}
+
+bool TimestampIndex::DB::WriteTimestamp(const CTimestampIndexKey& timestamp_index, const CTimestampBlockIndexKey& blockhash_index,
+                                        const CTimestampBlockIndexValue& logicalts)
+{
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestamp_index), 0);
+    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, blockhash_index), logicalts);
+    return WriteBatch(batch);
+}
+
+TimestampIndex::TimestampIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<TimestampIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+TimestampIndex::~TimestampIndex() {}
+
+bool TimestampIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block is not indexed.
+    if (pindex->nHeight == 0) return true;
+
+    unsigned int logicalTS = pindex->nTime;
+    unsigned int prevLogicalTS = 0;
+
+    // retrieve logical timestamp of the previous block
+    if (pindex->pprev->nHeight > 0 && !m_db->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS)) {
+        LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+    }
+
+    if (logicalTS <= prevLogicalTS) {
+        logicalTS = prevLogicalTS + 1;
+        LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
+    }
+
+    return m_db->WriteTimestamp(CTimestampIndexKey(logicalTS, pindex->GetBlockHash()),
+                                CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS));
+}
+
+BaseIndex::DB& TimestampIndex::GetDB() const { return *m_db; }
+
+bool TimestampIndex::FindBlockHashes(unsigned int high, unsigned int low, bool fActiveOnly,
+                                     std::vector<std::pair<uint256, unsigned int>>& hashes) const
+{
+    return m_db->ReadTimestampIndex(high, low, fActiveOnly, hashes);
+}
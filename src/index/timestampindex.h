@@ -0,0 +1,50 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_TIMESTAMPINDEX_H
+#define BITCOIN_INDEX_TIMESTAMPINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+#include <timestampindex.h>
+
+/**
+ * TimestampIndex is used to look up block hashes by a range of timestamps.
+ * Blocks are indexed by a logical timestamp, which is the block time forced
+ * to be strictly increasing along the chain. The index is written to its own
+ * LevelDB database and is built in the background.
+ */
+class TimestampIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "timestampindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit TimestampIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~TimestampIndex() override;
+
+    /// Look up the hashes of the blocks with a logical timestamp in [low, high).
+    /// If fActiveOnly is set, blocks that are not on the active chain are skipped.
+    bool FindBlockHashes(unsigned int high, unsigned int low, bool fActiveOnly,
+                         std::vector<std::pair<uint256, unsigned int>>& hashes) const;
+};
+
+/// The global timestamp index, used in GetTimestampIndex. May be null.
+extern std::unique_ptr<TimestampIndex> g_timestampindex;
+
+#endif // BITCOIN_INDEX_TIMESTAMPINDEX_H
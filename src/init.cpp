@@ -22,10 +22,16 @@
 #include <fetchparams.h>
 #include <httprpc.h>
 #include <httpserver.h>
+#include <index/addressindex.h>
 #include <index/blockfilterindex.h>
+#include <index/compactsaplingindex.h>
+#include <index/shieldedindex.h>
+#include <index/spentindex.h>
+#include <index/timestampindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <key.h>
+#include <key_io.h>
 #include <miner.h>
 #include <net.h>
 #include <net_permissions.h>
@@ -172,6 +178,21 @@ void Interrupt()
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_addressindex) {
+        g_addressindex->Interrupt();
+    }
+    if (g_spentindex) {
+        g_spentindex->Interrupt();
+    }
+    if (g_timestampindex) {
+        g_timestampindex->Interrupt();
+    }
+    if (g_shieldedindex) {
+        g_shieldedindex->Interrupt();
+    }
+    if (g_compactsaplingindex) {
+        g_compactsaplingindex->Interrupt();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
 }
 
@@ -189,6 +210,7 @@ void Shutdown(InitInterfaces& interfaces)
     /// module was initialized.
     util::ThreadRename("shutoff");
     mempool.AddTransactionsUpdated(1);
+    StopMining();
 
     StopHTTPRPC();
     StopREST();
@@ -253,6 +275,26 @@ void Shutdown(InitInterfaces& interfaces)
         g_txindex->Stop();
         g_txindex.reset();
     }
+    if (g_addressindex) {
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+    if (g_spentindex) {
+        g_spentindex->Stop();
+        g_spentindex.reset();
+    }
+    if (g_timestampindex) {
+        g_timestampindex->Stop();
+        g_timestampindex.reset();
+    }
+    if (g_shieldedindex) {
+        g_shieldedindex->Stop();
+        g_shieldedindex.reset();
+    }
+    if (g_compactsaplingindex) {
+        g_compactsaplingindex->Stop();
+        g_compactsaplingindex.reset();
+    }
     ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
     DestroyAllBlockFilterIndexes();
 
@@ -370,6 +412,7 @@ void SetupServerArgs()
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #endif
     gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockcheckthreads=<n>", strprintf("Number of threads running the context-free checks of blocks downloaded from peers while earlier blocks are connected, 0 to check them in the message handler thread (default: %d, maximum: %d)", DEFAULT_BLOCK_CHECK_THREADS, MAX_BLOCK_CHECK_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify directory to hold blocks subdirectory for *.dat files (default: <datadir>)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #if HAVE_SYSTEM
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -398,6 +441,7 @@ void SetupServerArgs()
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks. When in pruning mode or if blocks on disk might be corrupted, use full -reindex instead.", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-shieldedverifythreads=<n>", strprintf("Number of threads verifying the proofs and signatures of shielded transactions received from peers, 0 to verify them in the message handler thread (default: %d, maximum: %d)", DEFAULT_SHIELDED_VERIFY_THREADS, MAX_SHIELDED_VERIFY_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)", ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
 #else
@@ -407,6 +451,8 @@ void SetupServerArgs()
     gArgs.AddArg("-addressindex", strprintf("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)", DEFAULT_ADDRESSINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-spentindex", strprintf("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)", DEFAULT_SPENTINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-timestampindex", strprintf("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)", DEFAULT_TIMESTAMPINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-shieldedindex", strprintf("Maintain a shielded transaction index, used to query the transactions revealing nullifiers and creating note commitments (default: %u)", DEFAULT_SHIELDEDINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-compactsaplingindex", strprintf("Maintain an index of compact Sapling blocks, used to serve light wallets through the getcompactsaplingblocks rpc call and REST (default: %u)", DEFAULT_COMPACTSAPLINGINDEX), ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockfilterindex=<type>",
                  strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
                  " If <type> is not supplied or if <type> = 1, indexes for all known types are enabled.",
@@ -466,19 +512,23 @@ void SetupServerArgs()
     g_wallet_init_interface.AddWalletOptions();
 
 #if ENABLE_ZMQ
+    gArgs.AddArg("-zmqpubblocktemplate=<address>", "Enable publish block template and its changes in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashblock=<address>", "Enable publish hash block in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashtx=<address>", "Enable publish hash transaction in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblock=<address>", "Enable publish raw block in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>", ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubblocktemplatehwm=<n>", strprintf("Set publish block template outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashblockhwm=<n>", strprintf("Set publish hash block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashtxhwm=<n>", strprintf("Set publish hash transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblockhwm=<n>", strprintf("Set publish raw block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtxhwm=<n>", strprintf("Set publish raw transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), ArgsManager::ALLOW_ANY, OptionsCategory::ZMQ);
 #else
+    hidden_args.emplace_back("-zmqpubblocktemplate=<address>");
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
     hidden_args.emplace_back("-zmqpubrawblock=<address>");
     hidden_args.emplace_back("-zmqpubrawtx=<address>");
+    hidden_args.emplace_back("-zmqpubblocktemplatehwm=<n>");
     hidden_args.emplace_back("-zmqpubhashblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubhashtxhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawblockhwm=<n>");
@@ -535,9 +585,14 @@ void SetupServerArgs()
     gArgs.AddArg("-whitelistrelay", strprintf("Add 'relay' permission to whitelisted inbound peers with default permissions. The will accept relayed transactions even when not relaying transactions (default: %d)", DEFAULT_WHITELISTRELAY), ArgsManager::ALLOW_ANY, OptionsCategory::NODE_RELAY);
 
 
+    gArgs.AddArg("-blockmaxvalidationcost=<n>", strprintf("Set maximum shielded validation cost of a block, in virtual bytes (default: %d)", DEFAULT_BLOCK_MAX_VALIDATION_COST), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", ArgsManager::ALLOW_ANY | ArgsManager::DEBUG_ONLY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-equihashsolver=<solver>", strprintf("Equihash solver of the built-in miner and of the generate RPCs: \"arena\", which uses a preallocated arena per thread and is faster, or \"optimised\", which uses less memory for large parameters (default: \"arena\" if its arena takes at most %u MB, otherwise \"optimised\")", MAX_DEFAULT_EQUIHASH_ARENA_SIZE / (1024 * 1024)), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-gen", strprintf("Mine blocks to -mineraddress with the built-in miner (default: %u)", DEFAULT_GENERATE), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-genproclimit=<n>", strprintf("Set the number of Equihash solver threads of the built-in miner and of the generate RPCs (-1 = all cores, default: %d)", DEFAULT_GENERATE_THREADS), ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-mineraddress=<addr>", "Send the rewards of blocks mined with -gen to the given transparent address", ArgsManager::ALLOW_ANY, OptionsCategory::BLOCK_CREATION);
 
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", ArgsManager::ALLOW_ANY, OptionsCategory::RPC);
@@ -1053,7 +1108,21 @@ bool AppInitParameterInteraction()
         if (!g_enabled_filter_types.empty()) {
             return InitError(_("Prune mode is incompatible with -blockfilterindex.").translated);
         }
-    }
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex.").translated);
+        if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX))
+            return InitError(_("Prune mode is incompatible with -spentindex.").translated);
+        if (gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX))
+            return InitError(_("Prune mode is incompatible with -timestampindex.").translated);
+        if (gArgs.GetBoolArg("-shieldedindex", DEFAULT_SHIELDEDINDEX))
+            return InitError(_("Prune mode is incompatible with -shieldedindex.").translated);
+        if (gArgs.GetBoolArg("-compactsaplingindex", DEFAULT_COMPACTSAPLINGINDEX))
+            return InitError(_("Prune mode is incompatible with -compactsaplingindex.").translated);
+    }
+
+    fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    fTimestampIndex = gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
 
     // -bind and -whitebind can't be set when not listening
     size_t nUserBind = gArgs.GetArgs("-bind").size() + gArgs.GetArgs("-whitebind").size();
@@ -1206,6 +1275,14 @@ bool AppInitParameterInteraction()
             return InitError(AmountErrMsg("blockmintxfee", gArgs.GetArg("-blockmintxfee", "")).translated);
     }
 
+    if (gArgs.IsArgSet("-equihashsolver") && !IsValidEquihashSolver(gArgs.GetArg("-equihashsolver", ""))) {
+        return InitError(strprintf(_("Unknown -equihashsolver value %s.").translated, gArgs.GetArg("-equihashsolver", "")));
+    }
+
+    if (gArgs.GetBoolArg("-gen", DEFAULT_GENERATE) && !IsValidDestination(DecodeDestination(gArgs.GetArg("-mineraddress", "")))) {
+        return InitError(_("-gen requires a valid transparent -mineraddress").translated);
+    }
+
     // Feerate used to define dust.  Shouldn't be changed lightly as old
     // implementations may inadvertently create non-standard transactions
     if (gArgs.IsArgSet("-dustrelayfee"))
@@ -1354,6 +1431,7 @@ bool AppInitMain(InitInterfaces& interfaces)
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitShieldedProofCache();
 
     LogPrintf("Script verification uses %d additional threads\n", std::max(nScriptCheckThreads - 1, 0));
     if (nScriptCheckThreads) {
@@ -1510,7 +1588,7 @@ bool AppInitMain(InitInterfaces& interfaces)
     }
 
 #if ENABLE_ZMQ
-    g_zmq_notification_interface = CZMQNotificationInterface::Create();
+    g_zmq_notification_interface = CZMQNotificationInterface::Create(scheduler);
 
     if (g_zmq_notification_interface) {
         RegisterValidationInterface(g_zmq_notification_interface);
@@ -1540,14 +1618,20 @@ bool AppInitMain(InitInterfaces& interfaces)
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
     int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
     nTotalCache -= nBlockTreeDBCache;
-    int64_t nTxIndexCache = nTotalCache / 8;
-    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-        // enable 3/4 of the cache if addressindex and/or spentindex is enabled
-        nTxIndexCache = nTotalCache * 3 / 4;
-    } else {
-        nTxIndexCache = std::min(nTxIndexCache, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
-    }
+    int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
     nTotalCache -= nTxIndexCache;
+    // The address and spent indexes are written for every transparent input and
+    // output, so they get a larger share of the cache than the other indexes.
+    int64_t address_index_cache = fAddressIndex ? std::min(nTotalCache / 4, max_address_index_cache << 20) : 0;
+    nTotalCache -= address_index_cache;
+    int64_t spent_index_cache = fSpentIndex ? std::min(nTotalCache / 4, max_spent_index_cache << 20) : 0;
+    nTotalCache -= spent_index_cache;
+    int64_t timestamp_index_cache = fTimestampIndex ? std::min(nTotalCache / 8, max_timestamp_index_cache << 20) : 0;
+    nTotalCache -= timestamp_index_cache;
+    int64_t shielded_index_cache = gArgs.GetBoolArg("-shieldedindex", DEFAULT_SHIELDEDINDEX) ? std::min(nTotalCache / 8, max_shielded_index_cache << 20) : 0;
+    nTotalCache -= shielded_index_cache;
+    int64_t compact_sapling_index_cache = gArgs.GetBoolArg("-compactsaplingindex", DEFAULT_COMPACTSAPLINGINDEX) ? std::min(nTotalCache / 8, max_compact_sapling_index_cache << 20) : 0;
+    nTotalCache -= compact_sapling_index_cache;
     int64_t filter_index_cache = 0;
     if (!g_enabled_filter_types.empty()) {
         size_t n_indexes = g_enabled_filter_types.size();
@@ -1566,6 +1650,21 @@ bool AppInitMain(InitInterfaces& interfaces)
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         LogPrintf("* Using %.1f MiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
     }
+    if (fAddressIndex) {
+        LogPrintf("* Using %.1f MiB for address index database\n", address_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (fSpentIndex) {
+        LogPrintf("* Using %.1f MiB for spent index database\n", spent_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (fTimestampIndex) {
+        LogPrintf("* Using %.1f MiB for timestamp index database\n", timestamp_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-shieldedindex", DEFAULT_SHIELDEDINDEX)) {
+        LogPrintf("* Using %.1f MiB for shielded index database\n", shielded_index_cache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-compactsaplingindex", DEFAULT_COMPACTSAPLINGINDEX)) {
+        LogPrintf("* Using %.1f MiB for compact Sapling block index database\n", compact_sapling_index_cache * (1.0 / 1024 / 1024));
+    }
     for (BlockFilterType filter_type : g_enabled_filter_types) {
         LogPrintf("* Using %.1f MiB for %s block filter index database\n",
                   filter_index_cache * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
@@ -1620,21 +1719,10 @@ bool AppInitMain(InitInterfaces& interfaces)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?").translated);
                 }
 
-                // Check for changed -addressindex state
-                if (fAddressIndex != gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -addressindex").translated;
-                    break;
-                }
-
-                // Check for changed -spentindex state
-                if (fSpentIndex != gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -spentindex").translated;
-                    break;
-                }
-
-                // Check for changed -timestampindex state
-                if (fTimestampIndex != gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -timestampindex").translated;
+                // Drop the address, spent and timestamp index records that
+                // older versions kept in the block index database.
+                if (!pblocktree->EraseLegacyIndexes()) {
+                    strLoadError = _("Error removing legacy indexes from the block database").translated;
                     break;
                 }
 
@@ -1787,6 +1875,31 @@ bool AppInitMain(InitInterfaces& interfaces)
         g_txindex->Start();
     }
 
+    if (fAddressIndex) {
+        g_addressindex = MakeUnique<AddressIndex>(address_index_cache, false, fReindex);
+        g_addressindex->Start();
+    }
+
+    if (fSpentIndex) {
+        g_spentindex = MakeUnique<SpentIndex>(spent_index_cache, false, fReindex);
+        g_spentindex->Start();
+    }
+
+    if (fTimestampIndex) {
+        g_timestampindex = MakeUnique<TimestampIndex>(timestamp_index_cache, false, fReindex);
+        g_timestampindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-shieldedindex", DEFAULT_SHIELDEDINDEX)) {
+        g_shieldedindex = MakeUnique<ShieldedIndex>(shielded_index_cache, false, fReindex);
+        g_shieldedindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-compactsaplingindex", DEFAULT_COMPACTSAPLINGINDEX)) {
+        g_compactsaplingindex = MakeUnique<CompactSaplingIndex>(compact_sapling_index_cache, false, fReindex);
+        g_compactsaplingindex->Start();
+    }
+
     for (const auto& filter_type : g_enabled_filter_types) {
         InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
         GetBlockFilterIndex(filter_type)->Start();
@@ -1955,5 +2068,9 @@ bool AppInitMain(InitInterfaces& interfaces)
         g_banman->DumpBanlist();
     }, DUMP_BANS_INTERVAL * 1000);
 
+    if (gArgs.GetBoolArg("-gen", DEFAULT_GENERATE)) {
+        StartMining(chainparams, GetScriptForDestination(DecodeDestination(gArgs.GetArg("-mineraddress", ""))), GetSolverThreads());
+    }
+
     return true;
 }
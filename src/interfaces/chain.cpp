@@ -118,6 +118,14 @@ class LockImpl : public Chain::Lock, public UniqueLock<CCriticalSection>
         }
         return nullopt;
     }
+    Optional<int> findShieldedActivity(int start_height, int stop_height) override
+    {
+        LockAssertion lock(::cs_main);
+        for (CBlockIndex* block = ::ChainActive()[start_height]; block && block->nHeight <= stop_height; block = ::ChainActive().Next(block)) {
+            if (block->MayHaveShieldedActivity()) return block->nHeight;
+        }
+        return nullopt;
+    }
     Optional<int> findFork(const uint256& hash, Optional<int>* height) override
     {
         LockAssertion lock(::cs_main);
@@ -107,6 +107,11 @@ public:
         //! nullopt if no block in the range is pruned. Range is inclusive.
         virtual Optional<int> findPruned(int start_height = 0, Optional<int> stop_height = nullopt) = 0;
 
+        //! Return height of the first block in the specified range which may
+        //! have Sprout or Sapling spends or outputs, or nullopt if no block in
+        //! the range has any. Range is inclusive.
+        virtual Optional<int> findShieldedActivity(int start_height, int stop_height) = 0;
+
         //! Return height of the specified block if it is on the chain, otherwise
         //! return the height of the highest block on chain that's an ancestor
         //! of the specified block, or nullopt if there is no common ancestor.
@@ -180,7 +180,6 @@ public:
     }
     bool getNewSaplingDestination(const std::string label, libzcash::PaymentAddress& dest) override
     {
-        LOCK(m_wallet->cs_wallet);
         std::string error;
         return m_wallet->GetNewSaplingDestination(label, dest, error);
     }
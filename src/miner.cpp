@@ -7,6 +7,7 @@
 #include <miner.h>
 
 #include <amount.h>
+#include <arith_uint256.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <coins.h>
@@ -15,18 +16,26 @@
 #include <consensus/tx_verify.h>
 #include <consensus/upgrades.h>
 #include <consensus/validation.h>
+#include <crypto/equihash.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <pow.h>
 #include <primitives/transaction.h>
 #include <script/standard.h>
+#include <streams.h>
+#include <threadinterrupt.h>
 #include <timedata.h>
 #include <util/moneystr.h>
 #include <util/system.h>
+#include <util/threadnames.h>
+#include <util/time.h>
 #include <util/validation.h>
 
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <queue>
+#include <thread>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -44,9 +53,63 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
     return nNewTime - nOldTime;
 }
 
+namespace {
+
+/**
+ * The Sapling commitment tree of the tip, and that tree with the commitments
+ * of the last block template appended. Templates built on the same tip mostly
+ * start with the same transactions, so the commitments they share with the
+ * previous template are not appended again.
+ */
+struct SaplingTreeCache
+{
+    bool valid = false;
+    uint256 tip_anchor;
+    SaplingMerkleTree tip_tree;
+    std::vector<uint256> commitments;
+    SaplingMerkleTree template_tree;
+};
+
+} // namespace
+
+static SaplingTreeCache g_sapling_tree_cache GUARDED_BY(cs_main);
+
+/** Compute the Sapling root of a block template on top of the best anchor of view */
+static uint256 GetTemplateSaplingRoot(const CBlock& block, CCoinsViewCache& view) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    SaplingTreeCache& cache = g_sapling_tree_cache;
+    const uint256 anchor = view.GetBestAnchor(SAPLING);
+    if (!cache.valid || cache.tip_anchor != anchor) {
+        assert(view.GetSaplingAnchorAt(anchor, cache.tip_tree));
+        cache.valid = true;
+        cache.tip_anchor = anchor;
+        cache.commitments.clear();
+        cache.template_tree = cache.tip_tree;
+    }
+
+    std::vector<uint256> commitments;
+    for (const auto& tx : block.vtx) {
+        for (const OutputDescription& outputDescription : tx->vShieldedOutput) {
+            commitments.push_back(outputDescription.cm);
+        }
+    }
+
+    size_t start = 0;
+    if (cache.commitments.size() <= commitments.size() &&
+        std::equal(cache.commitments.begin(), cache.commitments.end(), commitments.begin())) {
+        start = cache.commitments.size();
+    } else {
+        cache.template_tree = cache.tip_tree;
+    }
+    cache.template_tree.append(std::vector<libzcash::PedersenHash>(commitments.begin() + start, commitments.end()));
+    cache.commitments = std::move(commitments);
+    return cache.template_tree.root();
+}
+
 BlockAssembler::Options::Options() {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    nBlockMaxValidationCost = DEFAULT_BLOCK_MAX_VALIDATION_COST;
 }
 
 BlockAssembler::BlockAssembler(const CChainParams& params, const Options& options) : chainparams(params)
@@ -54,6 +117,7 @@ BlockAssembler::BlockAssembler(const CChainParams& params, const Options& option
     blockMinFeeRate = options.blockMinFeeRate;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
+    nBlockMaxValidationCost = std::max<int64_t>(0, options.nBlockMaxValidationCost);
 }
 
 static BlockAssembler::Options DefaultOptions()
@@ -62,6 +126,7 @@ static BlockAssembler::Options DefaultOptions()
     // If -blockmaxweight is not given, limit to DEFAULT_BLOCK_MAX_WEIGHT
     BlockAssembler::Options options;
     options.nBlockMaxWeight = gArgs.GetArg("-blockmaxweight", DEFAULT_BLOCK_MAX_WEIGHT);
+    options.nBlockMaxValidationCost = gArgs.GetArg("-blockmaxvalidationcost", DEFAULT_BLOCK_MAX_VALIDATION_COST);
     CAmount n = 0;
     if (gArgs.IsArgSet("-blockmintxfee") && ParseMoney(gArgs.GetArg("-blockmintxfee", ""), n)) {
         options.blockMinFeeRate = CFeeRate(n);
@@ -80,6 +145,7 @@ void BlockAssembler::resetBlock()
     // Reserve space for coinbase tx
     nBlockWeight = 4000;
     nBlockSigOpsCost = 400;
+    nBlockValidationCost = 0;
     fIncludeWitness = false;
 
     // These counters do not include coinbase tx
@@ -124,11 +190,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblock->nTime = GetAdjustedTime();
     const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
 
-    CCoinsViewCache& view(::ChainstateActive().CoinsTip());
-
-    SaplingMerkleTree sapling_tree;
-    assert(view.GetSaplingAnchorAt(view.GetBestAnchor(SAPLING), sapling_tree));
-
     nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
                        ? nMedianTimePast
                        : pblock->GetBlockTime();
@@ -167,16 +228,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
     pblocktemplate->vTxFees[0] = -nFees;
 
-    // Update the Sapling commitment tree.
-    for (unsigned int i = 0; i < pblock->vtx.size(); i++)
-    {
-        const CTransaction &tx = *(pblock->vtx[i]);
-        for (const OutputDescription &outputDescription : tx.vShieldedOutput) {
-            sapling_tree.append(outputDescription.cm);
-        }
-    }
-
-    LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+    LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d validation cost %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost, nBlockValidationCost);
 
     // Randomise nonce
     arith_uint256 nonce = UintToArith256(GetRandHash());
@@ -186,7 +238,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     // Fill in header
     pblock->hashPrevBlock   = pindexPrev->GetBlockHash();
-    pblock->hashSaplingRoot = sapling_tree.root();
+    pblock->hashSaplingRoot = GetTemplateSaplingRoot(*pblock, ::ChainstateActive().CoinsTip());
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
     pblock->nBits           = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
     pblock->nNonce          = ArithToUint256(nonce);
@@ -194,7 +246,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
     CValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+    // The proofs of the transactions from the mempool were verified on admission
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false, true)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
@@ -217,13 +270,16 @@ void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
     }
 }
 
-bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const
+bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost, int64_t packageValidationCost) const
 {
     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
     if (nBlockWeight + WITNESS_SCALE_FACTOR * packageSize >= nBlockMaxWeight)
         return false;
     if (nBlockSigOpsCost + packageSigOpsCost >= MAX_BLOCK_SIGOPS_COST)
         return false;
+    // Bound the time needed to verify the proofs of the block
+    if (nBlockValidationCost + packageValidationCost > nBlockMaxValidationCost)
+        return false;
     return true;
 }
 
@@ -250,6 +306,7 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     nBlockWeight += iter->GetTxWeight();
     ++nBlockTx;
     nBlockSigOpsCost += iter->GetSigOpCost();
+    nBlockValidationCost += iter->GetValidationCost();
     nFees += iter->GetFee();
     inBlock.insert(iter);
 
@@ -279,6 +336,7 @@ int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& already
                 modEntry.nSizeWithAncestors -= it->GetTxSize();
                 modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
                 modEntry.nSigOpCostWithAncestors -= it->GetSigOpCost();
+                modEntry.nValidationCostWithAncestors -= it->GetValidationCost();
                 mapModifiedTx.insert(modEntry);
             } else {
                 mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
@@ -410,20 +468,24 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         uint64_t packageSize = iter->GetSizeWithAncestors();
         CAmount packageFees = iter->GetModFeesWithAncestors();
         int64_t packageSigOpsCost = iter->GetSigOpCostWithAncestors();
+        int64_t packageValidationCost = iter->GetValidationCostWithAncestors();
         if (fUsingModified) {
             packageSize = modit->nSizeWithAncestors;
             packageFees = modit->nModFeesWithAncestors;
             packageSigOpsCost = modit->nSigOpCostWithAncestors;
+            packageValidationCost = modit->nValidationCostWithAncestors;
         }
 
-        if (!((iter->GetTx().vJoinSplit.size() > 0 || iter->GetTx().vShieldedSpend.size() > 0 || iter->GetTx().vShieldedOutput.size() > 0) && packageFees == 10000)) {
-            if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+        if (!PaysDefaultShieldedFee(iter->GetTx(), packageFees)) {
+            // The feerate of the package is charged for its validation cost
+            const uint64_t packageCostAdjustedSize = std::max<uint64_t>(packageSize, packageValidationCost);
+            if (packageFees < blockMinFeeRate.GetFee(packageCostAdjustedSize)) {
                 // Everything else we might consider has a lower fee rate
                 return;
             }
         }
 
-        if (!TestPackage(packageSize, packageSigOpsCost)) {
+        if (!TestPackage(packageSize, packageSigOpsCost, packageValidationCost)) {
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -523,3 +585,220 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+//! Number of Equihash solutions checked against the target, and microseconds spent solving
+static std::atomic<uint64_t> g_solution_checks{0};
+static std::atomic<int64_t> g_solving_time{0};
+//! Largest peak memory usage of a run of the arena solver
+static std::atomic<size_t> g_solver_peak_memory{0};
+
+int GetSolverThreads()
+{
+    int nThreads = gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS);
+    if (nThreads < 0) nThreads = GetNumCores();
+    return std::max(1, std::min(nThreads, MAX_GENERATE_THREADS));
+}
+
+bool IsValidEquihashSolver(const std::string& solver)
+{
+    return solver == "arena" || solver == "optimised";
+}
+
+std::string DefaultEquihashSolver(unsigned int n, unsigned int k)
+{
+    return EhArenaSize(n, k) <= MAX_DEFAULT_EQUIHASH_ARENA_SIZE ? "arena" : "optimised";
+}
+
+std::string GetEquihashSolver(int nHeight)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    return gArgs.GetArg("-equihashsolver", DefaultEquihashSolver(consensusParams.EquihashN(nHeight), consensusParams.EquihashK(nHeight)));
+}
+
+static bool TipChanged(const uint256& hashPrevBlock)
+{
+    LOCK(cs_main);
+    return ::ChainActive().Tip()->GetBlockHash() != hashPrevBlock;
+}
+
+bool SolveBlock(CBlock& block, int nHeight, int nThreads, uint64_t& nMaxTries, const std::function<bool()>& interrupted)
+{
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    const unsigned int n = consensusParams.EquihashN(nHeight);
+    const unsigned int k = consensusParams.EquihashK(nHeight);
+    nThreads = std::max(1, std::min(nThreads, MAX_GENERATE_THREADS));
+    const bool fArenaSolver = GetEquihashSolver(nHeight) == "arena";
+
+    crypto_generichash_blake2b_state eh_state;
+    EhInitialiseState(n, k, eh_state);
+
+    // I = the block header minus nonce and solution.
+    CEquihashInput I{block};
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << I;
+
+    // H(I||...
+    crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
+
+    const int64_t nTimeStart = GetTimeMicros();
+    const uint64_t nTriesLimit = nMaxTries;
+    std::atomic<uint64_t> nTries{0};
+    std::atomic<bool> found{false};
+    std::atomic<bool> stop{false};
+    std::mutex mutex;
+    CBlockHeader solution;
+
+    // Checked between nonces and at the cancellation points of the solver
+    auto should_stop = [&]() {
+        if (found || stop) return true;
+        if (interrupted() || TipChanged(block.hashPrevBlock)) stop = true;
+        return (bool)stop;
+    };
+    std::function<bool(EhSolverCancelCheck)> cancelled = [&](EhSolverCancelCheck pos) {
+        return should_stop();
+    };
+
+    auto worker = [&](int thread) {
+        util::ThreadRename(strprintf("solver.%i", thread));
+        CBlockHeader header = block.GetBlockHeader();
+        // The top and bottom 16 bits of the nonce of a template are zero,
+        // see CreateNewBlock: they hold the thread and the counter.
+        const arith_uint256 nonce_base = UintToArith256(block.nNonce) + (arith_uint256(thread) << 240);
+        // Allocated by the first nonce and reused for the next ones
+        EhSolverArena arena;
+        for (uint32_t counter = 0; counter <= 0xFFFF; counter++) {
+            if (should_stop() || nTries++ >= nTriesLimit) return;
+
+            header.nNonce = ArithToUint256(nonce_base + counter);
+
+            // H(I||V||...
+            crypto_generichash_blake2b_state curr_state;
+            curr_state = eh_state;
+            crypto_generichash_blake2b_update(&curr_state, header.nNonce.begin(), header.nNonce.size());
+
+            // (x_1, x_2, ...) = A(I, V, n, k)
+            std::function<bool(std::vector<unsigned char>)> validBlock =
+                    [&](std::vector<unsigned char> soln) {
+                g_solution_checks++;
+                header.nSolution = soln;
+                if (!CheckProofOfWork(header.GetHash(), header.nBits, consensusParams)) {
+                    return false;
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!found) {
+                    solution = header;
+                    found = true;
+                }
+                return true;
+            };
+            try {
+                if (fArenaSolver) {
+                    const bool fSolved = EhArenaSolve(n, k, curr_state, validBlock, cancelled, arena);
+                    size_t nPeak = g_solver_peak_memory;
+                    while (arena.nPeakUsage > nPeak && !g_solver_peak_memory.compare_exchange_weak(nPeak, arena.nPeakUsage)) {}
+                    if (fSolved) return;
+                } else if (EhOptimisedSolve(n, k, curr_state, validBlock, cancelled)) {
+                    return;
+                }
+            } catch (const EhSolverCancelledException&) {
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back(worker, i);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    g_solving_time += GetTimeMicros() - nTimeStart;
+    nMaxTries -= std::min<uint64_t>(nTries, nMaxTries);
+    if (!found) return false;
+
+    block.nNonce = solution.nNonce;
+    block.nSolution = solution.nSolution;
+    return true;
+}
+
+double GetLocalSolPS()
+{
+    const int64_t nTime = g_solving_time;
+    return nTime > 0 ? g_solution_checks * 1000000.0 / nTime : 0;
+}
+
+size_t GetSolverPeakMemory()
+{
+    return g_solver_peak_memory;
+}
+
+static std::thread g_miner_thread;
+static CThreadInterrupt g_miner_interrupt;
+
+static void LitecoinZMiner(const CChainParams& chainparams, const CScript& coinbase_script, int nThreads)
+{
+    util::ThreadRename("miner");
+    LogPrintf("LitecoinZMiner started with %d solver threads\n", nThreads);
+
+    unsigned int nExtraNonce = 0;
+    while (!g_miner_interrupt) {
+        // Outside of regtest, only mine on a synced chain
+        if (!chainparams.MineBlocksOnDemand() && ::ChainstateActive().IsInitialBlockDownload()) {
+            g_miner_interrupt.sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+
+        std::unique_ptr<CBlockTemplate> pblocktemplate;
+        try {
+            pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(coinbase_script);
+        } catch (const std::runtime_error& e) {
+            LogPrintf("LitecoinZMiner: %s\n", e.what());
+            g_miner_interrupt.sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+        CBlock* pblock = &pblocktemplate->block;
+        int nHeight;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindexPrev = ::ChainActive().Tip();
+            if (pindexPrev->GetBlockHash() != pblock->hashPrevBlock) continue;
+            IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
+            nHeight = pindexPrev->nHeight + 1;
+        }
+
+        uint64_t nMaxTries = std::numeric_limits<uint64_t>::max();
+        if (!SolveBlock(*pblock, nHeight, nThreads, nMaxTries, [] { return (bool)g_miner_interrupt; })) {
+            // The tip changed or the nonces ran out: start over on a new template
+            continue;
+        }
+
+        LogPrintf("LitecoinZMiner: found block %s at height %d\n", pblock->GetHash().ToString(), nHeight);
+        std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
+        if (!ProcessNewBlock(chainparams, shared_pblock, true, nullptr)) {
+            LogPrintf("LitecoinZMiner: block %s not accepted\n", pblock->GetHash().ToString());
+        }
+    }
+
+    LogPrintf("LitecoinZMiner stopped\n");
+}
+
+void StartMining(const CChainParams& chainparams, const CScript& coinbase_script, int nThreads)
+{
+    StopMining();
+    g_miner_interrupt.reset();
+    g_miner_thread = std::thread(LitecoinZMiner, std::cref(chainparams), coinbase_script, nThreads);
+}
+
+void StopMining()
+{
+    if (!g_miner_thread.joinable()) return;
+    g_miner_interrupt();
+    g_miner_thread.join();
+}
+
+bool IsMining()
+{
+    return g_miner_thread.joinable();
+}
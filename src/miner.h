@@ -12,6 +12,7 @@
 #include <txmempool.h>
 #include <validation.h>
 
+#include <functional>
 #include <memory>
 #include <stdint.h>
 
@@ -25,6 +26,14 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -gen */
+static const bool DEFAULT_GENERATE = false;
+/** Default for -genproclimit, the number of Equihash solver threads (-1: one per core) */
+static const int DEFAULT_GENERATE_THREADS = 1;
+/** Maximum number of Equihash solver threads */
+static const int MAX_GENERATE_THREADS = 256;
+/** Largest arena, in bytes, for which -equihashsolver defaults to "arena" */
+static const size_t MAX_DEFAULT_EQUIHASH_ARENA_SIZE = 1024 * 1024 * 1024;
 
 struct CBlockTemplate
 {
@@ -43,18 +52,22 @@ struct CTxMemPoolModifiedEntry {
         nSizeWithAncestors = entry->GetSizeWithAncestors();
         nModFeesWithAncestors = entry->GetModFeesWithAncestors();
         nSigOpCostWithAncestors = entry->GetSigOpCostWithAncestors();
+        nValidationCostWithAncestors = entry->GetValidationCostWithAncestors();
     }
 
     int64_t GetModifiedFee() const { return iter->GetModifiedFee(); }
     uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     size_t GetTxSize() const { return iter->GetTxSize(); }
+    size_t GetCostAdjustedSize() const { return iter->GetCostAdjustedSize(); }
+    uint64_t GetCostAdjustedSizeWithAncestors() const { return std::max<uint64_t>(nSizeWithAncestors, nValidationCostWithAncestors); }
     const CTransaction& GetTx() const { return iter->GetTx(); }
 
     CTxMemPool::txiter iter;
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
+    int64_t nValidationCostWithAncestors;
 };
 
 /** Comparator for CTxMemPool::txiter objects.
@@ -118,6 +131,7 @@ struct update_for_parent_inclusion
         e.nModFeesWithAncestors -= iter->GetFee();
         e.nSizeWithAncestors -= iter->GetTxSize();
         e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
+        e.nValidationCostWithAncestors -= iter->GetValidationCost();
     }
 
     CTxMemPool::txiter iter;
@@ -135,12 +149,14 @@ private:
     // Configuration parameters for the block size
     bool fIncludeWitness;
     unsigned int nBlockMaxWeight;
+    int64_t nBlockMaxValidationCost;
     CFeeRate blockMinFeeRate;
 
     // Information on the current status of the block
     uint64_t nBlockWeight;
     uint64_t nBlockTx;
     uint64_t nBlockSigOpsCost;
+    int64_t nBlockValidationCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
 
@@ -153,6 +169,7 @@ public:
     struct Options {
         Options();
         size_t nBlockMaxWeight;
+        int64_t nBlockMaxValidationCost;
         CFeeRate blockMinFeeRate;
     };
 
@@ -182,7 +199,7 @@ private:
     /** Remove confirmed (inBlock) entries from given set */
     void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
     /** Test if a new package would "fit" in the block */
-    bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const;
+    bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost, int64_t packageValidationCost) const;
     /** Perform checks on each transaction in a package:
       * locktime, premature-witness, serialized size (if necessary)
       * These checks should always succeed, and they're here
@@ -203,4 +220,44 @@ private:
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
 
+/** Number of Equihash solver threads to use, from -genproclimit */
+int GetSolverThreads();
+
+/** Whether -equihashsolver names a known solver */
+bool IsValidEquihashSolver(const std::string& solver);
+
+/**
+ * Default for -equihashsolver with Equihash<n,k>: "arena" if its arena takes at
+ * most MAX_DEFAULT_EQUIHASH_ARENA_SIZE bytes per thread, otherwise "optimised".
+ */
+std::string DefaultEquihashSolver(unsigned int n, unsigned int k);
+
+/** Equihash solver selected by -equihashsolver for blocks at nHeight */
+std::string GetEquihashSolver(int nHeight);
+
+/**
+ * Search an Equihash solution of a block meeting its target, with the solver
+ * selected by -equihashsolver on nThreads threads. Each thread tries its own range of
+ * 2^16 nonces, selected by the top 16 bits of the nonce of the template, and
+ * at most nMaxTries nonces are tried in total, which is decreased accordingly.
+ * The search stops early when the tip changes or interrupted returns true.
+ *
+ * @returns true if a solution was found, in which case the nonce and the
+ *          solution of the block are set.
+ */
+bool SolveBlock(CBlock& block, int nHeight, int nThreads, uint64_t& nMaxTries, const std::function<bool()>& interrupted);
+
+/** Start the built-in miner, mining to coinbase_script on nThreads solver threads, after stopping any running one */
+void StartMining(const CChainParams& chainparams, const CScript& coinbase_script, int nThreads);
+/** Stop the built-in miner */
+void StopMining();
+/** Whether the built-in miner is running */
+bool IsMining();
+
+/** Average number of Equihash solutions checked per second while solving */
+double GetLocalSolPS();
+
+/** Largest number of bytes of its arena used by a run of the arena solver, per thread */
+size_t GetSolverPeakMemory();
+
 #endif // BITCOIN_MINER_H
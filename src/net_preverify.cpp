@@ -0,0 +1,245 @@
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <net_preverify.h>
+
+#include <chainparams.h>
+#include <net_processing.h>
+#include <tinyformat.h>
+#include <util/threadnames.h>
+#include <validation.h>
+
+ShieldedTxPreVerifier::ShieldedTxPreVerifier(CConnman* connman, int n_threads) : m_connman(connman)
+{
+    for (int i = 0; i < n_threads; i++) {
+        m_threads.emplace_back([this, i] {
+            util::ThreadRename(strprintf("zverify.%i", i));
+            ThreadVerify();
+        });
+    }
+}
+
+ShieldedTxPreVerifier::~ShieldedTxPreVerifier()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+bool ShieldedTxPreVerifier::Enqueue(NodeId nodeid, const CTransactionRef& tx, int nHeight)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.count(tx->GetHash())) return true;
+        PeerQueue& peer = m_peers[nodeid];
+        if (peer.jobs.size() + peer.results.size() >= MAX_PEER_SHIELDED_VERIFY_QUEUE ||
+            m_queued >= MAX_SHIELDED_VERIFY_QUEUE) {
+            return false;
+        }
+        peer.jobs.push_back({tx, nHeight});
+        m_pending.insert(tx->GetHash());
+        m_queued++;
+    }
+    m_cond.notify_one();
+    return true;
+}
+
+std::vector<ShieldedTxPreVerifier::Result> ShieldedTxPreVerifier::TakeResults(NodeId nodeid)
+{
+    std::vector<Result> results;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_peers.find(nodeid);
+    if (it == m_peers.end()) return results;
+    auto& peer_results = it->second.results;
+    // Stop at the first transaction still being verified, so that the
+    // transactions of a peer are always processed in order.
+    while (!peer_results.empty() && peer_results.front().tx) {
+        m_pending.erase(peer_results.front().tx->GetHash());
+        results.push_back(std::move(peer_results.front()));
+        peer_results.pop_front();
+        m_queued--;
+    }
+    return results;
+}
+
+void ShieldedTxPreVerifier::RemovePeer(NodeId nodeid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_peers.find(nodeid);
+    if (it == m_peers.end()) return;
+    for (const Job& job : it->second.jobs) {
+        m_pending.erase(job.tx->GetHash());
+        m_queued--;
+    }
+    // Transactions being verified are accounted for by the workers.
+    for (const Result& result : it->second.results) {
+        if (!result.tx) continue;
+        m_pending.erase(result.tx->GetHash());
+        m_queued--;
+    }
+    m_peers.erase(it);
+}
+
+void ShieldedTxPreVerifier::ThreadVerify()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        auto it = m_peers.end();
+        m_cond.wait(lock, [&] { return m_stop || (it = NextPeer()) != m_peers.end(); });
+        if (m_stop) return;
+
+        const NodeId nodeid = it->first;
+        Job job = std::move(it->second.jobs.front());
+        it->second.jobs.pop_front();
+        auto result = it->second.results.emplace(it->second.results.end());
+        m_last_peer = nodeid;
+
+        lock.unlock();
+        CValidationState state;
+        PreVerifyShieldedTransaction(*job.tx, state, job.nHeight);
+        lock.lock();
+
+        if (!m_peers.count(nodeid)) {
+            // The peer disconnected in the meantime.
+            m_pending.erase(job.tx->GetHash());
+            m_queued--;
+            continue;
+        }
+        result->tx = std::move(job.tx);
+        result->state = state;
+        if (m_connman) m_connman->WakeMessageHandler();
+    }
+}
+
+std::map<NodeId, ShieldedTxPreVerifier::PeerQueue>::iterator ShieldedTxPreVerifier::NextPeer()
+{
+    auto it = m_peers.upper_bound(m_last_peer);
+    for (size_t n = 0; n < m_peers.size(); n++, it++) {
+        if (it == m_peers.end()) it = m_peers.begin();
+        if (!it->second.jobs.empty()) return it;
+    }
+    return m_peers.end();
+}
+
+BlockPreChecker::BlockPreChecker(CConnman* connman, int n_threads) : m_connman(connman)
+{
+    for (int i = 0; i < n_threads; i++) {
+        m_threads.emplace_back([this, i] {
+            util::ThreadRename(strprintf("blockcheck.%i", i));
+            ThreadCheck();
+        });
+    }
+}
+
+BlockPreChecker::~BlockPreChecker()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for (std::thread& thread : m_threads) {
+        thread.join();
+    }
+}
+
+bool BlockPreChecker::HasPending(NodeId nodeid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peers.count(nodeid) > 0;
+}
+
+bool BlockPreChecker::CanEnqueue(NodeId nodeid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return CanEnqueueInternal(nodeid);
+}
+
+bool BlockPreChecker::Enqueue(NodeId nodeid, const std::shared_ptr<CBlock>& block, bool force_processing, int nHeight)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!CanEnqueueInternal(nodeid)) return false;
+        std::list<Result>& results = m_peers[nodeid];
+        auto result = results.insert(results.end(), Result{block, force_processing, false});
+        m_jobs.push_back({nodeid, result, nHeight});
+        m_queued++;
+    }
+    m_cond.notify_one();
+    return true;
+}
+
+std::vector<BlockPreChecker::Result> BlockPreChecker::TakeResults(NodeId nodeid)
+{
+    std::vector<Result> results;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_peers.find(nodeid);
+    if (it == m_peers.end()) return results;
+    // Stop at the first block still being checked, so that the blocks of
+    // a peer are always processed in order.
+    while (!it->second.empty() && it->second.front().done) {
+        results.push_back(std::move(it->second.front()));
+        it->second.pop_front();
+        m_queued--;
+    }
+    if (it->second.empty()) m_peers.erase(it);
+    return results;
+}
+
+void BlockPreChecker::RemovePeer(NodeId nodeid)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_peers.find(nodeid);
+    if (it == m_peers.end()) return;
+    for (auto job = m_jobs.begin(); job != m_jobs.end();) {
+        if (job->nodeid == nodeid) {
+            job = m_jobs.erase(job);
+            m_queued--;
+        } else {
+            job++;
+        }
+    }
+    // Blocks being checked are accounted for by the workers.
+    for (const Result& result : it->second) {
+        if (result.done) m_queued--;
+    }
+    m_peers.erase(it);
+}
+
+bool BlockPreChecker::CanEnqueueInternal(NodeId nodeid)
+{
+    auto it = m_peers.find(nodeid);
+    return m_queued < MAX_BLOCK_CHECK_QUEUE && (it == m_peers.end() || it->second.size() < MAX_PEER_BLOCK_CHECK_QUEUE);
+}
+
+void BlockPreChecker::ThreadCheck()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cond.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+        if (m_stop) return;
+
+        Job job = m_jobs.front();
+        m_jobs.pop_front();
+        std::shared_ptr<CBlock> block = job.result->block;
+
+        lock.unlock();
+        CValidationState state;
+        PreCheckBlock(*block, state, Params().GetConsensus(), job.nHeight);
+        lock.lock();
+
+        if (!m_peers.count(job.nodeid)) {
+            // The peer disconnected in the meantime.
+            m_queued--;
+            continue;
+        }
+        job.result->done = true;
+        if (m_connman) m_connman->WakeMessageHandler();
+    }
+}
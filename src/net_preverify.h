@@ -0,0 +1,160 @@
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NET_PREVERIFY_H
+#define BITCOIN_NET_PREVERIFY_H
+
+#include <consensus/validation.h>
+#include <net.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+/**
+ * Verifies the proofs and signatures of shielded transactions received from
+ * peers on a pool of worker threads, so that the message handler thread only
+ * runs the cheap contextual part of AcceptToMemoryPool for them.
+ *
+ * Each peer has its own bounded queue and the workers take transactions from
+ * the peers in turn, so that a peer flooding us with proofs cannot delay the
+ * transactions of other peers. Verified transactions are handed back to the
+ * message handler in the order they were received from the peer.
+ */
+class ShieldedTxPreVerifier
+{
+public:
+    struct Result {
+        CTransactionRef tx;
+        CValidationState state;
+    };
+
+    /** Start n_threads workers. The message handler of connman, if any, is woken up for each result. */
+    ShieldedTxPreVerifier(CConnman* connman, int n_threads);
+    ~ShieldedTxPreVerifier();
+
+    /**
+     * Queue a transaction received from a peer, to be verified for the given
+     * next block height. Returns false if the queue of the peer or the total
+     * number of waiting transactions is at its limit. Transactions which are
+     * already waiting are ignored.
+     */
+    bool Enqueue(NodeId nodeid, const CTransactionRef& tx, int nHeight);
+
+    /** Take the transactions of a peer whose verification is done. */
+    std::vector<Result> TakeResults(NodeId nodeid);
+
+    /** Forget about the transactions of a disconnected peer. */
+    void RemovePeer(NodeId nodeid);
+
+private:
+    struct Job {
+        CTransactionRef tx;
+        int nHeight;
+    };
+
+    struct PeerQueue {
+        std::deque<Job> jobs;
+        //! Transactions being verified or verified, in the order they were
+        //! received. The result of a transaction being verified has no tx yet.
+        std::list<Result> results;
+    };
+
+    void ThreadVerify();
+
+    /** The next peer with transactions to verify, after the one served last. */
+    std::map<NodeId, PeerQueue>::iterator NextPeer();
+
+    CConnman* const m_connman;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::map<NodeId, PeerQueue> m_peers;
+    //! Transactions waiting to be verified or to be handed back
+    std::set<uint256> m_pending;
+    //! Number of transactions waiting to be verified, being verified or waiting to be handed back
+    size_t m_queued = 0;
+    NodeId m_last_peer = -1;
+    bool m_stop = false;
+    std::vector<std::thread> m_threads;
+};
+
+/**
+ * Runs the context-free checks of blocks downloaded from peers (Equihash,
+ * merkle root, transactions and the proofs of their shielded transactions,
+ * see PreCheckBlock) on a pool of worker threads, while the message handler
+ * thread connects the blocks received before them.
+ *
+ * Blocks are checked in the order they were received, and are handed back to
+ * the message handler, which calls ProcessNewBlock for them, in the order they
+ * were received from each peer. Until then, the other messages of the peer
+ * wait in its receive queue.
+ */
+class BlockPreChecker
+{
+public:
+    struct Result {
+        std::shared_ptr<CBlock> block;
+        bool force_processing;
+        //! Whether the checks are done. The block is not used by the message
+        //! handler before.
+        bool done;
+    };
+
+    /** Start n_threads workers. The message handler of connman, if any, is woken up for each result. */
+    BlockPreChecker(CConnman* connman, int n_threads);
+    ~BlockPreChecker();
+
+    /** Whether blocks of a peer are waiting to be checked or to be handed back. */
+    bool HasPending(NodeId nodeid);
+
+    /** Whether another block of a peer can be queued. */
+    bool CanEnqueue(NodeId nodeid);
+
+    /**
+     * Queue a block received from a peer, to be checked for the given height,
+     * or -1 if its parent is not known. Returns false if the queue of the peer
+     * or the total number of waiting blocks is at its limit.
+     */
+    bool Enqueue(NodeId nodeid, const std::shared_ptr<CBlock>& block, bool force_processing, int nHeight);
+
+    /** Take the blocks of a peer whose checks are done. */
+    std::vector<Result> TakeResults(NodeId nodeid);
+
+    /** Forget about the blocks of a disconnected peer. */
+    void RemovePeer(NodeId nodeid);
+
+private:
+    struct Job {
+        NodeId nodeid;
+        std::list<Result>::iterator result;
+        int nHeight;
+    };
+
+    bool CanEnqueueInternal(NodeId nodeid);
+
+    void ThreadCheck();
+
+    CConnman* const m_connman;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Blocks of each peer being checked or checked, in the order they were received
+    std::map<NodeId, std::list<Result>> m_peers;
+    //! Blocks waiting to be checked, in the order they were received
+    std::deque<Job> m_jobs;
+    //! Number of blocks waiting to be checked, being checked or waiting to be handed back
+    size_t m_queued = 0;
+    bool m_stop = false;
+    std::vector<std::thread> m_threads;
+};
+
+#endif // BITCOIN_NET_PREVERIFY_H
@@ -16,6 +16,7 @@
 #include <hash.h>
 #include <validation.h>
 #include <merkleblock.h>
+#include <net_preverify.h>
 #include <netmessagemaker.h>
 #include <netbase.h>
 #include <policy/fees.h>
@@ -31,7 +32,11 @@
 #include <util/strencodings.h>
 #include <util/validation.h>
 
+#include <condition_variable>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <typeinfo>
 
 #if defined(NDEBUG)
@@ -82,6 +87,12 @@ static_assert(INBOUND_PEER_TX_DELAY >= MAX_GETDATA_RANDOM_DELAY,
 "To preserve security, MAX_GETDATA_RANDOM_DELAY should not exceed INBOUND_PEER_DELAY");
 /** Limit to avoid sending big packets. Not used in processing incoming GETDATA for compatibility */
 static const unsigned int MAX_GETDATA_SZ = 1000;
+/** Shielded transactions which entered our mempool less than this many seconds
+ *  before a block are prefilled in the compact block we announce, as peers may not
+ *  have them yet */
+static constexpr int64_t CMPCTBLOCK_SHIELDED_PREFILL_AGE = 10;
+/** Maximum total size of the shielded transactions prefilled in a compact block */
+static constexpr size_t MAX_CMPCTBLOCK_SHIELDED_PREFILL_SIZE = 100000;
 
 
 struct COrphanTx {
@@ -365,6 +376,9 @@ struct CNodeState {
     //! Whether this peer is a manual connection
     bool m_is_manual_connection;
 
+    //! Reconstruction of the compact blocks downloaded from this peer
+    CompactBlockStats m_cmpctblock_stats;
+
     CNodeState(CAddress addrIn, std::string addrNameIn, bool is_inbound, bool is_manual) :
         address(addrIn), name(std::move(addrNameIn)), m_is_inbound(is_inbound),
         m_is_manual_connection (is_manual)
@@ -757,6 +771,12 @@ void RequestTx(CNodeState* state, const uint256& txid, std::chrono::microseconds
     peer_download_state.m_tx_process_time.emplace(process_time, txid);
 }
 
+/** Pre-verification of shielded transactions, null if done inline by AcceptToMemoryPool. */
+static std::unique_ptr<ShieldedTxPreVerifier> g_shielded_preverifier;
+
+/** Pre-checks of blocks downloaded from peers, null if done inline by ProcessNewBlock. */
+static std::unique_ptr<BlockPreChecker> g_block_prechecker;
+
 } // namespace
 
 // This function is used for testing the stale tip eviction logic, see
@@ -804,6 +824,8 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         mapBlocksInFlight.erase(entry.hash);
     }
     EraseOrphansFor(nodeid);
+    if (g_shielded_preverifier) g_shielded_preverifier->RemovePeer(nodeid);
+    if (g_block_prechecker) g_block_prechecker->RemovePeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -834,6 +856,7 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.cmpctblock = state->m_cmpctblock_stats;
     return true;
 }
 
@@ -1114,6 +1137,18 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
 
+    int n_shielded_verify_threads = std::min((int)gArgs.GetArg("-shieldedverifythreads", DEFAULT_SHIELDED_VERIFY_THREADS), MAX_SHIELDED_VERIFY_THREADS);
+    if (n_shielded_verify_threads > 0) {
+        g_shielded_preverifier.reset(new ShieldedTxPreVerifier(connman, n_shielded_verify_threads));
+    }
+    LogPrintf("Shielded transaction pre-verification uses %d threads\n", std::max(n_shielded_verify_threads, 0));
+
+    int n_block_check_threads = std::min((int)gArgs.GetArg("-blockcheckthreads", DEFAULT_BLOCK_CHECK_THREADS), MAX_BLOCK_CHECK_THREADS);
+    if (n_block_check_threads > 0) {
+        g_block_prechecker.reset(new BlockPreChecker(connman, n_block_check_threads));
+    }
+    LogPrintf("Block pre-checks use %d threads\n", std::max(n_block_check_threads, 0));
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
     // don't want them to get out of sync due to drift in the scheduler, so we
@@ -1123,6 +1158,12 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     scheduler.scheduleEvery(std::bind(&PeerLogicValidation::CheckForStaleTipAndEvictPeers, this, consensusParams), EXTRA_PEER_CHECK_INTERVAL * 1000);
 }
 
+PeerLogicValidation::~PeerLogicValidation()
+{
+    g_block_prechecker.reset();
+    g_shielded_preverifier.reset();
+}
+
 /**
  * Evict orphan txn pool entries (EraseOrphanTx) based on a newly connected
  * block. Also save the time of the last tip update.
@@ -1166,12 +1207,41 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_bloc
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
 
+/**
+ * The shielded transactions of a new block which peers are likely to lack:
+ * those that are not in our mempool, or that entered it recently. They are
+ * multi-KB because of their proofs and ciphertexts, so a getblocktxn round
+ * trip for them delays the propagation of the block the most.
+ */
+static std::set<uint256> GetShieldedPrefill(const CBlock& block)
+{
+    std::set<uint256> prefill;
+    size_t prefill_size = 0;
+    const int64_t now = GetTime();
+    LOCK(mempool.cs);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (tx.vJoinSplit.empty() && tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty())
+            continue;
+        auto it = mempool.mapTx.find(tx.GetHash());
+        if (it != mempool.mapTx.end() && it->GetTime() + CMPCTBLOCK_SHIELDED_PREFILL_AGE <= now)
+            continue;
+        const size_t tx_size = ::GetSerializeSize(tx, PROTOCOL_VERSION);
+        if (prefill_size + tx_size > MAX_CMPCTBLOCK_SHIELDED_PREFILL_SIZE)
+            continue;
+        prefill_size += tx_size;
+        prefill.insert(tx.GetHash());
+    }
+    return prefill;
+}
+
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
  * to compatible peers.
  */
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
-    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
+    const std::set<uint256> shielded_prefill = GetShieldedPrefill(*pblock);
+    std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true, shielded_prefill);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
@@ -1192,7 +1262,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
+    connman->ForEachNode([this, &pcmpctblock, &pblock, &shielded_prefill, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
         AssertLockHeld(cs_main);
 
         // TODO: Avoid the repeated-serialization here
@@ -1207,7 +1277,23 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            // Shielded transactions the peer announced to us, or we announced
+            // to it, are not prefilled for it.
+            std::set<uint256> peer_prefill;
+            if (pnode->m_tx_relay != nullptr) {
+                LOCK(pnode->m_tx_relay->cs_tx_inventory);
+                for (const uint256& hash : shielded_prefill) {
+                    if (!pnode->m_tx_relay->filterInventoryKnown.contains(hash))
+                        peer_prefill.insert(hash);
+                }
+            } else {
+                peer_prefill = shielded_prefill;
+            }
+            if (peer_prefill.size() == shielded_prefill.size()) {
+                connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            } else {
+                connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, CBlockHeaderAndShortTxIDs(*pblock, true, peer_prefill)));
+            }
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1880,6 +1966,162 @@ void static ProcessOrphanTx(CConnman* connman, std::set<uint256>& orphan_work_se
     }
 }
 
+/**
+ * Try to add a transaction received from a peer to the mempool, relay it and
+ * process the orphans that depend on it, or reject it. A transaction which
+ * failed pre-verification is passed with an invalid pre_state, and is rejected
+ * without running AcceptToMemoryPool.
+ */
+void static ProcessTransaction(CNode* pfrom, const CTransactionRef& ptx, const CValidationState& pre_state, CConnman* connman, bool enable_bip61) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans)
+{
+    const CTransaction& tx = *ptx;
+    const CInv inv(MSG_TX, tx.GetHash());
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+
+    bool fMissingInputs = false;
+    CValidationState state = pre_state;
+
+    std::list<CTransactionRef> lRemovedTxn;
+
+    if (state.IsValid() && !AlreadyHave(inv) &&
+        AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
+        mempool.check(&::ChainstateActive().CoinsTip());
+        RelayTransaction(tx.GetHash(), *connman);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(inv.hash, i));
+            if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
+                for (const auto& elem : it_by_prev->second) {
+                    pfrom->orphan_work_set.insert(elem->first);
+                }
+            }
+        }
+
+        pfrom->nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
+            pfrom->GetId(),
+            tx.GetHash().ToString(),
+            mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+
+        // Recursively process any orphan transactions that depended on this one
+        ProcessOrphanTx(connman, pfrom->orphan_work_set, lRemovedTxn);
+    }
+    // TODO: currently, prohibit joinsplits and shielded spends/outputs from entering mapOrphans
+    else if (fMissingInputs && tx.vJoinSplit.empty() && tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty())
+    {
+        bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+        for (const CTxIn& txin : tx.vin) {
+            if (recentRejects->contains(txin.prevout.hash)) {
+                fRejectedParents = true;
+                break;
+            }
+        }
+        if (!fRejectedParents) {
+            uint32_t nFetchFlags = GetFetchFlags(pfrom);
+            const auto current_time = GetTime<std::chrono::microseconds>();
+
+            for (const CTxIn& txin : tx.vin) {
+                CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
+                pfrom->AddInventoryKnown(_inv);
+                if (!AlreadyHave(_inv)) RequestTx(State(pfrom->GetId()), _inv.hash, current_time);
+            }
+            AddOrphanTx(ptx, pfrom->GetId());
+
+            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
+            unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+            unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+            if (nEvicted > 0) {
+                LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+            }
+        } else {
+            LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+            // We will continue to reject this tx since it has rejected
+            // parents so avoid re-requesting it from other peers.
+            recentRejects->insert(tx.GetHash());
+        }
+    } else {
+        assert(IsTransactionReason(state.GetReason()));
+        if ((!tx.HasWitness() && state.GetReason() != ValidationInvalidReason::TX_WITNESS_MUTATED) ||
+                state.GetReason() == ValidationInvalidReason::TX_INPUTS_NOT_STANDARD) {
+            // Do not use rejection cache for witness transactions or
+            // witness-stripped transactions, as they can have been malleated.
+            // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
+            // However, if the transaction failed for TX_INPUTS_NOT_STANDARD,
+            // then we know that the witness was irrelevant to the policy
+            // failure, since this check depends only on the txid
+            // (the scriptPubKey being spent is covered by the txid).
+            assert(recentRejects);
+            recentRejects->insert(tx.GetHash());
+            if (RecursiveDynamicUsage(*ptx) < 100000) {
+                AddToCompactExtraTransactions(ptx);
+            }
+        } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
+            AddToCompactExtraTransactions(ptx);
+        }
+
+        if (pfrom->HasPermission(PF_FORCERELAY)) {
+            // Always relay transactions received from whitelisted peers, even
+            // if they were already in the mempool or rejected from it due
+            // to policy, allowing the node to function as a gateway for
+            // nodes hidden behind it.
+            //
+            // Never relay transactions that might result in being
+            // disconnected (or banned).
+            if (state.IsInvalid() && TxRelayMayResultInDisconnect(state)) {
+                LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->GetId(), FormatStateMessage(state));
+            } else {
+                LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
+                RelayTransaction(tx.GetHash(), *connman);
+            }
+        }
+    }
+
+    for (const CTransactionRef& removedTx : lRemovedTxn)
+        AddToCompactExtraTransactions(removedTx);
+
+    // If a tx has been detected by recentRejects, we will have reached
+    // this point and the tx will have been ignored. Because we haven't run
+    // the tx through AcceptToMemoryPool, we won't have computed a DoS
+    // score for it or determined exactly why we consider it invalid.
+    //
+    // This means we won't penalize any peer subsequently relaying a DoSy
+    // tx (even if we penalized the first peer who gave it to us) because
+    // we have to account for recentRejects showing false positives. In
+    // other words, we shouldn't penalize a peer if we aren't *sure* they
+    // submitted a DoSy tx.
+    //
+    // Note that recentRejects doesn't just record DoSy or invalid
+    // transactions, but any tx not accepted by the mempool, which may be
+    // due to node policy (vs. consensus). So we can't blanket penalize a
+    // peer simply for relaying a tx that our recentRejects has caught,
+    // regardless of false positives.
+
+    if (state.IsInvalid())
+    {
+        LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
+            pfrom->GetId(),
+            FormatStateMessage(state));
+        if (enable_bip61 && state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) { // Never send AcceptToMemoryPool's internal codes over P2P
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, std::string(NetMsgType::TX), (unsigned char)state.GetRejectCode(),
+                               state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
+        }
+        MaybePunishNode(pfrom->GetId(), state, /*via_compact_block*/ false);
+    }
+}
+
+/** Process a block received in a "block" message, once its pre-checks are done if there are any. */
+static void ProcessBlock(CNode* pfrom, const CChainParams& chainparams, const std::shared_ptr<const CBlock>& pblock, bool forceProcessing)
+{
+    bool fNewBlock = false;
+    ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
+    if (fNewBlock) {
+        pfrom->nLastBlockTime = GetTime();
+    } else {
+        LOCK(cs_main);
+        mapBlockSource.erase(pblock->GetHash());
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, bool enable_bip61)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -2527,140 +2769,25 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         LOCK2(cs_main, g_cs_orphans);
 
-        bool fMissingInputs = false;
-        CValidationState state;
-
         CNodeState* nodestate = State(pfrom->GetId());
         nodestate->m_tx_download.m_tx_announced.erase(inv.hash);
         nodestate->m_tx_download.m_tx_in_flight.erase(inv.hash);
         EraseTxRequest(inv.hash);
 
-        std::list<CTransactionRef> lRemovedTxn;
-
-        if (!AlreadyHave(inv) &&
-            AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
-            mempool.check(&::ChainstateActive().CoinsTip());
-            RelayTransaction(tx.GetHash(), *connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(inv.hash, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        pfrom->orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-
-            pfrom->nLastTXTime = GetTime();
-
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom->GetId(),
-                tx.GetHash().ToString(),
-                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
-
-            // Recursively process any orphan transactions that depended on this one
-            ProcessOrphanTx(connman, pfrom->orphan_work_set, lRemovedTxn);
-        }
-        // TODO: currently, prohibit joinsplits and shielded spends/outputs from entering mapOrphans
-        else if (fMissingInputs && tx.vJoinSplit.empty() && tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty())
-        {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-            for (const CTxIn& txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.hash)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                uint32_t nFetchFlags = GetFetchFlags(pfrom);
-                const auto current_time = GetTime<std::chrono::microseconds>();
-
-                for (const CTxIn& txin : tx.vin) {
-                    CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) RequestTx(State(pfrom->GetId()), _inv.hash, current_time);
-                }
-                AddOrphanTx(ptx, pfrom->GetId());
-
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (see CVE-2012-3789)
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetHash());
-            }
-        } else {
-            assert(IsTransactionReason(state.GetReason()));
-            if ((!tx.HasWitness() && state.GetReason() != ValidationInvalidReason::TX_WITNESS_MUTATED) ||
-                    state.GetReason() == ValidationInvalidReason::TX_INPUTS_NOT_STANDARD) {
-                // Do not use rejection cache for witness transactions or
-                // witness-stripped transactions, as they can have been malleated.
-                // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                // However, if the transaction failed for TX_INPUTS_NOT_STANDARD,
-                // then we know that the witness was irrelevant to the policy
-                // failure, since this check depends only on the txid
-                // (the scriptPubKey being spent is covered by the txid).
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
-                AddToCompactExtraTransactions(ptx);
-            }
-
-            if (pfrom->HasPermission(PF_FORCERELAY)) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool or rejected from it due
-                // to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that might result in being
-                // disconnected (or banned).
-                if (state.IsInvalid() && TxRelayMayResultInDisconnect(state)) {
-                    LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->GetId(), FormatStateMessage(state));
-                } else {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
-                    RelayTransaction(tx.GetHash(), *connman);
-                }
+        // The proofs and signatures of shielded transactions are verified by
+        // the pre-verification threads first. The transaction is then passed
+        // to ProcessTransaction from ProcessMessages.
+        if (g_shielded_preverifier && !AlreadyHave(inv) &&
+            (!tx.vJoinSplit.empty() || !tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty())) {
+            if (g_shielded_preverifier->Enqueue(pfrom->GetId(), ptx, ::ChainActive().Height() + 1)) {
+                return true;
             }
+            // The queue is full: verify the transaction here rather than
+            // dropping it, as it would not be requested again.
+            LogPrint(BCLog::MEMPOOL, "shielded pre-verification queue full, verifying %s from peer=%d inline\n", tx.GetHash().ToString(), pfrom->GetId());
         }
 
-        for (const CTransactionRef& removedTx : lRemovedTxn)
-            AddToCompactExtraTransactions(removedTx);
-
-        // If a tx has been detected by recentRejects, we will have reached
-        // this point and the tx will have been ignored. Because we haven't run
-        // the tx through AcceptToMemoryPool, we won't have computed a DoS
-        // score for it or determined exactly why we consider it invalid.
-        //
-        // This means we won't penalize any peer subsequently relaying a DoSy
-        // tx (even if we penalized the first peer who gave it to us) because
-        // we have to account for recentRejects showing false positives. In
-        // other words, we shouldn't penalize a peer if we aren't *sure* they
-        // submitted a DoSy tx.
-        //
-        // Note that recentRejects doesn't just record DoSy or invalid
-        // transactions, but any tx not accepted by the mempool, which may be
-        // due to node policy (vs. consensus). So we can't blanket penalize a
-        // peer simply for relaying a tx that our recentRejects has caught,
-        // regardless of false positives.
-
-        if (state.IsInvalid())
-        {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
-                pfrom->GetId(),
-                FormatStateMessage(state));
-            if (enable_bip61 && state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) { // Never send AcceptToMemoryPool's internal codes over P2P
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
-                                   state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-            }
-            MaybePunishNode(pfrom->GetId(), state, /*via_compact_block*/ false);
-        }
+        ProcessTransaction(pfrom, ptx, CValidationState(), connman, enable_bip61);
         return true;
     }
 
@@ -2782,6 +2909,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us invalid compact block\n", pfrom->GetId()));
                     return true;
                 } else if (status == READ_STATUS_FAILED) {
+                    nodestate->m_cmpctblock_stats.nBlocks++;
+                    nodestate->m_cmpctblock_stats.nFailed++;
                     // Duplicate txindexes, the block is now in-flight, so just request it
                     std::vector<CInv> vInv(1);
                     vInv[0] = CInv(MSG_BLOCK | GetFetchFlags(pfrom), cmpctblock.header.GetHash());
@@ -2794,13 +2923,20 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     if (!partialBlock.IsTxAvailable(i))
                         req.indexes.push_back(i);
                 }
+                CompactBlockStats& cmpctblock_stats = nodestate->m_cmpctblock_stats;
+                cmpctblock_stats.nBlocks++;
+                cmpctblock_stats.nTxPrefilled += cmpctblock.PrefilledTxCount();
+                cmpctblock_stats.nTxMempool += cmpctblock.BlockTxCount() - cmpctblock.PrefilledTxCount() - req.indexes.size();
+                cmpctblock_stats.nTxRequested += req.indexes.size();
                 if (req.indexes.empty()) {
+                    cmpctblock_stats.nReconstructed++;
                     // Dirty hack to jump to BLOCKTXN code (TODO: move message handling into their own functions)
                     BlockTransactions txn;
                     txn.blockhash = cmpctblock.header.GetHash();
                     blockTxnMsg << txn;
                     fProcessBLOCKTXN = true;
                 } else {
+                    cmpctblock_stats.nRoundTrips++;
                     req.blockhash = pindex->GetBlockHash();
                     connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
                 }
@@ -2908,6 +3044,14 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 return true;
             }
 
+            CompactBlockStats& cmpctblock_stats = State(pfrom->GetId())->m_cmpctblock_stats;
+            for (const CTransactionRef& tx : resp.txn) {
+                if (!tx->vJoinSplit.empty() || !tx->vShieldedSpend.empty() || !tx->vShieldedOutput.empty()) {
+                    cmpctblock_stats.nShieldedTxRequested++;
+                    cmpctblock_stats.nShieldedBytesRequested += ::GetSerializeSize(*tx, PROTOCOL_VERSION);
+                }
+            }
+
             PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
             ReadStatus status = partialBlock.FillBlock(*pblock, resp.txn);
             if (status == READ_STATUS_INVALID) {
@@ -2915,6 +3059,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->GetId()));
                 return true;
             } else if (status == READ_STATUS_FAILED) {
+                cmpctblock_stats.nFailed++;
                 // Might have collided, fall back to getdata now :(
                 std::vector<CInv> invs;
                 invs.push_back(CInv(MSG_BLOCK | GetFetchFlags(pfrom), resp.blockhash));
@@ -3006,6 +3151,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->GetId());
 
         bool forceProcessing = false;
+        int nHeight = -1;
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
@@ -3015,15 +3161,16 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
+            const CBlockIndex* pindexPrev = LookupBlockIndex(pblock->hashPrevBlock);
+            if (pindexPrev) nHeight = pindexPrev->nHeight + 1;
         }
-        bool fNewBlock = false;
-        ProcessNewBlock(chainparams, pblock, forceProcessing, &fNewBlock);
-        if (fNewBlock) {
-            pfrom->nLastBlockTime = GetTime();
-        } else {
-            LOCK(cs_main);
-            mapBlockSource.erase(pblock->GetHash());
+        // Blocks we asked for are checked on the block check threads while
+        // the blocks received before them are connected, see BlockPreChecker.
+        if (g_block_prechecker && (forceProcessing || g_block_prechecker->HasPending(pfrom->GetId())) &&
+            g_block_prechecker->Enqueue(pfrom->GetId(), pblock, forceProcessing, nHeight)) {
+            return true;
         }
+        ProcessBlock(pfrom, chainparams, pblock, forceProcessing);
         return true;
     }
 
@@ -3324,6 +3471,22 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         }
     }
 
+    if (g_shielded_preverifier) {
+        std::vector<ShieldedTxPreVerifier::Result> results = g_shielded_preverifier->TakeResults(pfrom->GetId());
+        if (!results.empty()) {
+            LOCK2(cs_main, g_cs_orphans);
+            for (const ShieldedTxPreVerifier::Result& result : results) {
+                ProcessTransaction(pfrom, result.tx, result.state, connman, m_enable_bip61);
+            }
+        }
+    }
+
+    if (g_block_prechecker) {
+        for (const BlockPreChecker::Result& result : g_block_prechecker->TakeResults(pfrom->GetId())) {
+            ProcessBlock(pfrom, chainparams, result.block, result.force_processing);
+        }
+    }
+
     if (pfrom->fDisconnect)
         return false;
 
@@ -3336,11 +3499,20 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     if (pfrom->fPauseSend)
         return false;
 
+    // While blocks of the peer are being checked, only further blocks are
+    // taken, so that the other messages are still processed after them. The
+    // block check threads wake us up when they are done.
+    const bool fBlocksPending = g_block_prechecker && g_block_prechecker->HasPending(pfrom->GetId());
+    if (fBlocksPending && !g_block_prechecker->CanEnqueue(pfrom->GetId()))
+        return false;
+
     std::list<CNetMessage> msgs;
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
             return false;
+        if (fBlocksPending && pfrom->vProcessMsg.front().hdr.GetCommand() != NetMsgType::BLOCK)
+            return false;
         // Just take one message
         msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -= msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
@@ -18,6 +18,22 @@ extern CCriticalSection cs_main;
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Default for -shieldedverifythreads, threads verifying the proofs of shielded transactions from peers (0 = verify inline) */
+static const int DEFAULT_SHIELDED_VERIFY_THREADS = 2;
+/** Maximum number of -shieldedverifythreads */
+static const int MAX_SHIELDED_VERIFY_THREADS = 16;
+/** Maximum number of shielded transactions from a single peer waiting for pre-verification */
+static const unsigned int MAX_PEER_SHIELDED_VERIFY_QUEUE = 16;
+/** Maximum number of shielded transactions waiting for pre-verification */
+static const unsigned int MAX_SHIELDED_VERIFY_QUEUE = 256;
+/** Default for -blockcheckthreads, threads running the context-free checks of blocks downloaded from peers (0 = check inline) */
+static const int DEFAULT_BLOCK_CHECK_THREADS = 0;
+/** Maximum number of -blockcheckthreads */
+static const int MAX_BLOCK_CHECK_THREADS = 16;
+/** Maximum number of blocks from a single peer waiting to be checked or processed */
+static const unsigned int MAX_PEER_BLOCK_CHECK_QUEUE = 16;
+/** Maximum number of blocks waiting to be checked or processed */
+static const unsigned int MAX_BLOCK_CHECK_QUEUE = 64;
 /** Default for BIP61 (sending reject messages) */
 static constexpr bool DEFAULT_ENABLE_BIP61{false};
 static const bool DEFAULT_PEERBLOOMFILTERS = false;
@@ -33,6 +49,7 @@ private:
     bool SendRejectsAndCheckIfBanned(CNode* pnode, bool enable_bip61) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 public:
     PeerLogicValidation(CConnman* connman, BanMan* banman, CScheduler &scheduler, bool enable_bip61);
+    ~PeerLogicValidation();
 
     /**
      * Overridden from CValidationInterface.
@@ -84,11 +101,31 @@ private:
     const bool m_enable_bip61;
 };
 
+/** Statistics of the reconstruction of the compact blocks downloaded from a peer */
+struct CompactBlockStats {
+    //! Compact blocks we started to reconstruct
+    uint64_t nBlocks = 0;
+    //! Blocks reconstructed without requesting transactions
+    uint64_t nReconstructed = 0;
+    //! Blocks for which missing transactions were requested
+    uint64_t nRoundTrips = 0;
+    //! Blocks for which the full block was requested instead
+    uint64_t nFailed = 0;
+    //! Transactions prefilled by the peer, found in our mempool, and requested
+    uint64_t nTxPrefilled = 0;
+    uint64_t nTxMempool = 0;
+    uint64_t nTxRequested = 0;
+    //! Shielded transactions among the requested ones, and their size
+    uint64_t nShieldedTxRequested = 0;
+    uint64_t nShieldedBytesRequested = 0;
+};
+
 struct CNodeStateStats {
     int nMisbehavior = 0;
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    CompactBlockStats cmpctblock;
 };
 
 /** Get statistics from node state */
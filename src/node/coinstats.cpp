@@ -10,16 +10,38 @@
 #include <chain.h>
 #include <hash.h>
 #include <serialize.h>
+#include <shutdown.h>
+#include <streams.h>
 #include <validation.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 
+#include <condition_variable>
 #include <map>
+#include <mutex>
+#include <thread>
 
-#include <boost/thread.hpp>
+//! Number of ranges the UTXO set is split into, one per value of the first txid byte in database order
+static const int NUM_COINSTATS_RANGES = 256;
 
+namespace {
 
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+//! Statistics of one range of the UTXO set, and its serialization to be hashed in order
+struct RangeStats
+{
+    uint64_t nTransactions = 0;
+    uint64_t nTransactionOutputs = 0;
+    uint64_t nBogoSize = 0;
+    CAmount nTotalAmount = 0;
+    std::vector<unsigned char> data;
+    bool done = false;
+};
+
+} // namespace
+
+template <typename Stats, typename Stream>
+static void ApplyStats(Stats &stats, Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
     ss << hash;
@@ -37,28 +59,20 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
     ss << VARINT(0u);
 }
 
-//! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+//! Walk the coins whose txid starts with prefix, the cursor being positioned at the first of them
+static bool WalkRange(CCoinsViewCursor* pcursor, unsigned char prefix, RangeStats& range)
 {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
-    }
-    ss << stats.hashBlock;
+    CVectorWriter ss(SER_GETHASH, PROTOCOL_VERSION, range.data, 0);
     uint256 prevkey;
     std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) return false;
         COutPoint key;
         Coin coin;
         if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (*key.hash.begin() != prefix) break;
             if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
+                ApplyStats(range, ss, prevkey, outputs);
                 outputs.clear();
             }
             prevkey = key.hash;
@@ -69,9 +83,126 @@ bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         pcursor->Next();
     }
     if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
+        ApplyStats(range, ss, prevkey, outputs);
+    }
+    return true;
+}
+
+static bool CountNullifiers(CNullifiersViewCursor* pcursor, uint64_t& count)
+{
+    count = 0;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        if (ShutdownRequested()) return false;
+        count++;
     }
+    return true;
+}
+
+//! Calculate statistics about the unspent transaction output set
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats, bool shielded)
+{
+    // The cursors are all created while holding cs_main, so that no flush of
+    // the coins database can happen in between and they see the same state.
+    std::vector<std::unique_ptr<CCoinsViewCursor>> cursors(NUM_COINSTATS_RANGES);
+    std::unique_ptr<CNullifiersViewCursor> sprout_cursor, sapling_cursor;
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < NUM_COINSTATS_RANGES; i++) {
+            uint256 start;
+            *start.begin() = i;
+            cursors[i].reset(view->CursorAt(start));
+            assert(cursors[i]);
+        }
+        if (shielded) {
+            sprout_cursor.reset(view->NullifiersCursor(SPROUT));
+            sapling_cursor.reset(view->NullifiersCursor(SAPLING));
+            assert(sprout_cursor && sapling_cursor);
+        }
+        stats.hashBlock = cursors[0]->GetBestBlock();
+        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<RangeStats> ranges(NUM_COINSTATS_RANGES);
+    int next_range = 0;
+    int hashed_ranges = 0;
+    bool failed = false;
+
+    const int n_threads = std::max(1, std::min(GetNumCores(), MAX_COINSTATS_THREADS));
+    // Ranges that are walked but not hashed yet are held in memory, so only
+    // let the workers run a bounded number of ranges ahead of the hasher.
+    const int max_pending = 4 * n_threads;
+
+    auto worker = [&]() {
+        util::ThreadRename("coinstats");
+        while (true) {
+            int i;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&] { return failed || next_range == NUM_COINSTATS_RANGES || next_range < hashed_ranges + max_pending; });
+                if (failed || next_range == NUM_COINSTATS_RANGES) return;
+                i = next_range++;
+            }
+            bool ok = WalkRange(cursors[i].get(), i, ranges[i]);
+            cursors[i].reset();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ranges[i].done = true;
+                if (!ok) failed = true;
+            }
+            cond.notify_all();
+        }
+    };
+
+    bool nullifiers_ok = true;
+    auto count_nullifiers = [&]() {
+        util::ThreadRename("coinstats");
+        if (!CountNullifiers(sprout_cursor.get(), stats.nSproutNullifiers) ||
+            !CountNullifiers(sapling_cursor.get(), stats.nSaplingNullifiers)) {
+            nullifiers_ok = false;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    if (shielded) {
+        threads.emplace_back(count_nullifiers);
+    }
+
+    // Totals are combined in any order, but the serialized ranges are hashed
+    // in database order so that the hash is the same as a sequential walk.
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << stats.hashBlock;
+    for (int i = 0; i < NUM_COINSTATS_RANGES; i++) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&] { return failed || ranges[i].done; });
+            if (failed) break;
+        }
+        RangeStats& range = ranges[i];
+        ss.write((const char*)range.data.data(), range.data.size());
+        stats.nTransactions += range.nTransactions;
+        stats.nTransactionOutputs += range.nTransactionOutputs;
+        stats.nBogoSize += range.nBogoSize;
+        stats.nTotalAmount += range.nTotalAmount;
+        std::vector<unsigned char>().swap(range.data);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            hashed_ranges = i + 1;
+        }
+        cond.notify_all();
+    }
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (failed || !nullifiers_ok) return false;
+
     stats.hashSerialized = ss.GetHash();
     stats.nDiskSize = view->EstimateSize();
+    stats.fShielded = shielded;
     return true;
 }
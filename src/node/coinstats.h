@@ -13,6 +13,9 @@
 
 class CCoinsView;
 
+//! Maximum number of threads used by GetUTXOStats to walk the UTXO set
+static const int MAX_COINSTATS_THREADS = 8;
+
 struct CCoinsStats
 {
     int nHeight;
@@ -24,10 +27,23 @@ struct CCoinsStats
     uint64_t nDiskSize;
     CAmount nTotalAmount;
 
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+    //! Shielded pool statistics, only computed if requested
+    bool fShielded;
+    uint64_t nSproutNullifiers;
+    uint64_t nSaplingNullifiers;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0),
+                    fShielded(false), nSproutNullifiers(0), nSaplingNullifiers(0) {}
 };
 
-//! Calculate statistics about the unspent transaction output set
-bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats);
+/**
+ * Calculate statistics about the unspent transaction output set.
+ *
+ * The set is split by txid prefix and walked by up to MAX_COINSTATS_THREADS
+ * threads. The serialized hash is computed over the ranges in database order,
+ * so it does not depend on the number of threads. If shielded is set, the
+ * Sprout and Sapling nullifier sets are counted as well.
+ */
+bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, bool shielded = false);
 
 #endif // BITCOIN_NODE_COINSTATS_H
@@ -283,6 +283,18 @@ int64_t GetVirtualTransactionSize(int64_t nWeight, int64_t nSigOpCost, unsigned
     return (std::max(nWeight, nSigOpCost * bytes_per_sigop) + WITNESS_SCALE_FACTOR - 1) / WITNESS_SCALE_FACTOR;
 }
 
+int64_t GetShieldedValidationCost(const CTransaction& tx)
+{
+    return (int64_t)tx.vShieldedSpend.size() * SAPLING_SPEND_VALIDATION_COST +
+           (int64_t)tx.vShieldedOutput.size() * SAPLING_OUTPUT_VALIDATION_COST +
+           (int64_t)tx.vJoinSplit.size() * JOINSPLIT_VALIDATION_COST;
+}
+
+bool PaysDefaultShieldedFee(const CTransaction& tx, CAmount nFee)
+{
+    return (tx.vJoinSplit.size() > 0 || tx.vShieldedSpend.size() > 0 || tx.vShieldedOutput.size() > 0) && nFee == 10000;
+}
+
 int64_t GetVirtualTransactionSize(const CTransaction& tx, int64_t nSigOpCost, unsigned int bytes_per_sigop)
 {
     return GetVirtualTransactionSize(GetTransactionWeight(tx), nSigOpCost, bytes_per_sigop);
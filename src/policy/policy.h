@@ -36,6 +36,14 @@ static const unsigned int MAX_STANDARD_TX_SIGOPS_COST = MAX_BLOCK_SIGOPS_COST/5;
 static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
 /** Default for -incrementalrelayfee, which sets the minimum feerate increase for mempool limiting or BIP 125 replacement **/
 static const unsigned int DEFAULT_INCREMENTAL_RELAY_FEE = 1000;
+/** Validation cost, in virtual bytes, of a Sapling spend description (a Groth16 proof and a spend authorization signature) */
+static const unsigned int SAPLING_SPEND_VALIDATION_COST = 1000;
+/** Validation cost, in virtual bytes, of a Sapling output description (a Groth16 proof) */
+static const unsigned int SAPLING_OUTPUT_VALIDATION_COST = 1000;
+/** Validation cost, in virtual bytes, of a JoinSplit description (a proof with two nullifiers and two commitments) */
+static const unsigned int JOINSPLIT_VALIDATION_COST = 2000;
+/** Default for -blockmaxvalidationcost, which bounds the total validation cost of the shielded components of blocks created by mining code */
+static const unsigned int DEFAULT_BLOCK_MAX_VALIDATION_COST = 1000000;
 /** Default for -bytespersigop */
 static const unsigned int DEFAULT_BYTES_PER_SIGOP = 20;
 /** Default for -permitbaremultisig */
@@ -109,6 +117,20 @@ int64_t GetVirtualTransactionSize(int64_t nWeight, int64_t nSigOpCost, unsigned
 int64_t GetVirtualTransactionSize(const CTransaction& tx, int64_t nSigOpCost, unsigned int bytes_per_sigop);
 int64_t GetVirtualTransactionInputSize(const CTxIn& tx, int64_t nSigOpCost, unsigned int bytes_per_sigop);
 
+/**
+ * Compute the cost of verifying the proofs and signatures of the shielded
+ * components of a transaction, in virtual bytes. Verification time is roughly
+ * proportional to the number of descriptions, not to their size.
+ */
+int64_t GetShieldedValidationCost(const CTransaction& tx);
+
+/**
+ * Check if tx is a shielded transaction paying the default fee of wallet
+ * shielded operations (10000 sat). Such transactions are exempt from the
+ * minimum feerates, whatever their size and validation cost.
+ */
+bool PaysDefaultShieldedFee(const CTransaction& tx, CAmount nFee);
+
 static inline int64_t GetVirtualTransactionSize(const CTransaction& tx)
 {
     return GetVirtualTransactionSize(tx, 0, 0);
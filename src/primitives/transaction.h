@@ -517,7 +517,7 @@ public:
      * Cached incremental witnesses for spendable Notes.
      * Beginning of the list is the most recent witness.
      */
-    std::list<SproutWitness> witnesses;
+    SproutWitnessCache witnesses;
 
     /**
      * Block height corresponding to the most current witness.
@@ -533,11 +533,20 @@ public:
     // In Memory Only
     bool witnessRootValidated;
 
-    SproutNoteData() : address(), nullifier(), witnessHeight {-1}, witnessRootValidated {false} { }
+    /**
+     * Witness height and nullifier as last written to the wallet database, so
+     * that only the witnesses added since are written, see
+     * CWallet::ChainStateFlushed. A witness height of -1 means the note data
+     * must be written in full.
+     */
+    int witnessHeightWritten;
+    Optional<uint256> nullifierWritten;
+
+    SproutNoteData() : address(), nullifier(), witnessHeight {-1}, witnessRootValidated {false}, witnessHeightWritten {-1} { }
     SproutNoteData(libzcash::SproutPaymentAddress a) :
-            address {a}, nullifier(), witnessHeight {-1}, witnessRootValidated {false} { }
+            address {a}, nullifier(), witnessHeight {-1}, witnessRootValidated {false}, witnessHeightWritten {-1} { }
     SproutNoteData(libzcash::SproutPaymentAddress a, uint256 n) :
-            address {a}, nullifier {n}, witnessHeight {-1}, witnessRootValidated {false} { }
+            address {a}, nullifier {n}, witnessHeight {-1}, witnessRootValidated {false}, witnessHeightWritten {-1} { }
 
     ADD_SERIALIZE_METHODS;
 
@@ -570,19 +579,23 @@ public:
      * We initialize the height to -1 for the same reason as we do in SproutNoteData.
      * See the comment in that class for a full description.
      */
-    SaplingNoteData() : witnessHeight {-1}, nullifier(), witnessRootValidated {false} { }
-    SaplingNoteData(libzcash::SaplingIncomingViewingKey ivk) : ivk {ivk}, witnessHeight {-1}, nullifier(), witnessRootValidated {false} { }
-    SaplingNoteData(libzcash::SaplingIncomingViewingKey ivk, uint256 n) : ivk {ivk}, witnessHeight {-1}, nullifier(n), witnessRootValidated {false} { }
+    SaplingNoteData() : witnessHeight {-1}, nullifier(), witnessRootValidated {false}, witnessHeightWritten {-1} { }
+    SaplingNoteData(libzcash::SaplingIncomingViewingKey ivk) : ivk {ivk}, witnessHeight {-1}, nullifier(), witnessRootValidated {false}, witnessHeightWritten {-1} { }
+    SaplingNoteData(libzcash::SaplingIncomingViewingKey ivk, uint256 n) : ivk {ivk}, witnessHeight {-1}, nullifier(n), witnessRootValidated {false}, witnessHeightWritten {-1} { }
 
     libzcash::SaplingIncomingViewingKey ivk;
     int witnessHeight;
     Optional<uint256> nullifier;
 
-    std::list<SaplingWitness> witnesses;
+    SaplingWitnessCache witnesses;
 
     // In Memory Only
     bool witnessRootValidated;
 
+    //! As in SproutNoteData
+    int witnessHeightWritten;
+    Optional<uint256> nullifierWritten;
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -8,6 +8,7 @@
 #include <chainparams.h>
 #include <core_io.h>
 #include <httpserver.h>
+#include <index/compactsaplingindex.h>
 #include <index/txindex.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
@@ -192,6 +193,85 @@ static bool rest_headers(HTTPRequest* req,
     }
 }
 
+static bool rest_compactsaplingblocks(HTTPRequest* req,
+                                      const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No block count specified. Use /rest/compactsaplingblocks/<count>/<hash>.<ext>.");
+
+    long count = strtol(path[0].c_str(), nullptr, 10);
+    if (count < 1 || count > MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block count out of range: " + path[0]);
+
+    std::string hashStr = path[1];
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (!g_compactsaplingindex)
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Compact Sapling block index is not enabled");
+    if (!g_compactsaplingindex->BlockUntilSyncedToCurrentChain())
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE, "Compact Sapling blocks are still in the process of being indexed");
+
+    int start_height;
+    const CBlockIndex* stop_index = nullptr;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (!pindex || !::ChainActive().Contains(pindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found in active chain");
+        start_height = pindex->nHeight;
+        stop_index = ::ChainActive()[std::min<int64_t>(start_height + count - 1, ::ChainActive().Height())];
+    }
+
+    switch (rf) {
+    case RetFormat::BINARY: {
+        std::vector<unsigned char> data;
+        if (!g_compactsaplingindex->LookupRawRange(start_height, stop_index, data))
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read compact Sapling blocks");
+
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, std::string(data.begin(), data.end()));
+        return true;
+    }
+
+    case RetFormat::HEX: {
+        std::vector<unsigned char> data;
+        if (!g_compactsaplingindex->LookupRawRange(start_height, stop_index, data))
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read compact Sapling blocks");
+
+        std::string strHex = HexStr(data) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RetFormat::JSON: {
+        std::vector<CompactSaplingBlock> blocks;
+        if (!g_compactsaplingindex->LookupRange(start_height, stop_index, blocks))
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read compact Sapling blocks");
+
+        UniValue jsonBlocks(UniValue::VARR);
+        for (const CompactSaplingBlock& block : blocks) {
+            jsonBlocks.push_back(compactSaplingBlockToJSON(block));
+        }
+        std::string strJSON = jsonBlocks.write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
 static bool rest_block(HTTPRequest* req,
                        const std::string& strURIPart,
                        bool showTxDetails)
@@ -633,6 +713,7 @@ static const struct {
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
+      {"/rest/compactsaplingblocks/", rest_compactsaplingblocks},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
 };
@@ -18,6 +18,9 @@
 #include <hash.h>
 #include <key_io.h>
 #include <index/blockfilterindex.h>
+#include <index/compactsaplingindex.h>
+#include <index/shieldedindex.h>
+#include <index/timestampindex.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -111,6 +114,20 @@ static UniValue ValuePoolDesc(const std::string &name, const Optional<CAmount> c
     return rv;
 }
 
+static UniValue CommitmentTreeDesc(const std::string &name, const Optional<uint64_t> chainSize, const Optional<uint32_t> sizeDelta)
+{
+    UniValue rv(UniValue::VOBJ);
+    rv.pushKV("id", name);
+    rv.pushKV("monitored", (bool)chainSize);
+    if (chainSize) {
+        rv.pushKV("size", *chainSize);
+    }
+    if (sizeDelta) {
+        rv.pushKV("sizeDelta", (uint64_t)*sizeDelta);
+    }
+    return rv;
+}
+
 static int ComputeNextBlockAndDepth(const CBlockIndex* tip, const CBlockIndex* blockindex, const CBlockIndex*& next)
 {
     next = tip->GetAncestor(blockindex->nHeight + 1);
@@ -153,6 +170,42 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
     return result;
 }
 
+UniValue compactSaplingBlockToJSON(const CompactSaplingBlock& block)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("hash", block.hash.GetHex());
+    result.pushKV("height", block.height);
+    result.pushKV("previousblockhash", block.prevHash.GetHex());
+    result.pushKV("time", (int64_t)block.time);
+
+    UniValue vtx(UniValue::VARR);
+    for (const CompactSaplingTx& tx : block.vtx) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("index", (int64_t)tx.index);
+        entry.pushKV("txid", tx.txid.GetHex());
+
+        UniValue spends(UniValue::VARR);
+        for (const CompactSaplingSpend& spend : tx.spends) {
+            spends.push_back(spend.nullifier.GetHex());
+        }
+        entry.pushKV("spends", spends);
+
+        UniValue outputs(UniValue::VARR);
+        for (const CompactSaplingOutput& output : tx.outputs) {
+            UniValue out(UniValue::VOBJ);
+            out.pushKV("cmu", output.cmu.GetHex());
+            out.pushKV("ephemeralKey", output.ephemeralKey.GetHex());
+            out.pushKV("ciphertext", HexStr(output.ciphertext.begin(), output.ciphertext.end()));
+            outputs.push_back(out);
+        }
+        entry.pushKV("outputs", outputs);
+
+        vtx.push_back(entry);
+    }
+    result.pushKV("vtx", vtx);
+    return result;
+}
+
 UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex)
 {
     AssertLockNotHeld(cs_main); // For performance reasons
@@ -286,6 +339,10 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIn
     valuePools.push_back(ValuePoolDesc("sprout", blockindex->nChainSproutValue, blockindex->nSproutValue));
     valuePools.push_back(ValuePoolDesc("sapling", blockindex->nChainSaplingValue, blockindex->nSaplingValue));
     result.pushKV("valuePools", valuePools);
+    UniValue commitmentTrees(UniValue::VARR);
+    commitmentTrees.push_back(CommitmentTreeDesc("sprout", blockindex->nChainSproutCommitments, blockindex->nSproutCommitments));
+    commitmentTrees.push_back(CommitmentTreeDesc("sapling", blockindex->nChainSaplingCommitments, blockindex->nSaplingCommitments));
+    result.pushKV("commitmentTrees", commitmentTrees);
 
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
@@ -506,6 +563,7 @@ static std::string EntryDescriptionString()
            "    \"size\" : n,             (numeric) (DEPRECATED) same as vsize. Only returned if litecoinzd is started with -deprecatedrpc=size\n"
            "                              size will be completely removed in v0.20.\n"
            "    \"weight\" : n,           (numeric) transaction weight as defined in BIP 141.\n"
+           "    \"validationcost\" : n,   (numeric) cost of verifying the shielded proofs and signatures, in virtual bytes. Feerates are charged for the larger of vsize and this cost.\n"
            "    \"fee\" : n,              (numeric) transaction fee in " + CURRENCY_UNIT + " (DEPRECATED)\n"
            "    \"modifiedfee\" : n,      (numeric) transaction fee with fee deltas used for mining priority (DEPRECATED)\n"
            "    \"time\" : n,             (numeric) local time transaction entered pool in seconds since 1 Jan 1970 GMT\n"
@@ -546,6 +604,7 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
     info.pushKV("vsize", (int)e.GetTxSize());
     if (IsDeprecatedRPCEnabled("size")) info.pushKV("size", (int)e.GetTxSize());
     info.pushKV("weight", (int)e.GetTxWeight());
+    info.pushKV("validationcost", e.GetValidationCost());
     info.pushKV("fee", ValueFromAmount(e.GetFee()));
     info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
     info.pushKV("time", e.GetTime());
@@ -986,6 +1045,14 @@ static UniValue getblock(const JSONRPCRequest& request)
             "  \"difficulty\" : x.xxx,  (numeric) The difficulty\n"
             "  \"chainwork\" : \"xxxx\",  (string) Expected number of hashes required to produce the chain up to this block (in hex)\n"
             "  \"nTx\" : n,             (numeric) The number of transactions in the block.\n"
+            "  \"commitmentTrees\" : [  (array) The note commitment trees\n"
+            "     {\n"
+            "       \"id\" : \"sprout\",     (string) The pool of the tree, sprout or sapling\n"
+            "       \"monitored\" : true,  (boolean) If the tree size up to this block is known\n"
+            "       \"size\" : n,          (numeric) The size of the tree up to and including this block\n"
+            "       \"sizeDelta\" : n      (numeric) The number of note commitments added by this block\n"
+            "     }, ...\n"
+            "  ],\n"
             "  \"previousblockhash\" : \"hash\",  (string) The hash of the previous block\n"
             "  \"nextblockhash\" : \"hash\"       (string) The hash of the next block\n"
             "}\n"
@@ -1173,8 +1240,9 @@ UniValue getblockhashes(const JSONRPCRequest& request)
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
 
-    if (fActiveOnly)
-        LOCK(cs_main);
+    if (g_timestampindex) {
+        g_timestampindex->BlockUntilSyncedToCurrentChain();
+    }
 
     if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
@@ -1257,7 +1325,9 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
                 "Note this call may take some time.\n",
-                {},
+                {
+                    {"shielded", RPCArg::Type::BOOL, /* default */ "false", "Also return statistics about the shielded pools"},
+                },
                 RPCResult{
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -1268,21 +1338,33 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"shielded\": {              (json object) Only present if shielded is true\n"
+            "    \"sprout\": {\n"
+            "      \"nullifiers\": n,       (numeric) The number of revealed Sprout nullifiers\n"
+            "      \"commitments\": n       (numeric) The size of the Sprout note commitment tree, if known\n"
+            "    },\n"
+            "    \"sapling\": {\n"
+            "      \"nullifiers\": n,       (numeric) The number of revealed Sapling nullifiers\n"
+            "      \"commitments\": n       (numeric) The size of the Sapling note commitment tree, if known\n"
+            "    }\n"
+            "  }\n"
             "}\n"
                 },
                 RPCExamples{
                     HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "true")
             + HelpExampleRpc("gettxoutsetinfo", "")
                 },
             }.Check(request);
 
     UniValue ret(UniValue::VOBJ);
+    bool shielded = request.params[0].isNull() ? false : request.params[0].get_bool();
 
     CCoinsStats stats;
     ::ChainstateActive().ForceFlushStateToDisk();
 
     CCoinsView* coins_view = WITH_LOCK(cs_main, return &ChainstateActive().CoinsDB());
-    if (GetUTXOStats(coins_view, stats)) {
+    if (GetUTXOStats(coins_view, stats, shielded)) {
         ret.pushKV("height", (int64_t)stats.nHeight);
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
         ret.pushKV("transactions", (int64_t)stats.nTransactions);
@@ -1291,6 +1373,23 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
         ret.pushKV("disk_size", stats.nDiskSize);
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+        if (stats.fShielded) {
+            const CBlockIndex* pindex = WITH_LOCK(cs_main, return LookupBlockIndex(stats.hashBlock));
+            UniValue sprout(UniValue::VOBJ);
+            sprout.pushKV("nullifiers", stats.nSproutNullifiers);
+            if (pindex->nChainSproutCommitments) {
+                sprout.pushKV("commitments", *pindex->nChainSproutCommitments);
+            }
+            UniValue sapling(UniValue::VOBJ);
+            sapling.pushKV("nullifiers", stats.nSaplingNullifiers);
+            if (pindex->nChainSaplingCommitments) {
+                sapling.pushKV("commitments", *pindex->nChainSaplingCommitments);
+            }
+            UniValue shielded_stats(UniValue::VOBJ);
+            shielded_stats.pushKV("sprout", sprout);
+            shielded_stats.pushKV("sapling", sapling);
+            ret.pushKV("shielded", shielded_stats);
+        }
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
@@ -2602,6 +2701,286 @@ static UniValue getblockfilter(const JSONRPCRequest& request)
     return ret;
 }
 
+static ShieldedType ParseShieldedPool(const UniValue& param)
+{
+    if (param.isNull() || param.get_str() == "sapling") {
+        return SAPLING;
+    } else if (param.get_str() == "sprout") {
+        return SPROUT;
+    }
+    throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown shielded pool " + param.get_str());
+}
+
+static void EnsureShieldedIndexReady()
+{
+    if (!g_shieldedindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Shielded index is not enabled. Use -shieldedindex to enable it.");
+    }
+    if (!g_shieldedindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Shielded transactions are still in the process of being indexed.");
+    }
+}
+
+static UniValue getnullifierinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getnullifierinfo",
+                "\nReturns the transaction in the active chain that revealed a nullifier.\n"
+                "Requires -shieldedindex.\n",
+                {
+                    {"nullifier", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The nullifier"},
+                    {"pool", RPCArg::Type::STR, /* default */ "sapling", "The shielded pool of the nullifier (sprout or sapling)"},
+                },
+                RPCResult{
+                    "{\n"
+                    "  \"txid\" : \"hex\",         (string) the id of the spending transaction\n"
+                    "  \"height\" : n,           (numeric) the height of the block containing the transaction\n"
+                    "  \"blockhash\" : \"hex\",    (string) the hash of the block containing the transaction\n"
+                    "  \"index\" : n             (numeric) the index of the spend description (sapling) or of the joinsplit (sprout)\n"
+                    "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getnullifierinfo", "\"2d6f4b13ef3ac8c8cbaaeb7ef5fcf8ea9d0a5e30e8f42bed9ae58a1b7e64bbf4\" \"sapling\"")
+            + HelpExampleRpc("getnullifierinfo", "\"2d6f4b13ef3ac8c8cbaaeb7ef5fcf8ea9d0a5e30e8f42bed9ae58a1b7e64bbf4\", \"sapling\"")
+                }
+            }.Check(request);
+
+    uint256 nullifier = ParseHashV(request.params[0], "nullifier");
+    ShieldedType type = ParseShieldedPool(request.params[1]);
+
+    EnsureShieldedIndexReady();
+
+    CNullifierIndexValue value;
+    if (!g_shieldedindex->FindNullifier(nullifier, type, value)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Nullifier not found in the active chain");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("txid", value.txid.GetHex());
+    ret.pushKV("height", value.blockHeight);
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = ::ChainActive()[value.blockHeight];
+        if (pindex) ret.pushKV("blockhash", pindex->GetBlockHash().GetHex());
+    }
+    ret.pushKV("index", (int64_t)value.index);
+    return ret;
+}
+
+static UniValue getnotecommitmentinfo(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getnotecommitmentinfo",
+                "\nReturns the transaction in the active chain that created a note commitment, and the\n"
+                "position of the commitment in the note commitment tree.\n"
+                "Requires -shieldedindex.\n",
+                {
+                    {"commitment", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The note commitment"},
+                    {"pool", RPCArg::Type::STR, /* default */ "sapling", "The shielded pool of the commitment (sprout or sapling)"},
+                },
+                RPCResult{
+                    "{\n"
+                    "  \"txid\" : \"hex\",         (string) the id of the transaction creating the note\n"
+                    "  \"height\" : n,           (numeric) the height of the block containing the transaction\n"
+                    "  \"blockhash\" : \"hex\",    (string) the hash of the block containing the transaction\n"
+                    "  \"outindex\" : n,         (numeric) (sapling only) the index of the output description\n"
+                    "  \"jsindex\" : n,          (numeric) (sprout only) the index of the joinsplit\n"
+                    "  \"jsoutindex\" : n,       (numeric) (sprout only) the index of the output within the joinsplit\n"
+                    "  \"position\" : n          (numeric) the position of the commitment in the note commitment tree\n"
+                    "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getnotecommitmentinfo", "\"4b6a7e2a9d4b1f0c3e5d7f9a1b3c5d7e9f0a2b4c6d8e0f1a3b5c7d9e1f2a4b6c\" \"sapling\"")
+            + HelpExampleRpc("getnotecommitmentinfo", "\"4b6a7e2a9d4b1f0c3e5d7f9a1b3c5d7e9f0a2b4c6d8e0f1a3b5c7d9e1f2a4b6c\", \"sapling\"")
+                }
+            }.Check(request);
+
+    uint256 commitment = ParseHashV(request.params[0], "commitment");
+    ShieldedType type = ParseShieldedPool(request.params[1]);
+
+    EnsureShieldedIndexReady();
+
+    CCommitmentIndexValue value;
+    if (!g_shieldedindex->FindCommitment(commitment, type, value)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Note commitment not found in the active chain");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("txid", value.txid.GetHex());
+    ret.pushKV("height", value.blockHeight);
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = ::ChainActive()[value.blockHeight];
+        if (pindex) ret.pushKV("blockhash", pindex->GetBlockHash().GetHex());
+    }
+    if (type == SPROUT) {
+        ret.pushKV("jsindex", (int64_t)(value.outputIndex / ZC_NUM_JS_OUTPUTS));
+        ret.pushKV("jsoutindex", (int64_t)(value.outputIndex % ZC_NUM_JS_OUTPUTS));
+    } else {
+        ret.pushKV("outindex", (int64_t)value.outputIndex);
+    }
+    ret.pushKV("position", (int64_t)value.position);
+    return ret;
+}
+
+static UniValue getcompactsaplingblocks(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getcompactsaplingblocks",
+                "\nReturns the compact Sapling blocks of a range of heights of the active chain. A compact block\n"
+                "only holds the nullifiers of the Sapling spends, and the note commitment, ephemeral key and\n"
+                "first " + std::to_string(COMPACT_NOTE_SIZE) + " bytes of the ciphertext of the Sapling outputs of each transaction.\n"
+                "At most " + std::to_string(MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST) + " blocks are returned per call.\n"
+                "Requires -compactsaplingindex.\n",
+                {
+                    {"start_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the first block"},
+                    {"stop_height", RPCArg::Type::NUM, /* default */ "start_height", "The height of the last block"},
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "false", "true for an array of json objects, false for the serialized blocks"},
+                },
+                {
+                    RPCResult{"for verbose = false",
+                        "\"data\"             (string) the serialized compact blocks, hex-encoded and concatenated in height order\n"
+                    },
+                    RPCResult{"for verbose = true",
+                        "[\n"
+                        "  {\n"
+                        "    \"hash\" : \"hash\",               (string) the block hash\n"
+                        "    \"height\" : n,                  (numeric) the block height\n"
+                        "    \"previousblockhash\" : \"hash\",  (string) the hash of the previous block\n"
+                        "    \"time\" : ttt,                  (numeric) the block time\n"
+                        "    \"vtx\" : [                      (array) the transactions with Sapling spends or outputs\n"
+                        "      {\n"
+                        "        \"index\" : n,               (numeric) the index of the transaction in the block\n"
+                        "        \"txid\" : \"id\",             (string) the transaction id\n"
+                        "        \"spends\" : [ \"nf\", ... ],   (array of string) the nullifiers of the spends\n"
+                        "        \"outputs\" : [\n"
+                        "          {\n"
+                        "            \"cmu\" : \"hex\",          (string) the note commitment\n"
+                        "            \"ephemeralKey\" : \"hex\", (string) the ephemeral public key\n"
+                        "            \"ciphertext\" : \"hex\"    (string) the compact note ciphertext\n"
+                        "          }, ...\n"
+                        "        ]\n"
+                        "      }, ...\n"
+                        "    ]\n"
+                        "  }, ...\n"
+                        "]\n"
+                    },
+                },
+                RPCExamples{
+                    HelpExampleCli("getcompactsaplingblocks", "1000 1010 true")
+            + HelpExampleRpc("getcompactsaplingblocks", "1000, 1010, true")
+                }
+            }.Check(request);
+
+    if (!g_compactsaplingindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Compact Sapling block index is not enabled. Use -compactsaplingindex to enable it.");
+    }
+
+    int start_height = request.params[0].get_int();
+    int stop_height = request.params[1].isNull() ? start_height : request.params[1].get_int();
+    bool verbose = request.params[2].isNull() ? false : request.params[2].get_bool();
+
+    if (start_height < 0 || stop_height < start_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    }
+    if (stop_height - start_height >= MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Height range exceeds %d blocks", MAX_COMPACT_SAPLING_BLOCKS_PER_REQUEST));
+    }
+
+    if (!g_compactsaplingindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Compact Sapling blocks are still in the process of being indexed.");
+    }
+
+    const CBlockIndex* stop_index;
+    {
+        LOCK(cs_main);
+        stop_index = ::ChainActive()[stop_height];
+    }
+    if (!stop_index) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
+
+    if (!verbose) {
+        std::vector<unsigned char> data;
+        if (!g_compactsaplingindex->LookupRawRange(start_height, stop_index, data)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to read compact Sapling blocks");
+        }
+        return HexStr(data);
+    }
+
+    std::vector<CompactSaplingBlock> blocks;
+    if (!g_compactsaplingindex->LookupRange(start_height, stop_index, blocks)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to read compact Sapling blocks");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const CompactSaplingBlock& block : blocks) {
+        ret.push_back(compactSaplingBlockToJSON(block));
+    }
+    return ret;
+}
+
+static UniValue getcommitmenttreesizes(const JSONRPCRequest& request)
+{
+            RPCHelpMan{"getcommitmenttreesizes",
+                "\nReturns the Sprout and Sapling note commitment tree sizes and the Sapling tree root after each\n"
+                "block of a range of heights of the active chain, without reading any block or tree from disk.\n"
+                "The position of the i-th note commitment of a block is the tree size of the previous block plus i.\n"
+                "At most " + std::to_string(MAX_COMMITMENT_TREE_SIZES_PER_REQUEST) + " blocks are returned per call.\n",
+                {
+                    {"start_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the first block"},
+                    {"stop_height", RPCArg::Type::NUM, /* default */ "start_height", "The height of the last block"},
+                },
+                RPCResult{
+                    "[\n"
+                    "  {\n"
+                    "    \"height\" : n,              (numeric) The block height\n"
+                    "    \"hash\" : \"hash\",           (string) The block hash\n"
+                    "    \"saplingroot\" : \"hash\",    (string) The root of the Sapling note commitment tree after this block\n"
+                    "    \"sproutsize\" : n,          (numeric) The size of the Sprout note commitment tree after this block,\n"
+                    "                               omitted if unknown (reindex to compute it)\n"
+                    "    \"saplingsize\" : n          (numeric) The size of the Sapling note commitment tree after this block,\n"
+                    "                               omitted if unknown (reindex to compute it)\n"
+                    "  }, ...\n"
+                    "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getcommitmenttreesizes", "1000 2000")
+            + HelpExampleRpc("getcommitmenttreesizes", "1000, 2000")
+                }
+            }.Check(request);
+
+    int start_height = request.params[0].get_int();
+    int stop_height = request.params[1].isNull() ? start_height : request.params[1].get_int();
+
+    if (start_height < 0 || stop_height < start_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    }
+    if (stop_height - start_height >= MAX_COMMITMENT_TREE_SIZES_PER_REQUEST) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Height range exceeds %d blocks", MAX_COMMITMENT_TREE_SIZES_PER_REQUEST));
+    }
+
+    LOCK(cs_main);
+    if (stop_height > ::ChainActive().Height()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (int height = start_height; height <= stop_height; height++) {
+        const CBlockIndex* pindex = ::ChainActive()[height];
+
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("height", height);
+        entry.pushKV("hash", pindex->GetBlockHash().GetHex());
+        entry.pushKV("saplingroot", pindex->hashSaplingRoot.GetHex());
+        if (pindex->nChainSproutCommitments) {
+            entry.pushKV("sproutsize", *pindex->nChainSproutCommitments);
+        }
+        if (pindex->nChainSaplingCommitments) {
+            entry.pushKV("saplingsize", *pindex->nChainSaplingCommitments);
+        }
+        ret.push_back(entry);
+    }
+    return ret;
+}
+
 // clang-format off
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
@@ -2617,6 +2996,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getcommitmenttreesizes", &getcommitmenttreesizes, {"start_height", "stop_height"} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
@@ -2624,7 +3004,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"shielded"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
@@ -2632,6 +3012,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
     { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },
+    { "blockchain",         "getnullifierinfo",       &getnullifierinfo,       {"nullifier", "pool"} },
+    { "blockchain",         "getnotecommitmentinfo",  &getnotecommitmentinfo,  {"commitment", "pool"} },
+    { "blockchain",         "getcompactsaplingblocks", &getcompactsaplingblocks, {"start_height", "stop_height", "verbose"} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
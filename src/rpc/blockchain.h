@@ -17,10 +17,14 @@ extern RecursiveMutex cs_main;
 class CBlock;
 class CBlockIndex;
 class CTxMemPool;
+struct CompactSaplingBlock;
 class UniValue;
 
 static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
 
+/** Maximum number of blocks returned by a single getcommitmenttreesizes call. */
+static constexpr int MAX_COMMITMENT_TREE_SIZES_PER_REQUEST = 10000;
+
 /**
  * Get the difficulty of the net wrt to the given block index.
  *
@@ -44,6 +48,9 @@ UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false);
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
 
+/** Compact Sapling block to JSON */
+UniValue compactSaplingBlockToJSON(const CompactSaplingBlock& block);
+
 /** Used by getblockstats to get feerates at different percentiles by weight  */
 void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
 
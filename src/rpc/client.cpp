@@ -158,6 +158,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblockhashes", 0 , "high"},
     { "getblockhashes", 1, "low"},
     { "getblockhashes", 2, "options" },
+    { "getcompactsaplingblocks", 0, "start_height" },
+    { "getcompactsaplingblocks", 1, "stop_height" },
+    { "getcompactsaplingblocks", 2, "verbose" },
+    { "getcommitmenttreesizes", 0, "start_height" },
+    { "getcommitmenttreesizes", 1, "stop_height" },
+    { "gettxoutsetinfo", 0, "shielded" },
     { "bumpfee", 1, "options" },
     { "logging", 0, "include" },
     { "logging", 1, "exclude" },
@@ -181,6 +187,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getnodeaddresses", 0, "count"},
     { "stop", 0, "wait" },
 
+    { "z_getnewaddresses", 0, "count" },
+    { "z_getnewdiversifiedaddresses", 1, "count" },
+    { "z_lookupdiversifiedaddresses", 0, "addresses" },
     { "z_getoperationresult", 0, "operationid" },
     { "z_getoperationstatus", 0, "operationid" },
     { "z_sendmany", 1, "amounts" },
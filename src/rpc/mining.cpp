@@ -11,7 +11,6 @@
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
-#include <crypto/equihash.h>
 #include <key_io.h>
 #include <miner.h>
 #include <net.h>
@@ -111,7 +110,7 @@ static UniValue getnetworkhashps(const JSONRPCRequest& request)
 static UniValue getlocalsolps(const JSONRPCRequest& request)
 {
             RPCHelpMan{"getlocalsolps",
-                "\nReturns the average local solutions per second since this node was started.\n"
+                "\nReturns the average local solutions per second while mining since this node was started.\n"
                 "This is the same information shown on the metrics screen (if enabled).\n",
                 { },
                 RPCResult{
@@ -123,8 +122,7 @@ static UniValue getlocalsolps(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(cs_main);
-    return 0;
+    return GetLocalSolPS();
 }
 
 static UniValue getnetworksolps(const JSONRPCRequest& request)
@@ -152,9 +150,6 @@ static UniValue getnetworksolps(const JSONRPCRequest& request)
 
 static UniValue generateBlocks(const CScript& coinbase_script, int nGenerate, uint64_t nMaxTries)
 {
-    static const int nInnerLoopCount = 0xFFFF;
-    static const int nInnerLoopMask = 0xFFFF;
-
     int nHeightEnd = 0;
     int nHeight = 0;
 
@@ -165,61 +160,26 @@ static UniValue generateBlocks(const CScript& coinbase_script, int nGenerate, ui
     }
     unsigned int nExtraNonce = 0;
     UniValue blockHashes(UniValue::VARR);
-    unsigned int n;
-    unsigned int k;
+    const int nThreads = GetSolverThreads();
 
     while (nHeight < nHeightEnd && !ShutdownRequested())
     {
-        n = Params().GetConsensus().EquihashN(nHeight + 1);
-        k = Params().GetConsensus().EquihashK(nHeight + 1);
-
         std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbase_script));
         if (!pblocktemplate.get())
             throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't create new block");
         CBlock *pblock = &pblocktemplate->block;
+        int nBlockHeight;
         {
             LOCK(cs_main);
             IncrementExtraNonce(pblock, ::ChainActive().Tip(), nExtraNonce);
+            nBlockHeight = ::ChainActive().Height() + 1;
         }
 
-        crypto_generichash_blake2b_state eh_state;
-        EhInitialiseState(n, k, eh_state);
-
-        // I = the block header minus nonce and solution.
-        CEquihashInput I{*pblock};
-        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-        ss << I;
-
-        // H(I||...
-        crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
-
-        while (nMaxTries > 0 &&
-               ((int)pblock->nNonce.GetUint64(0) & nInnerLoopMask) < nInnerLoopCount) {
-            // Yes, there is a chance every nonce could fail to satisfy the -regtest
-            // target -- 1 in 2^(2^256). That ain't gonna happen
-            pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) + 1);
-
-            // H(I||V||...
-            crypto_generichash_blake2b_state curr_state;
-            curr_state = eh_state;
-            crypto_generichash_blake2b_update(&curr_state, pblock->nNonce.begin(), pblock->nNonce.size());
-
-            // (x_1, x_2, ...) = A(I, V, n, k)
-            std::function<bool(std::vector<unsigned char>)> validBlock =
-                    [&pblock](std::vector<unsigned char> soln) {
-                pblock->nSolution = soln;
-                return CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus());
-            };
-            bool found = EhBasicSolveUncancellable(n, k, curr_state, validBlock);
-            --nMaxTries;
-            if (found) {
+        if (!SolveBlock(*pblock, nBlockHeight, nThreads, nMaxTries, [] { return ShutdownRequested(); })) {
+            if (nMaxTries == 0 || ShutdownRequested()) {
                 break;
             }
-        }
-        if (nMaxTries == 0 || ShutdownRequested()) {
-            break;
-        }
-        if (((int)pblock->nNonce.GetUint64(0) & nInnerLoopMask) == nInnerLoopCount) {
+            // The nonces ran out or the tip changed: start over on a new template
             continue;
         }
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
@@ -278,7 +238,11 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
                     "  \"currentblockweight\": nnn, (numeric, optional) The block weight of the last assembled block (only present if a block was ever assembled)\n"
                     "  \"currentblocktx\": nnn,     (numeric, optional) The number of block transactions of the last assembled block (only present if a block was ever assembled)\n"
                     "  \"difficulty\": xxx.xxxxx,   (numeric) The current difficulty\n"
-                    "  \"localsolps\": nnn,         (numeric) The average local solution rate in Sol/s since this node was started\n"
+                    "  \"generate\": true|false,    (boolean) If the built-in miner is running (see -gen)\n"
+                    "  \"genproclimit\": n,         (numeric) The number of Equihash solver threads used for mining (see -genproclimit)\n"
+                    "  \"equihashsolver\": \"xxxx\",  (string) The Equihash solver used for mining (see -equihashsolver)\n"
+                    "  \"solverpeakmemory\": n,     (numeric) The largest memory use of the arena solver in a thread, in bytes\n"
+                    "  \"localsolps\": nnn,         (numeric) The average local solution rate in Sol/s while mining since this node was started\n"
                     "  \"networksolps\": nnn,       (numeric) The estimated network solution rate in Sol/s\n"
                     "  \"networkhashps\": nnn,      (numeric) Left for backwards-compatibility. Use networksolps instead.\n"
                     "  \"pooledtx\": n,             (numeric) The size of the mempool\n"
@@ -299,6 +263,10 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
     if (BlockAssembler::m_last_block_weight) obj.pushKV("currentblockweight", *BlockAssembler::m_last_block_weight);
     if (BlockAssembler::m_last_block_num_txs) obj.pushKV("currentblocktx", *BlockAssembler::m_last_block_num_txs);
     obj.pushKV("difficulty",       (double)GetDifficulty(::ChainActive().Tip(), true));
+    obj.pushKV("generate",         IsMining());
+    obj.pushKV("genproclimit",     GetSolverThreads());
+    obj.pushKV("equihashsolver",   GetEquihashSolver(::ChainActive().Height() + 1));
+    obj.pushKV("solverpeakmemory", (uint64_t)GetSolverPeakMemory());
     obj.pushKV("localsolps",       getlocalsolps(request));
     obj.pushKV("networksolps",     getnetworksolps(request));
     obj.pushKV("networkhashps",    getnetworkhashps(request));
@@ -9,6 +9,8 @@
 #include <crypto/ripemd160.h>
 #include <key_io.h>
 #include <httpserver.h>
+#include <index/addressindex.h>
+#include <index/spentindex.h>
 #include <net.h>
 #include <netbase.h>
 #include <outputtype.h>
@@ -757,6 +759,10 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    if (g_addressindex) {
+        g_addressindex->BlockUntilSyncedToCurrentChain();
+    }
+
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -860,6 +866,10 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    if (g_addressindex) {
+        g_addressindex->BlockUntilSyncedToCurrentChain();
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -953,6 +963,10 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    if (g_addressindex) {
+        g_addressindex->BlockUntilSyncedToCurrentChain();
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -1010,6 +1024,10 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    if (g_addressindex) {
+        g_addressindex->BlockUntilSyncedToCurrentChain();
+    }
+
     int start = 0;
     int end = 0;
     if (request.params[0].isObject()) {
@@ -1096,6 +1114,10 @@ UniValue getspentinfo(const JSONRPCRequest& request)
     CSpentIndexKey key(txid, outputIndex);
     CSpentIndexValue value;
 
+    if (g_spentindex) {
+        g_spentindex->BlockUntilSyncedToCurrentChain();
+    }
+
     {
         LOCK(cs_main);
         if (!GetSpentIndex(key, value)) {
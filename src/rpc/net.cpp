@@ -109,6 +109,17 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"cmpctblocks\": {          (json object) Reconstruction of the compact blocks downloaded from the peer\n"
+            "       \"blocks\": n,               (numeric) The number of compact blocks we started to reconstruct\n"
+            "       \"reconstructed\": n,        (numeric) The number of blocks reconstructed without requesting transactions\n"
+            "       \"roundtrips\": n,           (numeric) The number of blocks for which missing transactions were requested\n"
+            "       \"failed\": n,               (numeric) The number of blocks for which the full block was requested instead\n"
+            "       \"prefilledtxn\": n,         (numeric) The number of transactions prefilled by the peer\n"
+            "       \"mempooltxn\": n,           (numeric) The number of transactions found in our mempool\n"
+            "       \"requestedtxn\": n,         (numeric) The number of transactions requested from the peer\n"
+            "       \"requestedshieldedtxn\": n, (numeric) The number of shielded transactions among the requested ones\n"
+            "       \"requestedshieldedbytes\": n, (numeric) The size of these shielded transactions\n"
+            "    },\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"minfeefilter\": n,         (numeric) The minimum fee rate for transactions this peer accepts\n"
             "    \"bytessent_per_msg\": {\n"
@@ -186,6 +197,17 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            UniValue cmpctblocks(UniValue::VOBJ);
+            cmpctblocks.pushKV("blocks", statestats.cmpctblock.nBlocks);
+            cmpctblocks.pushKV("reconstructed", statestats.cmpctblock.nReconstructed);
+            cmpctblocks.pushKV("roundtrips", statestats.cmpctblock.nRoundTrips);
+            cmpctblocks.pushKV("failed", statestats.cmpctblock.nFailed);
+            cmpctblocks.pushKV("prefilledtxn", statestats.cmpctblock.nTxPrefilled);
+            cmpctblocks.pushKV("mempooltxn", statestats.cmpctblock.nTxMempool);
+            cmpctblocks.pushKV("requestedtxn", statestats.cmpctblock.nTxRequested);
+            cmpctblocks.pushKV("requestedshieldedtxn", statestats.cmpctblock.nShieldedTxRequested);
+            cmpctblocks.pushKV("requestedshieldedbytes", statestats.cmpctblock.nShieldedBytesRequested);
+            obj.pushKV("cmpctblocks", cmpctblocks);
         }
         obj.pushKV("whitelisted", stats.m_legacyWhitelisted);
         UniValue permissions(UniValue::VARR);
@@ -72,6 +72,22 @@ extern "C" {
         unsigned char *result
     );
 
+    /// Computes the merkle tree hashes of `pairs_len` pairs of nodes at a
+    /// given depth, in a single call. The `depth` parameter should not be
+    /// larger than 62.
+    ///
+    /// `pairs` must be of length `64 * pairs_len`, each pair being the
+    /// concatenation of the `a` and `b` scalars of `librustzcash_merkle_hash`.
+    ///
+    /// The results are placed in `results`, which must be of length
+    /// `32 * pairs_len`.
+    void librustzcash_merkle_hash_batch(
+        size_t depth,
+        const unsigned char *pairs,
+        size_t pairs_len,
+        unsigned char *results
+    );
+
     /// Computes the signature for each Spend description, given the key
     /// `ask`, the re-randomization `ar`, the 32-byte sighash `sighash`,
     /// and an output `result` buffer of 64-bytes for the signature.
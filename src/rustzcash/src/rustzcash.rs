@@ -273,6 +273,42 @@ pub extern "C" fn librustzcash_merkle_hash(
     tmp.write_le(&mut result[..]).expect("length is 32 bytes");
 }
 
+/// Computes the merkle tree hashes of `pairs_len` pairs of nodes at a given
+/// depth. The `depth` parameter should not be larger than 62.
+///
+/// `pairs` must be of length `64 * pairs_len`, each pair being the
+/// concatenation of two scalars of BLS12-381 `a` and `b` as in
+/// `librustzcash_merkle_hash`.
+///
+/// The results are placed in `results`, which must be of length
+/// `32 * pairs_len`.
+#[no_mangle]
+pub extern "C" fn librustzcash_merkle_hash_batch(
+    depth: size_t,
+    pairs: *const [c_uchar; 64],
+    pairs_len: size_t,
+    results: *mut [c_uchar; 32],
+) {
+    if pairs_len == 0 {
+        return;
+    }
+
+    // Should be okay, because caller is responsible for ensuring the
+    // pointers are valid pointers to pairs_len pairs and results.
+    let pairs = unsafe { slice::from_raw_parts(pairs, pairs_len) };
+    let results = unsafe { slice::from_raw_parts_mut(results, pairs_len) };
+
+    for (pair, result) in pairs.iter().zip(results.iter_mut()) {
+        let mut a_repr = FrRepr::default();
+        a_repr.read_le(&pair[..32]).expect("length is 32 bytes");
+        let mut b_repr = FrRepr::default();
+        b_repr.read_le(&pair[32..]).expect("length is 32 bytes");
+
+        let tmp = merkle_hash(depth, &a_repr, &b_repr);
+        tmp.write_le(&mut result[..]).expect("length is 32 bytes");
+    }
+}
+
 #[no_mangle] // ToScalar
 pub extern "C" fn librustzcash_to_scalar(input: *const [c_uchar; 64], result: *mut [c_uchar; 32]) {
     // Should be okay, because caller is responsible for ensuring
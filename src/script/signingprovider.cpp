@@ -305,12 +305,18 @@ bool FillableSigningProvider::GetSaplingSpendingKey(const libzcash::SaplingExten
 }
 
 bool FillableSigningProvider::AddSaplingFullViewingKey(const libzcash::SaplingExtendedFullViewingKey &extfvk)
+{
+    return FillableSigningProvider::AddSaplingFullViewingKey(extfvk, extfvk.fvk.in_viewing_key(), extfvk.DefaultAddress());
+}
+
+bool FillableSigningProvider::AddSaplingFullViewingKey(const libzcash::SaplingExtendedFullViewingKey &extfvk,
+                                                       const libzcash::SaplingIncomingViewingKey &ivk,
+                                                       const libzcash::SaplingPaymentAddress &defaultAddr)
 {
     LOCK(cs_KeyStore);
-    auto ivk = extfvk.fvk.in_viewing_key();
     mapSaplingFullViewingKeys[ivk] = extfvk;
 
-    return FillableSigningProvider::AddSaplingIncomingViewingKey(ivk, extfvk.DefaultAddress());
+    return FillableSigningProvider::AddSaplingIncomingViewingKey(ivk, defaultAddr);
 }
 
 bool FillableSigningProvider::HaveSaplingFullViewingKey(const libzcash::SaplingIncomingViewingKey &ivk) const
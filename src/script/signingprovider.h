@@ -170,6 +170,10 @@ public:
 
     //! Support for Sapling full viewing keys
     virtual bool AddSaplingFullViewingKey(const libzcash::SaplingExtendedFullViewingKey &extfvk) override;
+    //! Add a Sapling full viewing key whose incoming viewing key and default address are already computed
+    bool AddSaplingFullViewingKey(const libzcash::SaplingExtendedFullViewingKey &extfvk,
+                                  const libzcash::SaplingIncomingViewingKey &ivk,
+                                  const libzcash::SaplingPaymentAddress &defaultAddr);
     virtual bool HaveSaplingFullViewingKey(const libzcash::SaplingIncomingViewingKey &ivk) const override;
     virtual bool GetSaplingFullViewingKey(const libzcash::SaplingIncomingViewingKey &ivk, libzcash::SaplingExtendedFullViewingKey& extfvkOut) const override;
 
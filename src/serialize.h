@@ -957,12 +957,10 @@ void Unserialize(Stream& is, std::list<T, A>& l)
 {
     l.clear();
     unsigned int nSize = ReadCompactSize(is);
-    typename std::list<T, A>::iterator it = l.begin();
     for (unsigned int i = 0; i < nSize; i++)
     {
-        T item;
-        Unserialize(is, item);
-        it = l.insert(it, item);
+        l.emplace_back();
+        Unserialize(is, l.back());
     }
 }
 
@@ -0,0 +1,335 @@
+// Copyright (c) 2017-2019 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/addressindex.h>
+#include <index/spentindex.h>
+#include <index/timestampindex.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+#include <test/setup_common.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+static void WaitForIndexSync(BaseIndex& index)
+{
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+}
+
+static CMutableTransaction CreateSpend(const CTransaction& prev_tx, const CScript& prev_script, const CKey& key,
+                                       const CScript& script_pub_key)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = prev_tx.GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = prev_tx.vout[0].nValue - CENT;
+    tx.vout[0].scriptPubKey = script_pub_key;
+
+    // Sign, adding the public key for pay-to-pubkey-hash outputs.
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(prev_script, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE, 0);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    if (prev_script.GetType() != CScript::UNKNOWN) {
+        tx.vin[0].scriptSig << ToByteVector(key.GetPubKey());
+    }
+    return tx;
+}
+
+static void InvalidateBlockByHash(const uint256& hash)
+{
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(hash);
+    }
+    BOOST_REQUIRE(pindex != nullptr);
+    CValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), pindex));
+}
+
+BOOST_FIXTURE_TEST_CASE(addressindex_initial_sync, TestChain100Setup)
+{
+    AddressIndex addressindex(1 << 20, true);
+
+    CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    const int type = coinbase_script_pub_key.GetType();
+    const uint160 address_hash = coinbase_script_pub_key.AddressHash();
+    BOOST_REQUIRE(type != CScript::UNKNOWN);
+
+    // BlockUntilSyncedToCurrentChain should return false before addressindex is started.
+    BOOST_CHECK(!addressindex.BlockUntilSyncedToCurrentChain());
+
+    addressindex.Start();
+
+    // Allow address index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!addressindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // The chain was mined to a pay-to-pubkey script, so nothing is indexed for the address yet.
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspent_outputs;
+    std::vector<std::pair<CAddressIndexKey, CAmount>> address_index;
+    BOOST_CHECK(addressindex.FindAddressUnspent(address_hash, type, unspent_outputs));
+    BOOST_CHECK(unspent_outputs.empty());
+
+    // Check that outputs of new blocks make it into the index.
+    for (int i = 0; i < 10; i++) {
+        std::vector<CMutableTransaction> no_txns;
+        const CBlock& block = CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+        const CTransaction& txn = *block.vtx[0];
+
+        BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+
+        unspent_outputs.clear();
+        BOOST_CHECK(addressindex.FindAddressUnspent(address_hash, type, unspent_outputs));
+        BOOST_CHECK_EQUAL(unspent_outputs.size(), (size_t)i + 1);
+        bool found = false;
+        for (const auto& entry : unspent_outputs) {
+            if (entry.first.txhash == txn.GetHash()) {
+                found = true;
+                BOOST_CHECK_EQUAL(entry.second.satoshis, txn.vout[entry.first.index].nValue);
+                BOOST_CHECK_EQUAL(entry.second.blockHeight, ::ChainActive().Height());
+            }
+        }
+        BOOST_CHECK(found);
+    }
+
+    BOOST_CHECK(addressindex.FindAddressIndex(address_hash, type, address_index));
+    BOOST_CHECK_EQUAL(address_index.size(), 10U);
+    for (const auto& entry : address_index) {
+        BOOST_CHECK(!entry.first.spending);
+        BOOST_CHECK(entry.second > 0);
+    }
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    addressindex.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_FIXTURE_TEST_CASE(addressindex_spentindex_reorg, TestChain100Setup)
+{
+    AddressIndex addressindex(1 << 20, true);
+    SpentIndex spentindex(1 << 20, true);
+    addressindex.Start();
+    spentindex.Start();
+    WaitForIndexSync(addressindex);
+    WaitForIndexSync(spentindex);
+
+    CKey key_a, key_b, key_other;
+    key_a.MakeNewKey(true);
+    key_b.MakeNewKey(true);
+    key_other.MakeNewKey(true);
+
+    // Blocks are mined to pay-to-pubkey scripts, which the address index skips.
+    const CScript coinbase_script = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CScript other_script = CScript() << ToByteVector(key_other.GetPubKey()) << OP_CHECKSIG;
+    const CScript script_a = GetScriptForDestination(PKHash(key_a.GetPubKey()));
+    const CScript script_b = GetScriptForDestination(PKHash(key_b.GetPubKey()));
+    const int type = script_a.GetType();
+    const uint160 hash_a = script_a.AddressHash();
+    const uint160 hash_b = script_b.AddressHash();
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspent_outputs;
+    std::vector<std::pair<CAddressIndexKey, CAmount>> address_index;
+    CSpentIndexValue spent;
+
+    // Spend a mature coinbase to address A.
+    const CTransaction& coinbase_tx = *m_coinbase_txns[0];
+    const CMutableTransaction tx1 = CreateSpend(coinbase_tx, coinbase_script, coinbaseKey, script_a);
+    const CBlock block1 = CreateAndProcessBlock({tx1}, coinbase_script);
+    const int height1 = ::ChainActive().Height();
+    BOOST_REQUIRE(::ChainActive().Tip()->GetBlockHash() == block1.GetHash());
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK(spentindex.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(addressindex.FindAddressUnspent(hash_a, type, unspent_outputs));
+    BOOST_REQUIRE_EQUAL(unspent_outputs.size(), 1U);
+    BOOST_CHECK(unspent_outputs[0].first.txhash == tx1.GetHash());
+    BOOST_CHECK_EQUAL(unspent_outputs[0].second.satoshis, tx1.vout[0].nValue);
+    BOOST_CHECK_EQUAL(unspent_outputs[0].second.blockHeight, height1);
+
+    BOOST_CHECK(spentindex.FindSpent(CSpentIndexKey(coinbase_tx.GetHash(), 0), spent));
+    BOOST_CHECK(spent.txid == tx1.GetHash());
+    BOOST_CHECK_EQUAL(spent.inputIndex, 0U);
+    BOOST_CHECK_EQUAL(spent.blockHeight, height1);
+    BOOST_CHECK_EQUAL(spent.satoshis, coinbase_tx.vout[0].nValue);
+
+    // Spend the output of address A to address B.
+    const CMutableTransaction tx2 = CreateSpend(CTransaction(tx1), script_a, key_a, script_b);
+    const CBlock block2 = CreateAndProcessBlock({tx2}, coinbase_script);
+    const int height2 = ::ChainActive().Height();
+    BOOST_REQUIRE(::ChainActive().Tip()->GetBlockHash() == block2.GetHash());
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK(spentindex.BlockUntilSyncedToCurrentChain());
+
+    unspent_outputs.clear();
+    BOOST_CHECK(addressindex.FindAddressUnspent(hash_a, type, unspent_outputs));
+    BOOST_CHECK(unspent_outputs.empty());
+    BOOST_CHECK(addressindex.FindAddressIndex(hash_a, type, address_index));
+    BOOST_REQUIRE_EQUAL(address_index.size(), 2U);
+    BOOST_CHECK(!address_index[0].first.spending);
+    BOOST_CHECK_EQUAL(address_index[0].second, tx1.vout[0].nValue);
+    BOOST_CHECK(address_index[1].first.spending);
+    BOOST_CHECK_EQUAL(address_index[1].first.blockHeight, height2);
+    BOOST_CHECK_EQUAL(address_index[1].second, -tx1.vout[0].nValue);
+
+    unspent_outputs.clear();
+    BOOST_CHECK(addressindex.FindAddressUnspent(hash_b, type, unspent_outputs));
+    BOOST_CHECK_EQUAL(unspent_outputs.size(), 1U);
+
+    BOOST_CHECK(spentindex.FindSpent(CSpentIndexKey(tx1.GetHash(), 0), spent));
+    BOOST_CHECK(spent.txid == tx2.GetHash());
+    BOOST_CHECK_EQUAL(spent.blockHeight, height2);
+    BOOST_CHECK_EQUAL(spent.satoshis, tx1.vout[0].nValue);
+    BOOST_CHECK_EQUAL(spent.addressType, type);
+    BOOST_CHECK(spent.addressHash == hash_a);
+
+    // Replace the second block. Connecting the replacement rewinds the
+    // indexes: the output of address A is unspent again and B is forgotten.
+    InvalidateBlockByHash(block2.GetHash());
+    CreateAndProcessBlock({}, other_script);
+    BOOST_REQUIRE_EQUAL(::ChainActive().Height(), height2);
+    BOOST_REQUIRE(::ChainActive().Tip()->GetBlockHash() != block2.GetHash());
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK(spentindex.BlockUntilSyncedToCurrentChain());
+
+    unspent_outputs.clear();
+    BOOST_CHECK(addressindex.FindAddressUnspent(hash_a, type, unspent_outputs));
+    BOOST_REQUIRE_EQUAL(unspent_outputs.size(), 1U);
+    BOOST_CHECK(unspent_outputs[0].first.txhash == tx1.GetHash());
+    BOOST_CHECK_EQUAL(unspent_outputs[0].second.satoshis, tx1.vout[0].nValue);
+    BOOST_CHECK_EQUAL(unspent_outputs[0].second.blockHeight, height1);
+    BOOST_CHECK(unspent_outputs[0].second.script == script_a);
+    address_index.clear();
+    BOOST_CHECK(addressindex.FindAddressIndex(hash_a, type, address_index));
+    BOOST_REQUIRE_EQUAL(address_index.size(), 1U);
+    BOOST_CHECK(!address_index[0].first.spending);
+
+    unspent_outputs.clear();
+    address_index.clear();
+    BOOST_CHECK(addressindex.FindAddressUnspent(hash_b, type, unspent_outputs));
+    BOOST_CHECK(unspent_outputs.empty());
+    BOOST_CHECK(addressindex.FindAddressIndex(hash_b, type, address_index));
+    BOOST_CHECK(address_index.empty());
+
+    BOOST_CHECK(!spentindex.FindSpent(CSpentIndexKey(tx1.GetHash(), 0), spent));
+    BOOST_CHECK(spentindex.FindSpent(CSpentIndexKey(coinbase_tx.GetHash(), 0), spent));
+
+    // Replace both blocks with a longer chain, rewinding more than one block.
+    InvalidateBlockByHash(block1.GetHash());
+    for (int i = 0; i < 3; i++) {
+        CreateAndProcessBlock({}, other_script);
+    }
+    BOOST_REQUIRE_EQUAL(::ChainActive().Height(), height2 + 1);
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK(spentindex.BlockUntilSyncedToCurrentChain());
+
+    unspent_outputs.clear();
+    address_index.clear();
+    BOOST_CHECK(addressindex.FindAddressUnspent(hash_a, type, unspent_outputs));
+    BOOST_CHECK(unspent_outputs.empty());
+    BOOST_CHECK(addressindex.FindAddressIndex(hash_a, type, address_index));
+    BOOST_CHECK(address_index.empty());
+    BOOST_CHECK(!spentindex.FindSpent(CSpentIndexKey(coinbase_tx.GetHash(), 0), spent));
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    addressindex.Stop();
+    spentindex.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_FIXTURE_TEST_CASE(timestampindex_ranges_and_reorg, TestChain100Setup)
+{
+    TimestampIndex timestampindex(1 << 20, true);
+    timestampindex.Start();
+    WaitForIndexSync(timestampindex);
+
+    const unsigned int max_timestamp = std::numeric_limits<unsigned int>::max();
+
+    // Every block but genesis is indexed in chain order, with strictly
+    // increasing logical timestamps no earlier than the block time.
+    std::vector<std::pair<uint256, unsigned int>> hashes;
+    BOOST_CHECK(timestampindex.FindBlockHashes(max_timestamp, 0, true, hashes));
+    BOOST_REQUIRE_EQUAL(hashes.size(), 100U);
+    for (size_t i = 0; i < hashes.size(); i++) {
+        const CBlockIndex* pindex = ::ChainActive()[i + 1];
+        BOOST_CHECK(hashes[i].first == pindex->GetBlockHash());
+        BOOST_CHECK(hashes[i].second >= pindex->nTime);
+        if (i > 0) BOOST_CHECK(hashes[i].second > hashes[i - 1].second);
+    }
+
+    // The range is inclusive at the low end and exclusive at the high end.
+    std::vector<std::pair<uint256, unsigned int>> range;
+    BOOST_CHECK(timestampindex.FindBlockHashes(hashes[59].second, hashes[49].second, true, range));
+    BOOST_REQUIRE_EQUAL(range.size(), 10U);
+    BOOST_CHECK(range.front() == hashes[49]);
+    BOOST_CHECK(range.back() == hashes[58]);
+
+    range.clear();
+    BOOST_CHECK(timestampindex.FindBlockHashes(hashes[10].second, hashes[10].second, true, range));
+    BOOST_CHECK(range.empty());
+
+    // Replace the tip. The stale block is kept in the index but is only
+    // returned when blocks off the active chain are asked for.
+    const uint256 stale_hash = ::ChainActive().Tip()->GetBlockHash();
+    InvalidateBlockByHash(stale_hash);
+    CKey key_other;
+    key_other.MakeNewKey(true);
+    const CScript other_script = CScript() << ToByteVector(key_other.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 2; i++) {
+        CreateAndProcessBlock({}, other_script);
+    }
+    BOOST_CHECK(timestampindex.BlockUntilSyncedToCurrentChain());
+
+    auto contains_stale = [&stale_hash](const std::vector<std::pair<uint256, unsigned int>>& v) {
+        return std::any_of(v.begin(), v.end(), [&stale_hash](const std::pair<uint256, unsigned int>& entry) {
+            return entry.first == stale_hash;
+        });
+    };
+
+    hashes.clear();
+    BOOST_CHECK(timestampindex.FindBlockHashes(max_timestamp, 0, true, hashes));
+    BOOST_CHECK_EQUAL(hashes.size(), 101U);
+    BOOST_CHECK(!contains_stale(hashes));
+    BOOST_CHECK(hashes.back().first == ::ChainActive().Tip()->GetBlockHash());
+
+    hashes.clear();
+    BOOST_CHECK(timestampindex.FindBlockHashes(max_timestamp, 0, false, hashes));
+    BOOST_CHECK_EQUAL(hashes.size(), 102U);
+    BOOST_CHECK(contains_stale(hashes));
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    timestampindex.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
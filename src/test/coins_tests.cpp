@@ -5,10 +5,14 @@
 
 #include <attributes.h>
 #include <clientversion.h>
+#include <chainparams.h>
 #include <coins.h>
+#include <hash.h>
+#include <node/coinstats.h>
 #include <script/standard.h>
 #include <streams.h>
 #include <test/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
 #include <undo.h>
 #include <util/strencodings.h>
@@ -877,4 +881,94 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+//! The UTXO set statistics of view computed by walking it with a single cursor
+static CCoinsStats SequentialUTXOStats(CCoinsView& view)
+{
+    CCoinsStats stats;
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << pcursor->GetBestBlock();
+
+    auto apply = [&](const uint256& hash, const std::map<uint32_t, Coin>& outputs) {
+        ss << hash;
+        ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
+        stats.nTransactions++;
+        for (const auto& output : outputs) {
+            ss << VARINT(output.first + 1);
+            ss << output.second.out.scriptPubKey;
+            ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+            stats.nTransactionOutputs++;
+            stats.nTotalAmount += output.second.out.nValue;
+            stats.nBogoSize += 32 + 4 + 4 + 8 + 2 + output.second.out.scriptPubKey.size();
+        }
+        ss << VARINT(0u);
+    };
+
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        COutPoint key;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        if (!outputs.empty() && key.hash != prevkey) {
+            apply(prevkey, outputs);
+            outputs.clear();
+        }
+        prevkey = key.hash;
+        outputs[key.n] = std::move(coin);
+    }
+    if (!outputs.empty()) {
+        apply(prevkey, outputs);
+    }
+    stats.hashSerialized = ss.GetHash();
+    return stats;
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstats_parallel_walk, TestingSetup)
+{
+    CCoinsViewDB db(GetDataDir() / "coinstats", 1 << 23, true, false);
+    CCoinsViewCache cache(&db);
+
+    // Transactions under nearly every first txid byte, including the first
+    // and the last, with none under 0x42.
+    std::vector<uint256> txids;
+    for (int i = 0; i < 1000; i++) {
+        txids.push_back(InsecureRand256());
+    }
+    for (unsigned char prefix : {0x00, 0x7f, 0x80, 0xff}) {
+        for (int i = 0; i < 3; i++) {
+            uint256 txid = InsecureRand256();
+            *txid.begin() = prefix;
+            txids.push_back(txid);
+        }
+    }
+    for (uint256& txid : txids) {
+        if (*txid.begin() == 0x42) *txid.begin() = 0x43;
+    }
+    for (const uint256& txid : txids) {
+        const int n_outputs = 1 + InsecureRandRange(4);
+        const uint32_t height = InsecureRandRange(1000);
+        const bool coinbase = InsecureRandBool();
+        for (int n = 0; n < n_outputs; n++) {
+            CTxOut out(InsecureRandRange(MAX_MONEY / 10000), CScript() << ToByteVector(InsecureRand256()));
+            cache.AddCoin(COutPoint(txid, InsecureRandRange(16)), Coin(std::move(out), height, coinbase), true);
+        }
+    }
+    cache.SetBestBlock(Params().GenesisBlock().GetHash());
+    BOOST_REQUIRE(cache.Flush());
+
+    const CCoinsStats expected = SequentialUTXOStats(db);
+    BOOST_CHECK_GE(expected.nTransactions, 1000U);
+
+    CCoinsStats stats;
+    BOOST_REQUIRE(GetUTXOStats(&db, stats));
+    BOOST_CHECK_EQUAL(stats.hashBlock, Params().GenesisBlock().GetHash());
+    BOOST_CHECK_EQUAL(stats.hashSerialized, expected.hashSerialized);
+    BOOST_CHECK_EQUAL(stats.nTransactions, expected.nTransactions);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, expected.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, expected.nTotalAmount);
+    BOOST_CHECK_EQUAL(stats.nBogoSize, expected.nBogoSize);
+    BOOST_CHECK(!stats.fShielded);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
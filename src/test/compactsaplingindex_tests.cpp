@@ -0,0 +1,183 @@
+// Copyright (c) 2017-2019 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/compactsaplingindex.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <test/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(compactsaplingindex_tests)
+
+static void CheckCompactBlock(const CompactSaplingBlock& compact_block, const CBlockIndex* block_index)
+{
+    BOOST_CHECK_EQUAL(compact_block.height, block_index->nHeight);
+    BOOST_CHECK_EQUAL(compact_block.hash, block_index->GetBlockHash());
+    BOOST_CHECK_EQUAL(compact_block.prevHash, block_index->pprev ? block_index->pprev->GetBlockHash() : uint256());
+    BOOST_CHECK_EQUAL(compact_block.time, block_index->nTime);
+}
+
+static void CheckRangeLookups(CompactSaplingIndex& index, int start_height, const CBlockIndex* stop_index)
+{
+    std::vector<CompactSaplingBlock> blocks;
+    std::vector<unsigned char> raw;
+    BOOST_REQUIRE(index.LookupRange(start_height, stop_index, blocks));
+    BOOST_REQUIRE(index.LookupRawRange(start_height, stop_index, raw));
+    BOOST_REQUIRE_EQUAL(blocks.size(), static_cast<size_t>(stop_index->nHeight - start_height + 1));
+
+    const CBlockIndex* block_index = stop_index;
+    for (size_t i = blocks.size(); i-- > 0; block_index = block_index->pprev) {
+        CheckCompactBlock(blocks[i], block_index);
+
+        CompactSaplingBlock block;
+        BOOST_CHECK(index.LookupBlock(block_index, block));
+        BOOST_CHECK_EQUAL(block.hash, blocks[i].hash);
+    }
+
+    // The raw range is the concatenation of the serialized records.
+    CDataStream expected(SER_DISK, CLIENT_VERSION);
+    for (const auto& block : blocks) {
+        expected << block;
+    }
+    BOOST_CHECK(std::vector<unsigned char>(expected.begin(), expected.end()) == raw);
+}
+
+static void InvalidateBlockByHash(const uint256& hash)
+{
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(hash);
+    }
+    BOOST_REQUIRE(pindex != nullptr);
+    CValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), pindex));
+}
+
+BOOST_FIXTURE_TEST_CASE(compactsaplingindex_initial_sync, TestChain100Setup)
+{
+    CompactSaplingIndex index(1 << 20, true);
+
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = ::ChainActive().Tip();
+    }
+
+    // Compact blocks should not be found in the index before it is started.
+    CompactSaplingBlock compact_block;
+    BOOST_CHECK(!index.LookupBlock(tip, compact_block));
+
+    // BlockUntilSyncedToCurrentChain should return false before index is started.
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Check that the index has all blocks that were in the chain before it started.
+    // None of them have Sapling transactions.
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* block_index = ::ChainActive().Genesis();
+             block_index != nullptr;
+             block_index = ::ChainActive().Next(block_index)) {
+            BOOST_CHECK(index.LookupBlock(block_index, compact_block));
+            CheckCompactBlock(compact_block, block_index);
+            BOOST_CHECK(compact_block.vtx.empty());
+        }
+    }
+    CheckRangeLookups(index, 0, tip);
+
+    // Replace the last two blocks with a longer fork.
+    const CBlockIndex* stale_tip = tip;
+    InvalidateBlockByHash(tip->pprev->GetBlockHash());
+    CKey coinbase_key;
+    coinbase_key.MakeNewKey(true);
+    const CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbase_key.GetPubKey()));
+    for (int i = 0; i < 3; i++) {
+        CreateAndProcessBlock({}, coinbase_script_pub_key);
+    }
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+    {
+        LOCK(cs_main);
+        tip = ::ChainActive().Tip();
+    }
+    BOOST_REQUIRE_EQUAL(tip->nHeight, stale_tip->nHeight + 1);
+
+    // Both the new chain and the stale blocks can be retrieved, including ranges
+    // whose records are spread over the flat file.
+    CheckRangeLookups(index, 0, tip);
+    CheckRangeLookups(index, 0, stale_tip);
+    CheckRangeLookups(index, stale_tip->nHeight - 1, stale_tip);
+    CheckRangeLookups(index, stale_tip->nHeight - 1, tip);
+
+    // Blocks with Sapling transactions cannot be mined in this test, so the
+    // connection of one is signalled to the index directly.
+    CMutableTransaction mtx;
+    mtx.vShieldedSpend.resize(2);
+    for (auto& spend : mtx.vShieldedSpend) {
+        spend.nullifier = GetRandHash();
+    }
+    mtx.vShieldedOutput.resize(3);
+    for (auto& output : mtx.vShieldedOutput) {
+        output.cm = GetRandHash();
+        output.ephemeralKey = GetRandHash();
+        GetRandBytes(output.encCiphertext.data(), output.encCiphertext.size());
+    }
+    auto block = std::make_shared<CBlock>();
+    block->vtx.push_back(MakeTransactionRef(CMutableTransaction()));
+    block->vtx.push_back(MakeTransactionRef(mtx));
+    block->hashPrevBlock = tip->GetBlockHash();
+    block->nTime = tip->nTime + 1;
+
+    const uint256 block_hash = block->GetHash();
+    CBlockIndex block_index(*block);
+    block_index.phashBlock = &block_hash;
+    block_index.pprev = const_cast<CBlockIndex*>(tip);
+    block_index.nHeight = tip->nHeight + 1;
+    block_index.BuildSkip();
+
+    GetMainSignals().BlockConnected(block, &block_index, std::make_shared<const std::vector<CTransactionRef>>());
+    SyncWithValidationInterfaceQueue();
+
+    BOOST_REQUIRE(index.LookupBlock(&block_index, compact_block));
+    CheckCompactBlock(compact_block, &block_index);
+    BOOST_REQUIRE_EQUAL(compact_block.vtx.size(), 1U);
+    const CompactSaplingTx& ctx = compact_block.vtx[0];
+    BOOST_CHECK_EQUAL(ctx.index, 1U);
+    BOOST_CHECK_EQUAL(ctx.txid, block->vtx[1]->GetHash());
+    BOOST_REQUIRE_EQUAL(ctx.spends.size(), mtx.vShieldedSpend.size());
+    for (size_t i = 0; i < ctx.spends.size(); i++) {
+        BOOST_CHECK_EQUAL(ctx.spends[i].nullifier, mtx.vShieldedSpend[i].nullifier);
+    }
+    BOOST_REQUIRE_EQUAL(ctx.outputs.size(), mtx.vShieldedOutput.size());
+    for (size_t i = 0; i < ctx.outputs.size(); i++) {
+        const OutputDescription& output = mtx.vShieldedOutput[i];
+        BOOST_CHECK_EQUAL(ctx.outputs[i].cmu, output.cm);
+        BOOST_CHECK_EQUAL(ctx.outputs[i].ephemeralKey, output.ephemeralKey);
+        BOOST_CHECK(std::equal(ctx.outputs[i].ciphertext.begin(), ctx.outputs[i].ciphertext.end(),
+                               output.encCiphertext.begin()));
+    }
+    CheckRangeLookups(index, tip->nHeight, &block_index);
+
+    index.Interrupt();
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
 #include <crypto/chacha_poly_aead.h>
+#include <crypto/equihash.h>
 #include <crypto/poly1305.h>
 #include <crypto/hkdf_sha256_32.h>
 #include <crypto/hmac_sha256.h>
@@ -17,6 +18,7 @@
 #include <util/strencodings.h>
 #include <test/setup_common.h>
 
+#include <set>
 #include <vector>
 
 #include <boost/test/unit_test.hpp>
@@ -749,4 +751,57 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(equihash_arena_size)
+{
+    // 144,5: 24 collision bits, 2^25 + 2^23 + 1024 rows per round and 18-byte hashes
+    BOOST_CHECK_EQUAL((Equihash<144,5>::ArenaRows), 41944064U);
+    // Pairs of the 4 first rounds, bucket boundaries, row order and two tables of hashes
+    const uint64_t rows = Equihash<144,5>::ArenaRows;
+    BOOST_CHECK_EQUAL(4 * (2 * 4 * rows + (1 << 24) + rows) + 2 * rows * 18, 3087081472U);
+    BOOST_CHECK_EQUAL(EhArenaSize(144, 5), 3087081472U);
+    BOOST_CHECK_EQUAL(EhArenaSize(200, 9), 339869696U);
+    BOOST_CHECK_EQUAL(EhArenaSize(48, 5), (Equihash<48,5>::ArenaSize));
+    BOOST_CHECK_THROW(EhArenaSize(144, 4), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(equihash_arena_solve)
+{
+    // The arena solver finds the same solutions as the basic solver, reusing its arena
+    const unsigned int n = 48, k = 5;
+    const size_t arena_size = Equihash<48,5>::ArenaSize;
+    EhSolverArena arena;
+    for (unsigned char nonce = 0; nonce < 20; nonce++) {
+        crypto_generichash_blake2b_state eh_state;
+        EhInitialiseState(n, k, eh_state);
+        const std::vector<unsigned char> input(140, nonce);
+        crypto_generichash_blake2b_update(&eh_state, input.data(), input.size());
+
+        std::set<std::vector<unsigned char>> basic_solns, arena_solns;
+        EhBasicSolveUncancellable(n, k, eh_state, [&](std::vector<unsigned char> soln) {
+            basic_solns.insert(soln);
+            return false;
+        });
+        EhArenaSolveUncancellable(n, k, eh_state, [&](std::vector<unsigned char> soln) {
+            arena_solns.insert(soln);
+            return false;
+        }, arena);
+        BOOST_CHECK(arena_solns == basic_solns);
+        for (const auto& soln : arena_solns) {
+            bool valid;
+            EhIsValidSolution(n, k, eh_state, soln, valid);
+            BOOST_CHECK(valid);
+        }
+        BOOST_CHECK_EQUAL(arena.buffer.size(), arena_size);
+        BOOST_CHECK(arena.nPeakUsage > 0 && arena.nPeakUsage <= arena_size);
+        BOOST_CHECK_EQUAL(arena.nDroppedRows, 0U);
+    }
+
+    // A cancelled run stops at the first check
+    crypto_generichash_blake2b_state eh_state;
+    EhInitialiseState(n, k, eh_state);
+    BOOST_CHECK_THROW(EhArenaSolve(n, k, eh_state, [](std::vector<unsigned char> soln) { return false; },
+                                   [](EhSolverCancelCheck pos) { return true; }, arena),
+                      EhSolverCancelledException);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
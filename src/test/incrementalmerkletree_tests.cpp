@@ -0,0 +1,321 @@
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <clientversion.h>
+#include <random.h>
+#include <streams.h>
+#include <test/setup_common.h>
+#include <zcash/IncrementalMerkleTree.hpp>
+
+#include <boost/test/unit_test.hpp>
+
+using libzcash::IncrementalMerkleTree;
+using libzcash::IncrementalWitness;
+using libzcash::IncrementalWitnessUpdater;
+using libzcash::PedersenHash;
+using libzcash::SHA256Compress;
+using libzcash::WitnessCache;
+
+BOOST_FIXTURE_TEST_SUITE(incrementalmerkletree_tests, BasicTestingSetup)
+
+template <typename T>
+static std::vector<unsigned char> Serialized(const T& obj)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << obj;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
+}
+
+/** A copy of obj read back from its serialization, with none of its memory only state. */
+template <typename T>
+static T Reserialized(const T& obj)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << obj;
+    T copy;
+    ss >> copy;
+    return copy;
+}
+
+template <typename Hash>
+static std::vector<Hash> RandomLeaves(size_t n)
+{
+    std::vector<Hash> leaves;
+    for (size_t i = 0; i < n; i++) {
+        leaves.emplace_back(GetRandHash());
+    }
+    return leaves;
+}
+
+template <size_t Depth, typename Hash>
+static void CheckRootCache()
+{
+    IncrementalMerkleTree<Depth, Hash> tree;
+    std::vector<IncrementalWitness<Depth, Hash>> witnesses;
+    for (const Hash& leaf : RandomLeaves<Hash>(size_t(1) << Depth)) {
+        // Fill the caches before each append
+        tree.root();
+        for (const auto& witness : witnesses) {
+            witness.root();
+        }
+
+        tree.append(leaf);
+        for (auto& witness : witnesses) {
+            witness.append(leaf);
+        }
+        witnesses.push_back(tree.witness());
+
+        BOOST_CHECK(tree.root() == Reserialized(tree).root());
+        for (const auto& witness : witnesses) {
+            const auto copy = Reserialized(witness);
+            BOOST_CHECK(witness.root() == copy.root());
+            BOOST_CHECK(witness.root() == tree.root());
+            BOOST_CHECK(Serialized(witness.path()) == Serialized(copy.path()));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(root_cache)
+{
+    CheckRootCache<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>();
+    CheckRootCache<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>();
+}
+
+template <size_t Depth, typename Hash>
+static void CheckRootCacheNotSerialized()
+{
+    IncrementalMerkleTree<Depth, Hash> tree;
+    for (const Hash& leaf : RandomLeaves<Hash>(3)) {
+        tree.append(leaf);
+    }
+    IncrementalWitness<Depth, Hash> witness = tree.witness();
+    for (const Hash& leaf : RandomLeaves<Hash>(6)) {
+        tree.append(leaf);
+        witness.append(leaf);
+    }
+
+    const auto tree_copy = Reserialized(tree);
+    const auto witness_copy = Reserialized(witness);
+    tree.root();
+    witness.root();
+    BOOST_CHECK(Serialized(tree) == Serialized(tree_copy));
+    BOOST_CHECK(Serialized(witness) == Serialized(witness_copy));
+    BOOST_CHECK(tree == tree_copy);
+    BOOST_CHECK(witness == witness_copy);
+}
+
+BOOST_AUTO_TEST_CASE(root_cache_not_serialized)
+{
+    CheckRootCacheNotSerialized<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>();
+    CheckRootCacheNotSerialized<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>();
+}
+
+template <typename Hash>
+static void CheckCombineAll()
+{
+    for (size_t depth = 0; depth < INCREMENTAL_MERKLE_TREE_DEPTH_TESTING; depth++) {
+        for (size_t n : {0, 2, 6}) {
+            const std::vector<Hash> nodes = RandomLeaves<Hash>(n);
+            const std::vector<Hash> combined = Hash::combine_all(nodes, depth);
+            BOOST_CHECK_EQUAL(combined.size(), n / 2);
+            for (size_t i = 0; i < combined.size(); i++) {
+                BOOST_CHECK(combined[i] == Hash::combine(nodes[2 * i], nodes[2 * i + 1], depth));
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(combine_all)
+{
+    CheckCombineAll<SHA256Compress>();
+    CheckCombineAll<PedersenHash>();
+}
+
+template <size_t Depth, typename Hash>
+static void CheckBatchAppend()
+{
+    const size_t max_size = size_t(1) << Depth;
+    const std::vector<Hash> leaves = RandomLeaves<Hash>(max_size);
+
+    // Every batch, from 0 leaves to all of those that fit, appended to every
+    // tree size, so that batches of odd and even sizes cross subtree boundaries
+    // and fill the tree.
+    for (size_t start = 0; start <= max_size; start++) {
+        IncrementalMerkleTree<Depth, Hash> tree;
+        for (size_t i = 0; i < start; i++) {
+            tree.append(leaves[i]);
+        }
+        Optional<IncrementalWitness<Depth, Hash>> witness;
+        if (start > 0) {
+            witness = tree.witness();
+        }
+
+        for (size_t n = 0; start + n <= max_size; n++) {
+            const std::vector<Hash> batch(leaves.begin() + start, leaves.begin() + start + n);
+
+            auto expected_tree = tree;
+            auto batch_tree = tree;
+            for (const Hash& leaf : batch) {
+                expected_tree.append(leaf);
+            }
+            batch_tree.append(batch);
+            BOOST_CHECK(batch_tree.root() == expected_tree.root());
+            BOOST_CHECK(Serialized(batch_tree) == Serialized(expected_tree));
+
+            if (witness) {
+                auto expected_witness = *witness;
+                auto batch_witness = *witness;
+                for (const Hash& leaf : batch) {
+                    expected_witness.append(leaf);
+                }
+                batch_witness.append(batch);
+                BOOST_CHECK(batch_witness.root() == expected_witness.root());
+                BOOST_CHECK(batch_witness.root() == expected_tree.root());
+                BOOST_CHECK(Serialized(batch_witness) == Serialized(expected_witness));
+                BOOST_CHECK(Serialized(batch_witness.path()) == Serialized(expected_witness.path()));
+            }
+        }
+
+        // One more leaf than fits
+        const std::vector<Hash> too_many = RandomLeaves<Hash>(max_size - start + 1);
+        auto full_tree = tree;
+        BOOST_CHECK_THROW(full_tree.append(too_many), std::runtime_error);
+        BOOST_CHECK(full_tree == tree);
+        if (witness) {
+            auto full_witness = *witness;
+            BOOST_CHECK_THROW(full_witness.append(too_many), std::runtime_error);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(batch_append)
+{
+    CheckBatchAppend<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>();
+    CheckBatchAppend<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>();
+}
+
+/** A witness of leaves[position] up to date with the first size leaves. */
+template <size_t Depth, typename Hash>
+static IncrementalWitness<Depth, Hash> MakeWitness(const std::vector<Hash>& leaves, size_t position, size_t size)
+{
+    IncrementalMerkleTree<Depth, Hash> tree;
+    for (size_t i = 0; i <= position; i++) {
+        tree.append(leaves[i]);
+    }
+    IncrementalWitness<Depth, Hash> witness = tree.witness();
+    for (size_t i = position + 1; i < size; i++) {
+        witness.append(leaves[i]);
+    }
+    return witness;
+}
+
+template <size_t Depth, typename Hash>
+static void CheckWitnessUpdater()
+{
+    const size_t max_size = size_t(1) << Depth;
+    const std::vector<Hash> leaves = RandomLeaves<Hash>(max_size);
+
+    for (size_t before = 0; before <= max_size; before++) {
+        IncrementalMerkleTree<Depth, Hash> tree;
+        for (size_t i = 0; i < before; i++) {
+            tree.append(leaves[i]);
+        }
+
+        for (size_t n = 0; before + n <= max_size; n++) {
+            const std::vector<Hash> objs(leaves.begin() + before, leaves.begin() + before + n);
+            const IncrementalWitnessUpdater<Depth, Hash> updater(tree, objs);
+
+            // Witnesses up to date with the tree before objs, or with some of
+            // objs already, end up as if the rest of objs were appended.
+            for (size_t position = 0; position < before; position++) {
+                const auto expected = MakeWitness<Depth, Hash>(leaves, position, before + n);
+                for (size_t k : {size_t(0), (n + 1) / 2, n}) {
+                    auto witness = MakeWitness<Depth, Hash>(leaves, position, before + k);
+                    updater.update(witness);
+                    BOOST_CHECK(witness.root() == expected.root());
+                    BOOST_CHECK(Serialized(witness) == Serialized(expected));
+                    BOOST_CHECK(Serialized(witness.path()) == Serialized(expected.path()));
+                }
+            }
+
+            // A witness behind the tree is out of range, objs are appended to it
+            if (before >= 2) {
+                auto witness = MakeWitness<Depth, Hash>(leaves, 0, before - 1);
+                auto expected = witness;
+                expected.append(objs);
+                updater.update(witness);
+                BOOST_CHECK(Serialized(witness) == Serialized(expected));
+            }
+        }
+
+        // One more leaf than fits
+        if (before > 0) {
+            const IncrementalWitnessUpdater<Depth, Hash> updater(tree, RandomLeaves<Hash>(max_size - before + 1));
+            auto witness = MakeWitness<Depth, Hash>(leaves, 0, before);
+            BOOST_CHECK_THROW(updater.update(witness), std::runtime_error);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(witness_updater)
+{
+    CheckWitnessUpdater<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>();
+    CheckWitnessUpdater<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>();
+}
+
+template <size_t Depth, typename Hash>
+static void CheckWitnessCache()
+{
+    typedef IncrementalWitness<Depth, Hash> Witness;
+    const size_t max_size = size_t(1) << Depth;
+    const std::vector<Hash> leaves = RandomLeaves<Hash>(max_size);
+
+    // Witnesses of the first leaf, most recent first, as the wallet caches them
+    std::list<Witness> list;
+    for (size_t size = 1; size <= max_size; size++) {
+        list.push_front(MakeWitness<Depth, Hash>(leaves, 0, size));
+    }
+
+    // Only the most recent witness is read, the others are written back as read
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << list;
+    WitnessCache<Witness> cache;
+    ss >> cache;
+    BOOST_CHECK_EQUAL(cache.size(), list.size());
+    BOOST_CHECK_EQUAL(cache.materialized(), 1U);
+    BOOST_CHECK(Serialized(cache.front()) == Serialized(list.front()));
+    BOOST_CHECK(Serialized(cache) == Serialized(list));
+    BOOST_CHECK_EQUAL(cache.materialized(), 1U);
+
+    // Witnesses are added and dropped at either end as in a list
+    cache.push_front(MakeWitness<Depth, Hash>(leaves, 1, max_size));
+    list.push_front(MakeWitness<Depth, Hash>(leaves, 1, max_size));
+    cache.pop_back();
+    list.pop_back();
+    BOOST_CHECK_EQUAL(cache.size(), list.size());
+    BOOST_CHECK_EQUAL(cache.materialized(), 2U);
+    BOOST_CHECK(Serialized(cache) == Serialized(list));
+    cache.pop_front();
+    list.pop_front();
+    BOOST_CHECK(Serialized(cache.front()) == Serialized(list.front()));
+
+    // All of them are read when one after the most recent is needed
+    const std::list<Witness>& materialized = cache.materialize(2);
+    BOOST_CHECK_EQUAL(materialized.size(), list.size());
+    BOOST_CHECK(Serialized(materialized) == Serialized(list));
+    BOOST_CHECK(Reserialized(cache) == cache);
+
+    while (!cache.empty()) {
+        cache.pop_back();
+    }
+    BOOST_CHECK(Serialized(cache) == Serialized(std::list<Witness>()));
+}
+
+BOOST_AUTO_TEST_CASE(witness_cache)
+{
+    CheckWitnessCache<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>();
+    CheckWitnessCache<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,10 +2,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <consensus/upgrades.h>
 #include <policy/policy.h>
 #include <txmempool.h>
 #include <util/system.h>
 #include <util/time.h>
+#include <validation.h>
 
 #include <test/setup_common.h>
 
@@ -108,6 +110,183 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     BOOST_CHECK_EQUAL(testPool.size(), 0U);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolRemoveWithAnchorTest)
+{
+    TestMemPoolEntryHelper entry;
+    const uint256 anchorA = InsecureRand256();
+    const uint256 anchorB = InsecureRand256();
+
+    // Two Sapling spenders of anchorA, one of anchorB, and a transparent
+    // child of the first spender of anchorA.
+    CMutableTransaction txSpend[3];
+    for (int i = 0; i < 3; i++) {
+        txSpend[i].vShieldedSpend.resize(1);
+        txSpend[i].vShieldedSpend[0].anchor = i < 2 ? anchorA : anchorB;
+        txSpend[i].vShieldedSpend[0].nullifier = InsecureRand256();
+        txSpend[i].vout.resize(1);
+        txSpend[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txSpend[i].vout[0].nValue = 10000LL;
+    }
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txSpend[0].GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9000LL;
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+
+    for (int i = 0; i < 3; i++) {
+        testPool.addUnchecked(entry.FromTx(txSpend[i]));
+    }
+    testPool.addUnchecked(entry.FromTx(txChild));
+    for (int i = 0; i < 3; i++) {
+        BOOST_CHECK(testPool.nullifierExists(txSpend[i].vShieldedSpend[0].nullifier, SAPLING));
+    }
+
+    // Unknown roots and Sprout roots do not remove anything:
+    testPool.removeWithAnchor(InsecureRand256(), SAPLING);
+    testPool.removeWithAnchor(anchorA, SPROUT);
+    BOOST_CHECK_EQUAL(testPool.size(), 4U);
+
+    // The spenders of anchorA go, together with their descendants:
+    testPool.removeWithAnchor(anchorA, SAPLING);
+    BOOST_CHECK_EQUAL(testPool.size(), 1U);
+    BOOST_CHECK(testPool.exists(txSpend[2].GetHash()));
+    BOOST_CHECK(!testPool.nullifierExists(txSpend[0].vShieldedSpend[0].nullifier, SAPLING));
+    BOOST_CHECK(!testPool.nullifierExists(txSpend[1].vShieldedSpend[0].nullifier, SAPLING));
+
+    // A removed transaction is no longer reachable through its anchor:
+    testPool.removeRecursive(CTransaction(txSpend[2]), REMOVAL_REASON_DUMMY);
+    testPool.addUnchecked(entry.FromTx(txSpend[0]));
+    testPool.removeWithAnchor(anchorB, SAPLING);
+    BOOST_CHECK_EQUAL(testPool.size(), 1U);
+    testPool.removeWithAnchor(anchorA, SAPLING);
+    BOOST_CHECK_EQUAL(testPool.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolValidationCostTest)
+{
+    TestMemPoolEntryHelper entry;
+
+    // A small transaction with many Sapling outputs, and a transparent child
+    CMutableTransaction txParent;
+    txParent.vShieldedOutput.resize(20);
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10000LL;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9000LL;
+
+    const int64_t parentCost = 20 * SAPLING_OUTPUT_VALIDATION_COST;
+    BOOST_CHECK_EQUAL(GetShieldedValidationCost(CTransaction(txParent)), parentCost);
+    BOOST_CHECK_EQUAL(GetShieldedValidationCost(CTransaction(txChild)), 0);
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+    testPool.addUnchecked(entry.FromTx(txParent));
+    testPool.addUnchecked(entry.FromTx(txChild));
+
+    // The size of the parent is its virtual size, and its feerate is charged
+    // for its validation cost, which is larger.
+    CTxMemPool::txiter parent = testPool.mapTx.find(txParent.GetHash());
+    CTxMemPool::txiter child = testPool.mapTx.find(txChild.GetHash());
+    const int64_t parentSize = GetVirtualTransactionSize(CTransaction(txParent));
+    BOOST_CHECK(parentSize < parentCost);
+    BOOST_CHECK_EQUAL(parent->GetTxSize(), parentSize);
+    BOOST_CHECK_EQUAL(parent->GetCostAdjustedSize(), parentCost);
+    BOOST_CHECK_EQUAL(parent->GetValidationCost(), parentCost);
+    BOOST_CHECK_EQUAL(parent->GetSizeWithDescendants(), parentSize + child->GetTxSize());
+    BOOST_CHECK_EQUAL(child->GetCostAdjustedSize(), child->GetTxSize());
+    BOOST_CHECK_EQUAL(child->GetValidationCostWithAncestors(), parentCost);
+    BOOST_CHECK_EQUAL(child->GetSizeWithAncestors(), parentSize + child->GetTxSize());
+    BOOST_CHECK_EQUAL(child->GetCostAdjustedSizeWithAncestors(), parentCost);
+
+    testPool.removeRecursive(CTransaction(txParent), REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(testPool.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolDefaultShieldedFeeTest)
+{
+    TestMemPoolEntryHelper entry;
+
+    // A wallet send of 12 notes paying the default shielded fee
+    CMutableTransaction txShielded;
+    txShielded.fOverwintered = true;
+    txShielded.nVersion = SAPLING_TX_VERSION;
+    txShielded.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    txShielded.vShieldedSpend.resize(12);
+    txShielded.vShieldedOutput.resize(2);
+    const CAmount nDefaultFee = 10000;
+    BOOST_CHECK(PaysDefaultShieldedFee(CTransaction(txShielded), nDefaultFee));
+    BOOST_CHECK(!PaysDefaultShieldedFee(CTransaction(txShielded), nDefaultFee + 1));
+
+    // A transparent transaction paying the same fee
+    CMutableTransaction txTransparent;
+    txTransparent.vin.resize(1);
+    txTransparent.vin[0].scriptSig = CScript() << OP_11;
+    txTransparent.vout.resize(1);
+    txTransparent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txTransparent.vout[0].nValue = 10000LL;
+    BOOST_CHECK(!PaysDefaultShieldedFee(CTransaction(txTransparent), nDefaultFee));
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+    testPool.addUnchecked(entry.Fee(nDefaultFee).FromTx(txShielded));
+    testPool.addUnchecked(entry.Fee(nDefaultFee).FromTx(txTransparent));
+
+    // The size of the send is its virtual size, which the default fee covers
+    // at the minimum relay feerate, while its validation cost would not be.
+    CTxMemPool::txiter shielded = testPool.mapTx.find(txShielded.GetHash());
+    const int64_t nCost = 12 * SAPLING_SPEND_VALIDATION_COST + 2 * SAPLING_OUTPUT_VALIDATION_COST;
+    BOOST_CHECK_EQUAL(shielded->GetTxSize(), GetVirtualTransactionSize(CTransaction(txShielded)));
+    BOOST_CHECK(::minRelayTxFee.GetFee(shielded->GetTxSize()) <= nDefaultFee);
+    BOOST_CHECK_EQUAL(shielded->GetCostAdjustedSize(), nCost);
+    BOOST_CHECK(::minRelayTxFee.GetFee(shielded->GetCostAdjustedSize()) > nDefaultFee);
+
+    // For the same fee, it is mined after the cheaper to validate transaction
+    auto& ancestorScoreIndex = testPool.mapTx.get<ancestor_score>();
+    BOOST_CHECK(ancestorScoreIndex.begin()->GetTx().GetHash() == txTransparent.GetHash());
+    BOOST_CHECK(std::next(ancestorScoreIndex.begin())->GetTx().GetHash() == txShielded.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(MempoolProofsVerifiedTest)
+{
+    TestMemPoolEntryHelper entry;
+    const uint32_t branchId = NetworkUpgradeInfo[Consensus::UPGRADE_SAPLING].nBranchId;
+
+    CMutableTransaction tx[2];
+    for (int i = 0; i < 2; i++) {
+        tx[i].vShieldedOutput.resize(i + 1);
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = 10000LL;
+    }
+
+    CTxMemPool testPool;
+    LOCK2(cs_main, testPool.cs);
+    testPool.addUnchecked(entry.BranchId(branchId).ShieldedProofsVerified(true).FromTx(tx[0]));
+    testPool.addUnchecked(entry.ShieldedProofsVerified(false).FromTx(tx[1]));
+
+    // Only verified entries are trusted, and only for the branch they were verified for
+    BOOST_CHECK(testPool.proofsVerified(tx[0].GetHash(), branchId));
+    BOOST_CHECK(!testPool.proofsVerified(tx[0].GetHash(), SPROUT_BRANCH_ID));
+    BOOST_CHECK(!testPool.proofsVerified(tx[1].GetHash(), branchId));
+    BOOST_CHECK(!testPool.proofsVerified(InsecureRand256(), branchId));
+
+    testPool.removeRecursive(CTransaction(tx[0]), REMOVAL_REASON_DUMMY);
+    BOOST_CHECK(!testPool.proofsVerified(tx[0].GetHash(), branchId));
+}
+
 template<typename name>
 static void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
 {
@@ -12,6 +12,7 @@
 #include <miner.h>
 #include <policy/policy.h>
 #include <pow.h>
+#include <random.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -45,10 +46,11 @@ private:
 
 static CFeeRate blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
 
-static BlockAssembler AssemblerForTest(const CChainParams& params) {
+static BlockAssembler AssemblerForTest(const CChainParams& params, int64_t nBlockMaxValidationCost = DEFAULT_BLOCK_MAX_VALIDATION_COST) {
     BlockAssembler::Options options;
 
     options.nBlockMaxWeight = MAX_BLOCK_WEIGHT;
+    options.nBlockMaxValidationCost = nBlockMaxValidationCost;
     options.blockMinFeeRate = blockMinFeeRate;
     return BlockAssembler(params, options);
 }
@@ -289,6 +291,46 @@ static void TestPackageSelection(const CChainParams& chainparams, const CScript&
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetHash() == hashLowFeeTx2);
 }
 
+// Test that -blockmaxvalidationcost bounds the validation cost of the
+// shielded transactions selected.
+static void TestValidationCostLimit(const CChainParams& chainparams, const CScript& scriptPubKey, const std::vector<CTransactionRef>& txFirst) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs)
+{
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = txFirst[3]->GetHash();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 5000000000LL - 10000;
+    uint256 hashTransparentTx = tx.GetHash();
+    mempool.addUnchecked(entry.Fee(10000).Time(GetTime()).SpendsCoinbase(true).FromTx(tx));
+
+    // This shielded tx paying the default fee spends a missing input, so
+    // template creation fails if it is selected
+    CMutableTransaction txShielded;
+    txShielded.vin.resize(1);
+    txShielded.vin[0].scriptSig = CScript() << OP_1;
+    txShielded.vin[0].prevout.hash = GetRandHash();
+    txShielded.vin[0].prevout.n = 0;
+    txShielded.vShieldedOutput.resize(5);
+    mempool.addUnchecked(entry.Fee(10000).Time(GetTime()).SpendsCoinbase(false).FromTx(txShielded));
+    const int64_t nShieldedCost = 5 * SAPLING_OUTPUT_VALIDATION_COST;
+    BOOST_CHECK_EQUAL(GetShieldedValidationCost(CTransaction(txShielded)), nShieldedCost);
+
+    // It is left out of blocks it does not fit in
+    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams, nShieldedCost - 1).CreateNewBlock(scriptPubKey);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashTransparentTx);
+    pblocktemplate = AssemblerForTest(chainparams, 0).CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+
+    // and selected when it fits
+    BOOST_CHECK_EXCEPTION(AssemblerForTest(chainparams, nShieldedCost).CreateNewBlock(scriptPubKey), std::runtime_error, HasReason("TestBlockValidity failed"));
+    BOOST_CHECK_EXCEPTION(AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey), std::runtime_error, HasReason("TestBlockValidity failed"));
+}
+
 // NOTE: These tests rely on CreateNewBlock doing its own self-validation!
 BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
 {
@@ -606,8 +648,59 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     mempool.clear();
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst);
+    mempool.clear();
+
+    TestValidationCostLimit(chainparams, scriptPubKey, txFirst);
+    mempool.clear();
 
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(SolveBlock_threads)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    std::unique_ptr<CBlockTemplate> pblocktemplate = AssemblerForTest(chainparams).CreateNewBlock(scriptPubKey);
+    CBlock& block = pblocktemplate->block;
+    int nHeight;
+    {
+        LOCK(cs_main);
+        unsigned int nExtraNonce = 0;
+        IncrementExtraNonce(&block, ::ChainActive().Tip(), nExtraNonce);
+        nHeight = ::ChainActive().Height() + 1;
+    }
+
+    // An interrupted search tries no nonce
+    uint64_t nMaxTries = 1000;
+    BOOST_CHECK(!SolveBlock(block, nHeight, 4, nMaxTries, [] { return true; }));
+    BOOST_CHECK_EQUAL(nMaxTries, 1000U);
+
+    BOOST_CHECK(SolveBlock(block, nHeight, 4, nMaxTries, [] { return false; }));
+    BOOST_CHECK(nMaxTries < 1000U);
+    BOOST_CHECK(CheckEquihashSolution(&block));
+    BOOST_CHECK(CheckProofOfWork(block.GetHash(), block.nBits, chainparams.GetConsensus()));
+    BOOST_CHECK(GetLocalSolPS() > 0);
+
+    std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(block);
+    BOOST_CHECK(ProcessNewBlock(chainparams, shared_pblock, true, nullptr));
+}
+
+BOOST_AUTO_TEST_CASE(DefaultEquihashSolver_arena_size)
+{
+    // The arena solver is the default only while its arena stays small enough
+    BOOST_CHECK(EhArenaSize(144, 5) > MAX_DEFAULT_EQUIHASH_ARENA_SIZE);
+    BOOST_CHECK_EQUAL(DefaultEquihashSolver(144, 5), "optimised");
+    BOOST_CHECK_EQUAL(DefaultEquihashSolver(200, 9), "arena");
+    BOOST_CHECK_EQUAL(DefaultEquihashSolver(48, 5), "arena");
+
+    // -equihashsolver overrides the default
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    const int nHeight = WITH_LOCK(cs_main, return ::ChainActive().Height() + 1);
+    const std::string strDefault = DefaultEquihashSolver(consensusParams.EquihashN(nHeight), consensusParams.EquihashK(nHeight));
+    BOOST_CHECK_EQUAL(GetEquihashSolver(nHeight), strDefault);
+    gArgs.ForceSetArg("-equihashsolver", "optimised");
+    BOOST_CHECK_EQUAL(GetEquihashSolver(nHeight), "optimised");
+    gArgs.ForceSetArg("-equihashsolver", strDefault);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
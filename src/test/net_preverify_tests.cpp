@@ -0,0 +1,233 @@
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <net_preverify.h>
+#include <net_processing.h>
+#include <test/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(net_preverify_tests, TestingSetup)
+
+/** A transaction which fails pre-verification quickly, made unique by its lock time. */
+static CTransactionRef MakeTx(uint32_t n)
+{
+    CMutableTransaction mtx;
+    mtx.nLockTime = n;
+    return MakeTransactionRef(mtx);
+}
+
+/** Take the results of a peer until n of them were handed back. */
+static std::vector<ShieldedTxPreVerifier::Result> TakeResults(ShieldedTxPreVerifier& verifier, NodeId nodeid, size_t n)
+{
+    std::vector<ShieldedTxPreVerifier::Result> results;
+    int64_t time_start = GetTimeMillis();
+    while (results.size() < n) {
+        BOOST_REQUIRE(time_start + 10 * 1000 > GetTimeMillis());
+        for (auto& result : verifier.TakeResults(nodeid)) {
+            results.push_back(std::move(result));
+        }
+        if (results.size() < n) MilliSleep(10);
+    }
+    return results;
+}
+
+BOOST_AUTO_TEST_CASE(shielded_preverify_peer_queue_full)
+{
+    ShieldedTxPreVerifier verifier(nullptr, 2);
+
+    // Transactions count against the queue of a peer until they are taken
+    // back, whether they were verified in the meantime or not.
+    std::vector<CTransactionRef> txs;
+    for (uint32_t n = 0; n < MAX_PEER_SHIELDED_VERIFY_QUEUE; n++) {
+        txs.push_back(MakeTx(n));
+        BOOST_CHECK(verifier.Enqueue(0, txs.back(), 1));
+    }
+    const CTransactionRef extra_tx = MakeTx(MAX_PEER_SHIELDED_VERIFY_QUEUE);
+    BOOST_CHECK(!verifier.Enqueue(0, extra_tx, 1));
+
+    // A transaction which is already waiting is not queued twice.
+    BOOST_CHECK(verifier.Enqueue(0, txs[0], 1));
+
+    // Other peers are not affected.
+    BOOST_CHECK(verifier.Enqueue(1, extra_tx, 1));
+
+    // The results are handed back in the order the transactions were received.
+    std::vector<ShieldedTxPreVerifier::Result> results = TakeResults(verifier, 0, txs.size());
+    BOOST_REQUIRE_EQUAL(results.size(), txs.size());
+    for (size_t i = 0; i < txs.size(); i++) {
+        BOOST_CHECK(results[i].tx == txs[i]);
+        BOOST_CHECK(!results[i].state.IsValid());
+    }
+
+    // Taking the results makes room again.
+    BOOST_CHECK(verifier.Enqueue(0, MakeTx(MAX_PEER_SHIELDED_VERIFY_QUEUE + 1), 1));
+    BOOST_CHECK_EQUAL(TakeResults(verifier, 1, 1).size(), 1U);
+    BOOST_CHECK_EQUAL(TakeResults(verifier, 0, 1).size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(shielded_preverify_total_queue_full)
+{
+    // Without workers nothing is verified, so the queues only fill up.
+    ShieldedTxPreVerifier verifier(nullptr, 0);
+
+    uint32_t n = 0;
+    const NodeId n_peers = MAX_SHIELDED_VERIFY_QUEUE / MAX_PEER_SHIELDED_VERIFY_QUEUE;
+    for (NodeId nodeid = 0; nodeid < n_peers; nodeid++) {
+        for (uint32_t i = 0; i < MAX_PEER_SHIELDED_VERIFY_QUEUE; i++) {
+            BOOST_CHECK(verifier.Enqueue(nodeid, MakeTx(n++), 1));
+        }
+    }
+    BOOST_CHECK(!verifier.Enqueue(n_peers, MakeTx(n++), 1));
+    BOOST_CHECK(verifier.TakeResults(0).empty());
+
+    // The transactions of a disconnected peer no longer count.
+    verifier.RemovePeer(0);
+    BOOST_CHECK(verifier.Enqueue(n_peers, MakeTx(n++), 1));
+}
+
+/** A block which fails its checks quickly, made unique by its time. */
+static std::shared_ptr<CBlock> MakeBlock(uint32_t n)
+{
+    std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+    block->nTime = n;
+    return block;
+}
+
+/** Take the checked blocks of a peer until n of them were handed back. */
+static std::vector<BlockPreChecker::Result> TakeBlocks(BlockPreChecker& checker, NodeId nodeid, size_t n)
+{
+    std::vector<BlockPreChecker::Result> results;
+    int64_t time_start = GetTimeMillis();
+    while (results.size() < n) {
+        BOOST_REQUIRE(time_start + 10 * 1000 > GetTimeMillis());
+        for (auto& result : checker.TakeResults(nodeid)) {
+            BOOST_CHECK(result.done);
+            results.push_back(std::move(result));
+        }
+        if (results.size() < n) MilliSleep(10);
+    }
+    return results;
+}
+
+BOOST_AUTO_TEST_CASE(block_precheck_order)
+{
+    BlockPreChecker checker(nullptr, 4);
+
+    // The blocks of each peer are handed back in the order they were received,
+    // whichever worker checks them first.
+    std::vector<std::shared_ptr<CBlock>> blocks[2];
+    for (uint32_t n = 0; n < 2 * MAX_PEER_BLOCK_CHECK_QUEUE; n++) {
+        const NodeId nodeid = n % 2;
+        blocks[nodeid].push_back(MakeBlock(n));
+        BOOST_CHECK(checker.Enqueue(nodeid, blocks[nodeid].back(), n % 3 == 0, -1));
+        BOOST_CHECK(checker.HasPending(nodeid));
+    }
+    for (NodeId nodeid = 0; nodeid < 2; nodeid++) {
+        std::vector<BlockPreChecker::Result> results = TakeBlocks(checker, nodeid, blocks[nodeid].size());
+        BOOST_REQUIRE_EQUAL(results.size(), blocks[nodeid].size());
+        for (size_t i = 0; i < results.size(); i++) {
+            BOOST_CHECK(results[i].block == blocks[nodeid][i]);
+            BOOST_CHECK_EQUAL(results[i].force_processing, (2 * i + nodeid) % 3 == 0);
+        }
+        BOOST_CHECK(!checker.HasPending(nodeid));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_precheck_queue_full)
+{
+    // Without workers nothing is checked, so the queues only fill up.
+    BlockPreChecker checker(nullptr, 0);
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < MAX_PEER_BLOCK_CHECK_QUEUE; i++) {
+        BOOST_CHECK(checker.CanEnqueue(0));
+        BOOST_CHECK(checker.Enqueue(0, MakeBlock(n++), true, -1));
+    }
+    BOOST_CHECK(!checker.CanEnqueue(0));
+    BOOST_CHECK(!checker.Enqueue(0, MakeBlock(n++), true, -1));
+    BOOST_CHECK(checker.TakeResults(0).empty());
+    BOOST_CHECK(checker.HasPending(0));
+
+    // Other peers are not affected, until the total limit is reached.
+    const NodeId n_peers = MAX_BLOCK_CHECK_QUEUE / MAX_PEER_BLOCK_CHECK_QUEUE;
+    BOOST_CHECK(!checker.HasPending(1));
+    for (NodeId nodeid = 1; nodeid < n_peers; nodeid++) {
+        for (uint32_t i = 0; i < MAX_PEER_BLOCK_CHECK_QUEUE; i++) {
+            BOOST_CHECK(checker.Enqueue(nodeid, MakeBlock(n++), true, -1));
+        }
+    }
+    BOOST_CHECK(!checker.CanEnqueue(n_peers));
+    BOOST_CHECK(!checker.Enqueue(n_peers, MakeBlock(n++), true, -1));
+
+    // The blocks of a disconnected peer no longer count.
+    checker.RemovePeer(0);
+    BOOST_CHECK(!checker.HasPending(0));
+    BOOST_CHECK(checker.Enqueue(n_peers, MakeBlock(n++), true, -1));
+}
+
+namespace {
+/** Records the states BlockChecked reports, from which net_processing punishes the peer a block came from. */
+struct BlockCheckedRecorder : public CValidationInterface
+{
+    std::vector<CValidationState> states;
+    void BlockChecked(const CBlock& block, const CValidationState& state) override
+    {
+        states.push_back(state);
+    }
+};
+} // namespace
+
+BOOST_FIXTURE_TEST_CASE(block_precheck_invalid_block, TestChain100Setup)
+{
+    BlockCheckedRecorder recorder;
+    RegisterValidationInterface(&recorder);
+
+    const CBlock tip = CreateAndProcessBlock({}, CScript() << OP_TRUE);
+    const int nHeight = WITH_LOCK(cs_main, return ::ChainActive().Height());
+    BlockPreChecker checker(nullptr, 2);
+
+    // A block is rejected with the same state, from which the peer it came
+    // from is punished, whether it was checked in advance or not.
+    auto check_like_inline = [&](const CBlock& invalid_block) {
+        recorder.states.clear();
+        BOOST_CHECK(!ProcessNewBlock(Params(), std::make_shared<const CBlock>(invalid_block), true, nullptr));
+        BOOST_REQUIRE_EQUAL(recorder.states.size(), 1U);
+        const CValidationState inline_state = recorder.states[0];
+        BOOST_CHECK(inline_state.IsInvalid());
+
+        BOOST_CHECK(checker.Enqueue(0, std::make_shared<CBlock>(invalid_block), true, nHeight));
+        std::vector<BlockPreChecker::Result> results = TakeBlocks(checker, 0, 1);
+        BOOST_REQUIRE_EQUAL(results.size(), 1U);
+        BOOST_CHECK(!results[0].block->fChecked);
+        recorder.states.clear();
+        BOOST_CHECK(!ProcessNewBlock(Params(), results[0].block, results[0].force_processing, nullptr));
+        BOOST_REQUIRE_EQUAL(recorder.states.size(), 1U);
+        BOOST_CHECK(recorder.states[0].GetReason() == inline_state.GetReason());
+        BOOST_CHECK_EQUAL(recorder.states[0].GetRejectReason(), inline_state.GetRejectReason());
+    };
+
+    // A transaction added without updating the merkle root
+    CBlock mutated_block = tip;
+    mutated_block.vtx.push_back(mutated_block.vtx[0]);
+    check_like_inline(mutated_block);
+
+    // An invalid Equihash solution
+    CBlock bad_solution_block = tip;
+    bad_solution_block.nSolution[0] ^= 1;
+    check_like_inline(bad_solution_block);
+
+    // A valid block is found checked already by ProcessNewBlock
+    BOOST_CHECK(checker.Enqueue(0, std::make_shared<CBlock>(tip), true, nHeight));
+    std::vector<BlockPreChecker::Result> results = TakeBlocks(checker, 0, 1);
+    BOOST_REQUIRE_EQUAL(results.size(), 1U);
+    BOOST_CHECK(results[0].block->fChecked);
+
+    UnregisterValidationInterface(&recorder);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -224,7 +224,7 @@ CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CMutableTransaction &tx) {
 
 CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CTransactionRef& tx)
 {
-    return CTxMemPoolEntry(tx, nFee, nTime, nHeight, spendsCoinbase, nBranchId, sigOpCost, lp);
+    return CTxMemPoolEntry(tx, nFee, nTime, nHeight, spendsCoinbase, nBranchId, sigOpCost, lp, shieldedProofsVerified);
 }
 
 /**
@@ -108,10 +108,11 @@ struct TestMemPoolEntryHelper
     uint32_t nBranchId;
     unsigned int sigOpCost;
     LockPoints lp;
+    bool shieldedProofsVerified;
 
     TestMemPoolEntryHelper() :
         nFee(0), nTime(0), nHeight(1),
-        spendsCoinbase(false), nBranchId(SPROUT_BRANCH_ID), sigOpCost(4) { }
+        spendsCoinbase(false), nBranchId(SPROUT_BRANCH_ID), sigOpCost(4), shieldedProofsVerified(false) { }
 
     CTxMemPoolEntry FromTx(const CMutableTransaction& tx);
     CTxMemPoolEntry FromTx(const CTransactionRef& tx);
@@ -121,8 +122,9 @@ struct TestMemPoolEntryHelper
     TestMemPoolEntryHelper &Time(int64_t _time) { nTime = _time; return *this; }
     TestMemPoolEntryHelper &Height(unsigned int _height) { nHeight = _height; return *this; }
     TestMemPoolEntryHelper &SpendsCoinbase(bool _flag) { spendsCoinbase = _flag; return *this; }
-    TestMemPoolEntryHelper &BranchId(bool _branchId) { nBranchId = _branchId; return *this; }
+    TestMemPoolEntryHelper &BranchId(uint32_t _branchId) { nBranchId = _branchId; return *this; }
     TestMemPoolEntryHelper &SigOpsCost(unsigned int _sigopsCost) { sigOpCost = _sigopsCost; return *this; }
+    TestMemPoolEntryHelper &ShieldedProofsVerified(bool _flag) { shieldedProofsVerified = _flag; return *this; }
 };
 
 CBlock getBlock13b8a();
@@ -0,0 +1,230 @@
+// Copyright (c) 2017-2019 The Bitcoin Core developers
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <consensus/validation.h>
+#include <crypto/equihash.h>
+#include <index/shieldedindex.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <test/setup_common.h>
+#include <util/time.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(shieldedindex_tests)
+
+/** Give block a valid Equihash solution, ignoring the target. */
+static void SolveEquihash(CBlock& block, int height)
+{
+    const unsigned int n = Params().GetConsensus().EquihashN(height);
+    const unsigned int k = Params().GetConsensus().EquihashK(height);
+
+    eh_HashState eh_state;
+    EhInitialiseState(n, k, eh_state);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CEquihashInput{block};
+    crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
+
+    std::function<bool(std::vector<unsigned char>)> valid_block = [&block](std::vector<unsigned char> soln) {
+        block.nSolution = soln;
+        return true;
+    };
+    while (true) {
+        block.nNonce = ArithToUint256(UintToArith256(block.nNonce) + 1);
+        eh_HashState curr_state = eh_state;
+        crypto_generichash_blake2b_update(&curr_state, block.nNonce.begin(), block.nNonce.size());
+        if (EhBasicSolveUncancellable(n, k, curr_state, valid_block)) return;
+    }
+}
+
+/**
+ * A block with Sprout and Sapling nullifiers and note commitments. Blocks
+ * like this cannot be connected by validation in these tests, so their
+ * connection is signalled to the index directly. They are stored in block
+ * files of their own for the index to read back when they are disconnected.
+ */
+struct ShieldedBlock {
+    std::shared_ptr<CBlock> block;
+    uint256 hash;
+    CBlockIndex index;
+
+    ShieldedBlock(const CBlockIndex* prev, size_t n_sapling_outputs)
+    {
+        CMutableTransaction mtx;
+        mtx.vJoinSplit.resize(1);
+        for (auto& nf : mtx.vJoinSplit[0].nullifiers) nf = GetRandHash();
+        for (auto& cm : mtx.vJoinSplit[0].commitments) cm = GetRandHash();
+        mtx.vShieldedSpend.resize(2);
+        for (auto& spend : mtx.vShieldedSpend) spend.nullifier = GetRandHash();
+        mtx.vShieldedOutput.resize(n_sapling_outputs);
+        for (auto& output : mtx.vShieldedOutput) output.cm = GetRandHash();
+
+        block = std::make_shared<CBlock>();
+        block->vtx.push_back(MakeTransactionRef(CMutableTransaction()));
+        block->vtx.push_back(MakeTransactionRef(mtx));
+        block->hashPrevBlock = prev->GetBlockHash();
+        block->nTime = prev->nTime + 1;
+        SolveEquihash(*block, prev->nHeight + 1);
+
+        hash = block->GetHash();
+        index = CBlockIndex(*block);
+        index.phashBlock = &hash;
+        index.pprev = const_cast<CBlockIndex*>(prev);
+        index.nHeight = prev->nHeight + 1;
+        index.BuildSkip();
+
+        static int next_file = 1000;
+        const FlatFilePos pos(next_file++, 0);
+        CAutoFile file(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!file.IsNull());
+        file << *block;
+        index.nFile = pos.nFile;
+        index.nDataPos = pos.nPos;
+        index.nStatus |= BLOCK_HAVE_DATA;
+    }
+
+    void Connect()
+    {
+        GetMainSignals().BlockConnected(block, &index, std::make_shared<const std::vector<CTransactionRef>>());
+        SyncWithValidationInterfaceQueue();
+    }
+
+    const CTransaction& tx() const { return *block->vtx[1]; }
+};
+
+static void InvalidateBlockByHash(const uint256& hash)
+{
+    CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(hash);
+    }
+    BOOST_REQUIRE(pindex != nullptr);
+    CValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), pindex));
+}
+
+BOOST_FIXTURE_TEST_CASE(shieldedindex_sync_and_lookups, TestChain100Setup)
+{
+    ShieldedIndex index(1 << 20, true);
+
+    // BlockUntilSyncedToCurrentChain should return false before index is started.
+    BOOST_CHECK(!index.BlockUntilSyncedToCurrentChain());
+
+    index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    CNullifierIndexValue nullifier_value;
+    CCommitmentIndexValue commitment_value;
+    BOOST_CHECK(!index.FindNullifier(GetRandHash(), SAPLING, nullifier_value));
+    BOOST_CHECK(!index.FindCommitment(GetRandHash(), SPROUT, commitment_value));
+
+    auto found = [&](const ShieldedBlock& block) {
+        const CTransaction& tx = block.tx();
+        size_t n_found = 0;
+        for (const uint256& nf : tx.vJoinSplit[0].nullifiers) n_found += index.FindNullifier(nf, SPROUT, nullifier_value);
+        for (const uint256& cm : tx.vJoinSplit[0].commitments) n_found += index.FindCommitment(cm, SPROUT, commitment_value);
+        for (const auto& spend : tx.vShieldedSpend) n_found += index.FindNullifier(spend.nullifier, SAPLING, nullifier_value);
+        for (const auto& output : tx.vShieldedOutput) n_found += index.FindCommitment(output.cm, SAPLING, commitment_value);
+        return n_found;
+    };
+
+    // Replace the last two blocks with a longer fork. Indexing the fork needs
+    // the tree sizes recorded for the fork point.
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = ::ChainActive().Tip();
+    }
+    InvalidateBlockByHash(tip->pprev->GetBlockHash());
+    CKey coinbase_key;
+    coinbase_key.MakeNewKey(true);
+    const CScript coinbase_script_pub_key = GetScriptForDestination(PKHash(coinbase_key.GetPubKey()));
+    for (int i = 0; i < 3; i++) {
+        CreateAndProcessBlock({}, coinbase_script_pub_key);
+    }
+    BOOST_CHECK(index.BlockUntilSyncedToCurrentChain());
+    {
+        LOCK(cs_main);
+        tip = ::ChainActive().Tip();
+    }
+
+    // Nullifiers and commitments are found with their transaction, and the
+    // commitment tree positions continue from one block to the next.
+    ShieldedBlock block1(tip, 3);
+    block1.Connect();
+    ShieldedBlock block2(&block1.index, 2);
+    block2.Connect();
+
+    uint64_t sprout_position = 0;
+    uint64_t sapling_position = 0;
+    for (const ShieldedBlock* block : {&block1, &block2}) {
+        const CTransaction& tx = block->tx();
+        const JSDescription& joinsplit = tx.vJoinSplit[0];
+        for (const uint256& nf : joinsplit.nullifiers) {
+            BOOST_REQUIRE(index.FindNullifier(nf, SPROUT, nullifier_value));
+            BOOST_CHECK_EQUAL(nullifier_value.txid, tx.GetHash());
+            BOOST_CHECK_EQUAL(nullifier_value.blockHeight, block->index.nHeight);
+            BOOST_CHECK_EQUAL(nullifier_value.index, 0U);
+            BOOST_CHECK(!index.FindNullifier(nf, SAPLING, nullifier_value));
+        }
+        for (size_t n = 0; n < joinsplit.commitments.size(); n++) {
+            BOOST_REQUIRE(index.FindCommitment(joinsplit.commitments[n], SPROUT, commitment_value));
+            BOOST_CHECK_EQUAL(commitment_value.txid, tx.GetHash());
+            BOOST_CHECK_EQUAL(commitment_value.outputIndex, n);
+            BOOST_CHECK_EQUAL(commitment_value.position, sprout_position++);
+        }
+        for (size_t i = 0; i < tx.vShieldedSpend.size(); i++) {
+            BOOST_REQUIRE(index.FindNullifier(tx.vShieldedSpend[i].nullifier, SAPLING, nullifier_value));
+            BOOST_CHECK_EQUAL(nullifier_value.txid, tx.GetHash());
+            BOOST_CHECK_EQUAL(nullifier_value.index, i);
+        }
+        for (size_t i = 0; i < tx.vShieldedOutput.size(); i++) {
+            BOOST_REQUIRE(index.FindCommitment(tx.vShieldedOutput[i].cm, SAPLING, commitment_value));
+            BOOST_CHECK_EQUAL(commitment_value.txid, tx.GetHash());
+            BOOST_CHECK_EQUAL(commitment_value.blockHeight, block->index.nHeight);
+            BOOST_CHECK_EQUAL(commitment_value.outputIndex, i);
+            BOOST_CHECK_EQUAL(commitment_value.position, sapling_position++);
+            BOOST_CHECK(!index.FindCommitment(tx.vShieldedOutput[i].cm, SPROUT, commitment_value));
+        }
+    }
+
+    // A block replacing block2 disconnects it from the index: its nullifiers
+    // and commitments are erased, and its replacement takes its positions.
+    ShieldedBlock block2b(&block1.index, 1);
+    block2b.Connect();
+    BOOST_CHECK_EQUAL(found(block1), 2U + 2 + 2 + 3);
+    BOOST_CHECK_EQUAL(found(block2), 0U);
+    BOOST_CHECK_EQUAL(found(block2b), 2U + 2 + 2 + 1);
+    BOOST_REQUIRE(index.FindCommitment(block2b.tx().vShieldedOutput[0].cm, SAPLING, commitment_value));
+    BOOST_CHECK_EQUAL(commitment_value.position, 3U);
+
+    // So are both blocks of a fork from before block1.
+    ShieldedBlock block1b(block1.index.pprev, 1);
+    block1b.Connect();
+    BOOST_CHECK_EQUAL(found(block1), 0U);
+    BOOST_CHECK_EQUAL(found(block2b), 0U);
+    BOOST_CHECK_EQUAL(found(block1b), 2U + 2 + 2 + 1);
+    BOOST_REQUIRE(index.FindCommitment(block1b.tx().vShieldedOutput[0].cm, SAPLING, commitment_value));
+    BOOST_CHECK_EQUAL(commitment_value.position, 0U);
+
+    index.Interrupt();
+    index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
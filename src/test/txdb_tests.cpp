@@ -0,0 +1,104 @@
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <streams.h>
+#include <test/setup_common.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <deque>
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txdb_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(commitment_counts_of_received_blocks)
+{
+    LOCK(cs_main);
+
+    // The test chain has no shielded transactions, so every block adds no
+    // commitments nor spends and both trees stay empty.
+    for (const CBlockIndex* pindex = ::ChainActive().Genesis(); pindex; pindex = ::ChainActive().Next(pindex)) {
+        if (pindex->nHeight == 0) continue;
+        BOOST_REQUIRE(pindex->nSproutCommitments && pindex->nSaplingCommitments && pindex->nSaplingSpends);
+        BOOST_CHECK_EQUAL(*pindex->nSproutCommitments, 0U);
+        BOOST_CHECK_EQUAL(*pindex->nSaplingCommitments, 0U);
+        BOOST_CHECK_EQUAL(*pindex->nSaplingSpends, 0U);
+        BOOST_CHECK(!pindex->MayHaveShieldedActivity());
+        BOOST_REQUIRE(pindex->nChainSproutCommitments && pindex->nChainSaplingCommitments);
+        BOOST_CHECK_EQUAL(*pindex->nChainSproutCommitments, 0U);
+        BOOST_CHECK_EQUAL(*pindex->nChainSaplingCommitments, 0U);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(commitment_counts_not_in_block_index_entry)
+{
+    LOCK(cs_main);
+
+    // Older client versions must be able to read and rewrite the block index
+    // entry, so the counts must not change its serialization.
+    CBlockIndex index = *::ChainActive().Tip();
+    index.nSproutCommitments = nullopt;
+    index.nSaplingCommitments = nullopt;
+    index.nSaplingSpends = nullopt;
+    CDataStream without_counts(SER_DISK, CLIENT_VERSION);
+    without_counts << CDiskBlockIndex(&index);
+
+    index.nSproutCommitments = 7;
+    index.nSaplingCommitments = 11;
+    index.nSaplingSpends = 13;
+    CDataStream with_counts(SER_DISK, CLIENT_VERSION);
+    with_counts << CDiskBlockIndex(&index);
+
+    BOOST_CHECK(without_counts.str() == with_counts.str());
+}
+
+BOOST_AUTO_TEST_CASE(commitment_counts_round_trip)
+{
+    CBlockTreeDB block_tree(1 << 20, true, true);
+
+    // Store the chain, with counts for every other block only.
+    std::deque<CBlockIndex> blocks;
+    std::vector<const CBlockIndex*> block_info;
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* pindex = ::ChainActive().Genesis(); pindex; pindex = ::ChainActive().Next(pindex)) {
+            blocks.push_back(*pindex);
+            CBlockIndex& block = blocks.back();
+            if (block.nHeight % 2 == 0) {
+                block.nSproutCommitments = block.nHeight;
+                block.nSaplingCommitments = 2 * block.nHeight + 1;
+                block.nSaplingSpends = 3 * block.nHeight + 2;
+            } else {
+                block.nSproutCommitments = nullopt;
+                block.nSaplingCommitments = nullopt;
+                block.nSaplingSpends = nullopt;
+            }
+            block_info.push_back(&block);
+        }
+    }
+    BOOST_REQUIRE(block_tree.WriteBatchSync({}, 0, block_info));
+
+    std::map<uint256, std::unique_ptr<CBlockIndex>> loaded;
+    auto insert_block_index = [&loaded](const uint256& hash) -> CBlockIndex* {
+        if (hash.IsNull()) return nullptr;
+        auto it = loaded.emplace(hash, MakeUnique<CBlockIndex>()).first;
+        it->second->phashBlock = &it->first;
+        return it->second.get();
+    };
+    BOOST_REQUIRE(block_tree.LoadBlockIndexGuts(Params().GetConsensus(), insert_block_index));
+    BOOST_REQUIRE_EQUAL(loaded.size(), blocks.size());
+
+    for (const CBlockIndex& block : blocks) {
+        const CBlockIndex& loaded_block = *loaded.at(block.GetBlockHash());
+        BOOST_CHECK(loaded_block.nSproutCommitments == block.nSproutCommitments);
+        BOOST_CHECK(loaded_block.nSaplingCommitments == block.nSaplingCommitments);
+        BOOST_CHECK(loaded_block.nSaplingSpends == block.nSaplingSpends);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
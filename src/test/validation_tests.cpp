@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chainparams.h>
+#include <consensus/upgrades.h>
 #include <net.h>
 #include <validation.h>
 
@@ -75,4 +76,68 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+/** A shielded transaction, which fails its checks before its proofs are verified, made unique by its lock time. */
+static CTransactionRef MakeShieldedTx(uint32_t n)
+{
+    CMutableTransaction mtx;
+    mtx.fOverwintered = true;
+    mtx.nVersion = SAPLING_TX_VERSION;
+    mtx.nVersionGroupId = SAPLING_VERSION_GROUP_ID;
+    mtx.nLockTime = n;
+    mtx.vShieldedOutput.resize(1);
+    return MakeTransactionRef(mtx);
+}
+
+static std::vector<unsigned char> MakeMempoolDumpKey()
+{
+    const uint256 key = InsecureRand256();
+    return std::vector<unsigned char>(key.begin(), key.end());
+}
+
+BOOST_AUTO_TEST_CASE(mempool_dump_proofs)
+{
+    const std::vector<unsigned char> key = MakeMempoolDumpKey();
+    const int nHeight = WITH_LOCK(cs_main, return ::ChainActive().Height() + 1);
+    const uint32_t consensusBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+    const int64_t nTime = GetTime();
+
+    auto make_entry = [&](const CTransactionRef& tx, const uint256& mac) {
+        return MempoolDumpEntry{tx, nTime, 0, mac};
+    };
+
+    // A MAC under the node's key for the current branch is trusted
+    const CTransactionRef tx = MakeShieldedTx(0);
+    const uint256 mac = GetMempoolProofMAC(key, *tx, consensusBranchId);
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(tx, mac)}, key, nTime - 1), 1);
+
+    // Unless the entry expired
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(tx, mac)}, key, nTime), 0);
+
+    // A MAC does not carry over to a tampered entry, nor to another branch
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(MakeShieldedTx(1), mac)}, key, nTime - 1), 0);
+    uint256 tampered_mac = mac;
+    *tampered_mac.begin() ^= 1;
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(tx, tampered_mac)}, key, nTime - 1), 0);
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(tx, GetMempoolProofMAC(key, *tx, consensusBranchId + 1))}, key, nTime - 1), 0);
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(tx, uint256())}, key, nTime - 1), 0);
+
+    // Nor does it hold under another key, or without one
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(tx, mac)}, MakeMempoolDumpKey(), nTime - 1), 0);
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(tx, mac)}, {}, nTime - 1), 0);
+
+    // Transparent transactions have nothing to trust
+    CMutableTransaction mtx;
+    const CTransactionRef transparent_tx = MakeTransactionRef(mtx);
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs({make_entry(transparent_tx, GetMempoolProofMAC(key, *transparent_tx, consensusBranchId))}, key, nTime - 1), 0);
+
+    // A batch is checked on several threads and counts each trusted entry once
+    std::vector<MempoolDumpEntry> batch;
+    for (uint32_t n = 0; n < 100; n++) {
+        const CTransactionRef batch_tx = MakeShieldedTx(n);
+        batch.push_back(make_entry(batch_tx, n % 2 ? GetMempoolProofMAC(key, *batch_tx, consensusBranchId) : uint256()));
+    }
+    BOOST_CHECK_EQUAL(CheckMempoolDumpProofs(batch, key, nTime - 1), 50);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,9 +6,12 @@
 
 #include <txdb.h>
 
+#include <addressindex.h>
 #include <pow.h>
 #include <random.h>
 #include <shutdown.h>
+#include <spentindex.h>
+#include <timestampindex.h>
 #include <ui_interface.h>
 #include <uint256.h>
 #include <util/system.h>
@@ -29,6 +32,7 @@ static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_SHIELDED_COUNTS = 'n';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_BEST_SPROUT_ANCHOR = 'a';
@@ -291,12 +295,18 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 }
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
+{
+    return CursorAt(uint256());
+}
+
+CCoinsViewCursor *CCoinsViewDB::CursorAt(const uint256 &hash) const
 {
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
+    COutPoint start(hash, 0);
+    i->pcursor->Seek(CoinEntry(&start));
     // Cache key of first record
     if (i->pcursor->Valid()) {
         CoinEntry entry(&i->keyTmp.second);
@@ -344,157 +354,126 @@ void CCoinsViewDBCursor::Next()
     }
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
-        batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
-    }
-    batch.Write(DB_LAST_BLOCK, nLastFile);
-    for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
-    }
-    return WriteBatch(batch, true);
-}
-
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect)
+CNullifiersViewCursor *CCoinsViewDB::NullifiersCursor(ShieldedType type) const
 {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
-        } else {
-            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
-        }
+    char prefix;
+    switch (type) {
+        case SPROUT:
+            prefix = DB_SPROUT_NULLIFIER;
+            break;
+        case SAPLING:
+            prefix = DB_SAPLING_NULLIFIER;
+            break;
+        default:
+            throw std::runtime_error("Unknown shielded type");
     }
-    return WriteBatch(batch);
+    return new CNullifiersViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), prefix);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
+CNullifiersViewDBCursor::CNullifiersViewDBCursor(CDBIterator* pcursorIn, char prefixIn) :
+    pcursor(pcursorIn), prefix(prefixIn)
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char,CAddressUnspentKey> key;
-        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash))
-            break;
-        CAddressUnspentValue nValue;
-        if (!pcursor->GetValue(nValue))
-            return error("failed to get address unspent value");
-        unspentOutputs.push_back(std::make_pair(key.second, nValue));
-        pcursor->Next();
+    pcursor->Seek(prefix);
+    // Cache key of first record
+    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp)) {
+        keyTmp.first = 0; // Make sure Valid() and GetKey() return false
     }
-    return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect)
+bool CNullifiersViewDBCursor::GetKey(uint256 &nf) const
 {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+    // Return cached key
+    if (keyTmp.first == prefix) {
+        nf = keyTmp.second;
+        return true;
+    }
+    return false;
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect)
+bool CNullifiersViewDBCursor::Valid() const
 {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+    return keyTmp.first == prefix;
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
+void CNullifiersViewDBCursor::Next()
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
-    }
-
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (!(pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash))
-            break;
-        if (end > 0 && key.second.blockHeight > end)
-            break;
-        CAmount nValue;
-        if (!pcursor->GetValue(nValue))
-            return error("failed to get address index value");
-        addressIndex.push_back(std::make_pair(key.second, nValue));
-        pcursor->Next();
+    pcursor->Next();
+    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp)) {
+        keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
     }
-    return true;
-}
-
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
-{
-    return Read(std::make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect)
-{
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
-        if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_SPENTINDEX, it->first));
-        } else {
-            batch.Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
+    for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
+        batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
+    }
+    batch.Write(DB_LAST_BLOCK, nLastFile);
+    for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        if ((*it)->nSproutCommitments && (*it)->nSaplingCommitments && (*it)->nSaplingSpends) {
+            batch.Write(std::make_pair(DB_SHIELDED_COUNTS, (*it)->GetBlockHash()), CDiskBlockShieldedCounts(*it));
         }
     }
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex)
-{
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+    return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(unsigned int high, unsigned int low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
+/** Erase all records of type K stored under the given key prefix. */
+template <typename K>
+static bool EraseLegacyRecords(CDBWrapper& db, char prefix)
 {
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-
-    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+    const size_t batch_size = 1 << 24; // 16 MiB
 
-    while (pcursor->Valid()) {
+    CDBBatch batch(db);
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    std::pair<char, K> key;
+    for (pcursor->Seek(prefix); pcursor->Valid(); pcursor->Next()) {
         boost::this_thread::interruption_point();
-        std::pair<char, CTimestampIndexKey> key;
-        if (!(pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high)) {
-            break;
-        }
-        if (fActiveOnly) {
-            CBlockIndex* pblockindex = LookupBlockIndex(key.second.blockHash);
-            if (::ChainActive().Contains(pblockindex)) {
-                hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
-            }
-        } else {
-            hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
+        if (!pcursor->GetKey(key) || key.first != prefix) break;
+        batch.Erase(key);
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch)) return false;
+            batch.Clear();
         }
-        pcursor->Next();
     }
+    if (!db.WriteBatch(batch)) return false;
+    db.CompactRange(prefix, static_cast<char>(prefix + 1));
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts)
+bool CBlockTreeDB::EraseLegacyIndexes()
 {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
-}
+    // The address, spent and timestamp indexes used to be written into this
+    // database by ConnectBlock. They now live in their own databases under
+    // indexes/, so any records left behind here are dead weight.
+    bool f_legacy_flag = false;
+    if (ReadFlag("addressindex", f_legacy_flag) && f_legacy_flag) {
+        LogPrintf("Removing legacy address index records from the block index database...\n");
+        if (!EraseLegacyRecords<CAddressIndexKey>(*this, DB_ADDRESSINDEX) ||
+            !EraseLegacyRecords<CAddressUnspentKey>(*this, DB_ADDRESSUNSPENTINDEX) ||
+            !WriteFlag("addressindex", false)) {
+            return error("%s: failed to remove legacy address index", __func__);
+        }
+    }
 
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp)
-{
-    CTimestampBlockIndexValue lts;
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
-        return false;
+    f_legacy_flag = false;
+    if (ReadFlag("spentindex", f_legacy_flag) && f_legacy_flag) {
+        LogPrintf("Removing legacy spent index records from the block index database...\n");
+        if (!EraseLegacyRecords<CSpentIndexKey>(*this, DB_SPENTINDEX) ||
+            !WriteFlag("spentindex", false)) {
+            return error("%s: failed to remove legacy spent index", __func__);
+        }
+    }
 
-    ltimestamp = lts.ltimestamp;
+    f_legacy_flag = false;
+    if (ReadFlag("timestampindex", f_legacy_flag) && f_legacy_flag) {
+        LogPrintf("Removing legacy timestamp index records from the block index database...\n");
+        if (!EraseLegacyRecords<CTimestampIndexKey>(*this, DB_TIMESTAMPINDEX) ||
+            !EraseLegacyRecords<CTimestampBlockIndexKey>(*this, DB_BLOCKHASHINDEX) ||
+            !WriteFlag("timestampindex", false)) {
+            return error("%s: failed to remove legacy timestamp index", __func__);
+        }
+    }
     return true;
 }
 
@@ -516,6 +495,11 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
+    // The shielded counts are keyed by block hash as well, so they are
+    // merged in by walking over them alongside the block index entries.
+    std::unique_ptr<CDBIterator> pcounts(NewIterator());
+    pcounts->Seek(std::make_pair(DB_SHIELDED_COUNTS, uint256()));
+
     // Load m_block_index
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
@@ -546,6 +530,22 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 pindexNew->nSproutValue     = diskindex.nSproutValue;
                 pindexNew->nSaplingValue    = diskindex.nSaplingValue;
 
+                std::pair<char, uint256> counts_key;
+                while (pcounts->Valid() && pcounts->GetKey(counts_key) && counts_key.first == DB_SHIELDED_COUNTS &&
+                       counts_key.second < key.second) {
+                    pcounts->Next();
+                }
+                if (pcounts->Valid() && pcounts->GetKey(counts_key) && counts_key.first == DB_SHIELDED_COUNTS &&
+                    counts_key.second == key.second) {
+                    CDiskBlockShieldedCounts counts;
+                    if (!pcounts->GetValue(counts)) {
+                        return error("%s: failed to read shielded counts", __func__);
+                    }
+                    pindexNew->nSproutCommitments  = counts.nSproutCommitments;
+                    pindexNew->nSaplingCommitments = counts.nSaplingCommitments;
+                    pindexNew->nSaplingSpends      = counts.nSaplingSpends;
+                }
+
                 // Consistency checks
                 auto header = pindexNew->GetBlockHeader();
                 if (header.GetHash() != pindexNew->GetBlockHash())
@@ -7,13 +7,10 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
-#include <addressindex.h>
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
-#include <spentindex.h>
-#include <timestampindex.h>
 
 #include <map>
 #include <memory>
@@ -43,6 +40,16 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxTxIndexCache = 1024;
 //! Max memory allocated to all block filter index caches combined in MiB.
 static const int64_t max_filter_index_cache = 1024;
+//! Max memory allocated to the address index cache in MiB.
+static const int64_t max_address_index_cache = 2048;
+//! Max memory allocated to the spent index cache in MiB.
+static const int64_t max_spent_index_cache = 1024;
+//! Max memory allocated to the timestamp index cache in MiB.
+static const int64_t max_timestamp_index_cache = 16;
+//! Max memory allocated to the shielded index cache in MiB.
+static const int64_t max_shielded_index_cache = 256;
+//! Max memory allocated to the compact Sapling block index cache in MiB.
+static const int64_t max_compact_sapling_index_cache = 16;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -74,6 +81,8 @@ public:
                     CNullifiersMap &mapSproutNullifiers,
                     CNullifiersMap &mapSaplingNullifiers) override;
     CCoinsViewCursor *Cursor() const override;
+    CCoinsViewCursor *CursorAt(const uint256 &hash) const override;
+    CNullifiersViewCursor *NullifiersCursor(ShieldedType type) const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
@@ -102,6 +111,26 @@ private:
     friend class CCoinsViewDB;
 };
 
+/** Specialization of CNullifiersViewCursor to iterate over a CCoinsViewDB */
+class CNullifiersViewDBCursor: public CNullifiersViewCursor
+{
+public:
+    ~CNullifiersViewDBCursor() {}
+
+    bool GetKey(uint256 &nf) const override;
+
+    bool Valid() const override;
+    void Next() override;
+
+private:
+    CNullifiersViewDBCursor(CDBIterator* pcursorIn, char prefixIn);
+    std::unique_ptr<CDBIterator> pcursor;
+    char prefix;
+    std::pair<char, uint256> keyTmp;
+
+    friend class CCoinsViewDB;
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -114,17 +143,8 @@ public:
     bool WriteReindexing(bool fReindexing);
     void ReadReindexing(bool &fReindexing);
 
-    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
-    bool ReadAddressUnspentIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
-    bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
-    bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
-    bool ReadAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start = 0, int end = 0);
-    bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
-    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
-    bool ReadTimestampIndex(unsigned int high, unsigned int low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
-    bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
-    bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    /** Remove the address, spent and timestamp index records written by older versions. */
+    bool EraseLegacyIndexes();
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
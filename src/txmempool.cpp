@@ -22,9 +22,9 @@
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
-                                 bool _spendsCoinbase, uint32_t _nBranchId, int64_t _sigOpsCost, LockPoints lp)
+                                 bool _spendsCoinbase, uint32_t _nBranchId, int64_t _sigOpsCost, LockPoints lp, bool _shieldedProofsVerified)
     : tx(_tx), nFee(_nFee), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), nBranchId(_nBranchId), sigOpCost(_sigOpsCost), lockPoints(lp)
+    spendsCoinbase(_spendsCoinbase), nBranchId(_nBranchId), sigOpCost(_sigOpsCost), validationCost(GetShieldedValidationCost(*tx)), shieldedProofsVerified(_shieldedProofsVerified), lockPoints(lp)
 {
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
@@ -36,6 +36,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCostWithAncestors = sigOpCost;
+    nValidationCostWithAncestors = validationCost;
 }
 
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
@@ -55,6 +56,13 @@ size_t CTxMemPoolEntry::GetTxSize() const
     return GetVirtualTransactionSize(nTxWeight, sigOpCost);
 }
 
+size_t CTxMemPoolEntry::GetCostAdjustedSize() const
+{
+    // Shielded transactions are charged for their verification time like
+    // transactions with many sigops are, so that feerates reflect it.
+    return std::max<int64_t>(GetTxSize(), validationCost);
+}
+
 // Update the given tx for any in-mempool descendants.
 // Assumes that setMemPoolChildren is correct for the given tx and all
 // descendants.
@@ -94,7 +102,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
             modifyCount++;
             cachedDescendants[updateIt].insert(cit);
             // Update ancestor state for each descendant
-            mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost(), updateIt->GetValidationCost()));
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -231,12 +239,14 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
     int64_t updateSize = 0;
     CAmount updateFee = 0;
     int64_t updateSigOpsCost = 0;
+    int64_t updateValidationCost = 0;
     for (txiter ancestorIt : setAncestors) {
         updateSize += ancestorIt->GetTxSize();
         updateFee += ancestorIt->GetModifiedFee();
         updateSigOpsCost += ancestorIt->GetSigOpCost();
+        updateValidationCost += ancestorIt->GetValidationCost();
     }
-    mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount, updateSigOpsCost));
+    mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount, updateSigOpsCost, updateValidationCost));
 }
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
@@ -266,8 +276,9 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCost();
+            int64_t modifyValidationCost = -removeIt->GetValidationCost();
             for (txiter dit : setDescendants) {
-                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps, modifyValidationCost));
             }
         }
     }
@@ -314,7 +325,7 @@ void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFe
     assert(int64_t(nCountWithDescendants) > 0);
 }
 
-void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int64_t modifySigOps)
+void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int64_t modifySigOps, int64_t modifyValidationCost)
 {
     nSizeWithAncestors += modifySize;
     assert(int64_t(nSizeWithAncestors) > 0);
@@ -323,6 +334,8 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int64_t(nCountWithAncestors) > 0);
     nSigOpCostWithAncestors += modifySigOps;
     assert(int(nSigOpCostWithAncestors) >= 0);
+    nValidationCostWithAncestors += modifyValidationCost;
+    assert(nValidationCostWithAncestors >= 0);
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator)
@@ -385,9 +398,11 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
         for (const uint256 &nf : joinsplit.nullifiers) {
             mapSproutNullifiers[nf] = &tx;
         }
+        mapSproutAnchors[joinsplit.anchor].insert(newit);
     }
     for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
         mapSaplingNullifiers[spendDescription.nullifier] = &tx;
+        mapSaplingAnchors[spendDescription.anchor].insert(newit);
     }
 
     // Don't bother worrying about child transactions of this one.
@@ -522,15 +537,27 @@ bool CTxMemPool::removeSpentIndex(const uint256 txhash)
     return true;
 }
 
+void CTxMemPool::removeAnchor(anchorsMap& mapAnchors, const uint256& anchor, txiter it)
+{
+    auto anchorit = mapAnchors.find(anchor);
+    if (anchorit == mapAnchors.end()) return;
+    anchorit->second.erase(it);
+    if (anchorit->second.empty()) {
+        mapAnchors.erase(anchorit);
+    }
+}
+
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
     for (const JSDescription& joinsplit : it->GetTx().vJoinSplit) {
         for (const uint256& nf : joinsplit.nullifiers) {
             mapSproutNullifiers.erase(nf);
         }
+        removeAnchor(mapSproutAnchors, joinsplit.anchor, it);
     }
     for (const SpendDescription &spendDescription : it->GetTx().vShieldedSpend) {
         mapSaplingNullifiers.erase(spendDescription.nullifier);
+        removeAnchor(mapSaplingAnchors, spendDescription.anchor, it);
     }
 
     NotifyEntryRemoved(it->GetSharedTx(), reason);
@@ -663,31 +690,20 @@ void CTxMemPool::removeWithAnchor(const uint256 &invalidRoot, ShieldedType type)
     // from that root -- almost as though they were spending coinbases
     // which are no longer valid to spend due to coinbase maturity.
     AssertLockHeld(cs);
-    setEntries txToRemove;
-    for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        const CTransaction& tx = it->GetTx();
-        switch (type) {
-            case SPROUT:
-                for (const JSDescription& joinsplit : tx.vJoinSplit) {
-                    if (joinsplit.anchor == invalidRoot) {
-                        txToRemove.insert(it);
-                        break;
-                    }
-                }
-            break;
-            case SAPLING:
-                for (const SpendDescription& spendDescription : tx.vShieldedSpend) {
-                    if (spendDescription.anchor == invalidRoot) {
-                        txToRemove.insert(it);
-                        break;
-                    }
-                }
+    const anchorsMap* mapToUse;
+    switch (type) {
+        case SPROUT:
+            mapToUse = &mapSproutAnchors;
             break;
-            default:
-                throw std::runtime_error("Unknown shielded type");
+        case SAPLING:
+            mapToUse = &mapSaplingAnchors;
             break;
-        }
+        default:
+            throw std::runtime_error("Unknown shielded type");
     }
+    auto anchorit = mapToUse->find(invalidRoot);
+    if (anchorit == mapToUse->end()) return;
+    const setEntries txToRemove = anchorit->second;
     setEntries setAllRemoves;
     for (txiter it : txToRemove) {
         CalculateDescendants(it, setAllRemoves);
@@ -797,6 +813,10 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapSproutNullifiers.clear();
+    mapSaplingNullifiers.clear();
+    mapSproutAnchors.clear();
+    mapSaplingAnchors.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -890,12 +910,19 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
             intermediates.insert(std::make_pair(tree.root(), tree));
         }
+        for (const JSDescription &joinsplit : tx.vJoinSplit) {
+            auto anchorit = mapSproutAnchors.find(joinsplit.anchor);
+            assert(anchorit != mapSproutAnchors.end() && anchorit->second.count(it));
+        }
 
         for (const SpendDescription &spendDescription : tx.vShieldedSpend) {
             SaplingMerkleTree tree;
 
             assert(pcoins->GetSaplingAnchorAt(spendDescription.anchor, tree));
             assert(!pcoins->GetNullifier(spendDescription.nullifier, SAPLING));
+
+            auto anchorit = mapSaplingAnchors.find(spendDescription.anchor);
+            assert(anchorit != mapSaplingAnchors.end() && anchorit->second.count(it));
         }
 
         assert(setParentCheck == GetMemPoolParents(it));
@@ -908,16 +935,19 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         uint64_t nSizeCheck = it->GetTxSize();
         CAmount nFeesCheck = it->GetModifiedFee();
         int64_t nSigOpCheck = it->GetSigOpCost();
+        int64_t nValidationCostCheck = it->GetValidationCost();
 
         for (txiter ancestorIt : setAncestors) {
             nSizeCheck += ancestorIt->GetTxSize();
             nFeesCheck += ancestorIt->GetModifiedFee();
             nSigOpCheck += ancestorIt->GetSigOpCost();
+            nValidationCostCheck += ancestorIt->GetValidationCost();
         }
 
         assert(it->GetCountWithAncestors() == nCountCheck);
         assert(it->GetSizeWithAncestors() == nSizeCheck);
         assert(it->GetSigOpCostWithAncestors() == nSigOpCheck);
+        assert(it->GetValidationCostWithAncestors() == nValidationCostCheck);
         assert(it->GetModFeesWithAncestors() == nFeesCheck);
 
         // Check children against mapNextTx
@@ -972,7 +1002,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
 void CTxMemPool::checkNullifiers(ShieldedType type) const
 {
-    const std::map<uint256, const CTransaction*>* mapToUse;
+    const nullifiersMap* mapToUse;
     switch (type) {
         case SPROUT:
             mapToUse = &mapSproutNullifiers;
@@ -1051,7 +1081,8 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid) const
 }
 
 static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator it) {
-    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee()};
+    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee(),
+                         it->GetValidatedBranchId(), it->GetShieldedProofsVerified()};
 }
 
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
@@ -1108,7 +1139,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             CalculateDescendants(it, setDescendants);
             setDescendants.erase(it);
             for (txiter descendantIt : setDescendants) {
-                mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
+                mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0, 0));
             }
             ++nTransactionsUpdated;
         }
@@ -1201,7 +1232,7 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(mapSproutNullifiers) + memusage::DynamicUsage(mapSaplingNullifiers) + memusage::DynamicUsage(mapSproutAnchors) + memusage::DynamicUsage(mapSaplingAnchors) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
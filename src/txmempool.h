@@ -7,6 +7,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <atomic>
 #include <map>
 #include <memory>
@@ -78,6 +79,8 @@ private:
     const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
     uint32_t nBranchId;             //!< Branch ID this transaction is known to commit to, cached for efficiency
     const int64_t sigOpCost;        //!< Total sigop cost
+    const int64_t validationCost;   //!< Cost of verifying the shielded components, see GetShieldedValidationCost
+    const bool shieldedProofsVerified; //!< Whether the shielded proofs and signatures were verified for nBranchId on admission
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
@@ -93,21 +96,25 @@ private:
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
+    int64_t nValidationCostWithAncestors;
 
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
                     bool spendsCoinbase, uint32_t nBranchId,
-                    int64_t nSigOpsCost, LockPoints lp);
+                    int64_t nSigOpsCost, LockPoints lp, bool shieldedProofsVerified = false);
 
     const CTransaction& GetTx() const { return *this->tx; }
     CTransactionRef GetSharedTx() const { return this->tx; }
     const CAmount& GetFee() const { return nFee; }
     size_t GetTxSize() const;
+    //! The larger of GetTxSize() and the validation cost, used for feerate checks and the mining score
+    size_t GetCostAdjustedSize() const;
     size_t GetTxWeight() const { return nTxWeight; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return entryHeight; }
     int64_t GetSigOpCost() const { return sigOpCost; }
+    int64_t GetValidationCost() const { return validationCost; }
     int64_t GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
@@ -115,7 +122,7 @@ public:
     // Adjusts the descendant state.
     void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
     // Adjusts the ancestor state
-    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int64_t modifySigOps);
+    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int64_t modifySigOps, int64_t modifyValidationCost);
     // Updates the fee delta used for mining priority score, and the
     // modified fees with descendants.
     void UpdateFeeDelta(int64_t feeDelta);
@@ -128,11 +135,14 @@ public:
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
     uint32_t GetValidatedBranchId() const { return nBranchId; }
+    bool GetShieldedProofsVerified() const { return shieldedProofsVerified; }
 
     uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
     uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
+    int64_t GetValidationCostWithAncestors() const { return nValidationCostWithAncestors; }
+    uint64_t GetCostAdjustedSizeWithAncestors() const { return std::max<uint64_t>(nSizeWithAncestors, nValidationCostWithAncestors); }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
 
@@ -158,18 +168,19 @@ struct update_descendant_state
 
 struct update_ancestor_state
 {
-    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount, int64_t _modifySigOpsCost) :
-        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount), modifySigOpsCost(_modifySigOpsCost)
+    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount, int64_t _modifySigOpsCost, int64_t _modifyValidationCost) :
+        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount), modifySigOpsCost(_modifySigOpsCost), modifyValidationCost(_modifyValidationCost)
     {}
 
     void operator() (CTxMemPoolEntry &e)
-        { e.UpdateAncestorState(modifySize, modifyFee, modifyCount, modifySigOpsCost); }
+        { e.UpdateAncestorState(modifySize, modifyFee, modifyCount, modifySigOpsCost, modifyValidationCost); }
 
     private:
         int64_t modifySize;
         CAmount modifyFee;
         int64_t modifyCount;
         int64_t modifySigOpsCost;
+        int64_t modifyValidationCost;
 };
 
 struct update_fee_delta
@@ -282,6 +293,7 @@ public:
 /** \class CompareTxMemPoolEntryByAncestorScore
  *
  *  Sort an entry by min(score/size of entry's tx, score/size with all ancestors).
+ *  Sizes are adjusted for the validation cost, see GetCostAdjustedSize().
  */
 class CompareTxMemPoolEntryByAncestorFee
 {
@@ -310,15 +322,15 @@ public:
     {
         // Compare feerate with ancestors to feerate of the transaction, and
         // return the fee/size for the min.
-        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithAncestors();
-        double f2 = (double)a.GetModFeesWithAncestors() * a.GetTxSize();
+        double f1 = (double)a.GetModifiedFee() * a.GetCostAdjustedSizeWithAncestors();
+        double f2 = (double)a.GetModFeesWithAncestors() * a.GetCostAdjustedSize();
 
         if (f1 > f2) {
             mod_fee = a.GetModFeesWithAncestors();
-            size = a.GetSizeWithAncestors();
+            size = a.GetCostAdjustedSizeWithAncestors();
         } else {
             mod_fee = a.GetModifiedFee();
-            size = a.GetTxSize();
+            size = a.GetCostAdjustedSize();
         }
     }
 };
@@ -346,6 +358,12 @@ struct TxMempoolInfo
 
     /** The fee delta. */
     int64_t nFeeDelta;
+
+    /** Branch ID the transaction was validated for. */
+    uint32_t nBranchId{0};
+
+    /** Whether the shielded proofs and signatures were verified for nBranchId on admission. */
+    bool fShieldedProofsVerified{false};
 };
 
 /** Reason why a transaction was removed from the mempool,
@@ -442,8 +460,9 @@ private:
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
-    std::map<uint256, const CTransaction*> mapSproutNullifiers;
-    std::map<uint256, const CTransaction*> mapSaplingNullifiers;
+    typedef std::unordered_map<uint256, const CTransaction*, SaltedTxidHasher> nullifiersMap;
+    nullifiersMap mapSproutNullifiers;
+    nullifiersMap mapSaplingNullifiers;
     void checkNullifiers(ShieldedType type) const;
 
     mutable int64_t lastRollingFeeUpdate;
@@ -538,6 +557,12 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    //! Transactions by the Sprout or Sapling anchors they spend from, see removeWithAnchor
+    typedef std::unordered_map<uint256, setEntries, SaltedTxidHasher> anchorsMap;
+    anchorsMap mapSproutAnchors;
+    anchorsMap mapSaplingAnchors;
+    void removeAnchor(anchorsMap& mapAnchors, const uint256& anchor, txiter it) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
     addressDeltaMap mapAddress;
 
@@ -711,6 +736,18 @@ public:
         return (mapTx.count(hash) != 0);
     }
 
+    /**
+     * @returns true if the transaction is in the mempool and its shielded
+     * proofs and signatures were verified on admission for nBranchId, so that
+     * block validation may skip verifying them again.
+     */
+    bool proofsVerified(const uint256& hash, uint32_t nBranchId) const
+    {
+        LOCK(cs);
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        return i != mapTx.end() && i->GetShieldedProofsVerified() && i->GetValidatedBranchId() == nBranchId;
+    }
+
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
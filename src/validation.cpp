@@ -16,9 +16,14 @@
 #include <consensus/tx_verify.h>
 #include <consensus/upgrades.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
+#include <crypto/hmac_sha256.h>
 #include <cuckoocache.h>
 #include <flatfile.h>
 #include <hash.h>
+#include <index/addressindex.h>
+#include <index/spentindex.h>
+#include <index/timestampindex.h>
 #include <index/txindex.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
@@ -43,14 +48,17 @@
 #include <util/rbf.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <util/translation.h>
 #include <util/validation.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <atomic>
 #include <future>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -190,6 +198,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 static FILE* OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
+static bool IsShieldedProofCached(const CTransaction& tx, uint32_t consensusBranchId);
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
@@ -571,12 +580,16 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     int nextBlockHeight = ::ChainActive().Height() + 1;
     auto consensusBranchId = CurrentEpochBranchId(nextBlockHeight, Params().GetConsensus());
 
-    auto verifier = ProofVerifier::Strict();
+    // Proofs and signatures of shielded transactions relayed by peers were
+    // usually verified off cs_main already, see PreVerifyShieldedTransaction.
+    const bool fShieldedVerified = IsShieldedProofCached(tx, consensusBranchId);
+
+    auto verifier = fShieldedVerified ? ProofVerifier::Disabled() : ProofVerifier::Strict();
     if (!CheckTransaction(tx, state, verifier))
         return false; // state filled in by CheckTransaction
 
     // Check transaction contextually against the set of consensus rules which apply in the next block to be mined.
-    if (!ContextualCheckTransaction(tx, state, nextBlockHeight))
+    if (!ContextualCheckTransaction(tx, state, nextBlockHeight, !fShieldedVerified))
         return false;
 
     // Coinbase is only valid in a block, not as a loose transaction
@@ -736,7 +749,9 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
         }
     }
 
-    entry.reset(new CTxMemPoolEntry(ptx, nFees, nAcceptTime, ::ChainActive().Height(), fSpendsCoinbase, consensusBranchId, nSigOpsCost, lp));
+    // The shielded proofs and signatures were verified for consensusBranchId
+    // above, or before being cached if fShieldedVerified
+    entry.reset(new CTxMemPoolEntry(ptx, nFees, nAcceptTime, ::ChainActive().Height(), fSpendsCoinbase, consensusBranchId, nSigOpsCost, lp, true));
     unsigned int nSize = entry->GetTxSize();
 
     if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
@@ -744,9 +759,10 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
                 strprintf("%d", nSigOpsCost));
 
     // No transactions are allowed below minRelayTxFee except from disconnected
-    // blocks or shielding operations using default fee (10000 sat)
-    if (!((tx.vJoinSplit.size() > 0 || tx.vShieldedSpend.size() > 0 || tx.vShieldedOutput.size() > 0) && nFees == 10000))
-        if (!bypass_limits && !CheckFeeRate(nSize, nModifiedFees, state)) return false;
+    // blocks or shielding operations using default fee (10000 sat). The
+    // feerate of other shielded transactions is charged for their validation cost.
+    if (!PaysDefaultShieldedFee(tx, nFees))
+        if (!bypass_limits && !CheckFeeRate(entry->GetCostAdjustedSize(), nModifiedFees, state)) return false;
 
     if (nAbsurdFee && nFees > nAbsurdFee)
         return state.Invalid(ValidationInvalidReason::TX_NOT_STANDARD, false,
@@ -1129,10 +1145,10 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
 
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
 {
-    if (!fTimestampIndex)
+    if (!g_timestampindex)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
+    if (!g_timestampindex->FindBlockHashes(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
@@ -1140,13 +1156,13 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
 
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 {
-    if (!fSpentIndex)
+    if (!g_spentindex)
         return false;
 
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!g_spentindex->FindSpent(key, value))
         return false;
 
     return true;
@@ -1154,10 +1170,10 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 
 bool GetAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
 {
-    if (!fAddressIndex)
+    if (!g_addressindex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!g_addressindex->FindAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
@@ -1165,10 +1181,10 @@ bool GetAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddre
 
 bool GetAddressUnspent(uint160 addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs)
 {
-    if (!fAddressIndex)
+    if (!g_addressindex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!g_addressindex->FindAddressUnspent(addressHash, type, unspentOutputs))
         return error("unable to get txids for address");
 
     return true;
@@ -1575,6 +1591,51 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+static Mutex cs_shieldedProofCache;
+static CuckooCache::cache<uint256, SignatureCacheHasher> shieldedProofCache GUARDED_BY(cs_shieldedProofCache);
+static uint256 shieldedProofCacheNonce(GetRandHash());
+
+void InitShieldedProofCache() {
+    LOCK(cs_shieldedProofCache);
+    size_t nElems = shieldedProofCache.setup_bytes((size_t)SHIELDED_PROOF_CACHE_SIZE << 20);
+    LogPrintf("Using %zu MiB for shielded proof cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >> 20, nElems);
+}
+
+static uint256 GetShieldedProofCacheEntry(const CTransaction& tx, uint32_t consensusBranchId)
+{
+    uint256 hashCacheEntry;
+    CSHA256().Write(shieldedProofCacheNonce.begin(), 32).Write(tx.GetHash().begin(), 32).Write((unsigned char*)&consensusBranchId, sizeof(consensusBranchId)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+static bool IsShieldedProofCached(const CTransaction& tx, uint32_t consensusBranchId)
+{
+    if (tx.vJoinSplit.empty() && tx.vShieldedSpend.empty() && tx.vShieldedOutput.empty()) return false;
+    const uint256 hashCacheEntry = GetShieldedProofCacheEntry(tx, consensusBranchId);
+    LOCK(cs_shieldedProofCache);
+    return shieldedProofCache.contains(hashCacheEntry, false);
+}
+
+void AddShieldedProofCached(const CTransaction& tx, uint32_t consensusBranchId)
+{
+    const uint256 hashCacheEntry = GetShieldedProofCacheEntry(tx, consensusBranchId);
+    LOCK(cs_shieldedProofCache);
+    shieldedProofCache.insert(hashCacheEntry);
+}
+
+bool PreVerifyShieldedTransaction(const CTransaction& tx, CValidationState& state, int nHeight)
+{
+    auto verifier = ProofVerifier::Strict();
+    if (!CheckTransaction(tx, state, verifier))
+        return false;
+    if (!ContextualCheckTransaction(tx, state, nHeight))
+        return false;
+
+    AddShieldedProofCached(tx, CurrentEpochBranchId(nHeight, Params().GetConsensus()));
+    return true;
+}
+
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set.
@@ -1794,10 +1855,8 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
 }
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
- *  When FAILED is returned, view is left in an indeterminate state.
- *  The addressIndex and spentIndex will be updated if requested.
-*/
-DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, bool ignoreAddressIndex)
+ *  When FAILED is returned, view is left in an indeterminate state. */
+DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
 {
     bool fClean = true;
 
@@ -1812,36 +1871,12 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         return DISCONNECT_FAILED;
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
         const CTransaction &tx = *(block.vtx[i]);
         uint256 const hash = tx.GetHash();
         bool is_coinbase = tx.IsCoinBase();
 
-        if (fAddressIndex) {
-            for (unsigned int k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
-                CScript::ScriptType scriptType = out.scriptPubKey.GetType();
-                if (scriptType != CScript::UNKNOWN) {
-                    uint160 const addrHash = out.scriptPubKey.AddressHash();
-
-                    // undo receiving activity
-                    addressIndex.push_back(std::make_pair(
-                        CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, k, false),
-                        out.nValue));
-
-                    // undo unspent index
-                    addressUnspentIndex.push_back(std::make_pair(
-                        CAddressUnspentKey(scriptType, addrHash, hash, k),
-                        CAddressUnspentValue()));
-                }
-            }
-        }
-
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
         for (size_t o = 0; o < tx.vout.size(); o++) {
@@ -1866,34 +1901,10 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 return DISCONNECT_FAILED;
             }
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
-                const CTxIn input = tx.vin[j];
                 const COutPoint &out = tx.vin[j].prevout;
                 int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
-
-                if (fAddressIndex) {
-                    const CTxOut &prevout = view.AccessCoin(tx.vin[j].prevout).out;
-                    CScript::ScriptType scriptType = prevout.scriptPubKey.GetType();
-                    if (scriptType != CScript::UNKNOWN) {
-                        uint160 const addrHash = prevout.scriptPubKey.AddressHash();
-
-                        // undo spending activity
-                        addressIndex.push_back(std::make_pair(
-                            CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, j, true),
-                            prevout.nValue * -1));
-
-                        // restore unspent index
-                        addressUnspentIndex.push_back(std::make_pair(
-                            CAddressUnspentKey(scriptType, addrHash, input.prevout.hash, input.prevout.n),
-                            CAddressUnspentValue(prevout.nValue, prevout.scriptPubKey, txundo.vprevout[j].nHeight)));
-                    }
-                }
-
-                if (fSpentIndex) {
-                    // undo and delete the spent index
-                    spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue()));
-                }
             }
             // At this point, all of txundo.vprevout should have been moved out.
         }
@@ -1916,24 +1927,6 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
-    if (!ignoreAddressIndex && fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            error("Failed to delete address index");
-            return DISCONNECT_FAILED;
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            error("Failed to write address unspent index");
-            return DISCONNECT_FAILED;
-        }
-    }
-
-    if (!ignoreAddressIndex && fSpentIndex) {
-        if (!pblocktree->UpdateSpentIndex(spentIndex)) {
-            error("Failed to write transaction index");
-            return DISCONNECT_FAILED;
-        }
-    }
-
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -2108,7 +2101,7 @@ static CBlockIndex* GetLastCheckpoint(const CCheckpointData& data) EXCLUSIVE_LOC
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, bool ignoreAddressIndex)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, bool fTrustMempoolProofs)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -2143,7 +2136,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     // is enforced in ContextualCheckBlockHeader(); we wouldn't want to
     // re-enforce that rule here (at least until we make it impossible for
     // GetAdjustedTime() to go backward).
-    if (!CheckBlock(block, state, chainparams.GetConsensus(), fExpensiveChecks ? verifier : disabledVerifier, !fJustCheck, !fJustCheck)) {
+    if (!CheckBlock(block, state, chainparams.GetConsensus(), fExpensiveChecks && !fTrustMempoolProofs ? verifier : disabledVerifier, !fJustCheck, !fJustCheck)) {
         if (state.GetReason() == ValidationInvalidReason::BLOCK_MUTATED) {
             // We don't write down blocks to disk if they may have been
             // corrupted, so this should be impossible unless we're having hardware
@@ -2153,6 +2146,17 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
     }
 
+    // JoinSplit proofs of transactions the mempool verified on admission
+    // are not verified again, see TestBlockValidity.
+    if (fExpensiveChecks && fTrustMempoolProofs) {
+        for (const auto& tx : block.vtx) {
+            if (tx->vJoinSplit.empty() || mempool.proofsVerified(tx->GetHash(), consensusBranchId))
+                continue;
+            if (!CheckTransaction(*tx, state, verifier, false))
+                return error("%s: Consensus::CheckTransaction: %s", __func__, FormatStateMessage(state));
+        }
+    }
+
     // verify that the view's current state corresponds to the previous block
     uint256 hashPrevBlock = pindex->pprev == nullptr ? uint256() : pindex->pprev->GetBlockHash();
     assert(hashPrevBlock == view.GetBestBlock());
@@ -2361,18 +2365,14 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     SaplingMerkleTree sapling_tree;
     assert(view.GetSaplingAnchorAt(view.GetBestAnchor(SAPLING), sapling_tree));
+    std::vector<libzcash::PedersenHash> sapling_commitments;
 
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
-
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
-        const uint256 hash = tx.GetHash();
 
         nInputs += tx.vin.size();
 
@@ -2414,35 +2414,6 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 return state.Invalid(ValidationInvalidReason::CONSENSUS, error("%s: contains a non-BIP68-final transaction", __func__),
                                  REJECT_INVALID, "bad-txns-nonfinal");
             }
-
-            if (fAddressIndex || fSpentIndex) {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.AccessCoin(tx.vin[j].prevout).out;
-                    CScript::ScriptType scriptType = prevout.scriptPubKey.GetType();
-                    const uint160 addrHash = prevout.scriptPubKey.AddressHash();
-                    if (fAddressIndex && scriptType != CScript::UNKNOWN) {
-                        // record spending activity
-                        addressIndex.push_back(std::make_pair(
-                            CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, j, true),
-                            prevout.nValue * -1));
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(std::make_pair(
-                            CAddressUnspentKey(scriptType, addrHash, input.prevout.hash, input.prevout.n),
-                            CAddressUnspentValue()));
-                    }
-                    if (fSpentIndex) {
-                        // Add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input.
-                        // If we do not recognize the script type, we still add an entry to the
-                        // spentindex db, with a script type of 0 and addrhash of all zeroes.
-                        spentIndex.push_back(std::make_pair(
-                            CSpentIndexKey(input.prevout.hash, input.prevout.n),
-                            CSpentIndexValue(hash, j, pindex->nHeight, prevout.nValue, scriptType, addrHash)));
-                    }
-                }
-            }
         }
 
         // GetTransactionSigOpCost counts 3 types of sigops:
@@ -2476,26 +2447,6 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             control.Add(vChecks);
         }
 
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-                CScript::ScriptType scriptType = out.scriptPubKey.GetType();
-                if (scriptType != CScript::UNKNOWN) {
-                    uint160 const addrHash = out.scriptPubKey.AddressHash();
-
-                    // record receiving activity
-                    addressIndex.push_back(std::make_pair(
-                        CAddressIndexKey(scriptType, addrHash, pindex->nHeight, i, hash, k, false),
-                        out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(std::make_pair(
-                        CAddressUnspentKey(scriptType, addrHash, hash, k),
-                        CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                }
-            }
-        }
-
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -2510,10 +2461,14 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         }
 
         for (const OutputDescription &outputDescription : tx.vShieldedOutput) {
-            sapling_tree.append(outputDescription.cm);
+            sapling_commitments.push_back(outputDescription.cm);
         }
     }
 
+    // Sapling anchors are the trees of previous blocks, so the commitments of
+    // the block are all appended at once.
+    sapling_tree.append(sapling_commitments);
+
     view.PushAnchor(sprout_tree);
     view.PushAnchor(sapling_tree);
     if (!fJustCheck) {
@@ -2566,42 +2521,6 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
     assert(pindex->phashBlock);
 
-    if (!ignoreAddressIndex && fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
-        }
-    }
-
-    if (!ignoreAddressIndex && fSpentIndex) {
-        if (!pblocktree->UpdateSpentIndex(spentIndex)) {
-            return AbortNode(state, "Failed to write transaction index");
-        }
-    }
-
-    if (fTimestampIndex) {
-        unsigned int logicalTS = pindex->nTime;
-        unsigned int prevLogicalTS = 0;
-
-        // retrieve logical timestamp of the previous block
-        if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
-                LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
-
-        if (logicalTS <= prevLogicalTS) {
-            logicalTS = prevLogicalTS + 1;
-            LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
-        }
-
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
-    }
-
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -3594,6 +3513,26 @@ void FallbackSproutValuePoolBalance(CBlockIndex *pindex, const CChainParams& cha
     }
 }
 
+/** Set the note commitment tree sizes of a block whose parents have all been linked. */
+static void UpdateChainCommitmentCounts(CBlockIndex* pindex)
+{
+    if (!pindex->pprev) {
+        pindex->nChainSproutCommitments = pindex->nSproutCommitments;
+        pindex->nChainSaplingCommitments = pindex->nSaplingCommitments;
+        return;
+    }
+    if (pindex->pprev->nChainSproutCommitments && pindex->nSproutCommitments) {
+        pindex->nChainSproutCommitments = *pindex->pprev->nChainSproutCommitments + *pindex->nSproutCommitments;
+    } else {
+        pindex->nChainSproutCommitments = nullopt;
+    }
+    if (pindex->pprev->nChainSaplingCommitments && pindex->nSaplingCommitments) {
+        pindex->nChainSaplingCommitments = *pindex->pprev->nChainSaplingCommitments + *pindex->nSaplingCommitments;
+    } else {
+        pindex->nChainSaplingCommitments = nullopt;
+    }
+}
+
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pindexNew, const FlatFilePos& pos, const Consensus::Params& consensusParams)
 {
@@ -3601,22 +3540,33 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
     pindexNew->nChainTx = 0;
     CAmount sproutValue = 0;
     CAmount saplingValue = 0;
-    for (auto tx : block.vtx) {
+    uint32_t sproutCommitments = 0;
+    uint32_t saplingCommitments = 0;
+    uint32_t saplingSpends = 0;
+    for (const auto& tx : block.vtx) {
         // Negative valueBalance "takes" money from the transparent value pool
         // and adds it to the Sapling value pool. Positive valueBalance "gives"
         // money to the transparent value pool, removing from the Sapling value
         // pool. So we invert the sign here.
         saplingValue += -tx->valueBalance;
+        saplingCommitments += tx->vShieldedOutput.size();
+        saplingSpends += tx->vShieldedSpend.size();
 
-        for (auto js : tx->vJoinSplit) {
+        for (const auto& js : tx->vJoinSplit) {
             sproutValue += js.vpub_old;
             sproutValue -= js.vpub_new;
+            sproutCommitments += js.commitments.size();
         }
     }
     pindexNew->nSproutValue = sproutValue;
     pindexNew->nChainSproutValue = nullopt;
     pindexNew->nSaplingValue = saplingValue;
     pindexNew->nChainSaplingValue = nullopt;
+    pindexNew->nSproutCommitments = sproutCommitments;
+    pindexNew->nChainSproutCommitments = nullopt;
+    pindexNew->nSaplingCommitments = saplingCommitments;
+    pindexNew->nChainSaplingCommitments = nullopt;
+    pindexNew->nSaplingSpends = saplingSpends;
     pindexNew->nCachedBranchId = CurrentEpochBranchId(pindexNew->nHeight, consensusParams);
     pindexNew->nFile = pos.nFile;
     pindexNew->nDataPos = pos.nPos;
@@ -3654,6 +3604,7 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
                 pindex->nChainSproutValue = pindex->nSproutValue;
                 pindex->nChainSaplingValue = pindex->nSaplingValue;
             }
+            UpdateChainCommitmentCounts(pindex);
 
             // Fall back to hardcoded Sprout value pool balance
             FallbackSproutValuePoolBalance(pindex, Params());
@@ -3847,6 +3798,29 @@ bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::P
     return true;
 }
 
+bool PreCheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, int nHeight)
+{
+    // Same checks as ProcessNewBlock, which then finds the block checked already.
+    auto verifier = ProofVerifier::Disabled();
+    if (!CheckBlock(block, state, consensusParams, verifier))
+        return false;
+
+    // The proofs and signatures of shielded transactions are remembered, so
+    // that ContextualCheckBlock does not verify them again under cs_main. A
+    // failure is reported by ContextualCheckBlock, as it would be without
+    // the pre-check.
+    if (nHeight >= 0) {
+        const uint32_t consensusBranchId = CurrentEpochBranchId(nHeight, consensusParams);
+        for (const auto& tx : block.vtx) {
+            if (tx->vJoinSplit.empty() && tx->vShieldedSpend.empty() && tx->vShieldedOutput.empty()) continue;
+            if (IsShieldedProofCached(*tx, consensusBranchId)) continue;
+            CValidationState tx_state;
+            PreVerifyShieldedTransaction(*tx, tx_state, nHeight);
+        }
+    }
+    return true;
+}
+
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
     int height = pindexPrev == nullptr ? 0 : pindexPrev->nHeight + 1;
@@ -3977,9 +3951,10 @@ static bool ContextualCheckBlockHeader(const CBlockHeader& block, CValidationSta
  *  in ConnectBlock().
  *  Note that -reindex-chainstate skips the validation that happens here!
  */
-static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
+static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev, bool fTrustMempoolProofs = false)
 {
     const int nHeight = pindexPrev == nullptr ? 0 : pindexPrev->nHeight + 1;
+    const uint32_t consensusBranchId = CurrentEpochBranchId(nHeight, consensusParams);
 
     // Start enforcing BIP113 (Median Time Past).
     int nLockTimeFlags = 0;
@@ -3995,7 +3970,10 @@ static bool ContextualCheckBlock(const CBlock& block, CValidationState& state, c
     // Check that all transactions are finalized
     for (const auto& tx : block.vtx) {
         // Check transaction contextually against consensus rules at block height
-        if (!ContextualCheckTransaction(*tx, state, nHeight)) {
+        // Proofs verified by PreCheckBlock or on admission to the mempool are not verified again.
+        const bool fCheckShieldedProofs = !IsShieldedProofCached(*tx, consensusBranchId) &&
+                                          (!fTrustMempoolProofs || !mempool.proofsVerified(tx->GetHash(), consensusBranchId));
+        if (!ContextualCheckTransaction(*tx, state, nHeight, fCheckShieldedProofs)) {
             return false; // Failure reason has been set in validation state object
         }
         if (!IsFinalTx(*tx, nHeight, nLockTimeCutoff)) {
@@ -4321,7 +4299,7 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     return true;
 }
 
-bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot)
+bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot, bool fTrustMempoolProofs)
 {
     AssertLockHeld(cs_main);
     assert(pindexPrev && pindexPrev == ::ChainActive().Tip());
@@ -4340,9 +4318,9 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
         return error("%s: Consensus::ContextualCheckBlockHeader: %s", __func__, FormatStateMessage(state));
     if (!CheckBlock(block, state, chainparams.GetConsensus(), verifier, fCheckPOW, fCheckMerkleRoot))
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
-    if (!ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindexPrev))
+    if (!ContextualCheckBlock(block, state, chainparams.GetConsensus(), pindexPrev, fTrustMempoolProofs))
         return error("%s: Consensus::ContextualCheckBlock: %s", __func__, FormatStateMessage(state));
-    if (!::ChainstateActive().ConnectBlock(block, state, &indexDummy, viewNew, chainparams, true))
+    if (!::ChainstateActive().ConnectBlock(block, state, &indexDummy, viewNew, chainparams, true, fTrustMempoolProofs))
         return false;
     assert(state.IsValid());
 
@@ -4608,6 +4586,9 @@ bool BlockManager::LoadBlockIndex(
                 pindex->nChainSproutValue = pindex->nSproutValue;
                 pindex->nChainSaplingValue = pindex->nSaplingValue;
             }
+            if (pindex->nChainTx) {
+                UpdateChainCommitmentCounts(pindex);
+            }
 
             // Fall back to hardcoded Sprout value pool balance
             FallbackSproutValuePoolBalance(pindex, Params());
@@ -4705,18 +4686,6 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_RE
     pblocktree->ReadReindexing(fReindexing);
     if(fReindexing) fReindex = true;
 
-    // Check whether we have an address index
-    pblocktree->ReadFlag("addressindex", fAddressIndex);
-    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
-
-    // Check whether we have a spent index
-    pblocktree->ReadFlag("spentindex", fSpentIndex);
-    LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
-
-    // Check whether we have a timestamp index
-    pblocktree->ReadFlag("timestampindex", fTimestampIndex);
-    LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
-
     // Fill in-memory data
     for (const std::pair<const uint256, CBlockIndex*>& item : g_blockman.m_block_index)
     {
@@ -4832,7 +4801,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && (coins.DynamicMemoryUsage() + ::ChainstateActive().CoinsTip().DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = ::ChainstateActive().DisconnectBlock(block, pindex, coins, true);
+            DisconnectResult res = ::ChainstateActive().DisconnectBlock(block, pindex, coins);
             if (res == DISCONNECT_FAILED) {
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             }
@@ -4867,7 +4836,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
                 return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            if (!::ChainstateActive().ConnectBlock(block, state, pindex, coins, chainparams, false, true))
+            if (!::ChainstateActive().ConnectBlock(block, state, pindex, coins, chainparams))
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s (%s)", pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
         }
     }
@@ -5162,21 +5131,6 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-
-        // Use the provided setting for -addressindex in the new database
-        fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
-        pblocktree->WriteFlag("addressindex", fAddressIndex);
-        LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
-
-        // Use the provided setting for -spentindex in the new database
-        fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
-        pblocktree->WriteFlag("spentindex", fSpentIndex);
-        LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
-
-        // Use the provided setting for -timestampindex in the new database
-        fTimestampIndex = gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
-        pblocktree->WriteFlag("timestampindex", fTimestampIndex);
-        LogPrintf("%s: timestamp index %s\n", __func__, fTimestampIndex ? "enabled" : "disabled");
     }
     return true;
 }
@@ -5547,7 +5501,91 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(::ChainActive().Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+//! Version of mempool.dat without proof verification records, which is still loaded
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_PROOFS = 1;
+//! Number of transactions of mempool.dat whose proofs are checked together before they are accepted
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+//! Maximum number of threads checking the proofs of a batch of mempool.dat
+static const int MAX_MEMPOOL_LOAD_THREADS = 8;
+
+/**
+ * Read the node-local secret that authenticates the proof verification
+ * records of mempool.dat, creating it if fCreate is set and it is missing.
+ */
+static bool GetMempoolDumpKey(std::vector<unsigned char>& key, bool fCreate)
+{
+    const fs::path path = GetDataDir() / "mempool.key";
+    key.resize(CHMAC_SHA256::OUTPUT_SIZE);
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (file) {
+        const bool ok = fread(key.data(), 1, key.size(), file) == key.size();
+        fclose(file);
+        if (ok) return true;
+    }
+    if (!fCreate) return false;
+
+    GetStrongRandBytes(key.data(), key.size());
+    file = fsbridge::fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(key.data(), 1, key.size(), file) == key.size();
+    ok = FileCommit(file) && ok;
+    fclose(file);
+    return ok;
+}
+
+uint256 GetMempoolProofMAC(const std::vector<unsigned char>& key, const CTransaction& tx, uint32_t consensusBranchId)
+{
+    unsigned char branch[4];
+    WriteLE32(branch, consensusBranchId);
+    uint256 mac;
+    CHMAC_SHA256(key.data(), key.size()).Write(tx.GetHash().begin(), 32).Write(branch, sizeof(branch)).Finalize(mac.begin());
+    return mac;
+}
+
+static bool IsShieldedTransaction(const CTransaction& tx)
+{
+    return !tx.vJoinSplit.empty() || !tx.vShieldedSpend.empty() || !tx.vShieldedOutput.empty();
+}
+
+int64_t CheckMempoolDumpProofs(const std::vector<MempoolDumpEntry>& batch, const std::vector<unsigned char>& key, int64_t nExpiryTime)
+{
+    int nHeight;
+    {
+        LOCK(cs_main);
+        nHeight = ::ChainActive().Height() + 1;
+    }
+    const uint32_t consensusBranchId = CurrentEpochBranchId(nHeight, Params().GetConsensus());
+
+    std::atomic<size_t> next{0};
+    std::atomic<int64_t> trusted{0};
+    auto worker = [&]() {
+        util::ThreadRename("loadmempool");
+        for (size_t i = next++; i < batch.size(); i = next++) {
+            const MempoolDumpEntry& entry = batch[i];
+            if (entry.nTime <= nExpiryTime || !IsShieldedTransaction(*entry.tx)) continue;
+            if (!key.empty() && !entry.mac.IsNull() && entry.mac == GetMempoolProofMAC(key, *entry.tx, consensusBranchId)) {
+                AddShieldedProofCached(*entry.tx, consensusBranchId);
+                trusted++;
+            } else {
+                // AcceptToMemoryPool reports the failure, if any
+                CValidationState state;
+                PreVerifyShieldedTransaction(*entry.tx, state, nHeight);
+            }
+            if (ShutdownRequested()) return;
+        }
+    };
+
+    const int n_threads = std::max(1, std::min(GetNumCores(), MAX_MEMPOOL_LOAD_THREADS));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return trusted;
+}
 
 bool LoadMempool(CTxMemPool& pool)
 {
@@ -5560,56 +5598,76 @@ bool LoadMempool(CTxMemPool& pool)
         return false;
     }
 
+    // Without the key that signed the dump, all proofs are verified again.
+    std::vector<unsigned char> key;
+    if (!GetMempoolDumpKey(key, false)) {
+        key.clear();
+    }
+
     int64_t count = 0;
     int64_t expired = 0;
     int64_t failed = 0;
     int64_t already_there = 0;
+    int64_t trusted = 0;
     int64_t nNow = GetTime();
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_PROOFS) {
             return false;
         }
         uint64_t num;
         file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+        std::vector<MempoolDumpEntry> batch;
+        while (num) {
+            batch.clear();
+            for (; num && batch.size() < MEMPOOL_LOAD_BATCH_SIZE; num--) {
+                MempoolDumpEntry entry;
+                file >> entry.tx;
+                file >> entry.nTime;
+                file >> entry.nFeeDelta;
+                if (version == MEMPOOL_DUMP_VERSION) {
+                    file >> entry.mac;
+                }
+                batch.push_back(std::move(entry));
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (pool.exists(tx->GetHash())) {
-                        ++already_there;
+
+            // The proofs of the batch are checked in parallel first, so that
+            // only the contextual checks are left to AcceptToMemoryPool.
+            trusted += CheckMempoolDumpProofs(batch, key, nNow - nExpiryTimeout);
+
+            for (const MempoolDumpEntry& entry : batch) {
+                const CTransactionRef& tx = entry.tx;
+                CAmount amountdelta = entry.nFeeDelta;
+                if (amountdelta) {
+                    pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                }
+                CValidationState state;
+                if (entry.nTime + nExpiryTimeout > nNow) {
+                    LOCK(cs_main);
+                    AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, nullptr /* pfMissingInputs */, entry.nTime,
+                                               nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
+                                               false /* test_accept */);
+                    if (state.IsValid()) {
+                        ++count;
                     } else {
-                        ++failed;
+                        // mempool may contain the transaction already, e.g. from
+                        // wallet(s) having loaded it while we were processing
+                        // mempool transactions; consider these as valid, instead of
+                        // failed, but mark them as 'already there'
+                        if (pool.exists(tx->GetHash())) {
+                            ++already_there;
+                        } else {
+                            ++failed;
+                        }
                     }
+                } else {
+                    ++expired;
                 }
-            } else {
-                ++expired;
+                if (ShutdownRequested())
+                    return false;
             }
-            if (ShutdownRequested())
-                return false;
         }
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
@@ -5622,7 +5680,7 @@ bool LoadMempool(CTxMemPool& pool)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there, %i with trusted proofs\n", count, failed, expired, already_there, trusted);
     return true;
 }
 
@@ -5646,6 +5704,14 @@ bool DumpMempool(const CTxMemPool& pool)
 
     int64_t mid = GetTimeMicros();
 
+    // The proofs of the shielded transactions are attested under the node's
+    // own key, so that LoadMempool does not verify them again.
+    std::vector<unsigned char> key;
+    if (!GetMempoolDumpKey(key, true)) {
+        LogPrintf("Failed to write mempool key, shielded proofs will be verified again on load.\n");
+        key.clear();
+    }
+
     try {
         FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
         if (!filestr) {
@@ -5662,6 +5728,11 @@ bool DumpMempool(const CTxMemPool& pool)
             file << *(i.tx);
             file << (int64_t)i.nTime;
             file << (int64_t)i.nFeeDelta;
+            uint256 mac;
+            if (!key.empty() && i.fShieldedProofsVerified && IsShieldedTransaction(*i.tx)) {
+                mac = GetMempoolProofMAC(key, *i.tx, i.nBranchId);
+            }
+            file << mac;
             mapDeltas.erase(i.tx->GetHash());
         }
 
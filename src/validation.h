@@ -82,6 +82,8 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
+/** Size in MiB of the cache of pre-verified shielded transactions */
+static const unsigned int SHIELDED_PROOF_CACHE_SIZE = 4;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
@@ -123,6 +125,8 @@ static const bool DEFAULT_TXINDEX = false;
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
+static const bool DEFAULT_SHIELDEDINDEX = false;
+static const bool DEFAULT_COMPACTSAPLINGINDEX = false;
 static const bool DEFAULT_DB_COMPRESSION = true;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
@@ -376,6 +380,24 @@ public:
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Initializes the cache of shielded transactions whose proofs and signatures were pre-verified */
+void InitShieldedProofCache();
+
+/**
+ * Run the context-free checks and the proof and signature checks of a shielded
+ * transaction for the consensus branch of nHeight. This does not need cs_main.
+ * On success the transaction is remembered, so that AcceptToMemoryPool does not
+ * verify its proofs and signatures again as long as the branch is the same.
+ */
+bool PreVerifyShieldedTransaction(const CTransaction& tx, CValidationState& state, int nHeight);
+
+/**
+ * Remember that the proofs and signatures of a shielded transaction were
+ * verified for a consensus branch, e.g. on its admission to the mempool, so
+ * that ContextualCheckBlock does not verify them again.
+ */
+void AddShieldedProofCached(const CTransaction& tx, uint32_t consensusBranchId);
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool GetAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start = 0, int end = 0);
@@ -394,8 +416,23 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 /** Context-independent validity checks */
 bool CheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, ProofVerifier& verifier, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
 
-/** Check a block is completely valid from start to finish (only works on top of our current best block) */
-bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/**
+ * Run the context-free checks of a block received from a peer, which do not
+ * need cs_main, before ProcessNewBlock is called with it. If nHeight is not
+ * negative, the proofs and signatures of its shielded transactions are also
+ * verified for the consensus branch of that height and remembered, see
+ * PreVerifyShieldedTransaction. The block must not be used by another thread
+ * in the meantime, as CBlock::fChecked is set.
+ */
+bool PreCheckBlock(const CBlock& block, CValidationState& state, const Consensus::Params& consensusParams, int nHeight);
+
+/**
+ * Check a block is completely valid from start to finish (only works on top of our current best block).
+ * If fTrustMempoolProofs is set, the shielded proofs and signatures of transactions the mempool
+ * verified on admission for the branch of the block are not verified again, as when testing the
+ * block templates built from it.
+ */
+bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fTrustMempoolProofs = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /** Check whether witness commitments are required for a block, and whether to enforce NULLDUMMY (BIP 147) rules.
  *  Note that transaction witness validation rules are always enforced when P2SH is enforced. */
@@ -715,9 +752,9 @@ public:
     bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const FlatFilePos* dbp, bool* fNewBlock) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block (dis)connection on a given view:
-    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, bool ignoreAddressIndex = false);
+    DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view);
     bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                      CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, bool ignoreAddressIndex = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+                      CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck = false, bool fTrustMempoolProofs = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Apply the effects of a block disconnection on the UTXO set.
     bool DisconnectTip(CValidationState& state, const CChainParams& chainparams, DisconnectedBlockTransactions* disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::mempool.cs);
@@ -818,12 +855,41 @@ static const unsigned int REJECT_HIGHFEE = 0x100;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
-/** Dump the mempool to disk. */
+/**
+ * Dump the mempool to disk. The shielded transactions whose proofs and
+ * signatures were verified on admission are recorded with a MAC under a
+ * node-local key (mempool.key), attesting it for their branch.
+ */
 bool DumpMempool(const CTxMemPool& pool);
 
-/** Load the mempool from disk. */
+/**
+ * Load the mempool from disk. Transactions are read in batches whose
+ * shielded proofs are checked on several threads, or trusted if their MAC is
+ * valid for the current branch, before they are accepted one by one.
+ */
 bool LoadMempool(CTxMemPool& pool);
 
+/** A transaction read from mempool.dat */
+struct MempoolDumpEntry
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+    uint256 mac;
+};
+
+/** MAC attesting that the shielded proofs and signatures of a transaction were verified for a consensus branch. */
+uint256 GetMempoolProofMAC(const std::vector<unsigned char>& key, const CTransaction& tx, uint32_t consensusBranchId);
+
+/**
+ * Make the proofs and signatures of the shielded transactions of a batch of
+ * mempool.dat known to AcceptToMemoryPool, on several threads. Those whose MAC
+ * is valid for the current branch were verified before the dump and are
+ * trusted, the others are verified. Entries from nExpiryTime or earlier are
+ * skipped. Returns the number of trusted ones.
+ */
+int64_t CheckMempoolDumpProofs(const std::vector<MempoolDumpEntry>& batch, const std::vector<unsigned char>& key, int64_t nExpiryTime);
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
@@ -92,9 +92,10 @@ void StartWallets(CScheduler& scheduler)
         pwallet->postInitProcess();
     }
 
-    // Schedule periodic wallet flushes and tx rebroadcasts
+    // Schedule periodic wallet flushes, tx rebroadcasts and Sapling keypool top-ups
     scheduler.scheduleEvery(MaybeCompactWalletDB, 500);
     scheduler.scheduleEvery(MaybeResendWalletTxs, 1000);
+    scheduler.scheduleEvery(MaybeTopUpSaplingKeyPools, 1000);
 }
 
 void FlushWallets()
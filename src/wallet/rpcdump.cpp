@@ -92,9 +92,9 @@ static bool GetWalletAddressesForKey(CWallet* const pwallet, const CKeyID& keyid
 
 static const int64_t TIMESTAMP_MIN = 0;
 
-static void RescanWallet(CWallet& wallet, const WalletRescanReserver& reserver, int64_t time_begin = TIMESTAMP_MIN, bool update = true)
+static void RescanWallet(CWallet& wallet, const WalletRescanReserver& reserver, int64_t time_begin = TIMESTAMP_MIN, bool update = true, bool shielded_only = false)
 {
-    int64_t scanned_time = wallet.RescanFromTime(time_begin, reserver, update);
+    int64_t scanned_time = wallet.RescanFromTime(time_begin, reserver, update, shielded_only);
     if (wallet.IsAbortingRescan()) {
         throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted by user.");
     } else if (scanned_time > time_begin) {
@@ -102,6 +102,36 @@ static void RescanWallet(CWallet& wallet, const WalletRescanReserver& reserver,
     }
 }
 
+/**
+ * Earliest time notes to a shielded address can have been mined at: the
+ * creation time of its key if known, and for Sapling no earlier than the
+ * activation of Sapling.
+ */
+int64_t GetShieldedKeyBirthday(const CWallet& wallet, interfaces::Chain::Lock& locked_chain, const libzcash::PaymentAddress& address) EXCLUSIVE_LOCKS_REQUIRED(wallet.cs_wallet)
+{
+    int64_t birthday = TIMESTAMP_MIN;
+    if (auto sprout_addr = std::get_if<libzcash::SproutPaymentAddress>(&address)) {
+        auto it = wallet.mapSproutKeyMetadata.find(*sprout_addr);
+        if (it != wallet.mapSproutKeyMetadata.end()) {
+            birthday = it->second.nCreateTime;
+        }
+    } else if (auto sapling_addr = std::get_if<libzcash::SaplingPaymentAddress>(&address)) {
+        libzcash::SaplingIncomingViewingKey ivk;
+        if (wallet.GetSaplingIncomingViewingKey(*sapling_addr, ivk)) {
+            auto it = wallet.mapSaplingKeyMetadata.find(ivk);
+            if (it != wallet.mapSaplingKeyMetadata.end()) {
+                birthday = it->second.nCreateTime;
+            }
+        }
+        const int activation_height = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_SAPLING].nActivationHeight;
+        const Optional<int> tip_height = locked_chain.getHeight();
+        if (activation_height > 0 && tip_height && *tip_height >= activation_height) {
+            birthday = std::max(birthday, locked_chain.getBlockTime(activation_height));
+        }
+    }
+    return birthday;
+}
+
 UniValue importprivkey(const JSONRPCRequest& request)
 {
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
@@ -1646,7 +1676,8 @@ UniValue z_importkey(const JSONRPCRequest& request)
                 "\nAdds a zkey (as returned by z_exportkey) to your wallet.\n"
             "\nNote: This call can take over an hour to complete if rescan is true, during that time, other rpc calls\n"
             "may report that the imported key exists but related transactions are still missing, leading to temporarily incorrect/bogus balances and unspent outputs until rescan completes.\n"
-            "Note: Use \"getwalletinfo\" to query the scanning progress.\n",
+            "Note: Use \"getwalletinfo\" to query the scanning progress.\n"
+            "Note: The rescan starts from the creation time of the key if known, and only scans blocks with shielded spends or outputs.\n",
                 {
                     {"zkey", RPCArg::Type::STR, RPCArg::Optional::NO, "The zkey (see z_exportkey)"},
                     {"label", RPCArg::Type::STR, /* default */ "current label if address exists, otherwise \"\"", "An optional label"},
@@ -1680,6 +1711,7 @@ UniValue z_importkey(const JSONRPCRequest& request)
 
     WalletRescanReserver reserver(pwallet);
     bool fRescan = true;
+    int64_t time_begin = TIMESTAMP_MIN;
     {
         auto locked_chain = pwallet->chain().lock();
         LOCK(pwallet->cs_wallet);
@@ -1740,9 +1772,13 @@ UniValue z_importkey(const JSONRPCRequest& request)
                 }
             }
         }
+
+        time_begin = GetShieldedKeyBirthday(*pwallet, *locked_chain, dest);
     }
     if (fRescan) {
-        RescanWallet(*pwallet, reserver);
+        // The rest of the wallet is up to date, so only blocks where the new
+        // key can have received or spent notes need to be scanned.
+        RescanWallet(*pwallet, reserver, time_begin, true /* update */, true /* shielded_only */);
     }
 
     return result;
@@ -1760,7 +1796,8 @@ UniValue z_importviewingkey(const JSONRPCRequest& request)
                 "\nAdds a viewing key (as returned by z_exportviewingkey) to your wallet. Requires a new wallet backup.\n"
             "\nNote: This call can take over an hour to complete if rescan is true, during that time, other rpc calls\n"
             "may report that the imported pubkey exists but related transactions are still missing, leading to temporarily incorrect/bogus balances and unspent outputs until rescan completes.\n"
-            "Note: Use \"getwalletinfo\" to query the scanning progress.\n",
+            "Note: Use \"getwalletinfo\" to query the scanning progress.\n"
+            "Note: The rescan only scans blocks with shielded spends or outputs, from the activation of Sapling for Sapling keys.\n",
                 {
                     {"vkey", RPCArg::Type::STR, RPCArg::Optional::NO, "The viewing key (see z_exportviewingkey)"},
                     {"label", RPCArg::Type::STR, /* default */ "\"\"", "An optional label"},
@@ -1831,7 +1868,8 @@ UniValue z_importviewingkey(const JSONRPCRequest& request)
     // We want to scan for transactions and notes
     if (fRescan)
     {
-        RescanWallet(*pwallet, reserver);
+        const int64_t time_begin = GetShieldedKeyBirthday(*pwallet, *locked_chain, addrInfo.second);
+        RescanWallet(*pwallet, reserver, time_begin, true /* update */, true /* shielded_only */);
         {
             auto locked_chain = pwallet->chain().lock();
             LOCK(pwallet->cs_wallet);
@@ -2559,6 +2559,7 @@ static UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"keypoololdest\": xxxxxx,           (numeric) the timestamp (seconds since Unix epoch) of the oldest pre-generated key in the key pool\n"
             "  \"keypoolsize\": xxxx,               (numeric) how many new keys are pre-generated (only counts external keys)\n"
             "  \"keypoolsize_hd_internal\": xxxx,   (numeric) how many new keys are pre-generated for internal use (used for change outputs, only appears if the wallet is using this feature, otherwise external keys are used)\n"
+            "  \"saplingkeypoolsize\": xxxx,        (numeric) how many new Sapling keys are pre-generated\n"
             "  \"unlocked_until\": ttt,             (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": x.xxxx,                (numeric) the transaction fee configuration, set in " + CURRENCY_UNIT + "/kB\n"
             "  \"hdseedid\": \"<hash160>\"            (string, optional) the Hash160 of the HD seed (only present when HD is enabled)\n"
@@ -2606,6 +2607,7 @@ static UniValue getwalletinfo(const JSONRPCRequest& request)
     if (pwallet->CanSupportFeature(FEATURE_HD_SPLIT)) {
         obj.pushKV("keypoolsize_hd_internal",   (int64_t)(pwallet->GetKeyPoolSize() - kpExternalSize));
     }
+    obj.pushKV("saplingkeypoolsize", (int64_t)pwallet->GetSaplingKeyPoolSize());
     if (pwallet->IsCrypted()) {
         obj.pushKV("unlocked_until", pwallet->nRelockTime);
     }
@@ -3155,6 +3157,7 @@ static UniValue z_listunspent(const JSONRPCRequest& request)
             "    \"spendable\" : true|false,  (boolean) true if note can be spent by wallet, false if address is watchonly\n"
             "    \"address\" : \"address\",     (string) the shielded address\n"
             "    \"label\" : \"label\",         (string) The associated label, or \"\" for the default label\n"
+            "    \"diversifier_index\" : \"hex\", (string) the diversifier index of the address, if it was generated by z_getnewdiversifiedaddresses (sapling)\n"
             "    \"amount\": xxxxx,           (numeric) the amount of value in the note\n"
             "    \"memo\": xxxxx,             (string) hexademical string representation of memo field\n"
             "    \"change\": true|false,      (boolean) true if the address that received the note is also one of the sending addresses\n"
@@ -3279,6 +3282,10 @@ static UniValue z_listunspent(const JSONRPCRequest& request)
         if (i != pwallet->mapSaplingAddressBook.end()) {
             obj.pushKV("label", i->second.name);
         }
+        CSaplingDiversifiedAddress diversified;
+        if (pwallet->GetSaplingDiversifiedAddress(entry.address, diversified)) {
+            obj.pushKV("diversifier_index", diversified.j.GetHex());
+        }
 
         obj.pushKV("amount", ValueFromAmount(CAmount(entry.note.value()))); // note.value() is equivalent to plaintext.value()
         obj.pushKV("memo", HexStr(entry.memo));
@@ -4704,10 +4711,11 @@ static UniValue z_getnewaddress(const JSONRPCRequest& request)
                 },
             }.Check(request);
 
-    LOCK(pwallet->cs_wallet);
-
-    if (!pwallet->CanGetAddresses()) {
-        throw JSONRPCError(RPC_WALLET_ERROR, "Error: This wallet has no available keys");
+    {
+        LOCK(pwallet->cs_wallet);
+        if (!pwallet->CanGetAddresses()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error: This wallet has no available keys");
+        }
     }
 
     // Parse the label first so we don't generate a key if there's an error
@@ -4725,12 +4733,11 @@ static UniValue z_getnewaddress(const JSONRPCRequest& request)
     libzcash::PaymentAddress dest;
     std::string error;
 
-    EnsureWalletIsUnlocked(pwallet);
-
     if (address_type == ADDR_TYPE_SPROUT) {
         if (isSaplingEnabled) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Generation of new sprout addresses is deprecated and will be fully removed in 3.1.0");
         }
+        EnsureWalletIsUnlocked(pwallet);
         if (!pwallet->GetNewSproutDestination(label, dest, error)) {
             throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, error);
         }
@@ -4745,6 +4752,202 @@ static UniValue z_getnewaddress(const JSONRPCRequest& request)
     return EncodePaymentAddress(dest);
 }
 
+static UniValue z_getnewaddresses(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+            RPCHelpMan{"z_getnewaddresses",
+                "\nReturns count new LitecoinZ Sapling addresses for receiving payments.\n"
+                "Addresses are taken from the Sapling keypool first, the remaining keys are derived\n"
+                "in parallel and written to the wallet at once.\n"
+                "If 'label' is specified, the addresses are added to the address book with 'label'.\n",
+                {
+                    {"count", RPCArg::Type::NUM, RPCArg::Optional::NO, "The number of addresses to generate, at most 10000."},
+                    {"label", RPCArg::Type::STR, /* default */ "\"\"", "The label name for the shielded addresses to be linked to. It can also be set to the empty string \"\" to represent the default label."},
+                },
+                RPCResult{
+            "[\n"
+            "  \"address\"    (string) A new litecoinz shielded address\n"
+            "  ,...\n"
+            "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("z_getnewaddresses", "100")
+            + HelpExampleRpc("z_getnewaddresses", "100, \"label\"")
+                },
+            }.Check(request);
+
+    {
+        LOCK(pwallet->cs_wallet);
+        if (!pwallet->CanGetAddresses()) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error: This wallet has no available keys");
+        }
+    }
+
+    int count = request.params[0].get_int();
+    if (count < 1 || count > 10000) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count, must be between 1 and 10000");
+    }
+
+    std::string label;
+    if (!request.params[1].isNull())
+        label = LabelFromValue(request.params[1]);
+
+    // Not holding cs_wallet, the keys not in the keypool are derived without it
+    std::vector<libzcash::PaymentAddress> dests;
+    std::string error;
+    if (!pwallet->GetNewSaplingDestinations(count, label, dests, error)) {
+        throw JSONRPCError(RPC_WALLET_KEYPOOL_RAN_OUT, error);
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& dest : dests) {
+        ret.push_back(EncodePaymentAddress(dest));
+    }
+    return ret;
+}
+
+static UniValue z_getnewdiversifiedaddresses(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+            RPCHelpMan{"z_getnewdiversifiedaddresses",
+                "\nReturns count new diversified addresses of the Sapling key of an address of the wallet.\n"
+                "All diversified addresses of a key share its incoming viewing key, so notes sent to any\n"
+                "of them cost the wallet a single trial decryption per output.\n"
+                "If 'label' is specified, the addresses are added to the address book with 'label'.\n",
+                {
+                    {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "A Sapling address of the key to generate addresses of."},
+                    {"count", RPCArg::Type::NUM, RPCArg::Optional::NO, "The number of addresses to generate, at most 10000."},
+                    {"label", RPCArg::Type::STR, /* default */ "\"\"", "The label name for the addresses to be linked to."},
+                },
+                RPCResult{
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"address\",            (string) A new diversified address\n"
+            "    \"diversifier_index\" : \"hex\",      (string) The diversifier index of the address\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("z_getnewdiversifiedaddresses", "\"zs1...\" 100")
+            + HelpExampleRpc("z_getnewdiversifiedaddresses", "\"zs1...\", 100, \"deposits\"")
+                },
+            }.Check(request);
+
+    auto res = DecodePaymentAddress(request.params[0].get_str());
+    auto addr = std::get_if<libzcash::SaplingPaymentAddress>(&res);
+    if (addr == nullptr) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Sapling address");
+    }
+
+    int count = request.params[1].get_int();
+    if (count < 1 || count > 10000) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid count, must be between 1 and 10000");
+    }
+
+    std::string label;
+    if (!request.params[2].isNull())
+        label = LabelFromValue(request.params[2]);
+
+    libzcash::SaplingIncomingViewingKey ivk;
+    libzcash::SaplingExtendedFullViewingKey extfvk;
+    if (!(pwallet->GetSaplingIncomingViewingKey(*addr, ivk) && pwallet->GetSaplingFullViewingKey(ivk, extfvk))) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address does not belong to this wallet, viewing key not found");
+    }
+
+    // Not holding cs_wallet, the diversifier search only takes it to write the addresses
+    UniValue ret(UniValue::VARR);
+    for (const auto& address : pwallet->GenerateSaplingDiversifiedAddresses(extfvk, count, label)) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("address", EncodePaymentAddress(address.second));
+        obj.pushKV("diversifier_index", address.first.GetHex());
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+static UniValue z_lookupdiversifiedaddresses(const JSONRPCRequest& request)
+{
+    std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
+    CWallet* const pwallet = wallet.get();
+
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+            RPCHelpMan{"z_lookupdiversifiedaddresses",
+                "\nReturns the Sapling key and diversifier index of addresses generated by z_getnewdiversifiedaddresses.\n",
+                {
+                    {"addresses", RPCArg::Type::ARR, RPCArg::Optional::NO, "A json array of Sapling addresses",
+                        {
+                            {"address", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "Sapling address"},
+                        },
+                    },
+                },
+                RPCResult{
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"address\",            (string) The address\n"
+            "    \"found\" : true|false,              (boolean) Whether the address is a diversified address of the wallet\n"
+            "    \"diversifier_index\" : \"hex\",      (string) The diversifier index of the address\n"
+            "    \"default_address\" : \"address\",    (string) The default address of the key of the address\n"
+            "    \"label\" : \"label\",                (string) The label of the address\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("z_lookupdiversifiedaddresses", "\"[\\\"zs1...\\\"]\"")
+            + HelpExampleRpc("z_lookupdiversifiedaddresses", "[\"zs1...\"]")
+                },
+            }.Check(request);
+
+    RPCTypeCheckArgument(request.params[0], UniValue::VARR);
+    const UniValue& addresses = request.params[0].get_array();
+
+    LOCK(pwallet->cs_wallet);
+
+    UniValue ret(UniValue::VARR);
+    for (unsigned int idx = 0; idx < addresses.size(); idx++) {
+        auto res = DecodePaymentAddress(addresses[idx].get_str());
+        auto addr = std::get_if<libzcash::SaplingPaymentAddress>(&res);
+        if (addr == nullptr) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid Sapling address: ") + addresses[idx].get_str());
+        }
+
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("address", addresses[idx].get_str());
+        CSaplingDiversifiedAddress diversified;
+        libzcash::SaplingExtendedFullViewingKey extfvk;
+        if (!pwallet->GetSaplingDiversifiedAddress(*addr, diversified) || !pwallet->GetSaplingFullViewingKey(diversified.ivk, extfvk)) {
+            obj.pushKV("found", false);
+            ret.push_back(obj);
+            continue;
+        }
+        obj.pushKV("found", true);
+        obj.pushKV("diversifier_index", diversified.j.GetHex());
+        obj.pushKV("default_address", EncodePaymentAddress(extfvk.DefaultAddress()));
+        auto i = pwallet->mapSaplingAddressBook.find(*addr);
+        if (i != pwallet->mapSaplingAddressBook.end()) {
+            obj.pushKV("label", i->second.name);
+        }
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
 // JSDescription size depends on the transaction version
 #define V3_JS_DESCRIPTION_SIZE    (GetSerializeSize(JSDescription(), SER_NETWORK, (OVERWINTER_TX_VERSION | (1 << 31))))
 // Here we define the maximum number of zaddr outputs that can be included in a transaction.
@@ -5468,6 +5671,10 @@ UniValue z_listaddresses(const JSONRPCRequest& request)
         std::set<libzcash::SaplingPaymentAddress> addresses;
         pwallet->GetSaplingPaymentAddresses(addresses);
         for (auto addr : addresses) {
+            // Addresses of the keypool have not been handed out yet
+            if (pwallet->IsSaplingKeyPoolAddress(addr)) {
+                continue;
+            }
             if (fIncludeWatchonly || HaveSpendingKeyForPaymentAddress(pwallet)(addr)) {
                 ret.push_back(EncodePaymentAddress(addr));
             }
@@ -5562,6 +5769,9 @@ static const CRPCCommand commands[] =
     { "wallet",             "z_getoperationstatus",             &z_getoperationstatus,          {"operationid"} },
     { "wallet",             "z_listoperationids",               &z_listoperationids,            {"status"} },
     { "wallet",             "z_getnewaddress",                  &z_getnewaddress,               {"address_type"} },
+    { "wallet",             "z_getnewaddresses",                &z_getnewaddresses,             {"count","label"} },
+    { "wallet",             "z_getnewdiversifiedaddresses",     &z_getnewdiversifiedaddresses,  {"address","count","label"} },
+    { "wallet",             "z_lookupdiversifiedaddresses",     &z_lookupdiversifiedaddresses,  {"addresses"} },
     { "wallet",             "z_sendmany",                       &z_sendmany,                    {"fromaddress","amounts","minconf","fee"} },
     { "wallet",             "z_getbalance",                     &z_getbalance,                  {"address","minconf"} },
     { "wallet",             "z_gettotalbalance",                &z_gettotalbalance,             {"minconf","includeWatchonly"} },
@@ -9,13 +9,16 @@
 #include <stdint.h>
 #include <vector>
 
+#include <chainparams.h>
 #include <interfaces/chain.h>
+#include <key_io.h>
 #include <policy/policy.h>
 #include <rpc/server.h>
 #include <test/setup_common.h>
 #include <validation.h>
 #include <wallet/coincontrol.h>
 #include <wallet/test/wallet_test_fixture.h>
+#include <zcash/Address.hpp>
 
 #include <boost/test/unit_test.hpp>
 #include <univalue.h>
@@ -23,6 +26,7 @@
 extern UniValue importmulti(const JSONRPCRequest& request);
 extern UniValue dumpwallet(const JSONRPCRequest& request);
 extern UniValue importwallet(const JSONRPCRequest& request);
+extern int64_t GetShieldedKeyBirthday(const CWallet& wallet, interfaces::Chain::Lock& locked_chain, const libzcash::PaymentAddress& address);
 
 BOOST_FIXTURE_TEST_SUITE(wallet_tests, WalletTestingSetup)
 
@@ -111,6 +115,93 @@ BOOST_FIXTURE_TEST_CASE(scan_for_wallet_transactions, TestChain100Setup)
     }
 }
 
+// Verify a shielded-only rescan scans the start block, the blocks which may
+// have shielded spends or outputs, including those whose counts are unknown,
+// and the last block.
+BOOST_FIXTURE_TEST_CASE(scan_for_wallet_transactions_shielded_only, TestChain100Setup)
+{
+    auto chain = interfaces::MakeChain();
+    auto locked_chain = chain->lock();
+    LockAssertion lock(::cs_main);
+
+    ::ChainActive()[50]->nSaplingSpends = 1;
+    ::ChainActive()[70]->nSaplingCommitments = nullopt;
+    BOOST_CHECK(::ChainActive()[50]->MayHaveShieldedActivity());
+    BOOST_CHECK(::ChainActive()[70]->MayHaveShieldedActivity());
+    BOOST_CHECK(!::ChainActive()[60]->MayHaveShieldedActivity());
+
+    const int tip_height = ::ChainActive().Height();
+    BOOST_CHECK_EQUAL(*locked_chain->findShieldedActivity(10, tip_height), 50);
+    BOOST_CHECK_EQUAL(*locked_chain->findShieldedActivity(50, tip_height), 50);
+    BOOST_CHECK_EQUAL(*locked_chain->findShieldedActivity(51, tip_height), 70);
+    BOOST_CHECK(!locked_chain->findShieldedActivity(51, 69));
+    BOOST_CHECK(!locked_chain->findShieldedActivity(71, tip_height));
+
+    CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    AddKey(wallet, coinbaseKey);
+    WalletRescanReserver reserver(&wallet);
+    reserver.reserve();
+    CWallet::ScanResult result = wallet.ScanForWalletTransactions(::ChainActive()[10]->GetBlockHash(), {} /* stop_block */, reserver, false /* update */, true /* shielded_only */);
+    BOOST_CHECK_EQUAL(result.status, CWallet::ScanResult::SUCCESS);
+    BOOST_CHECK_EQUAL(result.last_scanned_block, ::ChainActive().Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(*result.last_scanned_height, tip_height);
+
+    // Only the coinbase transactions of the scanned blocks were found
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 4U);
+    for (int height : {10, 50, 70, tip_height}) {
+        BOOST_CHECK(wallet.mapWallet.count(m_coinbase_txns[height - 1]->GetHash()));
+    }
+}
+
+// Verify the rescan after importing a shielded key starts at its creation
+// time, and for a Sapling key no earlier than the activation of Sapling.
+BOOST_FIXTURE_TEST_CASE(shielded_key_birthday, TestChain100Setup)
+{
+    auto chain = interfaces::MakeChain();
+    CWallet wallet(chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+
+    const libzcash::SproutPaymentAddress sprout_addr = libzcash::SproutSpendingKey::random().address();
+    const libzcash::SaplingExtendedSpendingKey sapling_sk = libzcash::SaplingExtendedSpendingKey::Master(HDSeed::Random());
+    const libzcash::SaplingPaymentAddress sapling_addr = sapling_sk.DefaultAddress();
+    const libzcash::SaplingIncomingViewingKey ivk = sapling_sk.expsk.full_viewing_key().in_viewing_key();
+    const libzcash::SaplingPaymentAddress unknown_addr = libzcash::SaplingExtendedSpendingKey::Master(HDSeed::Random()).DefaultAddress();
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.mapSproutKeyMetadata[sprout_addr] = CKeyMetadata(1000);
+        BOOST_CHECK(wallet.LoadSaplingPaymentAddress(sapling_addr, ivk));
+        wallet.LoadSaplingKeyMetadata(ivk, CKeyMetadata(1000));
+    }
+
+    auto birthday = [&](const libzcash::PaymentAddress& address) {
+        auto locked_chain = chain->lock();
+        LOCK(wallet.cs_wallet);
+        return GetShieldedKeyBirthday(wallet, *locked_chain, address);
+    };
+
+    // Before Sapling activates, keys date from their creation time, and keys
+    // of unknown age from the beginning of the chain.
+    const int activation_height = Params().GetConsensus().vUpgrades[Consensus::UPGRADE_SAPLING].nActivationHeight;
+    BOOST_REQUIRE(::ChainActive().Height() < activation_height);
+    BOOST_CHECK_EQUAL(birthday(sprout_addr), 1000);
+    BOOST_CHECK_EQUAL(birthday(sapling_addr), 1000);
+    BOOST_CHECK_EQUAL(birthday(unknown_addr), 0);
+
+    // Once it activated, no Sapling note can predate the activation block.
+    while (::ChainActive().Height() < activation_height) {
+        CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    }
+    const int64_t activation_time = ::ChainActive()[activation_height]->GetBlockTime();
+    BOOST_CHECK_EQUAL(birthday(sprout_addr), 1000);
+    BOOST_CHECK_EQUAL(birthday(sapling_addr), activation_time);
+    BOOST_CHECK_EQUAL(birthday(unknown_addr), activation_time);
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.LoadSaplingKeyMetadata(ivk, CKeyMetadata(activation_time + 1000));
+    }
+    BOOST_CHECK_EQUAL(birthday(sapling_addr), activation_time + 1000);
+}
+
 BOOST_FIXTURE_TEST_CASE(importmulti_rescan, TestChain100Setup)
 {
     // Cap last block file size, and mine new block in a new block file.
@@ -514,4 +605,277 @@ BOOST_FIXTURE_TEST_CASE(dummy_input_size_test, TestChain100Setup)
     BOOST_CHECK_EQUAL(CalculateNestedKeyhashInputSize(true), DUMMY_NESTED_P2WPKH_INPUT_SIZE);
 }
 
+//! The Sapling key of an account of the wallet seed, m/32'/coin_type'/account', derived on its own
+static libzcash::SaplingExtendedSpendingKey DeriveSaplingAccountKey(const CWallet& wallet, uint32_t account)
+{
+    HDSeed seed;
+    BOOST_REQUIRE(wallet.GetZecHDSeed(seed));
+    return libzcash::SaplingExtendedSpendingKey::Master(seed)
+        .Derive(32 | ZIP32_HARDENED_KEY_LIMIT)
+        .Derive(Params().BIP44CoinType() | ZIP32_HARDENED_KEY_LIMIT)
+        .Derive(account | ZIP32_HARDENED_KEY_LIMIT);
+}
+
+//! Check that the wallet holds the key of the account, with its keypath, and its address labeled
+static void CheckSaplingAccountKey(CWallet& wallet, uint32_t account, const libzcash::SaplingPaymentAddress& address, const std::string& label)
+{
+    LOCK(wallet.cs_wallet);
+    const libzcash::SaplingExtendedSpendingKey expected = DeriveSaplingAccountKey(wallet, account);
+    BOOST_CHECK(address == expected.DefaultAddress());
+    libzcash::SaplingExtendedSpendingKey xsk;
+    BOOST_CHECK(wallet.GetSaplingExtendedSpendingKey(address, xsk));
+    BOOST_CHECK(xsk == expected);
+    const libzcash::SaplingIncomingViewingKey ivk = expected.ToXFVK().fvk.in_viewing_key();
+    BOOST_CHECK_EQUAL(wallet.mapSaplingKeyMetadata.at(ivk).hdKeypath,
+                      "m/32'/" + std::to_string(Params().BIP44CoinType()) + "'/" + std::to_string(account) + "'");
+    BOOST_CHECK_EQUAL(wallet.mapSaplingAddressBook.at(address).name, label);
+}
+
+BOOST_AUTO_TEST_CASE(sapling_bulk_keygen)
+{
+    {
+        LOCK(m_wallet.cs_wallet);
+        m_wallet.GenerateNewZecSeed();
+        // A key the wallet already has is skipped
+        BOOST_CHECK(m_wallet.AddSaplingKey(DeriveSaplingAccountKey(m_wallet, 1)));
+    }
+
+    // Keys are generated for consecutive accounts, as if derived one by one
+    const auto addresses = m_wallet.GenerateNewSaplingKeys(4, "bulk");
+    const std::vector<uint32_t> accounts = {0, 2, 3, 4};
+    BOOST_REQUIRE_EQUAL(addresses.size(), accounts.size());
+    for (size_t i = 0; i < accounts.size(); i++) {
+        CheckSaplingAccountKey(m_wallet, accounts[i], addresses[i], "bulk");
+    }
+    BOOST_CHECK_EQUAL(m_wallet.GetZecHDChain().saplingAccountCounter, 5U);
+
+    // And found in a wallet loaded from the database, which carries on after them
+    CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::CreateMock());
+    BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).LoadWallet(&wallet) == DBErrors::LOAD_OK);
+    for (size_t i = 0; i < accounts.size(); i++) {
+        CheckSaplingAccountKey(wallet, accounts[i], addresses[i], "bulk");
+    }
+    BOOST_CHECK_EQUAL(wallet.GetZecHDChain().saplingAccountCounter, 5U);
+}
+
+BOOST_AUTO_TEST_CASE(sapling_bulk_keygen_encrypted)
+{
+    const SecureString passphrase("passphrase");
+    fs::create_directories(GetDataDir() / "encrypted");
+    CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::Create(GetDataDir() / "encrypted"));
+    bool fFirstRun;
+    BOOST_CHECK(wallet.LoadWallet(fFirstRun) == DBErrors::LOAD_OK);
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.GenerateNewZecSeed();
+    }
+    BOOST_CHECK(wallet.EncryptWallet(passphrase));
+
+    // No key is generated, nor account reserved, while the wallet is locked
+    BOOST_CHECK_THROW(wallet.GenerateNewSaplingKeys(2, ""), std::runtime_error);
+    BOOST_CHECK_EQUAL(wallet.GetZecHDChain().saplingAccountCounter, 0U);
+
+    BOOST_CHECK(wallet.Unlock(passphrase));
+    const auto addresses = wallet.GenerateNewSaplingKeys(3, "encrypted");
+    BOOST_REQUIRE_EQUAL(addresses.size(), 3U);
+    for (uint32_t account = 0; account < 3; account++) {
+        CheckSaplingAccountKey(wallet, account, addresses[account], "encrypted");
+    }
+    BOOST_CHECK(wallet.Lock());
+
+    // Only the encrypted keys are written
+    {
+        BerkeleyBatch batch(wallet.GetDBHandle(), "r");
+        for (const auto& address : addresses) {
+            libzcash::SaplingIncomingViewingKey ivk;
+            BOOST_CHECK(WITH_LOCK(wallet.cs_wallet, return wallet.GetSaplingIncomingViewingKey(address, ivk)));
+            BOOST_CHECK(!batch.Exists(std::make_pair(DBKeys::SAPLING_KEY, ivk)));
+            BOOST_CHECK(batch.Exists(std::make_pair(DBKeys::SAPLING_CRYPTED_KEY, ivk)));
+        }
+    }
+
+    // They are decrypted once the loaded wallet is unlocked
+    CWallet loaded(m_chain.get(), WalletLocation(), WalletDatabase::CreateMock());
+    BOOST_CHECK(WalletBatch(wallet.GetDBHandle()).LoadWallet(&loaded) == DBErrors::LOAD_OK);
+    BOOST_CHECK(loaded.IsCrypted());
+    BOOST_CHECK(loaded.Unlock(passphrase));
+    for (uint32_t account = 0; account < 3; account++) {
+        CheckSaplingAccountKey(loaded, account, addresses[account], "encrypted");
+    }
+}
+
+//! Call a wallet RPC on the single wallet loaded
+static UniValue CallWalletRPC(const std::string& method, const UniValue& params)
+{
+    if (RPCIsInWarmup(nullptr)) SetRPCWarmupFinished();
+    JSONRPCRequest request;
+    request.strMethod = method;
+    request.params = params;
+    return tableRPC.execute(request);
+}
+
+//! A wallet with a Zec HD seed and a mock database, loaded for RPCs until it is removed
+static std::shared_ptr<CWallet> AddSaplingWallet(interfaces::Chain& chain)
+{
+    std::shared_ptr<CWallet> wallet = std::make_shared<CWallet>(&chain, WalletLocation(), WalletDatabase::CreateMock());
+    bool fFirstRun;
+    BOOST_CHECK(wallet->LoadWallet(fFirstRun) == DBErrors::LOAD_OK);
+    {
+        LOCK(wallet->cs_wallet);
+        wallet->GenerateNewZecSeed();
+    }
+    AddWallet(wallet);
+    return wallet;
+}
+
+BOOST_AUTO_TEST_CASE(z_getnewaddresses_rpc)
+{
+    std::shared_ptr<CWallet> wallet = AddSaplingWallet(*m_chain);
+
+    UniValue params(UniValue::VARR);
+    params.push_back(3);
+    params.push_back("rpc");
+    const UniValue response = CallWalletRPC("z_getnewaddresses", params);
+    BOOST_REQUIRE_EQUAL(response.size(), 3U);
+    for (uint32_t account = 0; account < 3; account++) {
+        const libzcash::PaymentAddress address = DecodePaymentAddress(response[account].get_str());
+        BOOST_REQUIRE(IsValidPaymentAddress(address));
+        CheckSaplingAccountKey(*wallet, account, std::get<libzcash::SaplingPaymentAddress>(address), "rpc");
+    }
+
+    params.setArray();
+    params.push_back(0);
+    BOOST_CHECK_THROW(CallWalletRPC("z_getnewaddresses", params), UniValue);
+    RemoveWallet(wallet);
+}
+
+//! Hand out count new Sapling addresses of the wallet
+static std::vector<libzcash::SaplingPaymentAddress> GetNewSaplingAddresses(CWallet& wallet, unsigned int count, const std::string& label)
+{
+    std::vector<libzcash::PaymentAddress> dests;
+    std::string error;
+    BOOST_CHECK(wallet.GetNewSaplingDestinations(count, label, dests, error));
+    BOOST_CHECK(error.empty());
+    std::vector<libzcash::SaplingPaymentAddress> addresses;
+    for (const auto& dest : dests) {
+        addresses.push_back(std::get<libzcash::SaplingPaymentAddress>(dest));
+    }
+    return addresses;
+}
+
+BOOST_AUTO_TEST_CASE(sapling_keypool)
+{
+    {
+        LOCK(m_wallet.cs_wallet);
+        m_wallet.GenerateNewZecSeed();
+    }
+    BOOST_CHECK(m_wallet.TopUpSaplingKeyPool(5));
+    BOOST_CHECK_EQUAL(WITH_LOCK(m_wallet.cs_wallet, return m_wallet.GetSaplingKeyPoolSize()), 5U);
+    for (int64_t index = 1; index <= 5; index++) {
+        BOOST_CHECK(BerkeleyBatch(m_wallet.GetDBHandle(), "r").Exists(std::make_pair(DBKeys::SAPLING_POOL, index)));
+    }
+
+    // Addresses are taken in key order, the keys of the first accounts
+    const auto taken = GetNewSaplingAddresses(m_wallet, 2, "taken");
+    BOOST_REQUIRE_EQUAL(taken.size(), 2U);
+    for (uint32_t account = 0; account < 2; account++) {
+        CheckSaplingAccountKey(m_wallet, account, taken[account], "taken");
+        BOOST_CHECK(!WITH_LOCK(m_wallet.cs_wallet, return m_wallet.IsSaplingKeyPoolAddress(taken[account])));
+        BOOST_CHECK(!BerkeleyBatch(m_wallet.GetDBHandle(), "r").Exists(std::make_pair(DBKeys::SAPLING_POOL, int64_t(account + 1))));
+    }
+
+    // A wallet loaded from the database has the rest of the pool, under the
+    // same indexes, and tops it up after them
+    CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::CreateMock());
+    BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).LoadWallet(&wallet) == DBErrors::LOAD_OK);
+    BOOST_CHECK_EQUAL(WITH_LOCK(wallet.cs_wallet, return wallet.GetSaplingKeyPoolSize()), 3U);
+    BOOST_CHECK(wallet.TopUpSaplingKeyPool(4));
+    BOOST_CHECK(BerkeleyBatch(wallet.GetDBHandle(), "r").Exists(std::make_pair(DBKeys::SAPLING_POOL, int64_t(6))));
+    BOOST_CHECK(!BerkeleyBatch(wallet.GetDBHandle(), "r").Exists(std::make_pair(DBKeys::SAPLING_POOL, int64_t(7))));
+    const auto rest = GetNewSaplingAddresses(wallet, 4, "rest");
+    BOOST_REQUIRE_EQUAL(rest.size(), 4U);
+    for (uint32_t account = 2; account < 6; account++) {
+        CheckSaplingAccountKey(wallet, account, rest[account - 2], "rest");
+    }
+
+    // Keys the pool lacks are generated, for the accounts after it
+    const auto generated = GetNewSaplingAddresses(wallet, 2, "generated");
+    BOOST_REQUIRE_EQUAL(generated.size(), 2U);
+    CheckSaplingAccountKey(wallet, 6, generated[0], "generated");
+    CheckSaplingAccountKey(wallet, 7, generated[1], "generated");
+}
+
+BOOST_AUTO_TEST_CASE(sapling_keypool_abandoned_reservation)
+{
+    {
+        LOCK(m_wallet.cs_wallet);
+        m_wallet.GenerateNewZecSeed();
+        // Accounts reserved, as by a top-up whose wallet is locked before its
+        // keys are written
+        BOOST_CHECK_EQUAL(m_wallet.ReserveSaplingAccounts(3), 0U);
+    }
+
+    // The accounts reserved are not used again, by this wallet or once reloaded
+    BOOST_CHECK(m_wallet.TopUpSaplingKeyPool(1));
+    const auto addresses = GetNewSaplingAddresses(m_wallet, 1, "");
+    BOOST_REQUIRE_EQUAL(addresses.size(), 1U);
+    CheckSaplingAccountKey(m_wallet, 3, addresses[0], "");
+
+    CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::CreateMock());
+    BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).LoadWallet(&wallet) == DBErrors::LOAD_OK);
+    BOOST_CHECK_EQUAL(wallet.GetZecHDChain().saplingAccountCounter, 4U);
+    const auto more = GetNewSaplingAddresses(wallet, 1, "");
+    BOOST_REQUIRE_EQUAL(more.size(), 1U);
+    CheckSaplingAccountKey(wallet, 4, more[0], "");
+}
+
+BOOST_AUTO_TEST_CASE(sapling_keypool_locked)
+{
+    const SecureString passphrase("passphrase");
+    fs::create_directories(GetDataDir() / "locked");
+    CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::Create(GetDataDir() / "locked"));
+    bool fFirstRun;
+    BOOST_CHECK(wallet.LoadWallet(fFirstRun) == DBErrors::LOAD_OK);
+    {
+        LOCK(wallet.cs_wallet);
+        wallet.GenerateNewZecSeed();
+    }
+    BOOST_CHECK(wallet.EncryptWallet(passphrase));
+    BOOST_CHECK(wallet.Unlock(passphrase));
+    BOOST_CHECK(wallet.TopUpSaplingKeyPool(3));
+    BOOST_CHECK(wallet.Lock());
+
+    // The pool is not topped up while the wallet is locked, but hands out
+    // addresses until it runs out
+    BOOST_CHECK(!wallet.TopUpSaplingKeyPool(5));
+    const auto addresses = GetNewSaplingAddresses(wallet, 2, "locked");
+    BOOST_CHECK_EQUAL(addresses.size(), 2U);
+    std::vector<libzcash::PaymentAddress> dests;
+    std::string error;
+    BOOST_CHECK(!wallet.GetNewSaplingDestinations(2, "locked", dests, error));
+    BOOST_CHECK_EQUAL(error, "Error: Sapling keypool ran out, please call walletpassphrase first");
+    BOOST_CHECK(dests.empty());
+    BOOST_CHECK_EQUAL(WITH_LOCK(wallet.cs_wallet, return wallet.GetSaplingKeyPoolSize()), 1U);
+    BOOST_CHECK_EQUAL(wallet.GetZecHDChain().saplingAccountCounter, 3U);
+
+    BOOST_CHECK(wallet.Unlock(passphrase));
+    for (uint32_t account = 0; account < 2; account++) {
+        CheckSaplingAccountKey(wallet, account, addresses[account], "locked");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(z_listaddresses_keypool)
+{
+    std::shared_ptr<CWallet> wallet = AddSaplingWallet(*m_chain);
+    BOOST_CHECK(wallet->TopUpSaplingKeyPool(3));
+    const auto addresses = GetNewSaplingAddresses(*wallet, 1, "");
+    BOOST_REQUIRE_EQUAL(addresses.size(), 1U);
+
+    // Only the address handed out is listed, not those left in the pool
+    const UniValue response = CallWalletRPC("z_listaddresses", UniValue(UniValue::VARR));
+    BOOST_REQUIRE_EQUAL(response.size(), 1U);
+    BOOST_CHECK_EQUAL(response[0].get_str(), EncodePaymentAddress(addresses[0]));
+    RemoveWallet(wallet);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
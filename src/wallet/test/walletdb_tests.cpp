@@ -0,0 +1,206 @@
+// Copyright (c) 2017-2020 The LitecoinZ Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/walletdb.h>
+#include <wallet/wallet.h>
+#include <wallet/test/wallet_test_fixture.h>
+
+#include <random.h>
+#include <zcash/IncrementalMerkleTree.hpp>
+#include <zcash/address/zip32.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(walletdb_tests, WalletTestingSetup)
+
+/** A wallet transaction made unique by n, which is also its order position. */
+static CWalletTx MakeWalletTx(CWallet& wallet, uint32_t n)
+{
+    CMutableTransaction mtx;
+    mtx.nLockTime = n;
+    CWalletTx wtx(&wallet, MakeTransactionRef(mtx));
+    wtx.nOrderPos = n;
+    wtx.mapValue["n"] = std::to_string(n);
+    return wtx;
+}
+
+BOOST_AUTO_TEST_CASE(walletdb_load_many_txs)
+{
+    // Many more transactions than are read ahead of the one being loaded
+    const uint32_t n_txs = 4 * MAX_WALLET_LOAD_PENDING * MAX_WALLET_LOAD_THREADS;
+    {
+        WalletBatch batch(m_wallet.GetDBHandle());
+        for (uint32_t n = 0; n < n_txs; n++) {
+            CWalletTx wtx = MakeWalletTx(m_wallet, n);
+            BOOST_CHECK(batch.WriteTx(wtx));
+        }
+    }
+
+    CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).LoadWallet(&wallet) == DBErrors::LOAD_OK);
+
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), n_txs);
+    uint32_t n = 0;
+    for (const auto& entry : wallet.wtxOrdered) {
+        const CWalletTx& wtx = *entry.second;
+        BOOST_CHECK_EQUAL(entry.first, (int64_t)n);
+        BOOST_CHECK_EQUAL(wtx.tx->nLockTime, n);
+        BOOST_CHECK_EQUAL(wtx.mapValue.at("n"), std::to_string(n));
+        BOOST_CHECK(wtx.GetHash() == MakeWalletTx(m_wallet, n).GetHash());
+        n++;
+    }
+    BOOST_CHECK_EQUAL(n, n_txs);
+}
+
+BOOST_AUTO_TEST_CASE(walletdb_tx_updates)
+{
+    SproutMerkleTree tree;
+    tree.append(GetRandHash());
+    SproutWitness witness = tree.witness();
+
+    CWalletTx wtx_in = MakeWalletTx(m_wallet, 0);
+    const uint256 hash = wtx_in.GetHash();
+    const SproutOutPoint op(hash, 0, 0);
+    wtx_in.mapSproutNoteData[op] = SproutNoteData();
+    BOOST_CHECK(m_wallet.AddToWallet(wtx_in));
+
+    LOCK(m_wallet.cs_wallet);
+    CWalletTx& wtx = m_wallet.mapWallet.at(hash);
+    SproutNoteData& nd = wtx.mapSproutNoteData.at(op);
+
+    // Advance the witnesses of the note by a block and flush them
+    auto advance = [&] {
+        const uint256 cm = GetRandHash();
+        tree.append(cm);
+        witness.append(cm);
+        nd.witnesses.push_front(witness);
+        nd.witnessHeight++;
+        m_wallet.ChainStateFlushed(CBlockLocator());
+    };
+
+    // Check the update records of the transaction, and that loading them
+    // gives back its note data
+    auto check_load = [&](unsigned int n_updates) {
+        BOOST_CHECK_EQUAL(wtx.nWitnessUpdates, n_updates);
+        for (uint32_t seq = 0; seq <= MAX_WALLET_TX_UPDATES; seq++) {
+            BerkeleyBatch batch(m_wallet.GetDBHandle(), "r");
+            BOOST_CHECK_EQUAL(batch.Exists(std::make_pair(DBKeys::TX_UPDATE, std::make_pair(hash, seq))), seq < n_updates);
+        }
+
+        CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+        BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).LoadWallet(&wallet) == DBErrors::LOAD_OK);
+        LOCK(wallet.cs_wallet);
+        const CWalletTx& loaded = wallet.mapWallet.at(hash);
+        BOOST_CHECK_EQUAL(loaded.nWitnessUpdates, n_updates);
+        const SproutNoteData& loaded_nd = loaded.mapSproutNoteData.at(op);
+        BOOST_CHECK_EQUAL(loaded_nd.witnessHeight, nd.witnessHeight);
+        BOOST_CHECK(loaded_nd.witnesses == nd.witnesses);
+        BOOST_CHECK(loaded_nd.nullifier == nd.nullifier);
+    };
+
+    // The note data is written in full the first time
+    advance();
+    check_load(0);
+
+    // Then as updates, replayed on load, until they are compacted
+    for (unsigned int n = 1; n <= MAX_WALLET_TX_UPDATES; n++) {
+        advance();
+        check_load(n);
+    }
+    advance();
+    check_load(0);
+
+    // A nullifier learned alone is an update too
+    advance();
+    nd.nullifier = GetRandHash();
+    m_wallet.ChainStateFlushed(CBlockLocator());
+    check_load(2);
+
+    // Writing the transaction in full erases its updates, later ones are
+    // replayed over the new full record
+    BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).WriteTx(wtx));
+    check_load(0);
+    advance();
+    check_load(1);
+
+    // So is a write in full by the wallet, after which the note data is
+    // written as it is, and a flush has nothing to add
+    BOOST_CHECK(m_wallet.MarkReplaced(hash, GetRandHash()));
+    check_load(0);
+    m_wallet.ChainStateFlushed(CBlockLocator());
+    check_load(0);
+    advance();
+    check_load(1);
+
+    // Erasing the transaction erases its updates
+    BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).EraseTx(hash));
+    for (uint32_t seq = 0; seq <= MAX_WALLET_TX_UPDATES; seq++) {
+        BerkeleyBatch batch(m_wallet.GetDBHandle(), "r");
+        BOOST_CHECK(!batch.Exists(std::make_pair(DBKeys::TX_UPDATE, std::make_pair(hash, seq))));
+    }
+    CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::CreateDummy());
+    BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).LoadWallet(&wallet) == DBErrors::LOAD_OK);
+    LOCK(wallet.cs_wallet);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.count(hash), 0U);
+}
+
+//! The value of a diversifier index small enough to fit in 64 bits
+static uint64_t DiversifierIndexValue(const libzcash::diversifier_index_t& j)
+{
+    uint64_t value = 0;
+    for (size_t i = 8; i-- > 0;) {
+        value = (value << 8) | j.begin()[i];
+    }
+    return value;
+}
+
+BOOST_AUTO_TEST_CASE(walletdb_sapling_diversified_addresses)
+{
+    const libzcash::SaplingExtendedFullViewingKey extfvk = libzcash::SaplingExtendedSpendingKey::Master(HDSeed::Random()).ToXFVK();
+    const libzcash::SaplingIncomingViewingKey ivk = extfvk.fvk.in_viewing_key();
+    // The default address has the first valid diversifier index
+    const uint64_t default_index = DiversifierIndexValue(extfvk.Address(libzcash::diversifier_index_t()).get().first);
+
+    // Addresses are generated after the default address, in index order
+    const auto addresses = m_wallet.GenerateSaplingDiversifiedAddresses(extfvk, 100, "label");
+    BOOST_CHECK_EQUAL(addresses.size(), 100U);
+    uint64_t last_index = default_index;
+    for (const auto& address : addresses) {
+        BOOST_CHECK_GT(DiversifierIndexValue(address.first), last_index);
+        last_index = DiversifierIndexValue(address.first);
+        auto found = extfvk.Address(address.first);
+        BOOST_CHECK(found && found->first == address.first && found->second == address.second);
+    }
+
+    // Each address is looked up by its key and index, in the wallet and in a
+    // wallet loaded from its database
+    CWallet wallet(m_chain.get(), WalletLocation(), WalletDatabase::CreateMock());
+    BOOST_CHECK(WalletBatch(m_wallet.GetDBHandle()).LoadWallet(&wallet) == DBErrors::LOAD_OK);
+    for (CWallet* pwallet : {&m_wallet, &wallet}) {
+        LOCK(pwallet->cs_wallet);
+        for (const auto& address : addresses) {
+            CSaplingDiversifiedAddress diversified;
+            BOOST_CHECK(pwallet->GetSaplingDiversifiedAddress(address.second, diversified));
+            BOOST_CHECK(diversified.ivk == ivk);
+            BOOST_CHECK(diversified.j == address.first);
+            libzcash::SaplingIncomingViewingKey address_ivk;
+            BOOST_CHECK(pwallet->GetSaplingIncomingViewingKey(address.second, address_ivk));
+            BOOST_CHECK(address_ivk == ivk);
+            BOOST_CHECK_EQUAL(pwallet->mapSaplingAddressBook.at(address.second).name, "label");
+        }
+    }
+
+    // The loaded wallet carries on after the last index written
+    std::set<libzcash::SaplingPaymentAddress> generated;
+    for (const auto& address : addresses) {
+        generated.insert(address.second);
+    }
+    for (const auto& address : wallet.GenerateSaplingDiversifiedAddresses(extfvk, 10, "")) {
+        BOOST_CHECK_GT(DiversifierIndexValue(address.first), last_index);
+        BOOST_CHECK(generated.insert(address.second).second);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
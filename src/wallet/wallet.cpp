@@ -11,6 +11,7 @@
 #include <consensus/consensus.h>
 #include <consensus/upgrades.h>
 #include <consensus/validation.h>
+#include <crypto/siphash.h>
 #include <fs.h>
 #include <interfaces/chain.h>
 #include <interfaces/wallet.h>
@@ -20,6 +21,7 @@
 #include <policy/policy.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
+#include <random.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <script/descriptor.h>
@@ -31,6 +33,8 @@
 #include <util/fees.h>
 #include <util/moneystr.h>
 #include <util/rbf.h>
+#include <util/system.h>
+#include <util/threadnames.h>
 #include <util/translation.h>
 #include <util/validation.h>
 #include <validation.h>
@@ -41,8 +45,13 @@
 #include <zcash/Note.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <assert.h>
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <mutex>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -449,55 +458,236 @@ libzcash::SproutPaymentAddress CWallet::GenerateNewSproutKey(WalletBatch &batch)
     return addr;
 }
 
-// Generate a new Sapling spending key and return its public payment address
-libzcash::SaplingPaymentAddress CWallet::GenerateNewSaplingKey(WalletBatch &batch)
+//! Run f(i) for each i in [0, n) on up to MAX_SAPLING_KEYGEN_THREADS "zip32" threads, rethrowing the first exception once all of them stopped
+template <typename F>
+static void ForEachOnZip32Threads(size_t n, const F& f)
 {
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::exception_ptr error;
+
+    auto worker = [&]() {
+        util::ThreadRename("zip32");
+        try {
+            for (size_t i = next++; i < n; i = next++) {
+                f(i);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+            next = n;
+        }
+    };
+
+    const int n_threads = std::max(1, std::min<int>({GetNumCores(), MAX_SAPLING_KEYGEN_THREADS, (int)n}));
+    std::vector<std::thread> threads;
+    for (int i = 0; i < n_threads; i++) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+//! Derive the Sapling account keys of consecutive accounts from first_account on, on worker threads
+static void DeriveSaplingKeys(const libzcash::SaplingExtendedSpendingKey& parent, uint32_t first_account, std::vector<DerivedSaplingKey>& keys)
+{
+    ForEachOnZip32Threads(keys.size(), [&](size_t i) {
+        DerivedSaplingKey& key = keys[i];
+        key.account = first_account + i;
+        key.xsk = parent.Derive(key.account | ZIP32_HARDENED_KEY_LIMIT);
+        key.extfvk = key.xsk.ToXFVK();
+        key.ivk = key.extfvk.fvk.in_viewing_key();
+        key.address = key.extfvk.DefaultAddress();
+    });
+}
+
+//! Number of diversifier indexes searched by each task of GenerateSaplingDiversifiedAddresses
+static const uint64_t DIVERSIFIER_SEARCH_RANGE = 64;
+
+//! Add n to a little-endian diversifier index, returns false if it overflows
+static bool AddDiversifierIndex(libzcash::diversifier_index_t& j, uint64_t n)
+{
+    for (unsigned char* p = j.begin(); p != j.end(); ++p) {
+        n += *p;
+        *p = n & 0xff;
+        n >>= 8;
+    }
+    return n == 0;
+}
+
+//! Compare little-endian diversifier indexes by value
+static bool DiversifierIndexLess(const libzcash::diversifier_index_t& a, const libzcash::diversifier_index_t& b)
+{
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a.begin()[i] != b.begin()[i]) return a.begin()[i] < b.begin()[i];
+    }
+    return false;
+}
+
+//! Find the valid diversifiers of ranges of DIVERSIFIER_SEARCH_RANGE indexes from first on, one range per task
+static std::vector<std::pair<libzcash::diversifier_index_t, libzcash::SaplingPaymentAddress>> FindSaplingDiversifiedAddresses(
+    const libzcash::SaplingExtendedFullViewingKey& extfvk, const libzcash::diversifier_index_t& first, size_t n_ranges)
+{
+    std::vector<std::vector<std::pair<libzcash::diversifier_index_t, libzcash::SaplingPaymentAddress>>> ranges(n_ranges);
+    ForEachOnZip32Threads(n_ranges, [&](size_t i) {
+        libzcash::diversifier_index_t j = first, end = first;
+        if (!AddDiversifierIndex(j, i * DIVERSIFIER_SEARCH_RANGE)) return;
+        if (!AddDiversifierIndex(end, (i + 1) * DIVERSIFIER_SEARCH_RANGE)) end.SetNull(); // search to the end of the space
+        while (true) {
+            auto found = extfvk.Address(j);
+            if (!found || (!end.IsNull() && !DiversifierIndexLess(found->first, end))) break;
+            ranges[i].push_back(found.get());
+            j = found->first;
+            if (!AddDiversifierIndex(j, 1)) break;
+        }
+    });
+
+    std::vector<std::pair<libzcash::diversifier_index_t, libzcash::SaplingPaymentAddress>> addresses;
+    for (const auto& range : ranges) {
+        addresses.insert(addresses.end(), range.begin(), range.end());
+    }
+    return addresses;
+}
+
+//! Derive m/32'/coin_type', the parent of the Sapling account keys m/32'/coin_type'/account'
+static libzcash::SaplingExtendedSpendingKey DeriveSaplingCoinTypeKey(const HDSeed& seed)
+{
+    auto m = libzcash::SaplingExtendedSpendingKey::Master(seed);
+    return m.Derive(32 | ZIP32_HARDENED_KEY_LIMIT).Derive(Params().BIP44CoinType() | ZIP32_HARDENED_KEY_LIMIT);
+}
+
+//! The metadata of a Sapling account key, whose keypath is m/32'/coin_type'/account'
+static CKeyMetadata DerivedSaplingKeyMetadata(const DerivedSaplingKey& key, const uint256& seedFp, int64_t nCreationTime)
+{
+    CKeyMetadata metadata(nCreationTime);
+    metadata.hdKeypath = "m/32'/" + std::to_string(Params().BIP44CoinType()) + "'/" + std::to_string(key.account) + "'";
+    metadata.seedFp = seedFp;
+    return metadata;
+}
+
+uint32_t CWallet::ReserveSaplingAccounts(unsigned int count)
+{
+    AssertLockHeld(cs_wallet);
+
+    const uint32_t first_account = zecHDChain.saplingAccountCounter;
+    if (first_account + (uint64_t) count > ZIP32_HARDENED_KEY_LIMIT)
+        throw std::runtime_error(std::string(__func__) + ": No more Sapling accounts to derive");
+
+    zecHDChain.saplingAccountCounter += count;
+    if (!WalletBatch(*database).WriteZecHDChain(zecHDChain)) {
+        zecHDChain.saplingAccountCounter = first_account;
+        throw std::runtime_error(std::string(__func__) + ": Writing Zec HD chain model failed");
+    }
+    return first_account;
+}
+
+void CWallet::WriteDerivedSaplingKey(WalletBatch& batch, DerivedSaplingKey& key, int64_t nCreationTime)
+{
+    AssertLockHeld(cs_wallet);
+
+    // Make sure we aren't adding private keys to private key disabled wallets
     assert(!IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS));
-    assert(!IsWalletFlagSet(WALLET_FLAG_BLANK_WALLET));
+
+    const CKeyMetadata metadata = DerivedSaplingKeyMetadata(key, zecHDChain.seedFp, nCreationTime);
+    if (!IsCrypted()) {
+        if (!batch.WriteSaplingKey(key.ivk, key.xsk, metadata))
+            throw std::runtime_error(std::string(__func__) + ": Writing Sapling key failed");
+        return;
+    }
+
+    {
+        LOCK(cs_KeyStore);
+        if (IsLocked())
+            throw std::runtime_error(std::string(__func__) + ": Wallet is locked");
+        CSecureDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << key.xsk;
+        CKeyingMaterial vchSecret(ss.begin(), ss.end());
+        if (!EncryptSecret(vMasterKey, vchSecret, key.extfvk.fvk.GetFingerprint(), key.vchCryptedSecret))
+            throw std::runtime_error(std::string(__func__) + ": Encrypting Sapling key failed");
+    }
+    if (!batch.WriteCryptedSaplingKey(key.extfvk, key.vchCryptedSecret, metadata))
+        throw std::runtime_error(std::string(__func__) + ": Writing Sapling key failed");
+}
+
+void CWallet::LoadDerivedSaplingKey(const DerivedSaplingKey& key, int64_t nCreationTime)
+{
     AssertLockHeld(cs_wallet); // mapSaplingKeyMetadata
 
-    // Create new metadata
-    int64_t nCreationTime = GetTime();
-    CKeyMetadata metadata(nCreationTime);
+    mapSaplingKeyMetadata[key.ivk] = DerivedSaplingKeyMetadata(key, zecHDChain.seedFp, nCreationTime);
+
+    bool added = key.vchCryptedSecret.empty()
+        ? AddSaplingSpendingKey(key.xsk, key.extfvk, key.ivk, key.address)
+        : AddCryptedSaplingSpendingKeyInner(key.extfvk, key.ivk, key.address, key.vchCryptedSecret);
+    if (!added)
+        throw std::runtime_error(std::string(__func__) + ": AddSaplingKey failed");
+}
+
+std::vector<libzcash::SaplingPaymentAddress> CWallet::GenerateNewSaplingKeys(unsigned int count, const std::string& label)
+{
+    assert(!IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS));
+    assert(!IsWalletFlagSet(WALLET_FLAG_BLANK_WALLET));
 
     // Try to get the seed
     HDSeed seed;
-    if (!GetZecHDSeed(seed))
-        throw std::runtime_error(std::string(__func__) + ": Zec HD seed not found");
+    {
+        LOCK(cs_wallet);
+        if (!GetZecHDSeed(seed))
+            throw std::runtime_error(std::string(__func__) + ": Zec HD seed not found");
+    }
+    auto m_32h_cth = DeriveSaplingCoinTypeKey(seed);
 
-    auto m = libzcash::SaplingExtendedSpendingKey::Master(seed);
-    uint32_t bip44CoinType = Params().BIP44CoinType();
+    std::vector<DerivedSaplingKey> keys;
+    while (true) {
+        std::vector<DerivedSaplingKey> more;
+        uint32_t first_account;
+        {
+            LOCK(cs_wallet);
 
-    // We use a fixed keypath scheme of m/32'/coin_type'/account'
-    // Derive m/32'
-    auto m_32h = m.Derive(32 | ZIP32_HARDENED_KEY_LIMIT);
-    // Derive m/32'/coin_type'
-    auto m_32h_cth = m_32h.Derive(bip44CoinType | ZIP32_HARDENED_KEY_LIMIT);
+            // Skip keys already known to the wallet, derive more instead
+            keys.erase(std::remove_if(keys.begin(), keys.end(), [this](const DerivedSaplingKey& key) {
+                return HaveSaplingSpendingKey(key.extfvk);
+            }), keys.end());
 
-    // Derive account key at next index, skip keys already known to the wallet
-    libzcash::SaplingExtendedSpendingKey xsk;
-    do
-    {
-        xsk = m_32h_cth.Derive(zecHDChain.saplingAccountCounter | ZIP32_HARDENED_KEY_LIMIT);
-        metadata.hdKeypath = "m/32'/" + std::to_string(bip44CoinType) + "'/" + std::to_string(zecHDChain.saplingAccountCounter) + "'";
-        metadata.seedFp = zecHDChain.seedFp;
-        // Increment childkey index
-        zecHDChain.saplingAccountCounter++;
-    } while (HaveSaplingSpendingKey(xsk.ToXFVK()));
-
-    // Update the chain model in the database
-    if (!WalletBatch(*database).WriteZecHDChain(zecHDChain))
-        throw std::runtime_error(std::string(__func__) + ": Writing Zec HD chain model failed");
+            if (keys.size() == count) {
+                int64_t nCreationTime = GetTime();
+                WalletBatch batch(*database);
+                if (!batch.TxnBegin())
+                    throw std::runtime_error(std::string(__func__) + ": Couldn't start atomic write");
+                try {
+                    for (DerivedSaplingKey& key : keys) {
+                        WriteDerivedSaplingKey(batch, key, nCreationTime);
+                        if (!WriteSaplingAddressBook(batch, key.address, label, "receive"))
+                            throw std::runtime_error(std::string(__func__) + ": Writing address book failed");
+                    }
+                } catch (...) {
+                    batch.TxnAbort();
+                    throw;
+                }
+                if (!batch.TxnCommit())
+                    throw std::runtime_error(std::string(__func__) + ": Couldn't commit atomic write");
+
+                std::vector<libzcash::SaplingPaymentAddress> addresses;
+                for (const DerivedSaplingKey& key : keys) {
+                    LoadDerivedSaplingKey(key, nCreationTime);
+                    UpdateSaplingAddressBook(key.address, label, "receive");
+                    addresses.push_back(key.address);
+                }
+                UpdateTimeFirstKey(nCreationTime);
+                return addresses;
+            }
 
-    auto ivk = xsk.expsk.full_viewing_key().in_viewing_key();
-    mapSaplingKeyMetadata[ivk] = metadata;
-    UpdateTimeFirstKey(nCreationTime);
+            more.resize(count - keys.size());
+            first_account = ReserveSaplingAccounts(more.size());
+        }
 
-    if (!AddSaplingKeyWithDB(batch, xsk)) {
-        throw std::runtime_error(std::string(__func__) + ": AddSaplingKey failed");
+        // Derive the keys of the reserved accounts without holding cs_wallet
+        DeriveSaplingKeys(m_32h_cth, first_account, more);
+        keys.insert(keys.end(), more.begin(), more.end());
     }
-    // return default sapling payment address.
-    return xsk.DefaultAddress();
 }
 
 // Add spending key to keystore and persist to disk
@@ -1031,52 +1221,190 @@ void CWallet::ChainTip(const CBlock& block, const CBlockIndex *pindex, bool adde
     }
 }
 
+//! Mark the note data of a transaction as written to the wallet database as it is now
+static void MarkNoteDataWritten(CWalletTx& wtx)
+{
+    for (auto& item : wtx.mapSproutNoteData) {
+        item.second.witnessHeightWritten = item.second.witnessHeight;
+        item.second.nullifierWritten = item.second.nullifier;
+    }
+    for (auto& item : wtx.mapSaplingNoteData) {
+        item.second.witnessHeightWritten = item.second.witnessHeight;
+        item.second.nullifierWritten = item.second.nullifier;
+    }
+}
+
+/**
+ * Write a transaction in full outside of a chain state flush, where the write
+ * is durable once it succeeds, so its note data is marked as written.
+ */
+static bool WriteTxInFull(WalletBatch& batch, CWalletTx& wtx)
+{
+    if (!batch.WriteTx(wtx)) {
+        return false;
+    }
+    MarkNoteDataWritten(wtx);
+    return true;
+}
+
+/**
+ * Get the witnesses added to a note and its nullifier if they changed since
+ * the note was last written. Returns false if the change cannot be written as
+ * an update, because the witnesses were rewound or cleared or the note data
+ * was never written.
+ */
+template <typename NoteData, typename Witness>
+static bool GetNoteWitnessUpdate(const NoteData& nd, NoteWitnessUpdate<Witness>& update, bool& changed)
+{
+    changed = nd.witnessHeight != nd.witnessHeightWritten || nd.nullifier != nd.nullifierWritten;
+    if (!changed) return true;
+    if (nd.witnessHeightWritten < 0 || nd.witnessHeight < nd.witnessHeightWritten) return false;
+    const size_t n = nd.witnessHeight - nd.witnessHeightWritten;
+    if (n > nd.witnesses.size()) return false;
+    update.witnessHeight = nd.witnessHeight;
+    // The witnesses added since are at the front, where they were not
+    // serialized yet when the note data was last read
+    const auto& witnesses = nd.witnesses.materialize(n);
+    update.witnesses.assign(witnesses.begin(), std::next(witnesses.begin(), n));
+    update.nullifier = nd.nullifier;
+    return true;
+}
+
+template <typename NoteData, typename Witness>
+static void ApplyNoteWitnessUpdate(NoteData& nd, const NoteWitnessUpdate<Witness>& update)
+{
+    if (update.nullifier) {
+        nd.nullifier = update.nullifier;
+    }
+    // Updates are replayed on top of the most recent full record, which may
+    // already include some of their witnesses.
+    if (update.witnessHeight > nd.witnessHeight) {
+        const size_t n = update.witnessHeight - nd.witnessHeight;
+        if (nd.witnessHeight < 0 || n > update.witnesses.size()) {
+            // The witnesses can't be advanced to the update, they are rebuilt.
+            nd.witnesses.clear();
+            nd.witnessHeight = -1;
+            return;
+        }
+        for (size_t i = n; i-- > 0;) {
+            nd.witnesses.push_front(update.witnesses[i]);
+        }
+        while (nd.witnesses.size() > WITNESS_CACHE_SIZE) {
+            nd.witnesses.pop_back();
+        }
+        nd.witnessHeight = update.witnessHeight;
+    }
+}
+
 void CWallet::ChainStateFlushed(const CBlockLocator& loc)
 {
+    // Held until the note data is marked as written, once committed.
+    LOCK(cs_wallet);
     WalletBatch batch(*database);
     if (!batch.TxnBegin()) {
         // This needs to be done atomically, so don't do it at all
         LogPrintf("%s: Couldn't start atomic write\n", __func__);
         return;
     }
+    // Transactions written, and their number of updates before. The number is
+    // advanced as the records are written, and restored if they are not committed.
+    std::vector<std::pair<CWalletTx*, unsigned int>> vWritten;
+    auto AbortWrite = [&] {
+        batch.TxnAbort();
+        for (const auto& written : vWritten) {
+            written.first->nWitnessUpdates = written.second;
+        }
+    };
     try {
-        LOCK(cs_wallet);
         for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-            auto wtx = wtxItem.second;
+            CWalletTx& wtx = wtxItem.second;
             // We skip transactions for which mapSproutNoteData and mapSaplingNoteData
             // are empty. This covers transactions that have no Sprout or Sapling data
             // (i.e. are purely transparent), as well as shielding and unshielding
             // transactions in which we only have transparent addresses involved.
-            if (!(wtx.mapSproutNoteData.empty() && wtx.mapSaplingNoteData.empty())) {
+            if (wtx.mapSproutNoteData.empty() && wtx.mapSaplingNoteData.empty()) {
+                continue;
+            }
+
+            // Only the witnesses added and the nullifiers learned since the
+            // transaction was last written are appended as an update record,
+            // unless it has to be written in full.
+            CWalletTxUpdate update;
+            bool fChanged = false;
+            bool fFull = false;
+            for (const auto& item : wtx.mapSproutNoteData) {
+                NoteWitnessUpdate<SproutWitness> note_update;
+                bool changed;
+                bool ok = GetNoteWitnessUpdate(item.second, note_update, changed);
+                fChanged |= changed;
+                if (!ok) {
+                    fFull = true;
+                } else if (changed) {
+                    update.sprout.emplace(item.first, std::move(note_update));
+                }
+            }
+            for (const auto& item : wtx.mapSaplingNoteData) {
+                NoteWitnessUpdate<SaplingWitness> note_update;
+                bool changed;
+                bool ok = GetNoteWitnessUpdate(item.second, note_update, changed);
+                fChanged |= changed;
+                if (!ok) {
+                    fFull = true;
+                } else if (changed) {
+                    update.sapling.emplace(item.first, std::move(note_update));
+                }
+            }
+            if (!fChanged) {
+                continue;
+            }
+            if (wtx.nWitnessUpdates >= MAX_WALLET_TX_UPDATES) {
+                // Compact the updates into the full record
+                fFull = true;
+            }
+
+            vWritten.emplace_back(&wtx, wtx.nWitnessUpdates);
+            if (fFull) {
                 if (!batch.WriteTx(wtx)) {
                     LogPrintf("%s: Failed to write CWalletTx, aborting atomic write\n", __func__);
-                    batch.TxnAbort();
+                    AbortWrite();
                     return;
                 }
+            } else if (!batch.WriteTxUpdate(wtx.GetHash(), wtx.nWitnessUpdates, update)) {
+                LogPrintf("%s: Failed to write CWalletTx update, aborting atomic write\n", __func__);
+                AbortWrite();
+                return;
+            } else {
+                wtx.nWitnessUpdates++;
             }
         }
         if (!batch.WriteWitnessCacheSize(nWitnessCacheSize)) {
             LogPrintf("%s: Failed to write nWitnessCacheSize, aborting atomic write\n", __func__);
-            batch.TxnAbort();
+            AbortWrite();
             return;
         }
         if (!batch.WriteBestBlock(loc)) {
             LogPrintf("%s: Failed to write best block, aborting atomic write\n", __func__);
-            batch.TxnAbort();
+            AbortWrite();
             return;
         }
     } catch (const std::exception &exc) {
         // Unexpected failure
         LogPrintf("%s: Unexpected error during atomic write:\n", __func__);
         LogPrintf("%s\n", exc.what());
-        batch.TxnAbort();
+        AbortWrite();
         return;
     }
     if (!batch.TxnCommit()) {
         // Couldn't commit all to db, but in-memory state is fine
         LogPrintf("%s: Couldn't commit atomic write\n", __func__);
+        for (const auto& written : vWritten) {
+            written.first->nWitnessUpdates = written.second;
+        }
         return;
     }
+    for (const auto& written : vWritten) {
+        MarkNoteDataWritten(*written.first);
+    }
 }
 
 std::set<std::pair<libzcash::PaymentAddress, uint256>> CWallet::GetNullifiersForAddresses(
@@ -1418,10 +1746,12 @@ void CWallet::ClearNoteWitnessCache()
         for (mapSproutNoteData_t::value_type& item : wtxItem.second.mapSproutNoteData) {
             item.second.witnesses.clear();
             item.second.witnessHeight = -1;
+            item.second.witnessHeightWritten = -1;
         }
         for (mapSaplingNoteData_t::value_type& item : wtxItem.second.mapSaplingNoteData) {
             item.second.witnesses.clear();
             item.second.witnessHeight = -1;
+            item.second.witnessHeightWritten = -1;
         }
     }
     nWitnessCacheSize = 0;
@@ -1472,6 +1802,10 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
                         // the new witness cache height is one below it.
                         nd->witnesses.pop_front();
                         nd->witnessHeight = pindex->nHeight - 1;
+                        if (nd->witnessHeight < nd->witnessHeightWritten) {
+                            // The written witnesses are no longer on the chain
+                            nd->witnessHeightWritten = -1;
+                        }
                     }
                 }
             }
@@ -1487,6 +1821,10 @@ void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
                         // the new witness cache height is one below it.
                         nd->witnesses.pop_front();
                         nd->witnessHeight = pindex->nHeight - 1;
+                        if (nd->witnessHeight < nd->witnessHeightWritten) {
+                            // The written witnesses are no longer on the chain
+                            nd->witnessHeightWritten = -1;
+                        }
                     }
                 }
             }
@@ -1499,6 +1837,7 @@ void ClearSingleNoteWitnessCache(NoteData* nd)
 {
     nd->witnesses.clear();
     nd->witnessHeight = -1;
+    nd->witnessHeightWritten = -1;
     nd->witnessRootValidated = false;
 }
 
@@ -1590,33 +1929,34 @@ int CWallet::VerifyAndSetInitialWitness(const CBlockIndex* pindex, bool witnessO
                 CBlock block;
                 ReadBlockFromDisk(block, pblockindex, Params().GetConsensus());
 
+                std::vector<libzcash::SHA256Compress> commitments;
+                Optional<size_t> notePosition;
                 for (const CTransactionRef& ptx : block.vtx) {
                     auto hash = ptx->GetHash();
 
                     for (size_t i = 0; i < ptx->vJoinSplit.size(); i++) {
                         const JSDescription& jsdesc = ptx->vJoinSplit[i];
                         for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
-                            const uint256& note_commitment = jsdesc.commitments[j];
-                            // Increment existing witness until the end of the block
-                            if (!nd->witnesses.empty()) {
-                                nd->witnesses.front().append(note_commitment);
-                            }
-
-                            // Only needed for intial witness
-                            if (nd->witnesses.empty()) {
-                                sproutTree.append(note_commitment);
-
-                                // If this is our note, witness it
-                                if (hash == wtxHash) {
-                                    SproutOutPoint outPoint {hash, i, j};
-                                    if (op == outPoint) {
-                                        nd->witnesses.push_front(sproutTree.witness());
-                                    }
+                            // If this is our note, witness it
+                            if (hash == wtxHash) {
+                                SproutOutPoint outPoint {hash, i, j};
+                                if (op == outPoint) {
+                                    notePosition = commitments.size();
                                 }
                             }
+                            commitments.push_back(jsdesc.commitments[j]);
                         }
                     }
                 }
+
+                // Append the commitments up to the note to the tree, and the
+                // rest of the block to the witness.
+                if (notePosition) {
+                    auto split = commitments.begin() + *notePosition + 1;
+                    sproutTree.append(std::vector<libzcash::SHA256Compress>(commitments.begin(), split));
+                    nd->witnesses.push_front(sproutTree.witness());
+                    nd->witnesses.front().append(std::vector<libzcash::SHA256Compress>(split, commitments.end()));
+                }
                 nd->witnessHeight = pblockindex->nHeight;
                 UpdateSproutNullifierNoteMapWithTx(wtxItem.second);
                 nMinimumHeight = SproutWitnessMinimumHeight(*locked_chain, *item.second.nullifier, nd->witnessHeight, nMinimumHeight);
@@ -1674,32 +2014,32 @@ int CWallet::VerifyAndSetInitialWitness(const CBlockIndex* pindex, bool witnessO
                 CBlock block;
                 ReadBlockFromDisk(block, pblockindex, Params().GetConsensus());
 
+                std::vector<libzcash::PedersenHash> commitments;
+                Optional<size_t> notePosition;
                 for (const CTransactionRef& ptx : block.vtx) {
                     auto hash = ptx->GetHash();
 
                     // Sapling
                     for (uint32_t i = 0; i < ptx->vShieldedOutput.size(); i++) {
-                        const uint256& note_commitment = ptx->vShieldedOutput[i].cm;
-
-                        // Increment existing witness until the end of the block
-                        if (!nd->witnesses.empty()) {
-                            nd->witnesses.front().append(note_commitment);
-                        }
-
-                        // Only needed for intial witness
-                        if (nd->witnesses.empty()) {
-                            saplingTree.append(note_commitment);
-
-                            // If this is our note, witness it
-                            if (hash == wtxHash) {
-                                SaplingOutPoint outPoint {hash, i};
-                                if (op == outPoint) {
-                                    nd->witnesses.push_front(saplingTree.witness());
-                                }
+                        // If this is our note, witness it
+                        if (hash == wtxHash) {
+                            SaplingOutPoint outPoint {hash, i};
+                            if (op == outPoint) {
+                                notePosition = commitments.size();
                             }
                         }
+                        commitments.push_back(ptx->vShieldedOutput[i].cm);
                     }
                 }
+
+                // Append the commitments up to the note to the tree, and the
+                // rest of the block to the witness.
+                if (notePosition) {
+                    auto split = commitments.begin() + *notePosition + 1;
+                    saplingTree.append(std::vector<libzcash::PedersenHash>(commitments.begin(), split));
+                    nd->witnesses.push_front(saplingTree.witness());
+                    nd->witnesses.front().append(std::vector<libzcash::PedersenHash>(split, commitments.end()));
+                }
                 nd->witnessHeight = pblockindex->nHeight;
                 UpdateSaplingNullifierNoteMapWithTx(wtxItem.second);
                 nMinimumHeight = SaplingWitnessMinimumHeight(*locked_chain, *item.second.nullifier, nd->witnessHeight, nMinimumHeight);
@@ -1731,18 +2071,9 @@ void CWallet::BuildWitnessCache(const CBlockIndex* pindex, bool witnessOnly)
             LogPrintf("Building Witnesses for block %i %.4f%% complete\n", pblockindex->nHeight, pblockindex->nHeight / double(height) * 100);
         }
 
-        SproutMerkleTree sproutTree;
-        sproutRoot = pblockindex->pprev->hashSproutRoot;
-        ::ChainstateActive().CoinsTip().GetSproutAnchorAt(sproutRoot, sproutTree);
-
-        SaplingMerkleTree saplingTree;
-        saplingRoot = pblockindex->pprev->hashSaplingRoot;
-        ::ChainstateActive().CoinsTip().GetSaplingAnchorAt(saplingRoot, saplingTree);
-
-        // Cycle through blocks and transactions building sapling tree until the commitment needed is reached
-        CBlock block;
-        ReadBlockFromDisk(block, pblockindex, Params().GetConsensus());
-
+        // The notes whose witnesses advance with this block
+        std::vector<SproutNoteData*> sproutNotes;
+        std::vector<SaplingNoteData*> saplingNotes;
         for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
             if (wtxItem.second.mapSproutNoteData.empty() && wtxItem.second.mapSaplingNoteData.empty())
                 continue;
@@ -1753,21 +2084,7 @@ void CWallet::BuildWitnessCache(const CBlockIndex* pindex, bool witnessOnly)
                     auto* nd = &(item.second);
                     if (nd->nullifier && nd->witnessHeight == pblockindex->nHeight - 1
                         && GetSproutSpendDepth(*locked_chain, *item.second.nullifier) <= WITNESS_CACHE_SIZE) {
-                        nd->witnesses.push_front(nd->witnesses.front());
-                        while (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
-                            nd->witnesses.pop_back();
-                        }
-
-                        for (const CTransactionRef& ptx : block.vtx) {
-                            for (size_t i = 0; i < ptx->vJoinSplit.size(); i++) {
-                                const JSDescription& jsdesc = ptx->vJoinSplit[i];
-                                for (uint8_t j = 0; j < jsdesc.commitments.size(); j++) {
-                                    const uint256& note_commitment = jsdesc.commitments[j];
-                                    nd->witnesses.front().append(note_commitment);
-                                }
-                            }
-                        }
-                        nd->witnessHeight = pblockindex->nHeight;
+                        sproutNotes.push_back(nd);
                     }
                 }
 
@@ -1776,19 +2093,62 @@ void CWallet::BuildWitnessCache(const CBlockIndex* pindex, bool witnessOnly)
                     auto* nd = &(item.second);
                     if (nd->nullifier && nd->witnessHeight == pblockindex->nHeight - 1
                         && GetSaplingSpendDepth(*locked_chain, *item.second.nullifier) <= WITNESS_CACHE_SIZE) {
-                        nd->witnesses.push_front(nd->witnesses.front());
-                        while (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
-                            nd->witnesses.pop_back();
-                        }
+                        saplingNotes.push_back(nd);
+                    }
+                }
+            }
+        }
 
-                        for (const CTransactionRef& ptx : block.vtx) {
-                            for (uint32_t i = 0; i < ptx->vShieldedOutput.size(); i++) {
-                                const uint256& note_commitment = ptx->vShieldedOutput[i].cm;
-                                nd->witnesses.front().append(note_commitment);
-                            }
-                        }
-                        nd->witnessHeight = pblockindex->nHeight;
+        // Without any, neither the block nor the trees before it are needed
+        if (!sproutNotes.empty() || !saplingNotes.empty()) {
+            // Cycle through blocks and transactions building sapling tree until the commitment needed is reached
+            CBlock block;
+            ReadBlockFromDisk(block, pblockindex, Params().GetConsensus());
+
+            // The note commitments of the block are hashed into the trees once,
+            // and every witness is updated from the result.
+            std::vector<libzcash::SHA256Compress> sproutCommitments;
+            std::vector<libzcash::PedersenHash> saplingCommitments;
+            for (const CTransactionRef& ptx : block.vtx) {
+                for (const JSDescription& jsdesc : ptx->vJoinSplit) {
+                    sproutCommitments.insert(sproutCommitments.end(), jsdesc.commitments.begin(), jsdesc.commitments.end());
+                }
+                for (const OutputDescription& output : ptx->vShieldedOutput) {
+                    saplingCommitments.push_back(output.cm);
+                }
+            }
+
+            if (!sproutNotes.empty()) {
+                SproutMerkleTree sproutTree;
+                sproutRoot = pblockindex->pprev->hashSproutRoot;
+                ::ChainstateActive().CoinsTip().GetSproutAnchorAt(sproutRoot, sproutTree);
+                const SproutWitnessUpdater sproutUpdater(sproutTree, sproutCommitments);
+
+                for (SproutNoteData* nd : sproutNotes) {
+                    nd->witnesses.push_front(nd->witnesses.front());
+                    while (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
+                        nd->witnesses.pop_back();
+                    }
+
+                    sproutUpdater.update(nd->witnesses.front());
+                    nd->witnessHeight = pblockindex->nHeight;
+                }
+            }
+
+            if (!saplingNotes.empty()) {
+                SaplingMerkleTree saplingTree;
+                saplingRoot = pblockindex->pprev->hashSaplingRoot;
+                ::ChainstateActive().CoinsTip().GetSaplingAnchorAt(saplingRoot, saplingTree);
+                const SaplingWitnessUpdater saplingUpdater(saplingTree, saplingCommitments);
+
+                for (SaplingNoteData* nd : saplingNotes) {
+                    nd->witnesses.push_front(nd->witnesses.front());
+                    while (nd->witnesses.size() > WITNESS_CACHE_SIZE) {
+                        nd->witnesses.pop_back();
                     }
+
+                    saplingUpdater.update(nd->witnesses.front());
+                    nd->witnessHeight = pblockindex->nHeight;
                 }
             }
         }
@@ -1926,7 +2286,7 @@ DBErrors CWallet::ReorderTransactions()
             nOrderPos = nOrderPosNext++;
             nOrderPosOffsets.push_back(nOrderPos);
 
-            if (!batch.WriteTx(*pwtx))
+            if (!WriteTxInFull(batch, *pwtx))
                 return DBErrors::LOAD_FAIL;
         }
         else
@@ -1944,7 +2304,7 @@ DBErrors CWallet::ReorderTransactions()
                 continue;
 
             // Since we're changing the order, write it back
-            if (!batch.WriteTx(*pwtx))
+            if (!WriteTxInFull(batch, *pwtx))
                 return DBErrors::LOAD_FAIL;
         }
     }
@@ -2160,7 +2520,7 @@ bool CWallet::MarkReplaced(const uint256& originalHash, const uint256& newHash)
     WalletBatch batch(*database, "r+");
 
     bool success = true;
-    if (!batch.WriteTx(wtx)) {
+    if (!WriteTxInFull(batch, wtx)) {
         WalletLogPrintf("%s: Updating batch tx %s failed\n", __func__, wtx.GetHash().ToString());
         success = false;
     }
@@ -2287,7 +2647,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 
     // Write to disk
     if (fInsertedNew || fUpdated)
-        if (!batch.WriteTx(wtx))
+        if (!WriteTxInFull(batch, wtx))
             return false;
 
     // Break debit/credit balance caches:
@@ -2319,8 +2679,7 @@ bool CWallet::UpdatedNoteData(const CWalletTx& wtxIn, CWalletTx& wtx)
         // Ensure we keep any cached witnesses we may already have
         for (const std::pair <SproutOutPoint, SproutNoteData> nd : wtx.mapSproutNoteData) {
             if (tmp.count(nd.first) && nd.second.witnesses.size() > 0) {
-                tmp.at(nd.first).witnesses.assign(
-                        nd.second.witnesses.cbegin(), nd.second.witnesses.cend());
+                tmp.at(nd.first).witnesses = nd.second.witnesses;
             }
             tmp.at(nd.first).witnessHeight = nd.second.witnessHeight;
         }
@@ -2335,8 +2694,7 @@ bool CWallet::UpdatedNoteData(const CWalletTx& wtxIn, CWalletTx& wtx)
 
         for (const std::pair <SaplingOutPoint, SaplingNoteData> nd : wtx.mapSaplingNoteData) {
             if (tmp.count(nd.first) && nd.second.witnesses.size() > 0) {
-                tmp.at(nd.first).witnesses.assign(
-                        nd.second.witnesses.cbegin(), nd.second.witnesses.cend());
+                tmp.at(nd.first).witnesses = nd.second.witnesses;
             }
             tmp.at(nd.first).witnessHeight = nd.second.witnessHeight;
         }
@@ -2362,9 +2720,10 @@ void CWallet::LoadToWallet(CWalletTx& wtxIn)
         }
     }
     uint256 hash = wtxIn.GetHash();
-    const auto& ins = mapWallet.emplace(hash, wtxIn);
+    const auto& ins = mapWallet.emplace(hash, std::move(wtxIn));
     CWalletTx& wtx = ins.first->second;
     wtx.BindWallet(this);
+    MarkNoteDataWritten(wtx);
     UpdateNullifierNoteMapWithTx(mapWallet.at(hash));
     if (/* insertion took place */ ins.second) {
         wtx.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(wtx.nOrderPos, &wtx));
@@ -2381,7 +2740,31 @@ void CWallet::LoadToWallet(CWalletTx& wtxIn)
     }
 }
 
-bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, CWalletTx::Status status, const uint256& block_hash, int posInBlock, bool fUpdate)
+void CWallet::LoadTxUpdate(const uint256& hash, uint32_t seq, const CWalletTxUpdate& update)
+{
+    auto it = mapWallet.find(hash);
+    if (it == mapWallet.end()) {
+        return;
+    }
+    CWalletTx& wtx = it->second;
+    wtx.nWitnessUpdates = std::max(wtx.nWitnessUpdates, seq + 1);
+    for (const auto& item : update.sprout) {
+        auto nd = wtx.mapSproutNoteData.find(item.first);
+        if (nd != wtx.mapSproutNoteData.end()) {
+            ApplyNoteWitnessUpdate(nd->second, item.second);
+        }
+    }
+    for (const auto& item : update.sapling) {
+        auto nd = wtx.mapSaplingNoteData.find(item.first);
+        if (nd != wtx.mapSaplingNoteData.end()) {
+            ApplyNoteWitnessUpdate(nd->second, item.second);
+        }
+    }
+    MarkNoteDataWritten(wtx);
+    UpdateNullifierNoteMapWithTx(wtx);
+}
+
+bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, CWalletTx::Status status, const uint256& block_hash, int posInBlock, bool fUpdate, const WalletTxNotes* notes)
 {
     const CTransaction& tx = *ptx;
     {
@@ -2402,11 +2785,13 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, CWalletTx::St
 
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        auto sproutNoteData = FindMySproutNotes(tx);
-        auto saplingNoteDataAndAddressesToAdd = FindMySaplingNotes(tx);
+        auto sproutNoteData = notes ? notes->sprout : FindMySproutNotes(tx);
+        auto saplingNoteDataAndAddressesToAdd = notes ? notes->sapling : FindMySaplingNotes(tx);
         auto saplingNoteData = saplingNoteDataAndAddressesToAdd.first;
         auto addressesToAdd = saplingNoteDataAndAddressesToAdd.second;
         for (const auto &addressToAdd : addressesToAdd) {
+            // Notes found ahead may be for an address added since then
+            if (notes && HaveSaplingIncomingViewingKey(addressToAdd.first)) continue;
             if (!AddSaplingIncomingViewingKey(addressToAdd.second, addressToAdd.first)) {
                 return false;
             }
@@ -2531,7 +2916,7 @@ bool CWallet::AbandonTransaction(interfaces::Chain::Lock& locked_chain, const ui
             wtx.m_confirm.nIndex = 0;
             wtx.setAbandoned();
             wtx.MarkDirty();
-            batch.WriteTx(wtx);
+            WriteTxInFull(batch, wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -2586,7 +2971,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.m_confirm.hashBlock = hashBlock;
             wtx.setConflicted();
             wtx.MarkDirty();
-            batch.WriteTx(wtx);
+            WriteTxInFull(batch, wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
             while (iter != mapTxSpends.end() && iter->first.hash == now) {
@@ -2646,17 +3031,25 @@ Optional<uint256> CWallet::GetSproutNoteNullifier(const JSDescription &jsdesc,
  */
 mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
 {
-    LOCK(cs_KeyStore);
-    uint256 hash = tx.GetHash();
-
     mapSproutNoteData_t noteData;
+    if (tx.vJoinSplit.empty()) return noteData;
+
+    // Trial decryption runs without holding cs_KeyStore, so that several
+    // threads can scan transactions at once, see ScanForWalletTransactions.
+    NoteDecryptorMap decryptors;
+    {
+        LOCK(cs_KeyStore);
+        decryptors = mapNoteDecryptors;
+    }
+
+    uint256 hash = tx.GetHash();
     for (size_t i = 0; i < tx.vJoinSplit.size(); i++) {
         auto hSig = ZCJoinSplit::h_sig(
             tx.vJoinSplit[i].randomSeed,
             tx.vJoinSplit[i].nullifiers,
             tx.joinSplitPubKey);
         for (uint8_t j = 0; j < tx.vJoinSplit[i].ciphertexts.size(); j++) {
-            for (const NoteDecryptorMap::value_type& item : mapNoteDecryptors) {
+            for (const NoteDecryptorMap::value_type& item : decryptors) {
                 try {
                     auto address = item.first;
                     SproutOutPoint jsoutpt {hash, i, j};
@@ -2696,23 +3089,32 @@ mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
  */
 std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySaplingNotes(const CTransaction &tx) const
 {
-    LOCK(cs_KeyStore);
-    uint256 hash = tx.GetHash();
-
     mapSaplingNoteData_t noteData;
     SaplingIncomingViewingKeyMap viewingKeysToAdd;
+    if (tx.vShieldedOutput.empty()) return std::make_pair(noteData, viewingKeysToAdd);
+
+    // Trial decryption runs without holding cs_KeyStore, as in FindMySproutNotes.
+    std::vector<libzcash::SaplingIncomingViewingKey> ivks;
+    {
+        LOCK(cs_KeyStore);
+        ivks.reserve(mapSaplingFullViewingKeys.size());
+        for (const auto& entry : mapSaplingFullViewingKeys) {
+            ivks.push_back(entry.first);
+        }
+    }
+
+    uint256 hash = tx.GetHash();
 
     // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
     for (uint32_t i = 0; i < tx.vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.vShieldedOutput[i];
-        for (auto it = mapSaplingFullViewingKeys.begin(); it != mapSaplingFullViewingKeys.end(); ++it) {
-            libzcash::SaplingIncomingViewingKey ivk = it->first;
+        const OutputDescription& output = tx.vShieldedOutput[i];
+        for (const libzcash::SaplingIncomingViewingKey& ivk : ivks) {
             auto result = libzcash::SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cm);
             if (!result) {
                 continue;
             }
             auto address = ivk.address(result.get().d);
-            if (address && mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
+            if (address && !HaveSaplingIncomingViewingKey(address.get())) {
                 viewingKeysToAdd[address.get()] = ivk;
             }
             // We don't cache the nullifier here as computing it requires knowledge of the note position
@@ -2806,9 +3208,9 @@ void CWallet::GetSaplingNoteWitnesses(std::vector<SaplingOutPoint> notes,
     }
 }
 
-void CWallet::SyncTransaction(const CTransactionRef& ptx, CWalletTx::Status status, const uint256& block_hash, int posInBlock, bool update_tx)
+void CWallet::SyncTransaction(const CTransactionRef& ptx, CWalletTx::Status status, const uint256& block_hash, int posInBlock, bool update_tx, const WalletTxNotes* notes)
 {
-    if (!AddToWalletIfInvolvingMe(ptx, status, block_hash, posInBlock, update_tx))
+    if (!AddToWalletIfInvolvingMe(ptx, status, block_hash, posInBlock, update_tx, notes))
         return; // Not one of ours
 
     // If a transaction changes 'conflicted' state, that changes the balance
@@ -3484,7 +3886,7 @@ void CWalletTx::GetAmounts(std::list<COutputEntry>& listReceived,
  * @return Earliest timestamp that could be successfully scanned from. Timestamp
  * returned will be higher than startTime if relevant blocks could not be read.
  */
-int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update)
+int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update, bool shielded_only)
 {
     // Find starting block. May be null if nCreateTime is greater than the
     // highest blockchain timestamp, in which case there is nothing that needs
@@ -3499,7 +3901,7 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
 
     if (!start_block.IsNull()) {
         // TODO: this should take into account failure by ScanResult::USER_ABORT
-        ScanResult result = ScanForWalletTransactions(start_block, {} /* stop_block */, reserver, update);
+        ScanResult result = ScanForWalletTransactions(start_block, {} /* stop_block */, reserver, update, shielded_only);
         if (result.status == ScanResult::FAILURE) {
             int64_t time_max;
             if (!chain().findBlock(result.last_failed_block, nullptr /* block */, nullptr /* time */, &time_max)) {
@@ -3511,6 +3913,149 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+namespace {
+
+/**
+ * Reads the blocks of a rescan and trial-decrypts their shielded outputs on
+ * worker threads, ahead of the thread adding the transactions to the wallet
+ * in chain order. The scanning thread looks the blocks up and queues their
+ * positions on disk, so that the workers do not need cs_main, which callers
+ * of ScanForWalletTransactions may hold. Only a bounded number of blocks is
+ * held ahead of it.
+ */
+class RescanPrefetcher
+{
+public:
+    //! A block read by a worker, with the notes of each of its transactions
+    struct ScannedBlock
+    {
+        uint256 hash;
+        FlatFilePos pos;
+        CBlock block;
+        std::vector<WalletTxNotes> notes;
+        bool found = false;
+        bool has_notes = false;
+        bool done = false;
+    };
+
+    explicit RescanPrefetcher(const CWallet& wallet) : m_wallet(wallet)
+    {
+        const int n_threads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+        m_max_pending = 4 * n_threads;
+        for (int i = 0; i < n_threads; i++) {
+            m_threads.emplace_back([this] { ThreadScan(); });
+        }
+    }
+
+    ~RescanPrefetcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /** Whether another block can be queued. */
+    bool CanEnqueue()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return (int)m_blocks.size() < m_max_pending;
+    }
+
+    /** Queue the block at height to be read from pos. */
+    void Enqueue(int height, const uint256& hash, const FlatFilePos& pos)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ScannedBlock& scanned = m_blocks[height];
+            scanned.hash = hash;
+            scanned.pos = pos;
+            m_queue.push_back(height);
+        }
+        m_cond.notify_one();
+    }
+
+    /**
+     * Wait for the block at height to be read. Returns false if it was not
+     * queued. Blocks queued below height are dropped.
+     */
+    bool Take(int height, ScannedBlock& out)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = m_blocks.find(height);
+        if (it == m_blocks.end()) return false;
+        m_cond.wait(lock, [&] { return it->second.done; });
+        out = std::move(it->second);
+        m_blocks.erase(m_blocks.begin(), std::next(it));
+        return true;
+    }
+
+private:
+    void ThreadScan()
+    {
+        util::ThreadRename("rescan");
+        while (true) {
+            int height;
+            FlatFilePos pos;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [&] { return m_stop || !m_queue.empty(); });
+                if (m_stop) return;
+                height = m_queue.front();
+                m_queue.pop_front();
+                auto it = m_blocks.find(height);
+                if (it == m_blocks.end()) continue;
+                pos = it->second.pos;
+            }
+
+            CBlock block;
+            std::vector<WalletTxNotes> notes;
+            bool has_notes = false;
+            const bool found = ReadBlockFromDisk(block, pos, Params().GetConsensus());
+            if (found) {
+                notes.resize(block.vtx.size());
+                for (size_t i = 0; i < block.vtx.size(); i++) {
+                    const CTransaction& tx = *block.vtx[i];
+                    notes[i].sprout = m_wallet.FindMySproutNotes(tx);
+                    notes[i].sapling = m_wallet.FindMySaplingNotes(tx);
+                    if (!notes[i].sprout.empty() || !notes[i].sapling.first.empty()) {
+                        has_notes = true;
+                    }
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_blocks.find(height);
+                if (it != m_blocks.end()) {
+                    ScannedBlock& scanned = it->second;
+                    scanned.found = found && block.GetHash() == scanned.hash;
+                    scanned.block = std::move(block);
+                    scanned.notes = std::move(notes);
+                    scanned.has_notes = has_notes;
+                    scanned.done = true;
+                }
+            }
+            m_cond.notify_all();
+        }
+    }
+
+    const CWallet& m_wallet;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::map<int, ScannedBlock> m_blocks;
+    std::deque<int> m_queue;
+    int m_max_pending;
+    bool m_stop = false;
+    std::vector<std::thread> m_threads;
+};
+
+} // namespace
+
 /**
  * Scan the block chain (starting in start_block) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -3521,6 +4066,9 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
  * @param[in] stop_block  Scan ending block. If block is not on the active
  *                        chain, the scan will continue until it reaches the
  *                        chain tip.
+ * @param[in] shielded_only Only scan the blocks which may have shielded spends
+ *                        or outputs, and the ending block. This is enough
+ *                        after adding shielded keys to an up to date wallet.
  *
  * @return ScanResult returning scan information and indicating success or
  *         failure. Return status will be set to SUCCESS if scan was
@@ -3532,7 +4080,7 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
  * the main chain after to the addition of any new keys you want to detect
  * transactions for.
  */
-CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_block, const uint256& stop_block, const WalletRescanReserver& reserver, bool fUpdate)
+CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_block, const uint256& stop_block, const WalletRescanReserver& reserver, bool fUpdate, bool shielded_only)
 {
     int64_t nNow = GetTime();
     int64_t start_time = GetTimeMillis();
@@ -3551,6 +4099,24 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
     Optional<int> block_height = MakeOptional(false, int());
     double progress_begin;
     double progress_end;
+
+    // Blocks up to the stop block, or the tip, are looked up here while the
+    // chain is locked, and read and trial-decrypted ahead by the prefetcher.
+    RescanPrefetcher prefetcher(*this);
+    Optional<int> prefetch_stop_height;
+    int prefetch_height = 0;
+    auto prefetch_blocks = [&] {
+        LockAssertion lock(::cs_main);
+        while ((!prefetch_stop_height || prefetch_height <= *prefetch_stop_height) && prefetcher.CanEnqueue()) {
+            const CBlockIndex* pindex = ::ChainActive()[prefetch_height];
+            if (!pindex) break;
+            if ((pindex->nStatus & BLOCK_HAVE_DATA) && (!shielded_only || pindex->MayHaveShieldedActivity())) {
+                prefetcher.Enqueue(prefetch_height, pindex->GetBlockHash(), pindex->GetBlockPos());
+            }
+            prefetch_height++;
+        }
+    };
+
     {
         auto locked_chain = chain().lock();
         if (Optional<int> tip_height = locked_chain->getHeight()) {
@@ -3559,6 +4125,11 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
         block_height = locked_chain->getBlockHeight(block_hash);
         progress_begin = chain().guessVerificationProgress(block_hash);
         progress_end = chain().guessVerificationProgress(stop_block.IsNull() ? tip_hash : stop_block);
+        if (block_height) {
+            if (!stop_block.IsNull()) prefetch_stop_height = locked_chain->getBlockHeight(stop_block);
+            prefetch_height = *block_height;
+            prefetch_blocks();
+        }
     }
     double progress_current = progress_begin;
     while (block_height && !fAbortRescan && !chain().shutdownRequested()) {
@@ -3571,8 +4142,15 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
             WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", *block_height, progress_current);
         }
 
-        CBlock block;
-        if (chain().findBlock(block_hash, &block) && !block.IsNull()) {
+        // Blocks the prefetcher could not read, or which were replaced by a
+        // reorg since they were queued, are read here.
+        RescanPrefetcher::ScannedBlock scanned;
+        if (!prefetcher.Take(*block_height, scanned) || !scanned.found || scanned.hash != block_hash) {
+            scanned = RescanPrefetcher::ScannedBlock();
+            scanned.found = chain().findBlock(block_hash, &scanned.block) && !scanned.block.IsNull();
+        }
+        if (scanned.found) {
+            const CBlock& block = scanned.block;
             auto locked_chain = chain().lock();
             LOCK(cs_wallet);
             if (!locked_chain->getBlockHeight(block_hash)) {
@@ -3584,24 +4162,18 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                 result.status = ScanResult::FAILURE;
                 break;
             }
+            const bool prefetched = !scanned.notes.empty();
             for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                SyncTransaction(block.vtx[posInBlock], CWalletTx::Status::CONFIRMED, block_hash, posInBlock, fUpdate);
-            }
-
-            SproutMerkleTree sproutTree;
-            SaplingMerkleTree saplingTree;
-            // This should never fail: we should always be able to get the tree
-            // state on the path to the tip of our chain
-            const CBlockIndex* pindex = LookupBlockIndex(block_hash);
-            assert(::ChainstateActive().CoinsTip().GetSproutAnchorAt(pindex->hashSproutAnchor, sproutTree));
-            if (pindex->pprev) {
-                if (Params().GetConsensus().NetworkUpgradeActive(pindex->pprev->nHeight, Consensus::UPGRADE_SAPLING)) {
-                    assert(::ChainstateActive().CoinsTip().GetSaplingAnchorAt(pindex->pprev->hashSaplingRoot, saplingTree));
-                }
+                SyncTransaction(block.vtx[posInBlock], CWalletTx::Status::CONFIRMED, block_hash, posInBlock, fUpdate,
+                                prefetched ? &scanned.notes[posInBlock] : nullptr);
             }
 
-            // Build inital witness caches
-            BuildWitnessCache(pindex, true);
+            // Set the initial witnesses and nullifiers of the notes found, so
+            // that their spends in later blocks are detected. Blocks without
+            // notes of ours have nothing to set up.
+            if (!prefetched || scanned.has_notes) {
+                BuildWitnessCache(LookupBlockIndex(block_hash), true);
+            }
 
             // scan succeeded, record block as most recent successfully scanned
             result.last_scanned_block = block_hash;
@@ -3623,9 +4195,18 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                 break;
             }
 
-            // increment block and verification progress
-            block_hash = locked_chain->getBlockHash(++*block_height);
+            // increment block and verification progress. A shielded-only
+            // scan jumps to the next block with shielded spends or outputs,
+            // but always scans the last block.
+            ++*block_height;
+            if (shielded_only) {
+                Optional<int> last_height = stop_block.IsNull() ? nullopt : locked_chain->getBlockHeight(stop_block);
+                if (!last_height || *last_height < *block_height) last_height = tip_height;
+                block_height = locked_chain->findShieldedActivity(*block_height, *last_height).get_value_or(*last_height);
+            }
+            block_hash = locked_chain->getBlockHash(*block_height);
             progress_current = chain().guessVerificationProgress(block_hash);
+            prefetch_blocks();
 
             // handle updated tip hash
             const uint256 prev_tip_hash = tip_hash;
@@ -3929,6 +4510,17 @@ void MaybeResendWalletTxs()
     }
 }
 
+void MaybeTopUpSaplingKeyPools()
+{
+    for (const std::shared_ptr<CWallet>& pwallet : GetWallets()) {
+        try {
+            pwallet->TopUpSaplingKeyPool();
+        } catch (const std::exception& e) {
+            pwallet->WalletLogPrintf("%s: %s\n", __func__, e.what());
+        }
+    }
+}
+
 
 /** @defgroup Actions
  *
@@ -5338,6 +5930,19 @@ bool CWallet::SetSproutAddressBookWithDB(WalletBatch& batch, const libzcash::Pay
 }
 
 bool CWallet::SetSaplingAddressBookWithDB(WalletBatch& batch, const libzcash::PaymentAddress& address, const std::string& strName, const std::string& strPurpose)
+{
+    UpdateSaplingAddressBook(address, strName, strPurpose);
+    return WriteSaplingAddressBook(batch, address, strName, strPurpose);
+}
+
+bool CWallet::WriteSaplingAddressBook(WalletBatch& batch, const libzcash::PaymentAddress& address, const std::string& strName, const std::string& strPurpose)
+{
+    if (!strPurpose.empty() && !batch.WriteSaplingPurpose(EncodePaymentAddress(address), strPurpose))
+        return false;
+    return batch.WriteSaplingName(EncodePaymentAddress(address), strName);
+}
+
+void CWallet::UpdateSaplingAddressBook(const libzcash::PaymentAddress& address, const std::string& strName, const std::string& strPurpose)
 {
     bool fUpdated = false;
     {
@@ -5350,9 +5955,6 @@ bool CWallet::SetSaplingAddressBookWithDB(WalletBatch& batch, const libzcash::Pa
     }
     NotifySaplingAddressBookChanged(this, address, strName, ::IsMine(*this, address) != ISMINE_NO,
                                     strPurpose, (fUpdated ? CT_UPDATED : CT_NEW) );
-    if (!strPurpose.empty() && !batch.WriteSaplingPurpose(EncodePaymentAddress(address), strPurpose))
-        return false;
-    return batch.WriteSaplingName(EncodePaymentAddress(address), strName);
 }
 
 bool CWallet::SetAddressBook(const CTxDestination& address, const std::string& strName, const std::string& strPurpose)
@@ -5499,6 +6101,226 @@ void CWallet::LoadKeyPool(int64_t nIndex, const CKeyPool &keypool)
         mapKeyMetadata[keyid] = CKeyMetadata(keypool.nTime);
 }
 
+void CWallet::LoadSaplingKeyPool(int64_t nIndex, const CSaplingKeyPool &keypool)
+{
+    AssertLockHeld(cs_wallet);
+    m_sapling_keypool[nIndex] = keypool.address;
+    m_sapling_pool_address_to_index[keypool.address] = nIndex;
+    m_max_sapling_keypool_index = std::max(m_max_sapling_keypool_index, nIndex);
+}
+
+bool CWallet::TopUpSaplingKeyPool(unsigned int kpSize)
+{
+    HDSeed seed;
+    uint32_t first_account;
+    std::vector<DerivedSaplingKey> keys;
+    {
+        LOCK(cs_wallet);
+
+        if (IsWalletFlagSet(WALLET_FLAG_DISABLE_PRIVATE_KEYS) || IsWalletFlagSet(WALLET_FLAG_BLANK_WALLET) || IsLocked()) {
+            return false;
+        }
+
+        unsigned int nTargetSize;
+        if (kpSize > 0)
+            nTargetSize = kpSize;
+        else
+            nTargetSize = std::max(gArgs.GetArg("-saplingkeypool", DEFAULT_SAPLING_KEYPOOL_SIZE), (int64_t) 0);
+
+        if (m_sapling_keypool.size() >= nTargetSize) {
+            return true;
+        }
+        if (!GetZecHDSeed(seed)) {
+            return false;
+        }
+        keys.resize(nTargetSize - m_sapling_keypool.size());
+        if (zecHDChain.saplingAccountCounter + (uint64_t) keys.size() > ZIP32_HARDENED_KEY_LIMIT) {
+            return false;
+        }
+        first_account = ReserveSaplingAccounts(keys.size());
+    }
+
+    // Derive the keys of the reserved accounts and their default addresses
+    // without holding cs_wallet, so that addresses can be handed out in the
+    // meantime.
+    DeriveSaplingKeys(DeriveSaplingCoinTypeKey(seed), first_account, keys);
+
+    LOCK(cs_wallet);
+
+    // The wallet was locked in the meantime, the reserved accounts are skipped
+    if (IsLocked()) {
+        return false;
+    }
+
+    keys.erase(std::remove_if(keys.begin(), keys.end(), [this](const DerivedSaplingKey& key) {
+        return HaveSaplingSpendingKey(key.extfvk);
+    }), keys.end());
+
+    int64_t nCreationTime = GetTime();
+    int64_t nIndex = m_max_sapling_keypool_index;
+    WalletBatch batch(*database);
+    if (!batch.TxnBegin())
+        throw std::runtime_error(std::string(__func__) + ": Couldn't start atomic write");
+    try {
+        for (DerivedSaplingKey& key : keys) {
+            WriteDerivedSaplingKey(batch, key, nCreationTime);
+            if (!batch.WriteSaplingPool(++nIndex, CSaplingKeyPool(key.address)))
+                throw std::runtime_error(std::string(__func__) + ": writing generated key failed");
+        }
+    } catch (...) {
+        batch.TxnAbort();
+        throw;
+    }
+    if (!batch.TxnCommit())
+        throw std::runtime_error(std::string(__func__) + ": Couldn't commit atomic write");
+
+    for (const DerivedSaplingKey& key : keys) {
+        LoadDerivedSaplingKey(key, nCreationTime);
+        m_sapling_keypool[++m_max_sapling_keypool_index] = key.address;
+        m_sapling_pool_address_to_index[key.address] = m_max_sapling_keypool_index;
+    }
+    UpdateTimeFirstKey(nCreationTime);
+    WalletLogPrintf("Sapling keypool added %d keys, size=%u\n", keys.size(), m_sapling_keypool.size());
+    return true;
+}
+
+std::vector<libzcash::SaplingPaymentAddress> CWallet::TakeSaplingKeysFromKeyPool(unsigned int count, const std::string& label)
+{
+    AssertLockHeld(cs_wallet);
+
+    std::vector<libzcash::SaplingPaymentAddress> addresses;
+    if (m_sapling_keypool.empty()) {
+        return addresses;
+    }
+
+    WalletBatch batch(*database);
+    if (!batch.TxnBegin())
+        throw std::runtime_error(std::string(__func__) + ": Couldn't start atomic write");
+    auto it = m_sapling_keypool.begin();
+    try {
+        for (; it != m_sapling_keypool.end() && addresses.size() < count; ++it) {
+            if (!batch.EraseSaplingPool(it->first))
+                throw std::runtime_error(std::string(__func__) + ": erasing key from keypool failed");
+            if (!WriteSaplingAddressBook(batch, it->second, label, "receive"))
+                throw std::runtime_error(std::string(__func__) + ": Writing address book failed");
+            addresses.push_back(it->second);
+        }
+    } catch (...) {
+        batch.TxnAbort();
+        throw;
+    }
+    if (!batch.TxnCommit())
+        throw std::runtime_error(std::string(__func__) + ": Couldn't commit atomic write");
+
+    for (const auto& addr : addresses) {
+        m_sapling_pool_address_to_index.erase(addr);
+        UpdateSaplingAddressBook(addr, label, "receive");
+    }
+    m_sapling_keypool.erase(m_sapling_keypool.begin(), it);
+    return addresses;
+}
+
+bool CWallet::IsSaplingKeyPoolAddress(const libzcash::SaplingPaymentAddress& address) const
+{
+    AssertLockHeld(cs_wallet);
+    return m_sapling_pool_address_to_index.count(address) > 0;
+}
+
+void CWallet::LoadSaplingDiversifiedAddress(const libzcash::SaplingPaymentAddress &addr, const CSaplingDiversifiedAddress &diversified)
+{
+    AssertLockHeld(cs_wallet);
+    FillableSigningProvider::AddSaplingIncomingViewingKey(diversified.ivk, addr);
+    mapSaplingDiversifiedAddresses[addr] = diversified;
+
+    libzcash::diversifier_index_t next = diversified.j;
+    if (AddDiversifierIndex(next, 1)) {
+        auto it = mapSaplingNextDiversifierIndex.find(diversified.ivk);
+        if (it == mapSaplingNextDiversifierIndex.end()) {
+            mapSaplingNextDiversifierIndex.emplace(diversified.ivk, next);
+        } else if (DiversifierIndexLess(it->second, next)) {
+            it->second = next;
+        }
+    }
+}
+
+std::vector<std::pair<libzcash::diversifier_index_t, libzcash::SaplingPaymentAddress>> CWallet::GenerateSaplingDiversifiedAddresses(
+    const libzcash::SaplingExtendedFullViewingKey& extfvk, unsigned int count, const std::string& label)
+{
+    const libzcash::SaplingIncomingViewingKey ivk = extfvk.fvk.in_viewing_key();
+
+    // About half of the diversifiers are valid. Reserve ranges of indexes
+    // under cs_wallet, and search them without holding it until enough are
+    // found. The indexes of a range left unused are skipped.
+    std::vector<std::pair<libzcash::diversifier_index_t, libzcash::SaplingPaymentAddress>> addresses;
+    bool fExhausted = false;
+    while (addresses.size() < count && !fExhausted) {
+        const size_t n_ranges = (2 * (count - addresses.size()) + DIVERSIFIER_SEARCH_RANGE - 1) / DIVERSIFIER_SEARCH_RANGE;
+        libzcash::diversifier_index_t first;
+        {
+            LOCK(cs_wallet);
+            auto it = mapSaplingNextDiversifierIndex.find(ivk);
+            if (it != mapSaplingNextDiversifierIndex.end()) {
+                first = it->second;
+            } else {
+                // Start right after the default address of the key
+                first = extfvk.Address(first).get().first;
+                AddDiversifierIndex(first, 1);
+            }
+            libzcash::diversifier_index_t next = first;
+            if (!AddDiversifierIndex(next, n_ranges * DIVERSIFIER_SEARCH_RANGE)) {
+                // The search goes to the end of the diversifier space
+                std::fill(next.begin(), next.end(), 0xff);
+                fExhausted = true;
+            }
+            mapSaplingNextDiversifierIndex[ivk] = next;
+        }
+
+        auto found = FindSaplingDiversifiedAddresses(extfvk, first, n_ranges);
+        addresses.insert(addresses.end(), found.begin(), found.end());
+    }
+    if (addresses.size() > count) {
+        addresses.resize(count);
+    }
+    if (addresses.size() < count)
+        throw std::runtime_error(std::string(__func__) + ": No valid diversifiers left");
+
+    LOCK(cs_wallet);
+
+    WalletBatch batch(*database);
+    if (!batch.TxnBegin())
+        throw std::runtime_error(std::string(__func__) + ": Couldn't start atomic write");
+    try {
+        for (const auto& address : addresses) {
+            if (!batch.WriteSaplingDiversifiedAddress(address.second, CSaplingDiversifiedAddress(ivk, address.first)))
+                throw std::runtime_error(std::string(__func__) + ": Writing diversified address failed");
+            if (!WriteSaplingAddressBook(batch, address.second, label, "receive"))
+                throw std::runtime_error(std::string(__func__) + ": Writing address book failed");
+        }
+    } catch (...) {
+        batch.TxnAbort();
+        throw;
+    }
+    if (!batch.TxnCommit())
+        throw std::runtime_error(std::string(__func__) + ": Couldn't commit atomic write");
+
+    for (const auto& address : addresses) {
+        LoadSaplingDiversifiedAddress(address.second, CSaplingDiversifiedAddress(ivk, address.first));
+        UpdateSaplingAddressBook(address.second, label, "receive");
+    }
+    return addresses;
+}
+
+bool CWallet::GetSaplingDiversifiedAddress(const libzcash::SaplingPaymentAddress& address, CSaplingDiversifiedAddress& diversified) const
+{
+    AssertLockHeld(cs_wallet);
+    auto it = mapSaplingDiversifiedAddresses.find(address);
+    if (it == mapSaplingDiversifiedAddresses.end()) {
+        return false;
+    }
+    diversified = it->second;
+    return true;
+}
+
 bool CWallet::TopUpKeyPool(unsigned int kpSize)
 {
     if (!CanGenerateKeys()) {
@@ -5692,16 +6514,52 @@ bool CWallet::GetNewSproutDestination(const std::string label, libzcash::Payment
 
 bool CWallet::GetNewSaplingDestination(const std::string label, libzcash::PaymentAddress& dest, std::string& error)
 {
-    LOCK(cs_wallet);
+    std::vector<libzcash::PaymentAddress> dests;
+    if (!GetNewSaplingDestinations(1, label, dests, error)) {
+        return false;
+    }
+    dest = dests.front();
+    return true;
+}
+
+bool CWallet::GetNewSaplingDestinations(unsigned int count, const std::string label, std::vector<libzcash::PaymentAddress>& dests, std::string& error)
+{
     error.clear();
 
-    if (IsLocked()) return false;
+    std::vector<libzcash::SaplingPaymentAddress> addresses;
+    while (addresses.size() < count) {
+        const unsigned int remaining = count - addresses.size();
+        unsigned int from_pool;
+        {
+            LOCK(cs_wallet);
 
-    // Generate a new shielded key that is added to wallet
-    WalletBatch batch(*database);
-    dest = GenerateNewSaplingKey(batch);
+            // Keys of the keypool are handed out even while the wallet is locked
+            if (IsLocked() && m_sapling_keypool.size() < remaining) {
+                error = "Error: Sapling keypool ran out, please call walletpassphrase first";
+                return false;
+            }
+            from_pool = std::min<size_t>(m_sapling_keypool.size(), remaining);
+        }
+
+        // Generate the keys the keypool lacks first, deriving them without
+        // holding cs_wallet, so that no address is taken from the keypool and
+        // lost if that fails.
+        if (from_pool < remaining) {
+            for (const auto& addr : GenerateNewSaplingKeys(remaining - from_pool, label)) {
+                addresses.push_back(addr);
+            }
+        }
 
-    SetSaplingAddressBook(dest, label, "receive");
+        // Another caller may have taken keys from the keypool in the meantime,
+        // those missing are generated in the next round.
+        LOCK(cs_wallet);
+        for (const auto& addr : TakeSaplingKeysFromKeyPool(from_pool, label)) {
+            addresses.push_back(addr);
+        }
+    }
+    for (const auto& addr : addresses) {
+        dests.push_back(addr);
+    }
     return true;
 }
 
@@ -6589,7 +7447,7 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(interfaces::Chain& chain,
                     copyTo->nTimeSmart = copyFrom->nTimeSmart;
                     copyTo->fFromMe = copyFrom->fFromMe;
                     copyTo->nOrderPos = copyFrom->nOrderPos;
-                    batch.WriteTx(*copyTo);
+                    WriteTxInFull(batch, *copyTo);
                 }
             }
         }
@@ -6636,6 +7494,24 @@ bool CWallet::BackupWallet(const std::string& strDest)
     return database->Backup(strDest);
 }
 
+SaltedDiversifierHasher::SaltedDiversifierHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t SaltedDiversifierHasher::operator()(const libzcash::SaplingPaymentAddress& address) const
+{
+    return CSipHasher(k0, k1).Write(address.d.data(), address.d.size()).Finalize();
+}
+
+CSaplingKeyPool::CSaplingKeyPool()
+{
+    nTime = GetTime();
+}
+
+CSaplingKeyPool::CSaplingKeyPool(const libzcash::SaplingPaymentAddress& addressIn)
+{
+    nTime = GetTime();
+    address = addressIn;
+}
+
 CKeyPool::CKeyPool()
 {
     nTime = GetTime();
@@ -7262,6 +8138,14 @@ void CWallet::GetSproutPaymentAddresses(std::set<libzcash::SproutPaymentAddress>
 
 bool CWallet::AddCryptedSaplingSpendingKeyInner(const libzcash::SaplingExtendedFullViewingKey &extfvk,
                                                 const std::vector<unsigned char> &vchCryptedSecret)
+{
+    return AddCryptedSaplingSpendingKeyInner(extfvk, extfvk.fvk.in_viewing_key(), extfvk.DefaultAddress(), vchCryptedSecret);
+}
+
+bool CWallet::AddCryptedSaplingSpendingKeyInner(const libzcash::SaplingExtendedFullViewingKey &extfvk,
+                                                const libzcash::SaplingIncomingViewingKey &ivk,
+                                                const libzcash::SaplingPaymentAddress &defaultAddr,
+                                                const std::vector<unsigned char> &vchCryptedSecret)
 {
     LOCK(cs_KeyStore);
     if (!SetCrypted()) {
@@ -7269,7 +8153,7 @@ bool CWallet::AddCryptedSaplingSpendingKeyInner(const libzcash::SaplingExtendedF
     }
 
     // if extfvk is not in SaplingFullViewingKeyMap, add it
-    if (!FillableSigningProvider::AddSaplingFullViewingKey(extfvk)) {
+    if (!FillableSigningProvider::AddSaplingFullViewingKey(extfvk, ivk, defaultAddr)) {
         return false;
     }
 
@@ -7278,10 +8162,24 @@ bool CWallet::AddCryptedSaplingSpendingKeyInner(const libzcash::SaplingExtendedF
 }
 
 bool CWallet::AddSaplingSpendingKey(const libzcash::SaplingExtendedSpendingKey &sk)
+{
+    auto extfvk = sk.ToXFVK();
+    return AddSaplingSpendingKey(sk, extfvk, extfvk.fvk.in_viewing_key(), extfvk.DefaultAddress());
+}
+
+bool CWallet::AddSaplingSpendingKey(const libzcash::SaplingExtendedSpendingKey &sk,
+                                    const libzcash::SaplingExtendedFullViewingKey &extfvk,
+                                    const libzcash::SaplingIncomingViewingKey &ivk,
+                                    const libzcash::SaplingPaymentAddress &defaultAddr)
 {
     LOCK(cs_KeyStore);
     if (!fUseCrypto) {
-        return FillableSigningProvider::AddSaplingSpendingKey(sk);
+        // if extfvk is not in SaplingFullViewingKeyMap, add it
+        if (!FillableSigningProvider::AddSaplingFullViewingKey(extfvk, ivk, defaultAddr)) {
+            return false;
+        }
+        mapSaplingSpendingKeys[extfvk] = sk;
+        return true;
     }
 
     if (IsLocked()) {
@@ -7292,12 +8190,11 @@ bool CWallet::AddSaplingSpendingKey(const libzcash::SaplingExtendedSpendingKey &
     CSecureDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     ss << sk;
     CKeyingMaterial vchSecret(ss.begin(), ss.end());
-    auto extfvk = sk.ToXFVK();
     if (!EncryptSecret(vMasterKey, vchSecret, extfvk.fvk.GetFingerprint(), vchCryptedSecret)) {
         return false;
     }
 
-    return AddCryptedSaplingSpendingKeyInner(extfvk, vchCryptedSecret);
+    return AddCryptedSaplingSpendingKeyInner(extfvk, ivk, defaultAddr, vchCryptedSecret);
 }
 
 bool CWallet::HaveSaplingSpendingKey(const libzcash::SaplingExtendedFullViewingKey &extfvk) const
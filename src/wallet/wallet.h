@@ -38,6 +38,7 @@
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -70,6 +71,12 @@ WalletCreationStatus CreateWallet(interfaces::Chain& chain, const SecureString&
 
 //! Default for -keypool
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 1000;
+/**
+ * Default for -saplingkeypool. Every pooled key adds a trial decryption of
+ * each shielded output the wallet scans, so none are pooled by default; new
+ * addresses of a single key from z_getnewdiversifiedaddresses cost none.
+ */
+static const unsigned int DEFAULT_SAPLING_KEYPOOL_SIZE = 0;
 //! -paytxfee default
 constexpr CAmount DEFAULT_PAY_TX_FEE = 0;
 //! -fallbackfee default
@@ -108,6 +115,15 @@ static const int WITNESS_CACHE_SIZE = COINBASE_MATURITY;
 //! Size of HD seed in bytes
 static const size_t HD_WALLET_SEED_LENGTH = 32;
 
+//! Maximum number of threads reading and trial-decrypting blocks ahead during a rescan
+static const int MAX_RESCAN_THREADS = 8;
+
+//! Number of witness update records of a transaction after which they are compacted into its full record
+static const unsigned int MAX_WALLET_TX_UPDATES = 8;
+
+//! Maximum number of threads deriving Sapling keys in GenerateNewSaplingKeys
+static const int MAX_SAPLING_KEYGEN_THREADS = 8;
+
 class CCoinControl;
 class COutput;
 class SproutOutput;
@@ -281,6 +297,39 @@ public:
     }
 };
 
+/** A key from a CWallet's Sapling keypool
+ *
+ * Sapling keys of the keypool are derived ahead of time by
+ * TopUpSaplingKeyPool, which runs in the background, and stored with the
+ * other Sapling keys of the wallet so that notes sent to them are detected.
+ * The CSaplingKeyPool record only marks the default address of such a key as
+ * not handed out yet. Handing it out erases the record and adds the address
+ * to the address book, so new addresses are given out without deriving a key
+ * on the request path.
+ */
+class CSaplingKeyPool
+{
+public:
+    //! The time at which the key was generated
+    int64_t nTime;
+    //! The default address of the key
+    libzcash::SaplingPaymentAddress address;
+
+    CSaplingKeyPool();
+    explicit CSaplingKeyPool(const libzcash::SaplingPaymentAddress& addressIn);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        int nVersion = s.GetVersion();
+        if (!(s.GetType() & SER_GETHASH))
+            READWRITE(nVersion);
+        READWRITE(nTime);
+        READWRITE(address);
+    }
+};
+
 /** A wrapper to reserve an address from a wallet
  *
  * ReserveDestination is used to reserve an address.
@@ -502,6 +551,7 @@ public:
     mutable bool fChangeCached;
     mutable bool fInMempool;
     mutable CAmount nChangeCached;
+    unsigned int nWitnessUpdates; //!< number of witness update records written since the full record
 
     CWalletTx(const CWallet* pwalletIn, CTransactionRef arg)
         : tx(std::move(arg))
@@ -523,6 +573,7 @@ public:
         fChangeCached = false;
         fInMempool = false;
         nChangeCached = 0;
+        nWitnessUpdates = 0;
         nOrderPos = -1;
         m_confirm = Confirmation{};
     }
@@ -829,6 +880,98 @@ struct CoinSelectionParams
 typedef std::map<libzcash::SproutPaymentAddress, ZCNoteDecryption> NoteDecryptorMap;
 typedef std::map<libzcash::SaplingPaymentAddress, libzcash::SaplingIncomingViewingKey> SaplingIncomingViewingKeyMap;
 
+/** The notes of a transaction found by FindMySproutNotes and FindMySaplingNotes. */
+struct WalletTxNotes
+{
+    mapSproutNoteData_t sprout;
+    std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> sapling;
+};
+
+/** A Sapling account key derived from the wallet seed, with the keys and default address computed from it. */
+struct DerivedSaplingKey
+{
+    uint32_t account;
+    libzcash::SaplingExtendedSpendingKey xsk;
+    libzcash::SaplingExtendedFullViewingKey extfvk;
+    libzcash::SaplingIncomingViewingKey ivk;
+    libzcash::SaplingPaymentAddress address;
+    //! The encrypted spending key, set by CWallet::WriteDerivedSaplingKey if the wallet is encrypted
+    std::vector<unsigned char> vchCryptedSecret;
+};
+
+/** The Sapling key and diversifier index a diversified address was generated from. */
+struct CSaplingDiversifiedAddress
+{
+    libzcash::SaplingIncomingViewingKey ivk;
+    libzcash::diversifier_index_t j;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(ivk);
+        READWRITE(j);
+    }
+
+    CSaplingDiversifiedAddress() {}
+    CSaplingDiversifiedAddress(const libzcash::SaplingIncomingViewingKey& ivkIn, const libzcash::diversifier_index_t& jIn) : ivk(ivkIn), j(jIn) {}
+};
+
+/** Hashes a Sapling payment address by its diversifier only, with a random salt. */
+class SaltedDiversifierHasher
+{
+private:
+    /** Salt */
+    const uint64_t k0, k1;
+
+public:
+    SaltedDiversifierHasher();
+
+    size_t operator()(const libzcash::SaplingPaymentAddress& address) const;
+};
+
+/** The witnesses added to a note since the previous record of its transaction was written. */
+template <typename Witness>
+struct NoteWitnessUpdate
+{
+    //! Height of the most recent witness, the first of witnesses
+    int witnessHeight = -1;
+    std::vector<Witness> witnesses;
+    Optional<uint256> nullifier;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(witnessHeight);
+        READWRITE(witnesses);
+        READWRITE(nullifier);
+    }
+};
+
+/**
+ * An update of the notes of a wallet transaction, written after its full
+ * record instead of rewriting it when the witnesses of its notes advance or
+ * their nullifiers are learned. The updates of a transaction are applied in
+ * order when the wallet is loaded, and compacted into its full record after
+ * MAX_WALLET_TX_UPDATES of them.
+ */
+struct CWalletTxUpdate
+{
+    std::map<SproutOutPoint, NoteWitnessUpdate<SproutWitness>> sprout;
+    std::map<SaplingOutPoint, NoteWitnessUpdate<SaplingWitness>> sapling;
+
+    bool IsNull() const { return sprout.empty() && sapling.empty(); }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(sprout);
+        READWRITE(sapling);
+    }
+};
+
 class WalletRescanReserver; //forward declarations for ScanForWalletTransactions/RescanFromTime
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
@@ -957,8 +1100,11 @@ private:
      * abandoned is an indication that it is not safe to be considered abandoned.
      * Abandoned state should probably be more carefully tracked via different
      * posInBlock signals or by checking mempool presence when necessary.
+     *
+     * If notes is set, it holds the notes of the transaction found by trial
+     * decryption already, see ScanForWalletTransactions.
      */
-    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, CWalletTx::Status status, const uint256& block_hash, int posInBlock, bool fUpdate) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, CWalletTx::Status status, const uint256& block_hash, int posInBlock, bool fUpdate, const WalletTxNotes* notes = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
@@ -968,7 +1114,7 @@ private:
 
     /* Used by TransactionAddedToMemorypool/BlockConnected/Disconnected/ScanForWalletTransactions.
      * Should be called with non-zero block_hash and posInBlock if this is for a transaction that is included in a block. */
-    void SyncTransaction(const CTransactionRef& tx, CWalletTx::Status status, const uint256& block_hash, int posInBlock = 0, bool update_tx = true) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void SyncTransaction(const CTransactionRef& tx, CWalletTx::Status status, const uint256& block_hash, int posInBlock = 0, bool update_tx = true, const WalletTxNotes* notes = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     /* Update cached incremental witnesses when the active block chain tip changes */
     void ChainTip(const CBlock& block, const CBlockIndex *pindex, bool added) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet) override;
@@ -987,6 +1133,13 @@ private:
     std::set<int64_t> set_pre_split_keypool GUARDED_BY(cs_wallet);
     int64_t m_max_keypool_index GUARDED_BY(cs_wallet) = 0;
     std::map<CKeyID, int64_t> m_pool_key_to_index;
+    std::map<int64_t, libzcash::SaplingPaymentAddress> m_sapling_keypool GUARDED_BY(cs_wallet);
+    std::map<libzcash::SaplingPaymentAddress, int64_t> m_sapling_pool_address_to_index GUARDED_BY(cs_wallet);
+    int64_t m_max_sapling_keypool_index GUARDED_BY(cs_wallet) = 0;
+    //! Diversified addresses generated by GenerateSaplingDiversifiedAddresses, looked up by the hash of their diversifier
+    std::unordered_map<libzcash::SaplingPaymentAddress, CSaplingDiversifiedAddress, SaltedDiversifierHasher> mapSaplingDiversifiedAddresses GUARDED_BY(cs_wallet);
+    //! Diversifier index to search the next diversified address from, for each key with diversified addresses
+    std::map<libzcash::SaplingIncomingViewingKey, libzcash::diversifier_index_t> mapSaplingNextDiversifierIndex GUARDED_BY(cs_wallet);
     std::atomic<uint64_t> m_wallet_flags{0};
 
     int64_t nTimeFirstKey GUARDED_BY(cs_wallet) = 0;
@@ -1020,6 +1173,10 @@ private:
     bool SetAddressBookWithDB(WalletBatch& batch, const CTxDestination& address, const std::string& strName, const std::string& strPurpose);
     bool SetSproutAddressBookWithDB(WalletBatch& batch, const libzcash::PaymentAddress& address, const std::string& strName, const std::string& strPurpose);
     bool SetSaplingAddressBookWithDB(WalletBatch& batch, const libzcash::PaymentAddress& address, const std::string& strName, const std::string& strPurpose);
+    //! Write a Sapling address book entry without adding it to the wallet
+    bool WriteSaplingAddressBook(WalletBatch& batch, const libzcash::PaymentAddress& address, const std::string& strName, const std::string& strPurpose);
+    //! Add a Sapling address book entry to the wallet and notify it, once written by WriteSaplingAddressBook
+    void UpdateSaplingAddressBook(const libzcash::PaymentAddress& address, const std::string& strName, const std::string& strPurpose);
 
     //! Adds a script to the store and saves it to disk
     bool AddCScriptWithDB(WalletBatch& batch, const CScript& script);
@@ -1083,6 +1240,8 @@ public:
     const std::string& GetName() const { return m_location.GetName(); }
 
     void LoadKeyPool(int64_t nIndex, const CKeyPool &keypool) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void LoadSaplingKeyPool(int64_t nIndex, const CSaplingKeyPool &keypool) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void LoadSaplingDiversifiedAddress(const libzcash::SaplingPaymentAddress &addr, const CSaplingDiversifiedAddress &diversified) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void MarkPreSplitKeys() EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     // Map from Key ID to key metadata.
@@ -1292,7 +1451,24 @@ public:
      */
     CPubKey GenerateNewKey(WalletBatch& batch, bool internal = false) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     libzcash::SproutPaymentAddress GenerateNewSproutKey(WalletBatch& batch) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
-    libzcash::SaplingPaymentAddress GenerateNewSaplingKey(WalletBatch& batch) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    /**
+     * Generate count new Sapling spending keys, and add their default
+     * addresses to the address book with the given label. The accounts are
+     * reserved under cs_wallet, the keys derived without holding it on up to
+     * MAX_SAPLING_KEYGEN_THREADS threads, and then written in a single
+     * database transaction and added to the wallet once it is committed.
+     * Accounts whose key the wallet already has are skipped, and more are
+     * reserved in their place. Throws std::runtime_error on failure, e.g. if
+     * the wallet is locked; the accounts reserved by then are skipped, as
+     * with TopUpSaplingKeyPool, and none of the keys are written.
+     */
+    std::vector<libzcash::SaplingPaymentAddress> GenerateNewSaplingKeys(unsigned int count, const std::string& label);
+    //! Advance the Sapling account counter by count and write it, returns the first account reserved; throws on failure
+    uint32_t ReserveSaplingAccounts(unsigned int count) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Write a derived Sapling key and its metadata without adding them to the wallet, throws on failure
+    void WriteDerivedSaplingKey(WalletBatch& batch, DerivedSaplingKey& key, int64_t nCreationTime) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Add a derived Sapling key and its metadata to the wallet once written by WriteDerivedSaplingKey, throws on failure
+    void LoadDerivedSaplingKey(const DerivedSaplingKey& key, int64_t nCreationTime) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
@@ -1418,12 +1594,15 @@ public:
     void UpdateNullifierNoteMapForBlock(const CBlock* pblock) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
+    //! Add a transaction read from the wallet database. wtxIn is moved into mapWallet.
     void LoadToWallet(CWalletTx& wtxIn) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    //! Apply an update record read from the wallet database to a transaction loaded with LoadToWallet.
+    void LoadTxUpdate(const uint256& hash, uint32_t seq, const CWalletTxUpdate& update) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void TransactionAddedToMempool(const CTransactionRef& tx) override;
     void BlockConnected(const CBlock& block, const std::vector<CTransactionRef>& vtxConflicted) override;
     void BlockDisconnected(const CBlock& block) override;
     void UpdatedBlockTip() override;
-    int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update);
+    int64_t RescanFromTime(int64_t startTime, const WalletRescanReserver& reserver, bool update, bool shielded_only = false);
 
     struct ScanResult {
         enum { SUCCESS, FAILURE, USER_ABORT } status = SUCCESS;
@@ -1445,7 +1624,7 @@ public:
                                std::vector<Optional<SproutWitness>>& witnesses,
                                uint256 &final_anchor);
 
-    ScanResult ScanForWalletTransactions(const uint256& first_block, const uint256& last_block, const WalletRescanReserver& reserver, bool fUpdate);
+    ScanResult ScanForWalletTransactions(const uint256& first_block, const uint256& last_block, const WalletRescanReserver& reserver, bool fUpdate, bool shielded_only = false);
     void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
     void ReacceptWalletTransactions(interfaces::Chain::Lock& locked_chain) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void ResendWalletTransactions();
@@ -1531,6 +1710,32 @@ public:
     bool NewKeyPool();
     size_t KeypoolCountExternalKeys() EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     bool TopUpKeyPool(unsigned int kpSize = 0);
+    /**
+     * Derive Sapling keys until the Sapling keypool holds kpSize keys, or
+     * -saplingkeypool keys if kpSize is 0. The accounts are reserved under
+     * cs_wallet, and the keys derived without holding it.
+     * @return false if the wallet cannot derive keys, e.g. while it is locked
+     */
+    bool TopUpSaplingKeyPool(unsigned int kpSize = 0);
+    /**
+     * Hand out up to count addresses from the Sapling keypool, adding them to
+     * the address book with the given label.
+     */
+    std::vector<libzcash::SaplingPaymentAddress> TakeSaplingKeysFromKeyPool(unsigned int count, const std::string& label) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    bool IsSaplingKeyPoolAddress(const libzcash::SaplingPaymentAddress& address) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /**
+     * Generate count new diversified addresses of a Sapling key, and add them
+     * to the address book with the given label. Notes sent to any of them are
+     * found by trial decryption with the single incoming viewing key of the
+     * key. Ranges of diversifier indexes are reserved under cs_wallet and
+     * searched on worker threads without holding it, and the addresses are
+     * written in one transaction and added to the wallet once committed.
+     * @return the addresses with their diversifier indexes, in index order
+     */
+    std::vector<std::pair<libzcash::diversifier_index_t, libzcash::SaplingPaymentAddress>> GenerateSaplingDiversifiedAddresses(const libzcash::SaplingExtendedFullViewingKey& extfvk, unsigned int count, const std::string& label);
+    //! Get the key and diversifier index of an address generated by GenerateSaplingDiversifiedAddresses
+    bool GetSaplingDiversifiedAddress(const libzcash::SaplingPaymentAddress& address, CSaplingDiversifiedAddress& diversified) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     /**
      * Reserves a key from the keypool and sets nIndex to its index
@@ -1570,6 +1775,14 @@ public:
     bool GetNewDestination(const OutputType type, const std::string label, CTxDestination& dest, std::string& error);
     bool GetNewSproutDestination(const std::string label, libzcash::PaymentAddress& dest, std::string& error);
     bool GetNewSaplingDestination(const std::string label, libzcash::PaymentAddress& dest, std::string& error);
+    /**
+     * Hand out count new Sapling addresses, from the keypool first, and
+     * generate the keys it lacks with GenerateNewSaplingKeys. Those are
+     * generated before any address is taken from the keypool, so that if it
+     * throws, the keypool is left as it was. While the wallet is locked, only
+     * the keypool can hand out addresses.
+     */
+    bool GetNewSaplingDestinations(unsigned int count, const std::string label, std::vector<libzcash::PaymentAddress>& dests, std::string& error);
     bool GetNewChangeDestination(const OutputType type, CTxDestination& dest, std::string& error);
 
     Optional<uint256> GetSproutNoteNullifier(
@@ -1630,6 +1843,12 @@ public:
         return setInternalKeyPool.size() + setExternalKeyPool.size();
     }
 
+    unsigned int GetSaplingKeyPoolSize() EXCLUSIVE_LOCKS_REQUIRED(cs_wallet)
+    {
+        AssertLockHeld(cs_wallet);
+        return m_sapling_keypool.size();
+    }
+
     //! signify that a particular wallet feature is now used. this may change nWalletVersion and nWalletMaxVersion if those are lower
     void SetMinVersion(enum WalletFeature, WalletBatch* batch_in = nullptr, bool fExplicit = false);
 
@@ -1873,7 +2092,16 @@ public:
     //! Sapling
     virtual bool AddCryptedSaplingSpendingKeyInner(const libzcash::SaplingExtendedFullViewingKey &extfvk,
                                                    const std::vector<unsigned char> &vchCryptedSecret);
+    bool AddCryptedSaplingSpendingKeyInner(const libzcash::SaplingExtendedFullViewingKey &extfvk,
+                                           const libzcash::SaplingIncomingViewingKey &ivk,
+                                           const libzcash::SaplingPaymentAddress &defaultAddr,
+                                           const std::vector<unsigned char> &vchCryptedSecret);
     bool AddSaplingSpendingKey(const libzcash::SaplingExtendedSpendingKey &sk);
+    //! Add a Sapling spending key whose viewing keys and default address are already computed
+    bool AddSaplingSpendingKey(const libzcash::SaplingExtendedSpendingKey &sk,
+                               const libzcash::SaplingExtendedFullViewingKey &extfvk,
+                               const libzcash::SaplingIncomingViewingKey &ivk,
+                               const libzcash::SaplingPaymentAddress &defaultAddr);
     bool HaveSaplingSpendingKey(const libzcash::SaplingExtendedFullViewingKey &extfvk) const;
     bool GetSaplingSpendingKey(const libzcash::SaplingExtendedFullViewingKey &extfvk, libzcash::SaplingExtendedSpendingKey &skOut) const;
 };
@@ -1884,6 +2112,9 @@ public:
  */
 void MaybeResendWalletTxs();
 
+/** Top up the Sapling keypools of all wallets */
+void MaybeTopUpSaplingKeyPools();
+
 /** RAII object to check and reserve a wallet rescan */
 class WalletRescanReserver
 {
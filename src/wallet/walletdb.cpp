@@ -12,11 +12,16 @@
 #include <serialize.h>
 #include <sync.h>
 #include <util/system.h>
+#include <util/threadnames.h>
 #include <util/time.h>
 #include <wallet/wallet.h>
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
+#include <thread>
 
 #include <boost/thread.hpp>
 
@@ -44,6 +49,8 @@ const std::string MINVERSION{"minversion"};
 const std::string NAME{"name"};
 const std::string SPROUT_NAME{"sprout_name"};
 const std::string SAPLING_NAME{"sapling_name"};
+const std::string SAPLING_POOL{"sapzpool"};
+const std::string SAPLING_DIVERSIFIED_ADDRESS{"sapzdivaddr"};
 const std::string OLD_KEY{"wkey"};
 const std::string ORDERPOSNEXT{"orderposnext"};
 const std::string POOL{"pool"};
@@ -52,6 +59,7 @@ const std::string SPROUT_PURPOSE{"sprout_purpose"};
 const std::string SAPLING_PURPOSE{"sapling_purpose"};
 const std::string SETTINGS{"settings"};
 const std::string TX{"tx"};
+const std::string TX_UPDATE{"txupdate"};
 const std::string VERSION{"version"};
 const std::string WATCHMETA{"watchmeta"};
 const std::string SPROUT_WATCHMETA{"sprout_watchmeta"};
@@ -135,14 +143,36 @@ bool WalletBatch::EraseSaplingPurpose(const std::string& strAddress)
     return EraseIC(std::make_pair(DBKeys::SAPLING_PURPOSE, strAddress));
 }
 
-bool WalletBatch::WriteTx(const CWalletTx& wtx)
+bool WalletBatch::WriteTx(CWalletTx& wtx)
 {
-    return WriteIC(std::make_pair(DBKeys::TX, wtx.GetHash()), wtx);
+    // The full record supersedes the updates written since the last one
+    if (!WriteIC(std::make_pair(DBKeys::TX, wtx.GetHash()), wtx) || !EraseTxUpdates(wtx.GetHash(), wtx.nWitnessUpdates)) {
+        return false;
+    }
+    wtx.nWitnessUpdates = 0;
+    return true;
 }
 
 bool WalletBatch::EraseTx(uint256 hash)
 {
-    return EraseIC(std::make_pair(DBKeys::TX, hash));
+    // A transaction never has more updates than MAX_WALLET_TX_UPDATES, they
+    // are compacted into its full record before.
+    return EraseIC(std::make_pair(DBKeys::TX, hash)) && EraseTxUpdates(hash, MAX_WALLET_TX_UPDATES);
+}
+
+bool WalletBatch::WriteTxUpdate(const uint256& hash, uint32_t seq, const CWalletTxUpdate& update)
+{
+    return WriteIC(std::make_pair(DBKeys::TX_UPDATE, std::make_pair(hash, seq)), update);
+}
+
+bool WalletBatch::EraseTxUpdates(const uint256& hash, uint32_t count)
+{
+    for (uint32_t seq = 0; seq < count; seq++) {
+        if (!EraseIC(std::make_pair(DBKeys::TX_UPDATE, std::make_pair(hash, seq)))) {
+            return false;
+        }
+    }
+    return true;
 }
 
 bool WalletBatch::WriteKeyMetadata(const CKeyMetadata& meta, const CPubKey& pubkey, const bool overwrite)
@@ -238,6 +268,21 @@ bool WalletBatch::ErasePool(int64_t nPool)
     return EraseIC(std::make_pair(DBKeys::POOL, nPool));
 }
 
+bool WalletBatch::WriteSaplingPool(int64_t nPool, const CSaplingKeyPool& keypool)
+{
+    return WriteIC(std::make_pair(DBKeys::SAPLING_POOL, nPool), keypool);
+}
+
+bool WalletBatch::EraseSaplingPool(int64_t nPool)
+{
+    return EraseIC(std::make_pair(DBKeys::SAPLING_POOL, nPool));
+}
+
+bool WalletBatch::WriteSaplingDiversifiedAddress(const libzcash::SaplingPaymentAddress &addr, const CSaplingDiversifiedAddress &diversified)
+{
+    return WriteIC(std::make_pair(DBKeys::SAPLING_DIVERSIFIED_ADDRESS, addr), diversified);
+}
+
 bool WalletBatch::WriteMinVersion(int nVersion)
 {
     return WriteIC(DBKeys::MINVERSION, nVersion);
@@ -271,6 +316,67 @@ public:
     }
 };
 
+/**
+ * Deserialize a wallet transaction record, the key being positioned after the
+ * record type. This does not access the wallet, so that the transactions
+ * can be deserialized on several threads, see WalletBatch::LoadWallet.
+ */
+static bool ReadTx(CDataStream& ssKey, CDataStream& ssValue, CWalletTx& wtx, bool& upgraded, std::string& strErr)
+{
+    upgraded = false;
+    try {
+        uint256 hash;
+        ssKey >> hash;
+        ssValue >> wtx;
+        if (wtx.GetHash() != hash)
+            return false;
+
+        // Undo serialize changes in 31600
+        if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
+        {
+            if (!ssValue.empty())
+            {
+                char fTmp;
+                char fUnused;
+                std::string unused_string;
+                ssValue >> fTmp >> fUnused >> unused_string;
+                strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
+                                   wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
+                wtx.fTimeReceivedIsTxTime = fTmp;
+            }
+            else
+            {
+                strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
+                wtx.fTimeReceivedIsTxTime = 0;
+            }
+            upgraded = true;
+        }
+    } catch (const std::exception& e) {
+        if (strErr.empty()) {
+            strErr = e.what();
+        }
+        return false;
+    } catch (...) {
+        if (strErr.empty()) {
+            strErr = "Caught unknown exception in ReadTx";
+        }
+        return false;
+    }
+    return true;
+}
+
+/** Add a wallet transaction read by ReadTx to the wallet. */
+static void LoadTx(CWallet* pwallet, CWalletTx& wtx, bool upgraded, CWalletScanState& wss) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
+{
+    if (upgraded)
+        wss.vWalletUpgrade.push_back(wtx.GetHash());
+
+    if (wtx.nOrderPos == -1)
+        wss.fAnyUnordered = true;
+
+    pwallet->LoadToWallet(wtx);
+}
+
 static bool
 ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
              CWalletScanState &wss, std::string& strType, std::string& strErr) EXCLUSIVE_LOCKS_REQUIRED(pwallet->cs_wallet)
@@ -305,38 +411,12 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             ssKey >> strAddress;
             ssValue >> pwallet->mapSaplingAddressBook[DecodePaymentAddress(strAddress)].purpose;
         } else if (strType == DBKeys::TX) {
-            uint256 hash;
-            ssKey >> hash;
             CWalletTx wtx(nullptr /* pwallet */, MakeTransactionRef());
-            ssValue >> wtx;
-            if (wtx.GetHash() != hash)
+            bool upgraded;
+            if (!ReadTx(ssKey, ssValue, wtx, upgraded, strErr)) {
                 return false;
-
-            // Undo serialize changes in 31600
-            if (31404 <= wtx.fTimeReceivedIsTxTime && wtx.fTimeReceivedIsTxTime <= 31703)
-            {
-                if (!ssValue.empty())
-                {
-                    char fTmp;
-                    char fUnused;
-                    std::string unused_string;
-                    ssValue >> fTmp >> fUnused >> unused_string;
-                    strErr = strprintf("LoadWallet() upgrading tx ver=%d %d %s",
-                                       wtx.fTimeReceivedIsTxTime, fTmp, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = fTmp;
-                }
-                else
-                {
-                    strErr = strprintf("LoadWallet() repairing tx ver=%d %s", wtx.fTimeReceivedIsTxTime, hash.ToString());
-                    wtx.fTimeReceivedIsTxTime = 0;
-                }
-                wss.vWalletUpgrade.push_back(hash);
             }
-
-            if (wtx.nOrderPos == -1)
-                wss.fAnyUnordered = true;
-
-            pwallet->LoadToWallet(wtx);
+            LoadTx(pwallet, wtx, upgraded, wss);
         } else if (strType == DBKeys::WATCHS) {
             wss.nWatchKeys++;
             CScript script;
@@ -567,6 +647,20 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             ssValue >> keypool;
 
             pwallet->LoadKeyPool(nIndex, keypool);
+        } else if (strType == DBKeys::SAPLING_POOL) {
+            int64_t nIndex;
+            ssKey >> nIndex;
+            CSaplingKeyPool keypool;
+            ssValue >> keypool;
+
+            pwallet->LoadSaplingKeyPool(nIndex, keypool);
+        } else if (strType == DBKeys::SAPLING_DIVERSIFIED_ADDRESS) {
+            libzcash::SaplingPaymentAddress addr;
+            ssKey >> addr;
+            CSaplingDiversifiedAddress diversified;
+            ssValue >> diversified;
+
+            pwallet->LoadSaplingDiversifiedAddress(addr, diversified);
         } else if (strType == DBKeys::CSCRIPT) {
             uint160 hash;
             ssKey >> hash;
@@ -663,6 +757,171 @@ bool WalletBatch::IsKeyType(const std::string& strType)
             strType == DBKeys::MASTER_KEY || strType == DBKeys::CRYPTED_KEY);
 }
 
+/** Get the type of a record without consuming it from the key. */
+static std::string PeekRecordType(const CDataStream& ssKey)
+{
+    std::string strType;
+    try {
+        CDataStream ssType(ssKey);
+        ssType >> strType;
+    } catch (...) {
+        strType.clear();
+    }
+    return strType;
+}
+
+namespace {
+/**
+ * Deserializes the transaction records met by the LoadWallet cursor on up to
+ * MAX_WALLET_LOAD_THREADS threads while the cursor moves on, and adds them to
+ * the wallet in database order on the thread of the cursor. At most
+ * MAX_WALLET_LOAD_PENDING records per thread are held, read or deserialized,
+ * ahead of the one being added, so the memory used does not grow with the
+ * number of transactions of the wallet.
+ */
+class TxRecordLoader
+{
+public:
+    TxRecordLoader(CWallet* pwallet, CWalletScanState& wss, bool& fNoncriticalErrors)
+        : m_wallet(pwallet), m_wss(wss), m_noncritical_errors(fNoncriticalErrors),
+          m_n_threads(std::max(1, std::min(GetNumCores(), MAX_WALLET_LOAD_THREADS))),
+          m_max_pending(MAX_WALLET_LOAD_PENDING * m_n_threads) {}
+
+    ~TxRecordLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        for (std::thread& thread : m_threads) {
+            thread.join();
+        }
+    }
+
+    /** Queue a transaction record, adding the ones before it to the wallet if too many are pending. */
+    void Add(CDataStream&& ssKey, CDataStream&& ssValue) EXCLUSIVE_LOCKS_REQUIRED(m_wallet->cs_wallet)
+    {
+        // The threads are only started for wallets with transactions.
+        if (m_threads.empty()) {
+            for (int i = 0; i < m_n_threads; i++) {
+                m_threads.emplace_back([this] {
+                    util::ThreadRename("walletload");
+                    ThreadRead();
+                });
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_records.emplace_back(std::move(ssKey), std::move(ssValue));
+            m_jobs.push_back(&m_records.back());
+        }
+        m_cond.notify_all();
+        LoadRecords(m_max_pending);
+    }
+
+    /** Add all the remaining records to the wallet. */
+    void Finish() EXCLUSIVE_LOCKS_REQUIRED(m_wallet->cs_wallet)
+    {
+        LoadRecords(0);
+    }
+
+private:
+    /** A wallet transaction record, and the transaction once deserialized by ReadTx. */
+    struct TxRecord
+    {
+        CDataStream ssKey;
+        CDataStream ssValue;
+        CWalletTx wtx{nullptr /* pwallet */, MakeTransactionRef()};
+        bool read_ok = false;
+        bool upgraded = false;
+        bool done = false;
+        std::string strErr;
+
+        TxRecord(CDataStream&& key, CDataStream&& value) : ssKey(std::move(key)), ssValue(std::move(value)) {}
+    };
+
+    /**
+     * Add the records at the front to the wallet, those already deserialized
+     * and, waiting for them, as many as needed to leave max_pending.
+     */
+    void LoadRecords(size_t max_pending) EXCLUSIVE_LOCKS_REQUIRED(m_wallet->cs_wallet)
+    {
+        while (true) {
+            TxRecord* record;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                if (m_records.empty()) return;
+                if (!m_records.front().done) {
+                    if (m_records.size() <= max_pending) return;
+                    m_cond.wait(lock, [&] { return m_records.front().done; });
+                }
+                record = &m_records.front();
+            }
+            if (record->read_ok) {
+                LoadTx(m_wallet, record->wtx, record->upgraded, m_wss);
+            } else {
+                // Same handling as a bad transaction record in LoadWallet
+                m_noncritical_errors = true;
+                m_wallet->WalletLogPrintf("Error reading record type '%s' from wallet database\n", DBKeys::TX);
+                gArgs.SoftSetBoolArg("-rescan", true);
+            }
+            if (!record->strErr.empty())
+                m_wallet->WalletLogPrintf("%s\n", record->strErr);
+
+            // No thread refers to a record once it is done.
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_records.pop_front();
+        }
+    }
+
+    void ThreadRead()
+    {
+        while (true) {
+            TxRecord* record;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+                if (m_stop) return;
+                record = m_jobs.front();
+                m_jobs.pop_front();
+            }
+            try {
+                std::string strType;
+                record->ssKey >> strType;
+                record->read_ok = ReadTx(record->ssKey, record->ssValue, record->wtx, record->upgraded, record->strErr);
+            } catch (...) {
+                record->read_ok = false;
+            }
+            // The serialized record is not needed anymore.
+            record->ssKey = CDataStream(SER_DISK, CLIENT_VERSION);
+            record->ssValue = CDataStream(SER_DISK, CLIENT_VERSION);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                record->done = true;
+            }
+            m_cond.notify_all();
+        }
+    }
+
+    CWallet* const m_wallet;
+    CWalletScanState& m_wss;
+    bool& m_noncritical_errors;
+    const int m_n_threads;
+    const size_t m_max_pending;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Records not added to the wallet yet, in database order. Elements keep
+    //! their address as records are only added at the back and removed at the front.
+    std::deque<TxRecord> m_records;
+    //! Records waiting to be deserialized
+    std::deque<TxRecord*> m_jobs;
+    bool m_stop = false;
+    std::vector<std::thread> m_threads;
+};
+} // namespace
+
 DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
 {
     CWalletScanState wss;
@@ -686,6 +945,8 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
             return DBErrors::CORRUPT;
         }
 
+        TxRecordLoader tx_loader(pwallet, wss, fNoncriticalErrors);
+        std::map<std::pair<uint256, uint32_t>, CWalletTxUpdate> tx_updates;
         while (true)
         {
             // Read next record
@@ -700,6 +961,30 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
                 return DBErrors::CORRUPT;
             }
 
+            // Transactions are the bulk of large wallets, they are
+            // deserialized on several threads as the cursor moves on.
+            const std::string strRecordType = PeekRecordType(ssKey);
+            if (strRecordType == DBKeys::TX) {
+                tx_loader.Add(std::move(ssKey), std::move(ssValue));
+                continue;
+            }
+
+            // Transaction updates are applied in order once the transactions
+            // are loaded.
+            if (strRecordType == DBKeys::TX_UPDATE) {
+                try {
+                    std::string strType;
+                    std::pair<uint256, uint32_t> key;
+                    ssKey >> strType >> key;
+                    ssValue >> tx_updates[key];
+                } catch (...) {
+                    fNoncriticalErrors = true;
+                    pwallet->WalletLogPrintf("Error reading record type '%s' from wallet database\n", DBKeys::TX_UPDATE);
+                    gArgs.SoftSetBoolArg("-rescan", true);
+                }
+                continue;
+            }
+
             // Try to be tolerant of single corrupt records:
             std::string strType, strErr;
             if (!ReadKeyValue(pwallet, ssKey, ssValue, wss, strType, strErr))
@@ -724,6 +1009,11 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
                 pwallet->WalletLogPrintf("%s\n", strErr);
         }
         pcursor->close();
+
+        tx_loader.Finish();
+        for (const auto& update : tx_updates) {
+            pwallet->LoadTxUpdate(update.first.first, update.first.second, update.second);
+        }
     }
     catch (const boost::thread_interrupted&) {
         throw;
@@ -34,12 +34,20 @@
 
 static const bool DEFAULT_FLUSHWALLET = true;
 
+//! Maximum number of threads deserializing wallet transactions in LoadWallet
+static const int MAX_WALLET_LOAD_THREADS = 8;
+//! Maximum number of wallet transactions per thread read ahead of the one being loaded in LoadWallet
+static const size_t MAX_WALLET_LOAD_PENDING = 64;
+
 struct CBlockLocator;
 class CKeyPool;
+class CSaplingKeyPool;
+struct CSaplingDiversifiedAddress;
 class CMasterKey;
 class CScript;
 class CWallet;
 class CWalletTx;
+struct CWalletTxUpdate;
 class uint160;
 class uint256;
 
@@ -81,6 +89,8 @@ extern const std::string MINVERSION;
 extern const std::string NAME;
 extern const std::string SPROUT_NAME;
 extern const std::string SAPLING_NAME;
+extern const std::string SAPLING_POOL;
+extern const std::string SAPLING_DIVERSIFIED_ADDRESS;
 extern const std::string OLD_KEY;
 extern const std::string ORDERPOSNEXT;
 extern const std::string POOL;
@@ -89,6 +99,7 @@ extern const std::string SPROUT_PURPOSE;
 extern const std::string SAPLING_PURPOSE;
 extern const std::string SETTINGS;
 extern const std::string TX;
+extern const std::string TX_UPDATE;
 extern const std::string VERSION;
 extern const std::string WATCHMETA;
 extern const std::string SPROUT_WATCHMETA;
@@ -301,8 +312,14 @@ public:
     /** sapling */
     bool EraseSaplingPurpose(const std::string& strAddress);
 
-    bool WriteTx(const CWalletTx& wtx);
+    /** Write a transaction in full, erasing its update records and resetting its count of them. */
+    bool WriteTx(CWalletTx& wtx);
+    /** Erase a transaction and its update records. */
     bool EraseTx(uint256 hash);
+    /** Write the update record number seq of a transaction, see CWalletTxUpdate. */
+    bool WriteTxUpdate(const uint256& hash, uint32_t seq, const CWalletTxUpdate& update);
+    /** Erase the first count update records of a transaction. */
+    bool EraseTxUpdates(const uint256& hash, uint32_t count);
 
     bool WriteKeyMetadata(const CKeyMetadata& meta, const CPubKey& pubkey, const bool overwrite);
     bool WriteKey(const CPubKey& vchPubKey, const CPrivKey& vchPrivKey, const CKeyMetadata &keyMeta);
@@ -323,6 +340,11 @@ public:
     bool WritePool(int64_t nPool, const CKeyPool& keypool);
     bool ErasePool(int64_t nPool);
 
+    bool WriteSaplingPool(int64_t nPool, const CSaplingKeyPool& keypool);
+    bool EraseSaplingPool(int64_t nPool);
+
+    bool WriteSaplingDiversifiedAddress(const libzcash::SaplingPaymentAddress &addr, const CSaplingDiversifiedAddress &diversified);
+
     bool WriteMinVersion(int nVersion);
 
     /// Write destination data key,value tuple to database
@@ -30,6 +30,27 @@ PedersenHash PedersenHash::combine(
     return res;
 }
 
+std::vector<PedersenHash> PedersenHash::combine_all(
+    const std::vector<PedersenHash>& nodes,
+    size_t depth
+)
+{
+    static_assert(sizeof(PedersenHash) == 32, "nodes are passed as an array of 32-byte values");
+    assert(nodes.size() % 2 == 0);
+
+    std::vector<PedersenHash> res(nodes.size() / 2);
+    if (!res.empty()) {
+        librustzcash_merkle_hash_batch(
+            depth,
+            nodes.data()->begin(),
+            res.size(),
+            res.data()->begin()
+        );
+    }
+
+    return res;
+}
+
 PedersenHash PedersenHash::uncommitted() {
     PedersenHash res = PedersenHash();
 
@@ -439,6 +460,22 @@ SHA256Compress SHA256Compress::combine(
     return res;
 }
 
+std::vector<SHA256Compress> SHA256Compress::combine_all(
+    const std::vector<SHA256Compress>& nodes,
+    size_t depth
+)
+{
+    assert(nodes.size() % 2 == 0);
+
+    std::vector<SHA256Compress> res;
+    res.reserve(nodes.size() / 2);
+    for (size_t i = 0; i < nodes.size(); i += 2) {
+        res.push_back(combine(nodes[i], nodes[i + 1], depth));
+    }
+
+    return res;
+}
+
 static const std::array<SHA256Compress, 66> sha256_empty_roots = {
     uint256(std::vector<unsigned char>{
         0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
@@ -925,6 +962,8 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
         throw std::runtime_error("tree is full");
     }
 
+    root_cache = nullopt;
+
     if (!left) {
         // Set the left leaf
         left = obj;
@@ -956,6 +995,60 @@ void IncrementalMerkleTree<Depth, Hash>::append(Hash obj) {
     }
 }
 
+// This appends the objects in one pass per level, so that the new nodes of a
+// level are hashed together and the result is the same as appending them one
+// by one.
+template<size_t Depth, typename Hash>
+void IncrementalMerkleTree<Depth, Hash>::append(const std::vector<Hash>& objs) {
+    if (objs.empty()) {
+        return;
+    }
+    if (objs.size() > (size_t(1) << Depth) - size()) {
+        throw std::runtime_error("tree is full");
+    }
+
+    root_cache = nullopt;
+
+    // The leaves already in left and right have not been combined yet.
+    std::vector<Hash> nodes;
+    nodes.reserve(objs.size() + 2);
+    if (left) {
+        nodes.push_back(*left);
+    }
+    if (right) {
+        nodes.push_back(*right);
+    }
+    nodes.insert(nodes.end(), objs.begin(), objs.end());
+
+    // The last leaf, or the last two if they make a pair, are kept as left
+    // and right, and the leaves before them are combined.
+    const size_t keep = nodes.size() % 2 == 0 ? 2 : 1;
+    left = nodes[nodes.size() - keep];
+    right = keep == 2 ? Optional<Hash>(nodes.back()) : nullopt;
+    nodes.resize(nodes.size() - keep);
+
+    for (size_t d = 0; !nodes.empty(); d++) {
+        // The nodes of level d + 1 start with the collapsed left subtree of
+        // that level, if any, and an odd node left over becomes it.
+        std::vector<Hash> combined = Hash::combine_all(nodes, d);
+        nodes.clear();
+        if (d < parents.size() && parents[d]) {
+            nodes.push_back(*parents[d]);
+        }
+        nodes.insert(nodes.end(), combined.begin(), combined.end());
+
+        if (d >= parents.size()) {
+            parents.resize(d + 1);
+        }
+        if (nodes.size() % 2 == 1) {
+            parents[d] = nodes.back();
+            nodes.pop_back();
+        } else {
+            parents[d] = nullopt;
+        }
+    }
+}
+
 // This is for allowing the witness to determine if a subtree has filled
 // to a particular depth, or for append() to ensure we're not appending
 // to a full tree.
@@ -1018,21 +1111,39 @@ size_t IncrementalMerkleTree<Depth, Hash>::next_depth(size_t skip) const {
 // This calculates the root of the tree.
 template<size_t Depth, typename Hash>
 Hash IncrementalMerkleTree<Depth, Hash>::root(size_t depth,
-                                              std::deque<Hash> filler_hashes) const {
+                                              std::deque<Hash> filler_hashes,
+                                              std::vector<Hash>* partial_roots,
+                                              size_t partial_roots_valid) const {
     PathFiller<Depth, Hash> filler(filler_hashes);
 
+    if (partial_roots) {
+        partial_roots->resize(depth);
+    } else {
+        partial_roots_valid = 0;
+    }
+
     Hash combine_left =  left  ? *left  : filler.next(0);
     Hash combine_right = right ? *right : filler.next(0);
 
-    Hash root = Hash::combine(combine_left, combine_right, 0);
+    Hash root = partial_roots_valid > 0 ? (*partial_roots)[0] : Hash::combine(combine_left, combine_right, 0);
+    if (partial_roots) {
+        (*partial_roots)[0] = root;
+    }
 
     size_t d = 1;
 
     for (const Optional<Hash>& parent : parents) {
-        if (parent) {
-            root = Hash::combine(*parent, root, d);
+        // The filler is consumed even if the level is not hashed again.
+        Hash sibling = parent ? *parent : filler.next(d);
+        if (d < partial_roots_valid) {
+            root = (*partial_roots)[d];
+        } else if (parent) {
+            root = Hash::combine(sibling, root, d);
         } else {
-            root = Hash::combine(root, filler.next(d), d);
+            root = Hash::combine(root, sibling, d);
+        }
+        if (partial_roots) {
+            (*partial_roots)[d] = root;
         }
 
         d++;
@@ -1041,13 +1152,26 @@ Hash IncrementalMerkleTree<Depth, Hash>::root(size_t depth,
     // We may not have parents for ancestor trees, so we fill
     // the rest in here.
     while (d < depth) {
-        root = Hash::combine(root, filler.next(d), d);
+        Hash sibling = filler.next(d);
+        root = d < partial_roots_valid ? (*partial_roots)[d] : Hash::combine(root, sibling, d);
+        if (partial_roots) {
+            (*partial_roots)[d] = root;
+        }
         d++;
     }
 
     return root;
 }
 
+template<size_t Depth, typename Hash>
+Hash IncrementalMerkleTree<Depth, Hash>::cached_root(size_t depth) const {
+    if (!root_cache || root_cache_depth != depth) {
+        root_cache = root(depth);
+        root_cache_depth = depth;
+    }
+    return *root_cache;
+}
+
 // This constructs an authentication path into the tree in the format that the circuit
 // wants. The caller provides `filler_hashes` to fill in the uncle subtrees.
 template<size_t Depth, typename Hash>
@@ -1108,19 +1232,31 @@ std::deque<Hash> IncrementalWitness<Depth, Hash>::partial_path() const {
     std::deque<Hash> uncles(filled.begin(), filled.end());
 
     if (cursor) {
-        uncles.push_back(cursor->root(cursor_depth));
+        uncles.push_back(cursor->cached_root(cursor_depth));
     }
 
     return uncles;
 }
 
+template<size_t Depth, typename Hash>
+Hash IncrementalWitness<Depth, Hash>::root() const {
+    if (filled.empty() && !cursor) {
+        return tree.root();
+    }
+    if (partial_roots_valid < Depth) {
+        tree.root(Depth, partial_path(), &partial_roots, partial_roots_valid);
+        partial_roots_valid = Depth;
+    }
+    return partial_roots[Depth - 1];
+}
+
 template<size_t Depth, typename Hash>
 void IncrementalWitness<Depth, Hash>::append(Hash obj) {
     if (cursor) {
         cursor->append(obj);
 
         if (cursor->is_complete(cursor_depth)) {
-            filled.push_back(cursor->root(cursor_depth));
+            filled.push_back(cursor->cached_root(cursor_depth));
             cursor = nullopt;
         }
     } else {
@@ -1137,6 +1273,220 @@ void IncrementalWitness<Depth, Hash>::append(Hash obj) {
             cursor->append(obj);
         }
     }
+
+    // Only the uncle at cursor_depth changed.
+    partial_roots_valid = std::min(partial_roots_valid, cursor_depth);
+}
+
+template<size_t Depth, typename Hash>
+void IncrementalWitness<Depth, Hash>::append(const std::vector<Hash>& objs) {
+    auto it = objs.begin();
+    while (it != objs.end()) {
+        if (!cursor) {
+            cursor_depth = tree.next_depth(filled.size());
+
+            if (cursor_depth >= Depth) {
+                throw std::runtime_error("tree is full");
+            }
+
+            partial_roots_valid = std::min(partial_roots_valid, cursor_depth);
+            if (cursor_depth == 0) {
+                filled.push_back(*it++);
+                continue;
+            }
+            cursor = IncrementalMerkleTree<Depth, Hash>();
+        }
+
+        // Fill the cursor subtree with as many objects as it can take.
+        const size_t n = std::min<size_t>(objs.end() - it, (size_t(1) << cursor_depth) - cursor->size());
+        cursor->append(std::vector<Hash>(it, it + n));
+        it += n;
+        partial_roots_valid = std::min(partial_roots_valid, cursor_depth);
+
+        if (cursor->is_complete(cursor_depth)) {
+            filled.push_back(cursor->cached_root(cursor_depth));
+            cursor = nullopt;
+        }
+    }
+}
+
+template<size_t Depth, typename Hash>
+IncrementalWitnessUpdater<Depth, Hash>::IncrementalWitnessUpdater(const IncrementalMerkleTree<Depth, Hash>& tree,
+                                                                  const std::vector<Hash>& objs)
+    : size_before(tree.size()), size_after(tree.size() + objs.size()), objs(objs) {
+    if (objs.size() > (uint64_t(1) << Depth) - size_before) {
+        // Appending fails as it would on the witnesses themselves.
+        valid = false;
+        return;
+    }
+    if (objs.empty()) {
+        // Every witness is left as it is, nothing is hashed.
+        return;
+    }
+
+    // The leaves in left and right, which have not been combined yet,
+    // followed by the objects.
+    uint64_t start = size_before;
+    std::vector<Hash> nodes;
+    if (tree.left) {
+        nodes.push_back(*tree.left);
+        start--;
+    }
+    if (tree.right) {
+        nodes.push_back(*tree.right);
+        start--;
+    }
+    nodes.insert(nodes.end(), objs.begin(), objs.end());
+
+    for (size_t d = 0; d < Depth; d++) {
+        if (d + 1 == Depth) {
+            levels.emplace_back(start, std::move(nodes));
+            break;
+        }
+
+        // Each level starts with a left node, and an odd node left over at
+        // the end is only combined once its sibling is appended.
+        std::vector<Hash> pairs(nodes.begin(), nodes.begin() + (nodes.size() & ~size_t(1)));
+        std::vector<Hash> combined = Hash::combine_all(pairs, d);
+        levels.emplace_back(start, std::move(nodes));
+
+        start >>= 1;
+        nodes.clear();
+        if (start & 1) {
+            // The left sibling of the first node is a collapsed subtree of the tree.
+            if (d >= tree.parents.size() || !tree.parents[d]) {
+                valid = false;
+                return;
+            }
+            nodes.push_back(*tree.parents[d]);
+            start--;
+        }
+        nodes.insert(nodes.end(), combined.begin(), combined.end());
+    }
+}
+
+template<size_t Depth, typename Hash>
+bool IncrementalWitnessUpdater<Depth, Hash>::node(size_t depth, uint64_t index, Hash& out) const {
+    if (depth >= levels.size()) {
+        return false;
+    }
+    const auto& level = levels[depth];
+    if (index < level.first || index - level.first >= level.second.size()) {
+        return false;
+    }
+    out = level.second[index - level.first];
+    return true;
+}
+
+// This builds the cursor of a witness for the incomplete subtree of the given
+// depth whose leaves start at start, as appending its leaves one by one would.
+template<size_t Depth, typename Hash>
+bool IncrementalWitnessUpdater<Depth, Hash>::subtree(uint64_t start, size_t depth,
+                                                     IncrementalMerkleTree<Depth, Hash>& out) const {
+    const uint64_t count = size_after - start;
+    assert(count > 0 && count < (uint64_t(1) << depth));
+
+    // The last leaf, or the last two if they make a pair, are left and right,
+    // and the leaves before them are collapsed into parents.
+    const uint64_t collapsed = count % 2 == 0 ? count - 2 : count - 1;
+    Hash leaf;
+    if (!node(0, start + collapsed, leaf)) {
+        return false;
+    }
+    out.left = leaf;
+    if (count % 2 == 0) {
+        if (!node(0, start + collapsed + 1, leaf)) {
+            return false;
+        }
+        out.right = leaf;
+    }
+    for (size_t i = 0; (collapsed >> (i + 1)) != 0; i++) {
+        if ((collapsed >> (i + 1)) & 1) {
+            Hash parent;
+            if (!node(i + 1, ((start + collapsed) >> (i + 1)) - 1, parent)) {
+                return false;
+            }
+            out.parents.push_back(parent);
+        } else {
+            out.parents.push_back(nullopt);
+        }
+    }
+    return true;
+}
+
+template<size_t Depth, typename Hash>
+void IncrementalWitnessUpdater<Depth, Hash>::update(IncrementalWitness<Depth, Hash>& witness) const {
+    // Number of leaves the witness is up to date with
+    const uint64_t position = witness.position();
+    uint64_t size = position + 1;
+    for (size_t i = 0; i < witness.filled.size(); i++) {
+        size += uint64_t(1) << witness.tree.next_depth(i);
+    }
+    if (witness.cursor) {
+        size += witness.cursor->size();
+    }
+
+    if (!valid || size < size_before || size > size_after) {
+        witness.append(objs);
+        return;
+    }
+    if (size == size_after) {
+        return;
+    }
+
+    std::vector<Hash> filled = witness.filled;
+    Optional<IncrementalMerkleTree<Depth, Hash>> cursor;
+    size_t cursor_depth = witness.cursor_depth;
+    bool has_cursor = bool(witness.cursor);
+    bool ok = true;
+
+    while (true) {
+        // The uncles to fill are the right siblings of the path of the
+        // witnessed leaf, in order of depth.
+        const size_t depth = has_cursor ? cursor_depth : witness.tree.next_depth(filled.size());
+        if (depth >= Depth) {
+            ok = false;
+            break;
+        }
+        const uint64_t index = (position >> depth) + 1;
+        const uint64_t start = index << depth;
+        if (start >= size_after) {
+            break;
+        }
+        cursor_depth = depth;
+
+        if (start + (uint64_t(1) << depth) <= size_after) {
+            Hash uncle;
+            if (!node(depth, index, uncle)) {
+                ok = false;
+                break;
+            }
+            filled.push_back(uncle);
+            has_cursor = false;
+        } else {
+            cursor = IncrementalMerkleTree<Depth, Hash>();
+            if (!subtree(start, depth, *cursor)) {
+                ok = false;
+            }
+            break;
+        }
+    }
+
+    if (!ok) {
+#ifdef DEBUG
+        // The nodes of every witness in the range of the update are kept.
+        assert(!"IncrementalWitnessUpdater: nodes of a witness in range not found");
+#endif
+        witness.append(std::vector<Hash>(objs.begin() + (size - size_before), objs.end()));
+        return;
+    }
+
+    // The uncles below the first one filled here are unchanged.
+    witness.partial_roots_valid = std::min(witness.partial_roots_valid,
+                                           witness.cursor ? witness.cursor_depth : witness.tree.next_depth(witness.filled.size()));
+    witness.filled = std::move(filled);
+    witness.cursor = std::move(cursor);
+    witness.cursor_depth = cursor_depth;
 }
 
 template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
@@ -1151,4 +1501,10 @@ template class IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, Pede
 template class IncrementalWitness<SAPLING_INCREMENTAL_MERKLE_TREE_DEPTH, PedersenHash>;
 template class IncrementalWitness<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>;
 
+template class IncrementalWitnessUpdater<INCREMENTAL_MERKLE_TREE_DEPTH, SHA256Compress>;
+template class IncrementalWitnessUpdater<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, SHA256Compress>;
+
+template class IncrementalWitnessUpdater<SAPLING_INCREMENTAL_MERKLE_TREE_DEPTH, PedersenHash>;
+template class IncrementalWitnessUpdater<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, PedersenHash>;
+
 } // end namespace `libzcash`
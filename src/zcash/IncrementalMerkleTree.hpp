@@ -8,9 +8,11 @@
 
 #include <array>
 #include <deque>
+#include <list>
 #include <optional.h>
 #include <uint256.h>
 #include <serialize.h>
+#include <streams.h>
 
 #include <zcash/Zcash.h>
 #include <zcash/util.h>
@@ -80,10 +82,14 @@ bool operator==(const EmptyMerkleRoots<Depth, Hash>& a,
 template<size_t Depth, typename Hash>
 class IncrementalWitness;
 
+template<size_t Depth, typename Hash>
+class IncrementalWitnessUpdater;
+
 template<size_t Depth, typename Hash>
 class IncrementalMerkleTree {
 
 friend class IncrementalWitness<Depth, Hash>;
+friend class IncrementalWitnessUpdater<Depth, Hash>;
 
 public:
     static_assert(Depth >= 1);
@@ -99,8 +105,10 @@ public:
     size_t size() const;
 
     void append(Hash obj);
+    // Appends all of objs, hashing the new nodes of each level together.
+    void append(const std::vector<Hash>& objs);
     Hash root() const {
-        return root(Depth, std::deque<Hash>());
+        return cached_root(Depth);
     }
     Hash last() const;
 
@@ -116,6 +124,10 @@ public:
         READWRITE(right);
         READWRITE(parents);
 
+        if (ser_action.ForRead()) {
+            root_cache = nullopt;
+        }
+
         wfcheck();
     }
 
@@ -134,8 +146,18 @@ private:
 
     // Collapsed "left" subtrees ordered toward the root of the tree.
     std::vector<Optional<Hash>> parents;
+
+    // Root of the tree at root_cache_depth, until the next append.
+    mutable Optional<Hash> root_cache;
+    mutable size_t root_cache_depth = 0;
+
     MerklePath path(std::deque<Hash> filler_hashes = std::deque<Hash>()) const;
-    Hash root(size_t depth, std::deque<Hash> filler_hashes = std::deque<Hash>()) const;
+    // If partial_roots is given, the root of each level is stored in it, and
+    // the first partial_roots_valid levels are taken from it instead of being
+    // hashed again.
+    Hash root(size_t depth, std::deque<Hash> filler_hashes = std::deque<Hash>(),
+              std::vector<Hash>* partial_roots = nullptr, size_t partial_roots_valid = 0) const;
+    Hash cached_root(size_t depth) const;
     bool is_complete(size_t depth = Depth) const;
     size_t next_depth(size_t skip) const;
     void wfcheck() const;
@@ -153,6 +175,7 @@ bool operator==(const IncrementalMerkleTree<Depth, Hash>& a,
 template <size_t Depth, typename Hash>
 class IncrementalWitness {
 friend class IncrementalMerkleTree<Depth, Hash>;
+friend class IncrementalWitnessUpdater<Depth, Hash>;
 
 public:
     // Required for Unserialize()
@@ -172,11 +195,10 @@ public:
         return tree.size() - 1;
     }
 
-    Hash root() const {
-        return tree.root(Depth, partial_path());
-    }
+    Hash root() const;
 
     void append(Hash obj);
+    void append(const std::vector<Hash>& objs);
 
     ADD_SERIALIZE_METHODS;
 
@@ -187,6 +209,9 @@ public:
         READWRITE(cursor);
 
         cursor_depth = tree.next_depth(filled.size());
+        if (ser_action.ForRead()) {
+            partial_roots_valid = 0;
+        }
     }
 
     template <size_t D, typename H>
@@ -198,6 +223,13 @@ private:
     std::vector<Hash> filled;
     Optional<IncrementalMerkleTree<Depth, Hash>> cursor;
     size_t cursor_depth = 0;
+
+    // Roots of the levels of the witnessed tree filled with partial_path().
+    // Appending only changes the levels from cursor_depth up, so the levels
+    // below are kept.
+    mutable std::vector<Hash> partial_roots;
+    mutable size_t partial_roots_valid = 0;
+
     std::deque<Hash> partial_path() const;
     IncrementalWitness(IncrementalMerkleTree<Depth, Hash> tree) : tree(tree) {}
 };
@@ -211,6 +243,170 @@ bool operator==(const IncrementalWitness<Depth, Hash>& a,
             a.cursor_depth == b.cursor_depth);
 }
 
+/**
+ * Appends the same objects to many witnesses of a tree. The nodes added to
+ * the tree by the objects are hashed once, level by level, and the new
+ * uncles and cursor of each witness are taken from them instead of being
+ * hashed again for every witness.
+ */
+template<size_t Depth, typename Hash>
+class IncrementalWitnessUpdater {
+public:
+    // tree is the tree the witnesses are up to date with before objs.
+    IncrementalWitnessUpdater(const IncrementalMerkleTree<Depth, Hash>& tree, const std::vector<Hash>& objs);
+
+    // Appends the objects the witness does not have yet, so that it is up to
+    // date with the tree after objs. A witness of the tree before objs ends
+    // up as if objs were appended to it.
+    void update(IncrementalWitness<Depth, Hash>& witness) const;
+
+private:
+    // Number of leaves of the tree before and after objs
+    uint64_t size_before;
+    uint64_t size_after;
+    std::vector<Hash> objs;
+    // Index of the first node and the nodes of each level that contain any
+    // of objs, or that are needed to hash them.
+    std::vector<std::pair<uint64_t, std::vector<Hash>>> levels;
+    bool valid = true;
+
+    bool node(size_t depth, uint64_t index, Hash& out) const;
+    bool subtree(uint64_t start, size_t depth, IncrementalMerkleTree<Depth, Hash>& out) const;
+};
+
+/**
+ * The witnesses cached for a note, most recent first, serialized as a list of
+ * them. When a cache is read, only its most recent witness is deserialized,
+ * the one that is advanced with the chain. The others are kept serialized
+ * until they are needed, which is when the cache is rewound or copied out.
+ * Witnesses are added at the front and removed at the back without
+ * deserializing any.
+ */
+template<typename Witness>
+class WitnessCache {
+public:
+    size_t size() const { return witnesses.size() + offsets.size(); }
+    bool empty() const { return size() == 0; }
+
+    const Witness& front() const { return materialize(1).front(); }
+    Witness& front() {
+        materialize(1);
+        return witnesses.front();
+    }
+
+    void push_front(const Witness& witness) { witnesses.push_front(witness); }
+    void pop_front() {
+        materialize(1);
+        witnesses.pop_front();
+    }
+    void pop_back();
+    void clear();
+
+    // Deserializes the witnesses up to the nth if needed, and returns those
+    // deserialized, the nth and the ones before at least.
+    const std::list<Witness>& materialize(size_t n) const;
+
+    // Number of witnesses deserialized
+    size_t materialized() const { return witnesses.size(); }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        WriteCompactSize(s, size());
+        for (const Witness& witness : witnesses) {
+            ::Serialize(s, witness);
+        }
+        s.write((const char*)serialized.data(), serialized.size());
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        clear();
+        const uint64_t n = ReadCompactSize(s);
+        if (n == 0) return;
+        witnesses.emplace_back();
+        ::Unserialize(s, witnesses.back());
+
+        // The others are deserialized to find where they end, but not kept
+        nType = s.GetType();
+        nVersion = s.GetVersion();
+        Recorder<Stream> recorder(s, serialized);
+        Witness skipped;
+        for (uint64_t i = 1; i < n; i++) {
+            offsets.push_back(serialized.size());
+            ::Unserialize(recorder, skipped);
+        }
+    }
+
+    template<typename W>
+    friend bool operator==(const WitnessCache<W>& a, const WitnessCache<W>& b);
+
+private:
+    mutable std::list<Witness> witnesses;
+    // Serialization of the witnesses after those in the list, and the
+    // position of each of them in it
+    mutable std::vector<unsigned char> serialized;
+    mutable std::vector<uint32_t> offsets;
+    int nType = 0;
+    int nVersion = 0;
+
+    // Reads from a stream, keeping a copy of the data read
+    template<typename Stream>
+    class Recorder {
+    public:
+        Recorder(Stream& s, std::vector<unsigned char>& data) : s(s), data(data) {}
+        int GetType() const { return s.GetType(); }
+        int GetVersion() const { return s.GetVersion(); }
+        void read(char* pch, size_t n) {
+            s.read(pch, n);
+            data.insert(data.end(), (unsigned char*)pch, (unsigned char*)pch + n);
+        }
+        template<typename T>
+        Recorder& operator>>(T&& obj) {
+            ::Unserialize(*this, obj);
+            return *this;
+        }
+    private:
+        Stream& s;
+        std::vector<unsigned char>& data;
+    };
+};
+
+template<typename Witness>
+void WitnessCache<Witness>::pop_back() {
+    if (offsets.empty()) {
+        witnesses.pop_back();
+    } else {
+        serialized.resize(offsets.back());
+        offsets.pop_back();
+    }
+}
+
+template<typename Witness>
+void WitnessCache<Witness>::clear() {
+    witnesses.clear();
+    serialized.clear();
+    offsets.clear();
+}
+
+template<typename Witness>
+const std::list<Witness>& WitnessCache<Witness>::materialize(size_t n) const {
+    if (n > witnesses.size() && !offsets.empty()) {
+        VectorReader reader(nType, nVersion, serialized, 0);
+        for (size_t i = 0; i < offsets.size(); i++) {
+            witnesses.emplace_back();
+            reader >> witnesses.back();
+        }
+        std::vector<unsigned char>().swap(serialized);
+        std::vector<uint32_t>().swap(offsets);
+    }
+    return witnesses;
+}
+
+template<typename Witness>
+bool operator==(const WitnessCache<Witness>& a, const WitnessCache<Witness>& b) {
+    return a.materialize(a.size()) == b.materialize(b.size());
+}
+
 class SHA256Compress : public uint256 {
 public:
     SHA256Compress() : uint256() {}
@@ -222,6 +418,12 @@ public:
         size_t depth
     );
 
+    // Combines each pair of consecutive nodes, all at the same depth.
+    static std::vector<SHA256Compress> combine_all(
+        const std::vector<SHA256Compress>& nodes,
+        size_t depth
+    );
+
     static SHA256Compress uncommitted() {
         return SHA256Compress();
     }
@@ -239,6 +441,12 @@ public:
         size_t depth
     );
 
+    // Combines each pair of consecutive nodes, all at the same depth.
+    static std::vector<PedersenHash> combine_all(
+        const std::vector<PedersenHash>& nodes,
+        size_t depth
+    );
+
     static PedersenHash uncommitted();
     static PedersenHash EmptyRoot(size_t);
 };
@@ -260,4 +468,10 @@ typedef libzcash::IncrementalMerkleTree<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, l
 typedef libzcash::IncrementalWitness<SAPLING_INCREMENTAL_MERKLE_TREE_DEPTH, libzcash::PedersenHash> SaplingWitness;
 typedef libzcash::IncrementalWitness<INCREMENTAL_MERKLE_TREE_DEPTH_TESTING, libzcash::PedersenHash> SaplingTestingWitness;
 
+typedef libzcash::WitnessCache<SproutWitness> SproutWitnessCache;
+typedef libzcash::WitnessCache<SaplingWitness> SaplingWitnessCache;
+
+typedef libzcash::IncrementalWitnessUpdater<INCREMENTAL_MERKLE_TREE_DEPTH, libzcash::SHA256Compress> SproutWitnessUpdater;
+typedef libzcash::IncrementalWitnessUpdater<SAPLING_INCREMENTAL_MERKLE_TREE_DEPTH, libzcash::PedersenHash> SaplingWitnessUpdater;
+
 #endif /* ZC_INCREMENTALMERKLETREE_H_ */
@@ -44,6 +44,8 @@ public:
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyBlock(const CBlock& pblock);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    /** Notify that a new block template may be available, because the tip or the mempool changed */
+    virtual bool NotifyBlockTemplate();
 
 protected:
     void *psocket;
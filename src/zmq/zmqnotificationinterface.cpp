@@ -8,14 +8,16 @@
 
 #include <version.h>
 #include <validation.h>
+#include <scheduler.h>
 #include <util/system.h>
+#include <util/time.h>
 
 void zmqError(const char *str)
 {
     LogPrint(BCLog::ZMQ, "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(nullptr)
+CZMQNotificationInterface::CZMQNotificationInterface(CScheduler& schedulerIn) : pcontext(nullptr), scheduler(schedulerIn)
 {
 }
 
@@ -38,7 +40,7 @@ std::list<const CZMQAbstractNotifier*> CZMQNotificationInterface::GetActiveNotif
     return result;
 }
 
-CZMQNotificationInterface* CZMQNotificationInterface::Create()
+CZMQNotificationInterface* CZMQNotificationInterface::Create(CScheduler& scheduler)
 {
     CZMQNotificationInterface* notificationInterface = nullptr;
     std::map<std::string, CZMQNotifierFactory> factories;
@@ -49,6 +51,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
     factories["pubcheckedblock"] = CZMQAbstractNotifier::Create<CZMQPublishCheckedBlockNotifier>;
+    factories["pubblocktemplate"] = CZMQAbstractNotifier::Create<CZMQPublishBlockTemplateNotifier>;
 
     for (const auto& entry : factories)
     {
@@ -67,7 +70,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
 
     if (!notifiers.empty())
     {
-        notificationInterface = new CZMQNotificationInterface();
+        notificationInterface = new CZMQNotificationInterface(scheduler);
         notificationInterface->notifiers = notifiers;
 
         if (!notificationInterface->Initialize())
@@ -157,9 +160,65 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, co
             i = notifiers.erase(i);
         }
     }
+
+    ScheduleBlockTemplate(true);
 }
 
 void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef& ptx)
+{
+    NotifyTransaction(ptx);
+    ScheduleBlockTemplate(false);
+}
+
+void CZMQNotificationInterface::ScheduleBlockTemplate(bool fNewTip)
+{
+    // Building a template takes a while, so it is not done in the validation
+    // callbacks. Changes are coalesced into the next scheduled publication,
+    // which for mempool changes is at most every ZMQ_BLOCK_TEMPLATE_MIN_INTERVAL
+    // seconds, and a later one is scheduled instead of dropping the change.
+    int64_t nNow = GetTimeMillis();
+    int64_t nTime;
+    {
+        LOCK(cs_blocktemplate);
+        fBlockTemplatePending = true;
+        nTime = fNewTip ? nNow : std::max(nNow, nBlockTemplateLastTime + ZMQ_BLOCK_TEMPLATE_MIN_INTERVAL * 1000);
+        if (nBlockTemplateScheduledTime != 0 && nBlockTemplateScheduledTime <= nTime)
+            return;
+        nBlockTemplateScheduledTime = nTime;
+    }
+    scheduler.scheduleFromNow(std::bind(&CZMQNotificationInterface::NotifyBlockTemplate, this, nTime), nTime - nNow);
+}
+
+void CZMQNotificationInterface::NotifyBlockTemplate(int64_t nTime)
+{
+    {
+        LOCK(cs_blocktemplate);
+        // A run superseded by an earlier one has nothing left to publish.
+        if (nTime != nBlockTemplateScheduledTime)
+            return;
+        nBlockTemplateScheduledTime = 0;
+        if (!fBlockTemplatePending)
+            return;
+        fBlockTemplatePending = false;
+        nBlockTemplateLastTime = GetTimeMillis();
+    }
+
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    {
+        CZMQAbstractNotifier *notifier = *i;
+        if (notifier->NotifyBlockTemplate())
+        {
+            i++;
+        }
+        else
+        {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
+    }
+}
+
+void CZMQNotificationInterface::NotifyTransaction(const CTransactionRef& ptx)
 {
     // Used by BlockConnected and BlockDisconnected as well, because they're
     // all the same external callback.
@@ -184,7 +243,7 @@ void CZMQNotificationInterface::BlockConnected(const std::shared_ptr<const CBloc
 {
     for (const CTransactionRef& ptx : pblock->vtx) {
         // Do a normal notify for each transaction added in the block
-        TransactionAddedToMempool(ptx);
+        NotifyTransaction(ptx);
     }
 }
 
@@ -192,7 +251,7 @@ void CZMQNotificationInterface::BlockDisconnected(const std::shared_ptr<const CB
 {
     for (const CTransactionRef& ptx : pblock->vtx) {
         // Do a normal notify for each transaction removed in block disconnection
-        TransactionAddedToMempool(ptx);
+        NotifyTransaction(ptx);
     }
 }
 
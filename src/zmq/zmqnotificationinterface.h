@@ -7,12 +7,14 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include <consensus/validation.h>
+#include <sync.h>
 #include <validationinterface.h>
 #include <string>
 #include <map>
 #include <list>
 
 class CBlockIndex;
+class CScheduler;
 class CZMQAbstractNotifier;
 
 class CZMQNotificationInterface final : public CValidationInterface
@@ -22,7 +24,7 @@ public:
 
     std::list<const CZMQAbstractNotifier*> GetActiveNotifiers() const;
 
-    static CZMQNotificationInterface* Create();
+    static CZMQNotificationInterface* Create(CScheduler& scheduler);
 
 protected:
     bool Initialize();
@@ -36,10 +38,25 @@ protected:
     void BlockChecked(const CBlock& block, const CValidationState& state) override;
 
 private:
-    CZMQNotificationInterface();
+    explicit CZMQNotificationInterface(CScheduler& scheduler);
+
+    void NotifyTransaction(const CTransactionRef& ptx);
+    /** Schedule the publication of a block template, right away for a new tip (fNewTip) */
+    void ScheduleBlockTemplate(bool fNewTip);
+    /** Publish a block template, if the run scheduled for nTime is still the current one */
+    void NotifyBlockTemplate(int64_t nTime);
 
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+
+    CScheduler& scheduler;
+    Mutex cs_blocktemplate;
+    //! Whether the tip or mempool changed since the last published template
+    bool fBlockTemplatePending GUARDED_BY(cs_blocktemplate) {false};
+    //! Time in milliseconds of the next scheduled publication, 0 if none
+    int64_t nBlockTemplateScheduledTime GUARDED_BY(cs_blocktemplate) {0};
+    //! Time in milliseconds of the last publication
+    int64_t nBlockTemplateLastTime GUARDED_BY(cs_blocktemplate) {0};
 };
 
 extern CZMQNotificationInterface* g_zmq_notification_interface;
@@ -5,6 +5,8 @@
 
 #include <chain.h>
 #include <chainparams.h>
+#include <hash.h>
+#include <miner.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
@@ -18,6 +20,72 @@ static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
 static const char *MSG_CHECKEDBLOCK = "checkedblock";
+static const char *MSG_BLOCKTEMPLATE = "blocktemplate";
+
+namespace {
+
+/** A transaction of a block template, as in the transactions array of getblocktemplate */
+struct BlockTemplateTx
+{
+    CTransactionRef tx;
+    CAmount fee;
+    int64_t sigops;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(tx);
+        READWRITE(fee);
+        READWRITE(sigops);
+    }
+};
+
+/**
+ * Body of a blocktemplate notification. If fFull is set, vAdded holds all
+ * the transactions of the template and vRemoved is empty. Otherwise they are
+ * relative to the template hashPrevTemplate. vTxids is the order of the
+ * transactions in the block, without the coinbase.
+ */
+struct BlockTemplateMessage
+{
+    uint256 hashTemplate;
+    uint256 hashPrevTemplate;
+    bool fFull;
+    int32_t nVersion;
+    uint256 hashPrevBlock;
+    uint256 hashSaplingRoot;
+    uint32_t nTime;
+    uint32_t nBits;
+    int32_t nHeight;
+    CAmount nCoinbaseValue;
+    std::vector<unsigned char> vchCoinbaseCommitment;
+    std::vector<uint256> vTxids;
+    std::vector<uint256> vRemoved;
+    std::vector<BlockTemplateTx> vAdded;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashTemplate);
+        READWRITE(hashPrevTemplate);
+        READWRITE(fFull);
+        READWRITE(nVersion);
+        READWRITE(hashPrevBlock);
+        READWRITE(hashSaplingRoot);
+        READWRITE(nTime);
+        READWRITE(nBits);
+        READWRITE(nHeight);
+        READWRITE(nCoinbaseValue);
+        READWRITE(vchCoinbaseCommitment);
+        READWRITE(vTxids);
+        READWRITE(vRemoved);
+        READWRITE(vAdded);
+    }
+};
+
+} // namespace
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -219,3 +287,67 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishBlockTemplateNotifier::NotifyBlockTemplate()
+{
+    // The coinbase is left to the subscribers, as with getblocktemplate
+    CScript scriptDummy = CScript() << OP_TRUE;
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    int nHeight;
+    try {
+        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy);
+        LOCK(cs_main);
+        const CBlockIndex* pindexPrev = LookupBlockIndex(pblocktemplate->block.hashPrevBlock);
+        if (!pindexPrev) return true;
+        nHeight = pindexPrev->nHeight + 1;
+    } catch (const std::runtime_error& e) {
+        LogPrint(BCLog::ZMQ, "zmq: Unable to create block template: %s\n", e.what());
+        return true;
+    }
+    const CBlock& block = pblocktemplate->block;
+
+    BlockTemplateMessage msg;
+    std::set<uint256> setTxids;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const uint256& txid = block.vtx[i]->GetHash();
+        msg.vTxids.push_back(txid);
+        setTxids.insert(txid);
+    }
+    msg.hashTemplate = SerializeHash(std::make_pair(block.hashPrevBlock, msg.vTxids));
+    if (msg.hashTemplate == hashPrevTemplate)
+        return true;
+
+    // Only send the whole template when the tip changed
+    msg.fFull = block.hashPrevBlock != hashPrevTip;
+    msg.hashPrevTemplate = msg.fFull ? uint256() : hashPrevTemplate;
+    if (!msg.fFull) {
+        for (const uint256& txid : setPrevTxids) {
+            if (!setTxids.count(txid)) msg.vRemoved.push_back(txid);
+        }
+    }
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        if (msg.fFull || !setPrevTxids.count(block.vtx[i]->GetHash())) {
+            msg.vAdded.push_back(BlockTemplateTx{block.vtx[i], pblocktemplate->vTxFees[i], pblocktemplate->vTxSigOpsCost[i]});
+        }
+    }
+    msg.nVersion = block.nVersion;
+    msg.hashPrevBlock = block.hashPrevBlock;
+    msg.hashSaplingRoot = block.hashSaplingRoot;
+    msg.nTime = block.nTime;
+    msg.nBits = block.nBits;
+    msg.nHeight = nHeight;
+    msg.nCoinbaseValue = block.vtx[0]->vout[0].nValue;
+    msg.vchCoinbaseCommitment = pblocktemplate->vchCoinbaseCommitment;
+
+    LogPrint(BCLog::ZMQ, "zmq: Publish blocktemplate %s (%s, %u added, %u removed)\n", msg.hashTemplate.GetHex(),
+             msg.fFull ? "full" : "delta", msg.vAdded.size(), msg.vRemoved.size());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    ss << msg;
+    if (!SendMessage(MSG_BLOCKTEMPLATE, &(*ss.begin()), ss.size()))
+        return false;
+
+    hashPrevTemplate = msg.hashTemplate;
+    hashPrevTip = block.hashPrevBlock;
+    setPrevTxids = std::move(setTxids);
+    return true;
+}
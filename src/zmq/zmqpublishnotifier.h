@@ -8,8 +8,15 @@
 
 #include <zmq/zmqabstractnotifier.h>
 
+#include <uint256.h>
+
+#include <set>
+
 class CBlockIndex;
 
+/** Minimum number of seconds between two block templates published for mempool changes on the same tip */
+static const int64_t ZMQ_BLOCK_TEMPLATE_MIN_INTERVAL = 5;
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
@@ -59,4 +66,20 @@ public:
     bool NotifyBlock(const CBlock &block) override;
 };
 
+/**
+ * Publishes block templates built on the tip, each with the transactions
+ * added to and removed from the previous one, so that pool servers do not
+ * have to poll getblocktemplate and parse the whole template again.
+ */
+class CZMQPublishBlockTemplateNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    uint256 hashPrevTemplate;          //!< Id of the last published template
+    uint256 hashPrevTip;               //!< Tip the last published template was built on
+    std::set<uint256> setPrevTxids;    //!< Transactions of the last published template
+
+public:
+    bool NotifyBlockTemplate() override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
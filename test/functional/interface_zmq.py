@@ -48,6 +48,7 @@ class ZMQTest (BitcoinTestFramework):
         try:
             self.test_basic()
             self.test_reorg()
+            self.test_blocktemplate()
         finally:
             # Destroy the ZMQ context.
             self.log.debug("Destroying ZMQ context")
@@ -156,5 +157,35 @@ class ZMQTest (BitcoinTestFramework):
         # Should receive nodes[1] tip
         assert_equal(self.nodes[1].getbestblockhash(), hashblock.receive().hex())
 
+    def test_blocktemplate(self):
+        import zmq
+        address = 'tcp://127.0.0.1:28334'
+        socket = self.ctx.socket(zmq.SUB)
+        socket.set(zmq.RCVTIMEO, 60000)
+        blocktemplate = ZMQSubscriber(socket, b'blocktemplate')
+
+        self.restart_node(0, ['-zmqpub%s=%s' % (blocktemplate.topic.decode(), address)])
+        socket.connect(address)
+        # Relax so that the subscriber is ready before publishing zmq messages
+        sleep(0.2)
+
+        # A new tip publishes a full template built on it
+        self.nodes[0].generatetoaddress(1, ADDRESS_BCRT1_UNSPENDABLE)
+        body = blocktemplate.receive()
+        assert_equal(body[32:64], b'\x00' * 32)  # no previous template
+        assert_equal(body[64], 1)  # full template
+        assert_equal(body[69:101][::-1].hex(), self.nodes[0].getbestblockhash())
+
+        if self.is_wallet_compiled():
+            # Mempool changes publish a delta on the previous template, and one
+            # made within the throttle interval is deferred rather than dropped
+            for _ in range(2):
+                prev_template = body[0:32]
+                txid = self.nodes[0].sendtoaddress(self.nodes[0].getnewaddress(), 1.0)
+                body = blocktemplate.receive()
+                assert_equal(body[32:64], prev_template)
+                assert_equal(body[64], 0)  # delta
+                assert bytes.fromhex(self.nodes[0].getrawtransaction(txid)) in body
+
 if __name__ == '__main__':
     ZMQTest().main()
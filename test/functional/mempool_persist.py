@@ -115,12 +115,14 @@ class MempoolPersistTest(BitcoinTestFramework):
         os.remove(mempooldat0)
         self.nodes[0].savemempool()
         assert os.path.isfile(mempooldat0)
+        assert os.path.isfile(os.path.join(self.nodes[0].datadir, 'regtest', 'mempool.key'))
 
         self.log.debug("Stop nodes, make node1 use mempool.dat from node0. Verify it has 5 transactions")
         os.rename(mempooldat0, mempooldat1)
         self.stop_nodes()
-        self.start_node(1, extra_args=[])
-        wait_until(lambda: self.nodes[1].getmempoolinfo()["loaded"])
+        with self.nodes[1].assert_debug_log(['Imported mempool transactions from disk: 5 succeeded, 0 failed, 0 expired, 0 already there, 0 with trusted proofs']):
+            self.start_node(1, extra_args=[])
+            wait_until(lambda: self.nodes[1].getmempoolinfo()["loaded"])
         assert_equal(len(self.nodes[1].getrawmempool()), 5)
 
         self.log.debug("Prevent litecoinzd from writing mempool.dat to disk. Verify that `savemempool` fails")
@@ -75,9 +75,13 @@ class MiningTest(BitcoinTestFramework):
         assert_equal(mining_info['difficulty'], Decimal('4.656542373906925E-10'))
         assert_equal(mining_info['networkhashps'], Decimal('0.003333333333333334'))
         assert_equal(mining_info['pooledtx'], 0)
+        assert_equal(mining_info['generate'], False)
+        assert_equal(mining_info['genproclimit'], 1)
+        assert_equal(mining_info['equihashsolver'], 'arena')
 
         # Mine a block to leave initial block download
         node.generatetoaddress(1, node.get_deterministic_priv_key().address)
+        assert node.getmininginfo()['solverpeakmemory'] > 0
         tmpl = node.getblocktemplate({'rules': ['segwit']})
         self.log.info("getblocktemplate: Test capability advertised")
         assert 'proposal' in tmpl['capabilities']